@@ -0,0 +1,222 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+// STD includes
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+// Benchmark settings
+struct BenchSettings
+{
+  BenchSettings ()
+    : min_time_ (0.5)
+    , min_iterations_ (3)
+    , max_iterations_ (1000)
+    , filter_ ("")
+  {};
+
+  double min_time_;         // Minimum total time of the timed iterations of a benchmark (seconds)
+  int min_iterations_;      // Minimum number of timed iterations
+  int max_iterations_;      // Maximum number of timed iterations
+  std::string filter_;      // Only benchmarks whose name contains this string are run
+};
+
+// Timing of a single benchmark. All times are in milliseconds
+struct BenchResult
+{
+  BenchResult ()
+    : iterations_ (0)
+    , real_time_mean_ (0.0)
+    , real_time_median_ (0.0)
+    , real_time_min_ (0.0)
+    , real_time_stddev_ (0.0)
+    , cpu_time_mean_ (0.0)
+    , items_ (0)
+  {};
+
+  std::string name_;
+  int iterations_;
+  double real_time_mean_;
+  double real_time_median_;
+  double real_time_min_;
+  double real_time_stddev_;
+  double cpu_time_mean_;      // Process CPU time, summed over all threads
+  long items_;                // Number of items (points, queries, ...) processed per iteration
+};
+
+////////////////////////////////////////////////////////////////////////////////
+inline
+double getWallTimeMs ()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline
+double getCpuTimeMs ()
+{
+  return static_cast<double>(std::clock()) * 1000.0 / static_cast<double>(CLOCKS_PER_SEC);
+}
+
+/** \brief Time a function. The function is run once untimed to warm up the
+ * caches and the thread local workspaces and then repeatedly until both the
+ * minimum time and the minimum number of iterations are reached.
+ *  \param[in]  name      benchmark name
+ *  \param[in]  function  function to time, returns false if it failed
+ *  \param[in]  items     number of items processed per call of the function
+ *  \param[in]  settings  benchmark settings
+ *  \param[out] results   the result is appended to the results
+ *  \return false if the function failed
+ */
+template <typename FunctionT>
+inline
+bool runBenchmark ( const std::string &name,
+                    FunctionT function,
+                    const long items,
+                    const BenchSettings &settings,
+                    std::vector<BenchResult> &results
+                  )
+{
+  if (!settings.filter_.empty() && name.find(settings.filter_) == std::string::npos)
+    return true;
+
+  std::cout << std::left << std::setw(48) << name << std::flush;
+
+  // Warm up
+  if (!function())
+  {
+    std::cout << "failed" << std::endl;
+    return false;
+  }
+
+  // Timed iterations
+  std::vector<double> realTimes, cpuTimes;
+  double totalTime = 0.0;
+  while ( (static_cast<int>(realTimes.size()) < settings.min_iterations_ || totalTime < settings.min_time_ * 1000.0) &&
+          static_cast<int>(realTimes.size()) < settings.max_iterations_ )
+  {
+    double realStart = getWallTimeMs();
+    double cpuStart = getCpuTimeMs();
+    function();
+    realTimes.push_back(getWallTimeMs() - realStart);
+    cpuTimes.push_back(getCpuTimeMs() - cpuStart);
+    totalTime += realTimes.back();
+  }
+
+  // Statistics
+  BenchResult result;
+  result.name_ = name;
+  result.iterations_ = static_cast<int>(realTimes.size());
+  result.items_ = items;
+
+  for (size_t itId = 0; itId < realTimes.size(); itId++)
+  {
+    result.real_time_mean_ += realTimes[itId];
+    result.cpu_time_mean_ += cpuTimes[itId];
+  }
+  result.real_time_mean_ /= static_cast<double>(result.iterations_);
+  result.cpu_time_mean_ /= static_cast<double>(result.iterations_);
+
+  for (size_t itId = 0; itId < realTimes.size(); itId++)
+    result.real_time_stddev_ += (realTimes[itId] - result.real_time_mean_) * (realTimes[itId] - result.real_time_mean_);
+  result.real_time_stddev_ = std::sqrt(result.real_time_stddev_ / static_cast<double>(result.iterations_));
+
+  std::sort(realTimes.begin(), realTimes.end());
+  result.real_time_min_ = realTimes.front();
+  result.real_time_median_ = realTimes[realTimes.size() / 2];
+
+  results.push_back(result);
+
+  std::cout << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << result.real_time_median_ << " ms"
+            << std::setw(12) << result.cpu_time_mean_ << " ms cpu"
+            << std::setw(8) << result.iterations_ << " it" << std::endl;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline
+std::string escapeJSON (const std::string &string)
+{
+  std::string escaped;
+  for (size_t charId = 0; charId < string.size(); charId++)
+  {
+    if (string[charId] == '"' || string[charId] == '\\')
+      escaped += '\\';
+    escaped += string[charId];
+  }
+  return escaped;
+}
+
+/** \brief Write benchmark results to a JSON file. The layout follows the JSON
+ * output of Google Benchmark ("context" and "benchmarks" with "name",
+ * "iterations", "real_time", "cpu_time" and "time_unit"), so that its
+ * comparison tools can be used to track regressions between two runs.
+ *  \param[in]  filename    output filename
+ *  \param[in]  results     benchmark results
+ *  \param[in]  num_threads number of OpenMP threads used
+ *  \return false if the file could not be written
+ */
+inline
+bool writeBenchmarkJSON ( const std::string &filename,
+                          const std::vector<BenchResult> &results,
+                          const int num_threads
+                        )
+{
+  std::ofstream file (filename.c_str());
+  if (!file.is_open())
+  {
+    std::cout << "[writeBenchmarkJSON] could not open file '" << filename << "' for writing." << std::endl;
+    return false;
+  }
+
+  std::time_t now = std::time(NULL);
+  char date[64];
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+  file << std::setprecision(6) << std::fixed;
+  file << "{" << std::endl;
+  file << "  \"context\": {" << std::endl;
+  file << "    \"date\": \"" << date << "\"," << std::endl;
+  file << "    \"executable\": \"symseg_bench\"," << std::endl;
+  file << "    \"num_threads\": " << num_threads << std::endl;
+  file << "  }," << std::endl;
+  file << "  \"benchmarks\": [" << std::endl;
+
+  for (size_t resId = 0; resId < results.size(); resId++)
+  {
+    const BenchResult &result = results[resId];
+    file << "    {" << std::endl;
+    file << "      \"name\": \"" << escapeJSON(result.name_) << "\"," << std::endl;
+    file << "      \"run_type\": \"iteration\"," << std::endl;
+    file << "      \"iterations\": " << result.iterations_ << "," << std::endl;
+    file << "      \"real_time\": " << result.real_time_median_ << "," << std::endl;
+    file << "      \"cpu_time\": " << result.cpu_time_mean_ << "," << std::endl;
+    file << "      \"time_unit\": \"ms\"," << std::endl;
+    file << "      \"real_time_mean\": " << result.real_time_mean_ << "," << std::endl;
+    file << "      \"real_time_min\": " << result.real_time_min_ << "," << std::endl;
+    file << "      \"real_time_stddev\": " << result.real_time_stddev_ << "," << std::endl;
+    file << "      \"items\": " << result.items_ << "," << std::endl;
+    file << "      \"items_per_second\": " << (result.real_time_median_ > 0.0 ? static_cast<double>(result.items_) / result.real_time_median_ * 1000.0 : 0.0) << std::endl;
+    file << "    }" << (resId + 1 < results.size() ? "," : "") << std::endl;
+  }
+
+  file << "  ]" << std::endl;
+  file << "}" << std::endl;
+
+  return file.good();
+}
+
+#endif // BENCHMARK_HPP_
@@ -0,0 +1,455 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+// STD includes
+#include <cstdlib>
+#include <random>
+
+// OpenMP includes
+#include <omp.h>
+
+// PCL
+#include <pcl/io/ply_io.h>
+#include <pcl/common/io.h>
+#include <pcl/common/common.h>
+#include <pcl/common/centroid.h>
+
+// Utilities includes
+#include "filesystem/filesystem.hpp"
+#include "filesystem/cloud_cache.hpp"
+#include "eigen.hpp"
+#include "graph/min_cut.hpp"
+#include "pointcloud/pointcloud.hpp"
+#include "pointcloud/neighbor_grid.hpp"
+#include "pointcloud/cloud_soa.hpp"
+
+// Occupancy map
+#include "occupancy_map.hpp"
+
+// Segmentation
+#include "segmentation.hpp"
+#include "region_growing_smoothness/region_growing_smoothness.hpp"
+
+// Symmetry segmentation
+#include "symseg_pipeline.hpp"
+
+// Project includes
+#include "benchmark.hpp"
+
+typedef pcl::PointXYZRGBNormal PointNC;
+
+////////////////////////////////////////////////////////////////////////////////
+void parseCommandLine(int argc, char** argv, std::vector<std::string> &sceneDirnames, std::string &outputFilename, BenchSettings &settings)
+{
+  sceneDirnames.clear();
+  outputFilename = "symseg_bench.json";
+  
+  // Check parameters
+  for (size_t i = 1; i < static_cast<size_t>(argc); i++)
+  {
+    std::string curParameter (argv[i]);
+    
+    if (curParameter == "-out" && i + 1 < static_cast<size_t>(argc))
+      outputFilename = argv[++i];
+    
+    else if (curParameter == "-min_time" && i + 1 < static_cast<size_t>(argc))
+      settings.min_time_ = std::atof(argv[++i]);
+    
+    else if (curParameter == "-min_iterations" && i + 1 < static_cast<size_t>(argc))
+      settings.min_iterations_ = std::atoi(argv[++i]);
+    
+    else if (curParameter == "-filter" && i + 1 < static_cast<size_t>(argc))
+      settings.filter_ = argv[++i];
+    
+    else if (curParameter[0] != '-')
+      sceneDirnames.push_back(curParameter);
+    
+    else 
+      std::cout << "Unknown parameter '" << curParameter << "'" << std::endl;
+  }  
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Same parameters as the full segmentation example
+void setSceneParameters(sym::SymSegParams &params)
+{
+  // Scene oversegmentation parameters
+  utl::SmoothSegParams &sceneOversegParams = params.overseg;
+  sceneOversegParams.voxel_size = 0.005f;
+  sceneOversegParams.min_segment_size = 120;
+  sceneOversegParams.max_iou = 0.8f;
+  sceneOversegParams.smoothness = { std::pair<float, float>(pcl::deg2rad(10.0f), 0.5f),
+                                    std::pair<float, float>(pcl::deg2rad(15.0f), 0.5f) };  
+                                    
+  // Rotational symmetry detection parameters
+  sym::RotSymDetectParams &rotDetParams = params.rot_det;
+  rotDetParams.ref_max_fit_angle       = pcl::deg2rad(45.0f);
+  rotDetParams.min_normal_fit_angle    = pcl::deg2rad(10.0f);
+  rotDetParams.max_normal_fit_angle    = pcl::deg2rad(60.0f);
+  rotDetParams.min_occlusion_distance  = 0.01f;
+  rotDetParams.max_occlusion_distance  = 0.03f;
+  rotDetParams.max_symmetry_score      = 0.02f;
+  rotDetParams.max_occlusion_score     = 0.012f;
+  rotDetParams.max_perpendicular_score = 0.6f;
+  rotDetParams.min_coverage_score      = 0.3f;
+  
+  // Rotational segmentation parameters
+  sym::RotSymSegParams &rotSegParams = params.rot_seg;
+  rotSegParams.voxel_size = 0.005f;
+  rotSegParams.min_normal_fit_angle    = pcl::deg2rad(0.0f);    // Minimum symmetry error of fit for a point
+  rotSegParams.max_normal_fit_angle    = pcl::deg2rad(15.0f);    // Minimum symmetry error of fit for a point
+  rotSegParams.min_occlusion_distance = 0.005f;
+  rotSegParams.max_occlusion_distance = 0.03f;
+  rotSegParams.max_perpendicular_angle = pcl::deg2rad(30.0f);
+  rotSegParams.aw_radius = rotSegParams.voxel_size * 2.0f;
+  rotSegParams.aw_num_neighbors = 9;
+  rotSegParams.aw_sigma_convex = 2.0f;
+  rotSegParams.aw_sigma_concave = 0.15f;
+  rotSegParams.fg_weight_importance  = 1.0f;
+  rotSegParams.bg_weight_importance  = 1.0f;
+  rotSegParams.bin_weight_importance = 2.0f;
+  
+  rotSegParams.max_symmetry_score    = 0.03f;
+  rotSegParams.max_occlusion_score   = 0.015f;
+  rotSegParams.max_smoothness_score  = 0.3f;
+  rotSegParams.min_segment_size      = 100;
+
+  // Reflectional symmetry detection parameters
+  sym::ReflSymDetectParams &reflDetParams = params.refl_det;
+  reflDetParams.voxel_size                  = 0.0f;
+  reflDetParams.num_angle_divisions         = 5;
+  reflDetParams.flatness_threshold          = 0.005f;
+  reflDetParams.refine_iterations           = 20;
+  
+  reflDetParams.max_correspondence_reflected_distance = 0.01f;
+  reflDetParams.max_occlusion_distance                = 0.03f;
+  reflDetParams.min_inlier_normal_angle               = pcl::deg2rad(15.0f);
+  reflDetParams.max_inlier_normal_angle               = pcl::deg2rad(20.0f);
+    
+  reflDetParams.max_occlusion_score           = 0.01f;
+  reflDetParams.min_cloud_inlier_score        = 0.3f;
+  reflDetParams.min_corresp_inlier_score      = 0.8f;
+  
+  reflDetParams.symmetry_min_angle_diff       = pcl::deg2rad(7.0);
+  reflDetParams.symmetry_min_distance_diff    = 0.01f;
+  reflDetParams.max_reference_point_distance  = 0.3f;
+  
+  // Reflectional symmetry segmentation parameters
+  sym::ReflSymSegParams &reflSegParams = params.refl_seg;
+  reflSegParams.voxel_size = 0.0f;
+  
+  reflSegParams.max_sym_corresp_reflected_distance = 0.01f;
+  reflSegParams.min_occlusion_distance = 0.01f;
+  reflSegParams.max_occlusion_distance = 0.03f;
+  reflSegParams.min_normal_fit_angle = pcl::deg2rad(10.0f);
+  reflSegParams.max_normal_fit_angle = pcl::deg2rad(45.0f);
+  
+  reflSegParams.aw_radius = std::max(reflSegParams.voxel_size, 0.005f) * 2.0f;
+  reflSegParams.aw_num_neighbors = 9;
+  reflSegParams.aw_sigma_convex = 2.0f;
+  reflSegParams.aw_sigma_concave = 0.15f;
+  reflSegParams.fg_weight_importance  = 1.0f;
+  reflSegParams.bg_weight_importance  = 2.0f;
+  reflSegParams.bin_weight_importance = 5.0f;
+  
+  reflSegParams.max_symmetry_score    = 0.3f;
+  reflSegParams.max_occlusion_score   = 0.005f;
+  reflSegParams.max_smoothness_score  = 0.3f;
+  reflSegParams.min_segment_size      = 200;
+  reflSegParams.min_symmetry_support_overlap      = 0.5f;
+  reflSegParams.similar_segment_iou_ = 0.95f;
+  
+  // Rotational refinement parameters
+  params.rot_refine_max_fit_angle = pcl::deg2rad(5.0f);
+  
+  // Occupancy map parameters
+  params.occupancy_bbx_inflation_radius = 0.15f;                                   // Inflation radius of the distance map bounding box relative to the scene cloud bounding box  
+  
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool benchmarkScene(const std::string &sceneDirname, const sym::SymSegParams &params, const BenchSettings &settings, std::vector<BenchResult> &results)
+{
+  const std::string sceneName = utl::getBasename(utl::removeTrailingSlash(sceneDirname));
+  
+  //----------------------------------------------------------------------------
+  // Load data
+  //----------------------------------------------------------------------------
+  
+  std::string sceneCloudFilename  = utl::fullfile(sceneDirname, "cloud.ply");
+  std::string octomapFilename     = utl::fullfile(sceneDirname, "occupancy.bt");  
+  std::string tablePlaneFilename  = utl::fullfile(sceneDirname, "table_plane.txt");
+  
+  pcl::PointCloud<PointNC>::Ptr sceneCloudHighRes  (new pcl::PointCloud<PointNC>);
+  if (!utl::isFile(sceneCloudFilename) || !utl::loadPointCloudCached(sceneCloudFilename, *sceneCloudHighRes))
+  {
+    std::cout << "Couldn't load pointcloud file '" << sceneCloudFilename << "'" << std::endl;
+    return false;
+  }
+  
+  OccupancyMapPtr sceneOccupancyMap (new OccupancyMap);
+  if (!sceneOccupancyMap->readOccupancyTree(octomapFilename))
+    return false;
+  
+  Eigen::Vector4f tablePlaneCoefficients;
+  utl::readASCII(tablePlaneFilename, tablePlaneCoefficients);
+  if (tablePlaneCoefficients.size () != 4)
+  {
+    std::cout << "Table plane coefficients must have 4 values, instead has " << tablePlaneCoefficients.size() << " values." << std::endl;
+    return false;
+  }
+  
+  std::cout << "----------------------------" << std::endl;
+  std::cout << "Scene: " << sceneName << " (" << sceneCloudHighRes->size() << " points)" << std::endl;
+  
+  //----------------------------------------------------------------------------
+  // End to end segmentation. The result of the last run provides the inputs
+  // of the kernel benchmarks below.
+  //----------------------------------------------------------------------------
+  
+  sym::SymSegPipeline<PointNC> pipeline (params);
+  if (!runBenchmark(sceneName + "/end_to_end", [&] () { return pipeline.process(sceneCloudHighRes, sceneOccupancyMap, tablePlaneCoefficients); },
+                    sceneCloudHighRes->size(), settings, results))
+    return false;
+  
+  // Run the pipeline once more if the end to end benchmark was filtered out
+  if (pipeline.getResult().scene_cloud->empty() && !pipeline.process(sceneCloudHighRes, sceneOccupancyMap, tablePlaneCoefficients))
+    return false;
+  
+  const sym::SymSegResult<PointNC> &result = pipeline.getResult();
+  
+  //----------------------------------------------------------------------------
+  // Occupancy map
+  //----------------------------------------------------------------------------
+  
+  // Same bounding box and maximum distance as the pipeline
+  Eigen::Vector4f bbxMin, bbxMax;
+  pcl::getMinMax3D(*sceneCloudHighRes, bbxMin, bbxMax);
+  bbxMin.array() -= params.occupancy_bbx_inflation_radius;
+  bbxMax.array() += params.occupancy_bbx_inflation_radius;
+  float maxDistance = std::max( std::max(params.rot_seg.max_occlusion_distance, params.rot_det.max_occlusion_distance),
+                                std::max(params.refl_seg.max_occlusion_distance, params.refl_det.max_occlusion_distance));
+  
+  // Distance map is constructed in a separate map, so that the scene map stays in query mode
+  OccupancyMap distanceMap;
+  if (!distanceMap.readOccupancyTree(octomapFilename))
+    return false;
+  distanceMap.setBoundingPlanes(std::vector<Eigen::Vector4f> (1, tablePlaneCoefficients));
+  runBenchmark (sceneName + "/distance_map_from_occupancy",
+                [&] () { return distanceMap.distanceMapFromOccupancy(bbxMin.head(3), bbxMax.head(3), distanceMap.getOccupancyTreeDepth(), maxDistance, true); },
+                1, settings, results);
+  
+  // Random query points in the distance map bounding box
+  const int numQueries = 100000;
+  std::mt19937 generator (0);
+  std::uniform_real_distribution<float> uniform (0.0f, 1.0f);
+  std::vector<Eigen::Vector3f> queryPoints (numQueries);
+  for (int pointId = 0; pointId < numQueries; pointId++)
+    for (int dimId = 0; dimId < 3; dimId++)
+      queryPoints[pointId][dimId] = bbxMin[dimId] + uniform(generator) * (bbxMax[dimId] - bbxMin[dimId]);
+  
+  std::vector<float> queryDistances (numQueries);
+  runBenchmark (sceneName + "/get_nearest_obstacle_distance",
+                [&] () {
+                  for (int pointId = 0; pointId < numQueries; pointId++)
+                    queryDistances[pointId] = sceneOccupancyMap->getNearestObstacleDistance(queryPoints[pointId]);
+                  return true;
+                },
+                numQueries, settings, results);
+  
+  //----------------------------------------------------------------------------
+  // Oversegmentation
+  //----------------------------------------------------------------------------
+  
+  pcl::PointCloud<PointNC> sceneCloudDS;
+  utl::Map downsampleMap;
+  runBenchmark (sceneName + "/downsample",
+                [&] () {
+                  utl::Downsample<PointNC> ds;
+                  ds.setInputCloud(sceneCloudHighRes);
+                  ds.setDownsampleMethod(utl::Downsample<PointNC>::AVERAGE);
+                  ds.setLeafSize(params.overseg.voxel_size);
+                  ds.filter(sceneCloudDS);
+                  ds.getDownsampleMap (downsampleMap);
+                  return true;
+                },
+                sceneCloudHighRes->size(), settings, results);
+  
+  utl::Map smoothSegments;
+  runBenchmark (sceneName + "/region_growing_smoothness",
+                [&] () {
+                  utl::RegionGrowingSmoothness<PointNC> rg;
+                  rg.setInputCloud(result.scene_cloud);
+                  rg.setConsistentNormals(true);
+                  rg.setSearchRadius (params.overseg.voxel_size * std::sqrt (3));
+                  rg.setMinSegmentSize(params.overseg.min_segment_size);
+                  rg.setNormalAngleThreshold(params.overseg.smoothness[0].first);
+                  rg.setMinValidBinaryNeighborsFraction(params.overseg.smoothness[0].second);
+                  rg.segment(smoothSegments);
+                  return true;
+                },
+                result.scene_cloud->size(), settings, results);
+  
+  pcl::PointCloud<PointNC>::Ptr oversegCloud;
+  utl::Map oversegDownsampleMap;
+  std::vector<utl::Map> oversegSegmentsRaw;
+  std::vector<std::vector<int> > segMergedIds;
+  if (!oversegmentSceneRaw<PointNC>(sceneCloudHighRes, params.overseg, oversegCloud, oversegDownsampleMap, oversegSegmentsRaw, segMergedIds))
+    return false;
+  
+  int numSegmentsRaw = 0;
+  for (size_t segParamId = 0; segParamId < oversegSegmentsRaw.size(); segParamId++)
+    numSegmentsRaw += oversegSegmentsRaw[segParamId].size();
+  runBenchmark (sceneName + "/merge_duplicate_segments",
+                [&] () { utl::mergeDuplicateSegments(oversegSegmentsRaw, segMergedIds, params.overseg.max_iou); return true; },
+                numSegmentsRaw, settings, results);
+  
+  //----------------------------------------------------------------------------
+  // Rotational kernels. Use the first detected symmetry and its support segment
+  //----------------------------------------------------------------------------
+  
+  if (result.rot_symmetry.empty())
+  {
+    std::cout << "No rotational symmetries detected, skipping rotational kernels." << std::endl;
+  }
+  else
+  {
+    const sym::RotationalSymmetry &rotSymmetry = result.rot_symmetry[0];
+    std::vector<int> rotSupport;
+    result.rot_symmetry_support[0].toVector(rotSupport);
+    pcl::PointCloud<PointNC> rotSupportCloud;
+    pcl::copyPointCloud(*result.scene_cloud, rotSupport, rotSupportCloud);
+    const utl::PointCloudSoA rotSupportCloudSoA (rotSupportCloud);
+    
+    std::vector<float> pointOcclusionScores;
+    runBenchmark (sceneName + "/rot_sym_cloud_occlusion_score",
+                  [&] () {
+                    sym::rotSymCloudOcclusionScore(rotSupportCloudSoA, sceneOccupancyMap, rotSymmetry, pointOcclusionScores,
+                                                   params.rot_det.min_occlusion_distance, params.rot_det.max_occlusion_distance);
+                    return true;
+                  },
+                  rotSupportCloud.size(), settings, results);
+    
+    // Min cut of the scene with occlusion based unary potentials of the
+    // symmetry and the adjacency used by rotational segmentation
+    utl::GraphWeighted binaryPotentials;
+    if (!utl::cloudAdjacencyWeights<PointNC> (result.scene_cloud,
+                                              params.rot_seg.aw_radius,
+                                              params.rot_seg.aw_num_neighbors,
+                                              params.rot_seg.aw_sigma_convex,
+                                              params.rot_seg.aw_sigma_concave,
+                                              binaryPotentials))
+      return false;
+    
+    std::vector<float> sceneOcclusionScores;
+    sym::rotSymCloudOcclusionScore<PointNC>(*result.scene_cloud, sceneOccupancyMap, rotSymmetry, sceneOcclusionScores,
+                                            params.rot_seg.min_occlusion_distance, params.rot_seg.max_occlusion_distance);
+    std::vector<float> sourcePotentials (sceneOcclusionScores.size()), sinkPotentials (sceneOcclusionScores.size());
+    for (size_t pointId = 0; pointId < sceneOcclusionScores.size(); pointId++)
+    {
+      sourcePotentials[pointId] = 1.0f - sceneOcclusionScores[pointId];
+      sinkPotentials[pointId] = sceneOcclusionScores[pointId];
+    }
+    
+    std::vector<int> sourcePoints, sinkPoints;
+    runBenchmark (sceneName + "/mincut",
+                  [&] () { return utl::mincut(sourcePotentials, sinkPotentials, binaryPotentials, sourcePoints, sinkPoints) >= 0.0; },
+                  result.scene_cloud->size(), settings, results);
+  }
+  
+  //----------------------------------------------------------------------------
+  // Reflectional kernels. Use the first detected symmetry and its support segment
+  //----------------------------------------------------------------------------
+  
+  if (result.refl_symmetry.empty())
+  {
+    std::cout << "No reflectional symmetries detected, skipping reflectional kernels." << std::endl;
+  }
+  else
+  {
+    const sym::ReflectionalSymmetry &reflSymmetry = result.refl_symmetry[0];
+    std::vector<int> reflSupport;
+    result.refl_symmetry_support[0].toVector(reflSupport);
+    pcl::PointCloud<PointNC>::Ptr reflSupportCloud (new pcl::PointCloud<PointNC>);
+    pcl::copyPointCloud(*result.scene_cloud_after_rot, reflSupport, *reflSupportCloud);
+    const utl::PointCloudSoA reflSupportCloudSoA (*reflSupportCloud);
+    
+    utl::NeighborGrid<PointNC> reflSupportGrid;
+    if (!reflSupportGrid.setInputCloud(reflSupportCloud, std::max(params.refl_det.max_correspondence_reflected_distance, 0.005f)))
+      return false;
+    
+    Eigen::Vector4f reflSupportMean;
+    pcl::compute3DCentroid(*reflSupportCloud, reflSupportMean);
+    
+    pcl::Correspondences correspondences;
+    std::vector<float> pointSymmetryScores;
+    runBenchmark (sceneName + "/refl_sym_point_symmetry_scores",
+                  [&] () {
+                    sym::reflSymPointSymmetryScores<PointNC>  ( reflSupportGrid, reflSupportCloudSoA,
+                                                                std::vector<int>(), std::vector<int>(),
+                                                                reflSymmetry, correspondences, pointSymmetryScores,
+                                                                params.refl_det.max_correspondence_reflected_distance,
+                                                                params.refl_det.min_inlier_normal_angle,
+                                                                params.refl_det.max_inlier_normal_angle );
+                    return true;
+                  },
+                  reflSupportCloud->size(), settings, results);
+    
+    // Refine from a symmetry with the normal rotated away from the detected one
+    const Eigen::Vector3f normal = reflSymmetry.getNormal();
+    const Eigen::Vector3f normalPerturbed = Eigen::AngleAxisf(pcl::deg2rad(5.0f), normal.unitOrthogonal()) * normal;
+    const sym::ReflectionalSymmetry reflSymmetryPerturbed (reflSymmetry.getOrigin(), normalPerturbed);
+    sym::ReflectionalSymmetry reflSymmetryRefined;
+    runBenchmark (sceneName + "/refine_refl_sym_global",
+                  [&] () {
+                    return sym::refineReflSymGlobal<PointNC>  ( reflSupportGrid, reflSupportCloud, reflSupportMean.head(3),
+                                                                sceneOccupancyMap, reflSymmetryPerturbed, reflSymmetryRefined,
+                                                                correspondences, params.refl_det.refine_iterations );
+                  },
+                  reflSupportCloud->size(), settings, results);
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{  
+  //----------------------------------------------------------------------------
+  // Parse command line
+  //----------------------------------------------------------------------------
+  
+  std::vector<std::string> sceneDirnames;
+  std::string outputFilename;
+  BenchSettings settings;
+  parseCommandLine(argc, argv, sceneDirnames, outputFilename, settings);
+  
+  if (sceneDirnames.empty())
+  {
+    std::cout << "Usage: symseg_bench <scene_dir> [<scene_dir> ...] [-out <filename>] [-min_time <seconds>] [-min_iterations <n>] [-filter <string>]" << std::endl;
+    return -1;
+  }
+  
+  sym::SymSegParams params;
+  setSceneParameters(params);
+  
+  //----------------------------------------------------------------------------
+  // Run benchmarks
+  //----------------------------------------------------------------------------
+  
+  std::vector<BenchResult> results;
+  for (size_t sceneId = 0; sceneId < sceneDirnames.size(); sceneId++)
+  {
+    if (!benchmarkScene(sceneDirnames[sceneId], params, settings, results))
+      std::cout << "Could not benchmark scene '" << sceneDirnames[sceneId] << "'." << std::endl;
+  }
+  
+  if (!writeBenchmarkJSON(outputFilename, results, omp_get_max_threads()))
+    return -1;
+  
+  std::cout << "----------------------------" << std::endl;
+  std::cout << "Results written to '" << outputFilename << "'." << std::endl;
+  
+  return 0;
+}
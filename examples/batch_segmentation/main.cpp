@@ -0,0 +1,363 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+// STD includes
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// OpenMP includes
+#include <omp.h>
+
+// PCL
+#include <pcl/common/time.h>
+
+// Utilities includes
+#include "filesystem/filesystem.hpp"
+#include "bounded_queue.hpp"
+
+// Symmetry segmentation
+#include "symseg_pipeline.hpp"
+#include "symseg_io.hpp"
+
+typedef pcl::PointXYZRGBNormal PointNC;
+typedef boost::shared_ptr<sym::SymSegScene<PointNC> > SymSegScenePtr;
+typedef boost::shared_ptr<sym::SymSegResult<PointNC> > SymSegResultPtr;
+
+// Result waiting to be written by the writer thread
+struct WriteJob
+{
+  std::string resultDirname_;
+  SymSegResultPtr result_;
+};
+
+// Batch settings
+struct BatchSettings
+{
+  BatchSettings ()
+    : outputDirname_ ("default")
+    , numJobs_ (1)
+    , numIOThreads_ (2)
+    , prefetchSize_ (2)
+    , cacheDistanceMaps_ (false)
+    , timeBudget_ (0.0f)
+  {};
+  
+  std::string outputDirname_;   // Name of the result directory of every scene
+  int numJobs_;                 // Number of scenes segmented concurrently. OpenMP threads are split between them
+  int numIOThreads_;            // Number of threads loading scenes
+  int prefetchSize_;            // Maximum number of loaded scenes waiting to be segmented
+  bool cacheDistanceMaps_;      // Cache distance maps in the scene directories
+  float timeBudget_;            // Time budget of every scene in seconds (0 - no limit)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+bool readSceneList(const std::string &listFilename, std::vector<std::string> &sceneDirnames)
+{
+  std::ifstream file (listFilename.c_str());
+  if (!file.is_open())
+  {
+    std::cout << "Could not open scene list file '" << listFilename << "'." << std::endl;
+    return false;
+  }
+  
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (!line.empty() && line[0] != '#')
+      sceneDirnames.push_back(line);
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool parseCommandLine(int argc, char** argv, std::vector<std::string> &sceneDirnames, BatchSettings &settings)
+{
+  sceneDirnames.clear();
+  
+  // Check parameters
+  for (size_t i = 1; i < static_cast<size_t>(argc); i++)
+  {
+    std::string curParameter (argv[i]);
+    bool hasValue = i + 1 < static_cast<size_t>(argc);
+    
+    if (curParameter == "-list" && hasValue)
+    {
+      if (!readSceneList(argv[++i], sceneDirnames))
+        return false;
+    }
+    
+    else if (curParameter == "-out" && hasValue)
+      settings.outputDirname_ = argv[++i];
+    
+    else if (curParameter == "-jobs" && hasValue)
+      settings.numJobs_ = std::max(1, std::atoi(argv[++i]));
+    
+    else if (curParameter == "-io_threads" && hasValue)
+      settings.numIOThreads_ = std::max(1, std::atoi(argv[++i]));
+    
+    else if (curParameter == "-prefetch" && hasValue)
+      settings.prefetchSize_ = std::max(1, std::atoi(argv[++i]));
+    
+    else if (curParameter == "-time_budget" && hasValue)
+      settings.timeBudget_ = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+    
+    else if (curParameter == "-cache")
+      settings.cacheDistanceMaps_ = true;
+    
+    else if (curParameter[0] != '-')
+      sceneDirnames.push_back(curParameter);
+    
+    else 
+      std::cout << "Unknown parameter '" << curParameter << "'" << std::endl;
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Same parameters as the full segmentation example
+void setSceneParameters(sym::SymSegParams &params)
+{
+  // Scene oversegmentation parameters
+  utl::SmoothSegParams &sceneOversegParams = params.overseg;
+  sceneOversegParams.voxel_size = 0.005f;
+  sceneOversegParams.min_segment_size = 120;
+  sceneOversegParams.max_iou = 0.8f;
+  sceneOversegParams.smoothness = { std::pair<float, float>(pcl::deg2rad(10.0f), 0.5f),
+                                    std::pair<float, float>(pcl::deg2rad(15.0f), 0.5f) };  
+                                    
+  // Rotational symmetry detection parameters
+  sym::RotSymDetectParams &rotDetParams = params.rot_det;
+  rotDetParams.ref_max_fit_angle       = pcl::deg2rad(45.0f);
+  rotDetParams.min_normal_fit_angle    = pcl::deg2rad(10.0f);
+  rotDetParams.max_normal_fit_angle    = pcl::deg2rad(60.0f);
+  rotDetParams.min_occlusion_distance  = 0.01f;
+  rotDetParams.max_occlusion_distance  = 0.03f;
+  rotDetParams.max_symmetry_score      = 0.02f;
+  rotDetParams.max_occlusion_score     = 0.012f;
+  rotDetParams.max_perpendicular_score = 0.6f;
+  rotDetParams.min_coverage_score      = 0.3f;
+  
+  // Rotational segmentation parameters
+  sym::RotSymSegParams &rotSegParams = params.rot_seg;
+  rotSegParams.voxel_size = 0.005f;
+  rotSegParams.min_normal_fit_angle    = pcl::deg2rad(0.0f);    // Minimum symmetry error of fit for a point
+  rotSegParams.max_normal_fit_angle    = pcl::deg2rad(15.0f);    // Minimum symmetry error of fit for a point
+  rotSegParams.min_occlusion_distance = 0.005f;
+  rotSegParams.max_occlusion_distance = 0.03f;
+  rotSegParams.max_perpendicular_angle = pcl::deg2rad(30.0f);
+  rotSegParams.aw_radius = rotSegParams.voxel_size * 2.0f;
+  rotSegParams.aw_num_neighbors = 9;
+  rotSegParams.aw_sigma_convex = 2.0f;
+  rotSegParams.aw_sigma_concave = 0.15f;
+  rotSegParams.fg_weight_importance  = 1.0f;
+  rotSegParams.bg_weight_importance  = 1.0f;
+  rotSegParams.bin_weight_importance = 2.0f;
+  
+  rotSegParams.max_symmetry_score    = 0.03f;
+  rotSegParams.max_occlusion_score   = 0.015f;
+  rotSegParams.max_smoothness_score  = 0.3f;
+  rotSegParams.min_segment_size      = 100;
+
+  // Reflectional symmetry detection parameters
+  sym::ReflSymDetectParams &reflDetParams = params.refl_det;
+  reflDetParams.voxel_size                  = 0.0f;
+  reflDetParams.num_angle_divisions         = 5;
+  reflDetParams.flatness_threshold          = 0.005f;
+  reflDetParams.refine_iterations           = 20;
+  
+  reflDetParams.max_correspondence_reflected_distance = 0.01f;
+  reflDetParams.max_occlusion_distance                = 0.03f;
+  reflDetParams.min_inlier_normal_angle               = pcl::deg2rad(15.0f);
+  reflDetParams.max_inlier_normal_angle               = pcl::deg2rad(20.0f);
+    
+  reflDetParams.max_occlusion_score           = 0.01f;
+  reflDetParams.min_cloud_inlier_score        = 0.3f;
+  reflDetParams.min_corresp_inlier_score      = 0.8f;
+  
+  reflDetParams.symmetry_min_angle_diff       = pcl::deg2rad(7.0);
+  reflDetParams.symmetry_min_distance_diff    = 0.01f;
+  reflDetParams.max_reference_point_distance  = 0.3f;
+  
+  // Reflectional symmetry segmentation parameters
+  sym::ReflSymSegParams &reflSegParams = params.refl_seg;
+  reflSegParams.voxel_size = 0.0f;
+  
+  reflSegParams.max_sym_corresp_reflected_distance = 0.01f;
+  reflSegParams.min_occlusion_distance = 0.01f;
+  reflSegParams.max_occlusion_distance = 0.03f;
+  reflSegParams.min_normal_fit_angle = pcl::deg2rad(10.0f);
+  reflSegParams.max_normal_fit_angle = pcl::deg2rad(45.0f);
+  
+  reflSegParams.aw_radius = std::max(reflSegParams.voxel_size, 0.005f) * 2.0f;
+  reflSegParams.aw_num_neighbors = 9;
+  reflSegParams.aw_sigma_convex = 2.0f;
+  reflSegParams.aw_sigma_concave = 0.15f;
+  reflSegParams.fg_weight_importance  = 1.0f;
+  reflSegParams.bg_weight_importance  = 2.0f;
+  reflSegParams.bin_weight_importance = 5.0f;
+  
+  reflSegParams.max_symmetry_score    = 0.3f;
+  reflSegParams.max_occlusion_score   = 0.005f;
+  reflSegParams.max_smoothness_score  = 0.3f;
+  reflSegParams.min_segment_size      = 200;
+  reflSegParams.min_symmetry_support_overlap      = 0.5f;
+  reflSegParams.similar_segment_iou_ = 0.95f;
+  
+  // Rotational refinement parameters
+  params.rot_refine_max_fit_angle = pcl::deg2rad(5.0f);
+  
+  // Occupancy map parameters
+  params.occupancy_bbx_inflation_radius = 0.15f;                                   // Inflation radius of the distance map bounding box relative to the scene cloud bounding box  
+  
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{  
+  //----------------------------------------------------------------------------
+  // Parse command line
+  //----------------------------------------------------------------------------
+  
+  std::vector<std::string> sceneDirnames;
+  BatchSettings settings;
+  if (!parseCommandLine(argc, argv, sceneDirnames, settings))
+    return -1;
+  
+  if (sceneDirnames.empty())
+  {
+    std::cout << "Usage: batch_segmentation <scene_dir> [<scene_dir> ...] [-list <scene_list_file>] [-out <result_dirname>]" << std::endl;
+    std::cout << "                          [-jobs <n>] [-io_threads <n>] [-prefetch <n>] [-cache]" << std::endl;
+    std::cout << "                          [-time_budget <seconds>]" << std::endl;
+    return -1;
+  }
+  
+  sym::SymSegParams params;
+  setSceneParameters(params);
+  params.time_budget = settings.timeBudget_;
+  
+  const int numThreadsPerJob = std::max(1, omp_get_max_threads() / settings.numJobs_);
+  std::cout << "Segmenting " << sceneDirnames.size() << " scenes, " << settings.numJobs_ << " at a time with " << numThreadsPerJob << " threads each." << std::endl;
+  
+  //----------------------------------------------------------------------------
+  // Segment scenes. I/O threads load the next scenes while the current ones
+  // are segmented and a writer thread writes the results in the background.
+  //----------------------------------------------------------------------------
+  
+  double totalStart = pcl::getTime ();
+  
+  utl::BoundedQueue<SymSegScenePtr> sceneQueue (settings.prefetchSize_);
+  utl::BoundedQueue<WriteJob> writeQueue (settings.numJobs_ + settings.prefetchSize_);
+  std::atomic<size_t> nextSceneId (0);
+  std::atomic<int> numActiveLoaders (settings.numIOThreads_);
+  std::atomic<int> numSegmented (0), numFailed (0);
+  std::mutex printMutex;
+  
+  // Loaders. The last loader to finish closes the scene queue
+  std::vector<std::thread> loaders;
+  for (int loaderId = 0; loaderId < settings.numIOThreads_; loaderId++)
+  {
+    loaders.push_back(std::thread ([&] () {
+      for (size_t sceneId = nextSceneId++; sceneId < sceneDirnames.size(); sceneId = nextSceneId++)
+      {
+        SymSegScenePtr scene (new sym::SymSegScene<PointNC>);
+        if (!sym::loadSymSegScene<PointNC>(sceneDirnames[sceneId], *scene))
+        {
+          std::lock_guard<std::mutex> lock (printMutex);
+          std::cout << "Could not load scene '" << sceneDirnames[sceneId] << "'." << std::endl;
+          numFailed++;
+          continue;
+        }
+        
+        sceneQueue.push(scene);
+      }
+      
+      if (--numActiveLoaders == 0)
+        sceneQueue.close();
+    }));
+  }
+  
+  // Writer
+  std::thread writer ([&] () {
+    WriteJob job;
+    while (writeQueue.pop(job))
+    {
+      if (!sym::writeSymSegResult(*job.result_, job.resultDirname_))
+      {
+        std::lock_guard<std::mutex> lock (printMutex);
+        std::cout << "Could not write results to '" << job.resultDirname_ << "'." << std::endl;
+        numFailed++;
+      }
+    }
+  });
+  
+  // Segmentation workers. Every worker has its own pipeline and OpenMP thread
+  // budget
+  std::vector<std::thread> workers;
+  for (int jobId = 0; jobId < settings.numJobs_; jobId++)
+  {
+    workers.push_back(std::thread ([&] () {
+      omp_set_num_threads(numThreadsPerJob);
+      sym::SymSegPipeline<PointNC> pipeline (params);
+      
+      SymSegScenePtr scene;
+      while (sceneQueue.pop(scene))
+      {
+        pipeline.setDistanceMapCacheDirname(settings.cacheDistanceMaps_ ? scene->dirname : "");
+        
+        double sceneStart = pcl::getTime ();
+        if (!pipeline.process(scene->cloud, scene->occupancy_map, scene->table_plane))
+        {
+          std::lock_guard<std::mutex> lock (printMutex);
+          std::cout << "Could not segment scene '" << scene->dirname << "'." << std::endl;
+          numFailed++;
+          continue;
+        }
+        double sceneTime = pcl::getTime() - sceneStart;
+        
+        // Clouds are not written. Dropping them from the copy lets the
+        // pipeline reuse them for the next scene
+        WriteJob job;
+        job.resultDirname_ = utl::fullfile(utl::fullfile(scene->dirname, "rotational_symmetry_segmentation"), settings.outputDirname_);
+        job.result_.reset(new sym::SymSegResult<PointNC> (pipeline.getResult()));
+        job.result_->scene_cloud.reset();
+        job.result_->scene_cloud_after_rot.reset();
+        const size_t numSegments = job.result_->rot_segment_filtered_ids.size() + job.result_->refl_segments.size();
+        const bool partial = job.result_->partial;
+        writeQueue.push(job);
+        
+        {
+          std::lock_guard<std::mutex> lock (printMutex);
+          std::cout << "[" << ++numSegmented << "/" << sceneDirnames.size() << "] " << scene->dirname << ": "
+                    << numSegments << " segments, " << sceneTime << " seconds" << (partial ? " (partial)." : ".") << std::endl;
+        }
+        
+        // Release the scene before waiting for the next one
+        scene.reset();
+      }
+    }));
+  }
+  
+  for (size_t workerId = 0; workerId < workers.size(); workerId++)
+    workers[workerId].join();
+  for (size_t loaderId = 0; loaderId < loaders.size(); loaderId++)
+    loaders[loaderId].join();
+  writeQueue.close();
+  writer.join();
+  
+  std::cout << "----------------------------" << std::endl;
+  std::cout << "Segmented " << numSegmented << " / " << sceneDirnames.size() << " scenes in " << (pcl::getTime() - totalStart) << " seconds." << std::endl;
+  if (numFailed > 0)
+  {
+    std::cout << numFailed << " scenes failed." << std::endl;
+    return -1;
+  }
+  
+  return 0;
+}
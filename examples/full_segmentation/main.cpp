@@ -8,18 +8,16 @@
 
 // Utilities includes
 #include "filesystem/filesystem.hpp"
+#include "filesystem/cloud_cache.hpp"
 #include "eigen.hpp"
+#include "profiling.hpp"
 
 // Occupancy map
 #include "occupancy_map.hpp"
 
 // Symmetry segmentation
-#include "symmetry/rotational_symmetry_segmentation.hpp"
-#include "symmetry/reflectional_symmetry_segmentation.hpp"
-
-#include "scene_oversegmentation.hpp"
-#include "rotational_symmetry_detection_scene.hpp"
-#include "reflectional_symmetry_detection_scene.hpp"
+#include "symseg_pipeline.hpp"
+#include "symseg_io.hpp"
 
 // Project includes
 #include "vis.hpp"
@@ -127,8 +125,10 @@ int main(int argc, char** argv)
   ///////////////////////           PARAMETERS           ///////////////////////
   //////////////////////////////////////////////////////////////////////////////
   
+  sym::SymSegParams params;
+  
   // Scene oversegmentation parameters
-  utl::SmoothSegParams sceneOversegParams;
+  utl::SmoothSegParams &sceneOversegParams = params.overseg;
   sceneOversegParams.voxel_size = 0.005f;
   sceneOversegParams.min_segment_size = 120;
   sceneOversegParams.max_iou = 0.8f;
@@ -136,7 +136,7 @@ int main(int argc, char** argv)
                                     std::pair<float, float>(pcl::deg2rad(15.0f), 0.5f) };  
                                     
   // Rotatioanal symmetry detection parameters
-  sym::RotSymDetectParams rotDetParams;
+  sym::RotSymDetectParams &rotDetParams = params.rot_det;
   rotDetParams.ref_max_fit_angle       = pcl::deg2rad(45.0f);
   rotDetParams.min_normal_fit_angle    = pcl::deg2rad(10.0f);
   rotDetParams.max_normal_fit_angle    = pcl::deg2rad(60.0f);
@@ -148,7 +148,7 @@ int main(int argc, char** argv)
   rotDetParams.min_coverage_score      = 0.3f;
   
   // Rotational segmentation parameters
-  sym::RotSymSegParams rotSegParams;
+  sym::RotSymSegParams &rotSegParams = params.rot_seg;
   rotSegParams.voxel_size = 0.005f;
   rotSegParams.min_normal_fit_angle    = pcl::deg2rad(0.0f);    // Minimum symmetry error of fit for a point
   rotSegParams.max_normal_fit_angle    = pcl::deg2rad(15.0f);    // Minimum symmetry error of fit for a point
@@ -169,7 +169,7 @@ int main(int argc, char** argv)
   rotSegParams.min_segment_size      = 100;
 
   // Reflectional symmetry detection parameters
-  sym::ReflSymDetectParams reflDetParams;
+  sym::ReflSymDetectParams &reflDetParams = params.refl_det;
   reflDetParams.voxel_size                  = 0.0f;
   reflDetParams.num_angle_divisions         = 5;
   reflDetParams.flatness_threshold          = 0.005f;
@@ -189,7 +189,7 @@ int main(int argc, char** argv)
   reflDetParams.max_reference_point_distance  = 0.3f;
   
   // Reflectional symmetry segmentation parameters
-  sym::ReflSymSegParams reflSegParams;
+  sym::ReflSymSegParams &reflSegParams = params.refl_seg;
   reflSegParams.voxel_size = 0.0f;
   
   reflSegParams.max_sym_corresp_reflected_distance = 0.01f;
@@ -213,10 +213,11 @@ int main(int argc, char** argv)
   reflSegParams.min_symmetry_support_overlap      = 0.5f;
   reflSegParams.similar_segment_iou_ = 0.95f;
   
+  // Rotational refinement parameters
+  params.rot_refine_max_fit_angle = pcl::deg2rad(5.0f);
+  
   // Occupancy map parameters
-  float occupancyMapBBXInflationRadius = 0.15f;                                    // Inflation radius of the distance map bounding box relative to the scene cloud bounding box  
-  float occupancyMapMaxDistance = std::max( std::max(rotSegParams.max_occlusion_distance, rotDetParams.max_occlusion_distance),
-                                            std::max(reflSegParams.max_occlusion_distance, reflDetParams.max_occlusion_distance));
+  params.occupancy_bbx_inflation_radius = 0.15f;                                   // Inflation radius of the distance map bounding box relative to the scene cloud bounding box  
   
   //////////////////////////////////////////////////////////////////////////////
   ///////////////////////           DATA LOAD            ///////////////////////
@@ -225,7 +226,7 @@ int main(int argc, char** argv)
   std::cout << "Loading data..." << std::endl;
   
   pcl::PointCloud<PointNC>::Ptr sceneCloudHighRes  (new pcl::PointCloud<PointNC>);
-  if (pcl::io::loadPLYFile (sceneCloudFilename, *sceneCloudHighRes))
+  if (!utl::loadPointCloudCached(sceneCloudFilename, *sceneCloudHighRes))
     return -1;
   
   // Read scene octree
@@ -244,416 +245,40 @@ int main(int argc, char** argv)
     std::cout << "Table plane coefficients must have 4 values, instead has " << tablePlaneCoefficients.size() << " values." << std::endl;
     return -1;
   }
-  
-  //----------------------------------------------------------------------------
-  // Create a scene occupancy map
-  //----------------------------------------------------------------------------
-    
-  std::cout << "Constructing scene occupancy map..." << std::endl;
-  double start = pcl::getTime ();
-  double totalStart = pcl::getTime ();
 
-  // Get cloud bounding box size
-  Eigen::Vector4f bbxMin, bbxMax;
-  pcl::getMinMax3D(*sceneCloudHighRes, bbxMin, bbxMax);
-  bbxMin.array() -= occupancyMapBBXInflationRadius;
-  bbxMax.array() += occupancyMapBBXInflationRadius;
-  
-  // Initialize map
-  sceneOccupancyMap->setBoundingPlanes(std::vector<Eigen::Vector4f> (1, tablePlaneCoefficients));
-  sceneOccupancyMap->distanceMapFromOccupancy ( bbxMin.head(3), bbxMax.head(3),
-                                                sceneOccupancyMap->getOccupancyTreeDepth(),
-                                                occupancyMapMaxDistance,
-                                                true  );
-      
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
-                                    
   //////////////////////////////////////////////////////////////////////////////
-  ////////////////           SCENE OVERSEGMENTATION            /////////////////
+  ///////////////////////      SYMMETRY SEGMENTATION      //////////////////////
   //////////////////////////////////////////////////////////////////////////////
   
-  pcl::PointCloud<PointNC>::Ptr     sceneCloud                (new pcl::PointCloud<PointNC>);
-  utl::Map                     downsampleMap;
-  std::vector<utl::Map>        oversegSegments;
-  utl::Map                     oversegSegmentsLinear;
-  
-  oversegmentScene<PointNC> (sceneCloudHighRes, sceneOversegParams, sceneCloud, downsampleMap, oversegSegments, oversegSegmentsLinear);
-
-  //////////////////////////////////////////////////////////////////////////////
-  ///////////////////////           ROTATIONAL           ///////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  
-  //----------------------------------------------------------------------------
-  // Symmetry detection
-  //----------------------------------------------------------------------------
-    
-  std::cout << "Detecting rotational symmetry..." << std::endl;
-  start = pcl::getTime (); 
-  
-  std::vector<sym::RotationalSymmetry>  rotSymmetry;
-  std::vector<std::vector<int> >        rotSymmetrySupport;
-  
-  if (  !detectRotationalSymmetryScene<PointNC> ( sceneCloud,
-                                                  sceneOccupancyMap,
-                                                  oversegSegmentsLinear,
-                                                  rotDetParams,
-                                                  rotSymmetry,
-                                                  rotSymmetrySupport ))
-  {
-    std::cout << "Could not detect rotational symmetries." << std::endl;
+  sym::SymSegPipeline<PointNC> pipeline (params);
+  pipeline.setDistanceMapCacheDirname(sceneDirname);
+  pipeline.setVerbose(true);
+  if (!pipeline.process(sceneCloudHighRes, sceneOccupancyMap, tablePlaneCoefficients))
     return -1;
-  }
-
-  std::cout << "  " << rotSymmetry.size() << " symmetries detected." << std::endl;
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;  
-    
-  //----------------------------------------------------------------------------
-  // Symmetry segmentation
-  //----------------------------------------------------------------------------
-      
-  std::cout << "Segmenting rotational objects..." << std::endl;
-  start = pcl::getTime ();
-
-  // Variables  
-  utl::Map       rotSegments;
-  std::vector<int>    rotSegmentFilteredIds;
-  std::vector<float>  rotSymmetryScores, rotOcclusionScores, rotSmoothnessScores;
-  
-  sym::RotationalSymmetrySegmentation<PointNC> rotSeg;
-  rotSeg.setInputCloud(sceneCloud);
-  rotSeg.setInputOcuppancyMap(sceneOccupancyMap);
-  rotSeg.setInputSymmetries(rotSymmetry);
-  rotSeg.setParameters(rotSegParams);
-  rotSeg.segment();
-  rotSeg.filter();
-  rotSeg.getSegments(rotSegments, rotSegmentFilteredIds);
-  rotSeg.getScores(rotSymmetryScores, rotOcclusionScores, rotSmoothnessScores);
-  
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
-  
-  //----------------------------------------------------------------------------
-  // Refine symmetries given segments and filter
-  //----------------------------------------------------------------------------
-
-  std::cout << "Refining symmetry and filtering..." << std::endl;
-  start = pcl::getTime ();
-    
-  std::vector<sym::RotationalSymmetry>  rotSymmetryRefined             (rotSymmetry.size());
-  std::vector<float>                    rotSymmetryScoresRefined       (rotSymmetry.size());
-  std::vector<float>                    rotOcclusionScoresRefined      (rotSymmetry.size());
-  
-  rotDetParams.ref_max_fit_angle = pcl::deg2rad(5.f);
-  
-  # pragma omp parallel for
-  for (size_t segId = 0; segId < rotSegments.size(); segId++)
-  {
-    if (rotSegments[segId].size() < 3)
-    {
-      rotSymmetryRefined[segId] = rotSymmetry[segId];
-    }
-    else
-    {
-      // Prepare input
-      pcl::PointCloud<PointNC>::Ptr segmentCloud (new pcl::PointCloud<PointNC>);
-      pcl::copyPointCloud<PointNC>(*sceneCloud, rotSegments[segId], *segmentCloud);
-      std::vector<sym::RotationalSymmetry> symmetriesInitial (1, rotSymmetry[segId]);
-      
-      // Output variables
-      std::vector<sym::RotationalSymmetry> symmetriesRefinedTMP;
-      std::vector<int>  symmetryFilteredIdsTMP, symmetryMergedIdsTMP;
-      std::vector<float>  symmetryScoresRefinedTMP;
-      std::vector<float>  occlusionScoresRefinedTMP;
-      std::vector<float>  perpendicularScoresRefinedTMP;
-      std::vector<float>  coverageScoresRefinedTMP;
-      
-      // Refine
-      sym::RotationalSymmetryDetection<PointNC> rsd (rotDetParams);
-      rsd.setInputCloud(segmentCloud);
-      rsd.setInputOcuppancyMap(sceneOccupancyMap);
-      rsd.setInputSymmetries(symmetriesInitial);
-      rsd.detect();
-      rsd.getSymmetries(symmetriesRefinedTMP, symmetryFilteredIdsTMP, symmetryMergedIdsTMP);
-      rsd.getScores(symmetryScoresRefinedTMP, occlusionScoresRefinedTMP, perpendicularScoresRefinedTMP, coverageScoresRefinedTMP);
-      
-      // Get output
-      rotSymmetryRefined[segId] = symmetriesRefinedTMP[0];
-      rotSymmetryScoresRefined[segId] = symmetryScoresRefinedTMP[0];
-      rotOcclusionScoresRefined[segId] = occlusionScoresRefinedTMP[0];
-    }
-  }
-   
-  rotSegmentFilteredIds.clear();
-  for (size_t segId = 0; segId < rotSegments.size(); segId++)
-  {
-    if (  rotSymmetryScoresRefined[segId]  < rotSegParams.max_symmetry_score       &&
-          rotOcclusionScoresRefined[segId] < rotSegParams.max_occlusion_score      &&
-          rotSmoothnessScores[segId]    < rotSegParams.max_smoothness_score     &&
-          rotSegments[segId].size()     > rotSegParams.min_segment_size
-        )
-    {
-      rotSegmentFilteredIds.push_back(segId);
-    }
-  }
-  
-  std::cout << "  " << rotSegmentFilteredIds.size() << " filtered segments." << std::endl;
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;  
-  
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////           REFLECTIONAL           //////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  
-  //----------------------------------------------------------------------------
-  // Remove rotational segments from the pointcloud
-  //----------------------------------------------------------------------------
-
-  // Get a boolean mask of points belonging to rotational segments
-  std::vector<bool> rotationalSegmentsMask (sceneCloud->size(), false);
-  for (size_t rotSegIdIt = 0; rotSegIdIt < rotSegmentFilteredIds.size(); rotSegIdIt++)
-  {
-    int rotSegId = rotSegmentFilteredIds[rotSegIdIt];
-    
-    for (size_t pointIdIt = 0; pointIdIt < rotSegments[rotSegId].size(); pointIdIt++)
-      rotationalSegmentsMask[rotSegments[rotSegId][pointIdIt]] = true;
-  }
-
-  // Remove isolated points
-  utl::GraphWeighted adjacency;
-  rotSeg.getAdjacency(adjacency);
-  utl::Graph graph_tmp (adjacency.getNumVertices());
-  for (size_t i = 0; i < adjacency.getNumEdges(); i++)
-  {
-    utl::EdgeWeighted edge;
-    if (adjacency.getEdge(i, edge))
-      if (!rotationalSegmentsMask[edge.vtx1Id_] && !rotationalSegmentsMask[edge.vtx2Id_])
-        graph_tmp.addEdge(edge.vtx1Id_, edge.vtx2Id_);
-  }
-  
-  utl::Map subSegments = utl::getConnectedComponents(graph_tmp);
-  for (size_t i = 0; i < subSegments.size(); i++)
-    if (subSegments[i].size() < 15)
-      for (size_t j = 0; j < subSegments[i].size(); j++)
-        rotationalSegmentsMask[subSegments[i][j]] = true;
 
-  // Get non-rotaional pointcloud
-  std::vector<int> cloudAfterRotIndices;    // Points belonging to filtered cloud
-  std::vector<int> cloudAfterRotIndicesInverse (sceneCloud->size(), -1);
-  
-  for (size_t pointId = 0; pointId < rotationalSegmentsMask.size(); pointId++)
-  {
-    if (!rotationalSegmentsMask[pointId])
-    {
-      cloudAfterRotIndicesInverse[pointId] = cloudAfterRotIndices.size(); 
-      cloudAfterRotIndices.push_back(pointId);
-    }
-  }
-  
-  pcl::PointCloud<PointNC>::Ptr sceneCloudAfterRot (new pcl::PointCloud<PointNC>);
-  pcl::copyPointCloud<PointNC>(*sceneCloud, cloudAfterRotIndices, *sceneCloudAfterRot);  
-
-  //----------------------------------------------------------------------------
-  // Remove segments that are already used for rotational symmetry
-  //----------------------------------------------------------------------------
+#ifdef SYMSEG_PROFILING
+  // Write the profile of the scene. Trace can be opened in chrome://tracing
+  utl::Profiler::getInstance().writeJSON(utl::fullfile(sceneDirname, "symseg_profile.json"));
+  utl::Profiler::getInstance().writeChromeTrace(utl::fullfile(sceneDirname, "symseg_trace.json"));
+#endif
   
-  std::vector<utl::Map>        oversegSegmentsAfterRot (sceneOversegParams.smoothness.size());
-  utl::Map                     oversegSegmentsAfterRotLinear;
-    
-  for (size_t segParamId = 0; segParamId < sceneOversegParams.smoothness.size(); segParamId++)
-  {
-    for (size_t oversegSegId = 0; oversegSegId < oversegSegments[segParamId].size(); oversegSegId++)
-    {
-      std::vector<int> curSegment = oversegSegments[segParamId][oversegSegId];
-      std::vector<int> curSegmentAfterRot;
-      for (size_t pointIdIt = 0; pointIdIt < curSegment.size(); pointIdIt++)
-      {
-        int pointId = curSegment[pointIdIt];
-        if (!rotationalSegmentsMask[pointId])
-          curSegmentAfterRot.push_back(cloudAfterRotIndicesInverse[pointId]);
-      }
-      
-      if (curSegmentAfterRot.size() > sceneOversegParams.min_segment_size)
-      {
-        oversegSegmentsAfterRot[segParamId].push_back(curSegmentAfterRot);
-        oversegSegmentsAfterRotLinear.push_back(curSegmentAfterRot);
-      }
-    }
-  }
-  
-  //----------------------------------------------------------------------------
-  // Symmetry detection
-  //----------------------------------------------------------------------------
-    
-  std::cout << "Detecting reflectional symmetry..." << std::endl;
-  start = pcl::getTime (); 
-  
-  std::vector<sym::ReflectionalSymmetry>  reflSymmetry;
-  std::vector<std::vector<int> >          reflSymmetrySupport;
-  
-  if (  !detectReflectionalSymmetryScene<PointNC> ( sceneCloudAfterRot,
-                                                    sceneOccupancyMap,
-                                                    oversegSegmentsAfterRotLinear,
-                                                    reflDetParams,
-                                                    reflSymmetry,
-                                                    reflSymmetrySupport ))
-  {
-    std::cout << "Could not detect reflectional symmetries." << std::endl;
+  const sym::SymSegResult<PointNC> &result = pipeline.getResult();
+  if (save && !sym::writeSymSegResult(result, resultDirname))
     return -1;
-  }
-
-  std::cout << "  " << reflSymmetry.size() << " symmetries detected." << std::endl;
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;  
-  
-  //----------------------------------------------------------------------------
-  // Symmetry segmentation
-  //----------------------------------------------------------------------------
-      
-  std::cout << "Segmenting reflectional objects..." << std::endl;
-  start = pcl::getTime ();
-
-  // Variables  
-  utl::Map                   reflSegments;
-  std::vector<int>                reflSegmentFilteredIds;
-  std::vector<std::vector<int> >  reflSegmentMergedIds;
-  
-  sym::ReflectionalSymmetrySegmentation<PointNC> reflSeg;
-  reflSeg.setInputCloud(sceneCloudAfterRot);
-  reflSeg.setInputOcuppancyMap(sceneOccupancyMap);
-  reflSeg.setInputTablePlane(tablePlaneCoefficients);
-  reflSeg.setInputSymmetries(reflSymmetry, reflSymmetrySupport);
-  reflSeg.setParameters(reflSegParams);
-  reflSeg.segment();
-  reflSeg.getSegments(reflSegments, reflSegmentFilteredIds, reflSegmentMergedIds);
-
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
-  
-  //----------------------------------------------------------------------------
-  // Refine symmetries given segments
-  //----------------------------------------------------------------------------
-
-  std::cout << "Refining symmetry..." << std::endl;
-  start = pcl::getTime ();
-    
-  std::vector<sym::ReflectionalSymmetry>  reflSymmetryRefined (reflSegments.size());
-  
-  # pragma omp parallel for
-  for (size_t segId = 0; segId < reflSegments.size(); segId++)
-  {
-    if (reflSegments[segId].size() < 3)
-    {
-      reflSymmetryRefined[segId] = reflSymmetry[segId];
-    }
-    else
-    {
-      // Prepare input
-      pcl::PointCloud<PointNC>::Ptr segmentCloud (new pcl::PointCloud<PointNC>);
-      pcl::copyPointCloud<PointNC>(*sceneCloudAfterRot, reflSegments[segId], *segmentCloud);
-      std::vector<sym::ReflectionalSymmetry> symmetriesInitial (1, reflSymmetry[segId]);
-      
-      // Output variables
-      std::vector<sym::ReflectionalSymmetry> symmetriesRefinedTMP;
-      std::vector<int>  symmetryFilteredIdsTMP, symmetryMergedIdsTMP;
-      
-      // Refine
-      sym::ReflectionalSymmetryDetection<PointNC> rsd (reflDetParams);
-      rsd.setInputCloud(segmentCloud);
-      rsd.setInputOcuppancyMap(sceneOccupancyMap);
-      rsd.setInputSymmetries(symmetriesInitial);
-      if (rsd.detect())
-      {
-        rsd.getSymmetries(symmetriesRefinedTMP, symmetryFilteredIdsTMP, symmetryMergedIdsTMP);
-        reflSymmetryRefined[segId] = symmetriesRefinedTMP[0];
-        pcl::PointCloud<PointNC>::Ptr segmentCloud (new pcl::PointCloud<PointNC>);
-        pcl::copyPointCloud(*sceneCloudAfterRot, reflSegments[segId], *segmentCloud);
-        Eigen::Vector4f cloudMeanTMP;
-        pcl::compute3DCentroid<PointNC>(*segmentCloud, cloudMeanTMP);
-      }
-      else
-      {
-        reflSymmetryRefined[segId] = reflSymmetry[segId];
-      }
-    }
-  }
   
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
-
-  //----------------------------------------------------------------------------
-  // Refine segments given refined symmetries
-  //----------------------------------------------------------------------------
-
-  std::cout << "Segmenting refined..." << std::endl;
-  start = pcl::getTime ();
-      
-  std::vector<std::vector<int> >    reflSegmentsRefined;
-  std::vector<int>                  reflSegmentFilteredIdsRefined;
-  std::vector<std::vector<int> >    reflSegmentMergedIdsRefined;
-  
-  reflSeg.setInputSymmetries(reflSymmetryRefined, reflSymmetrySupport);
-  reflSeg.segment();
-  reflSeg.filter();
-  reflSeg.merge();
-  reflSeg.getSegments(reflSegmentsRefined, reflSegmentFilteredIdsRefined, reflSegmentMergedIdsRefined);
-  
-  // Convert segments to full cloud
-  utl::Map reflSegmentsFinal (reflSegmentMergedIdsRefined.size());
-  std::vector<std::vector<sym::ReflectionalSymmetry> > reflSymmetryFinal (reflSegmentMergedIdsRefined.size());
-  
-  for (size_t segIdIt = 0; segIdIt < reflSegmentMergedIdsRefined.size(); segIdIt++)
-  {
-    std::vector<int> curSegment = reflSegmentsRefined[reflSegmentMergedIdsRefined[segIdIt][0]];
-    for (size_t pointIdIt = 0; pointIdIt < curSegment.size(); pointIdIt++)
-    {
-      int pointId  = curSegment[pointIdIt];
-      curSegment[pointIdIt] = cloudAfterRotIndices[pointId];
-    }
-    reflSegmentsFinal[segIdIt] = curSegment;
-    
-    for (size_t symIdIt = 0; symIdIt < reflSegmentMergedIdsRefined[segIdIt].size(); symIdIt++)
-    {
-      int symId = reflSegmentMergedIdsRefined[segIdIt][symIdIt];
-      reflSymmetryFinal[segIdIt].push_back(reflSymmetryRefined[symId]);
-    }
-  }
-  
-  std::cout << "  " << reflSegmentMergedIdsRefined.size() << " merged refined segments." << std::endl;
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
-  
-  //----------------------------------------------------------------------------
-  // Remove duplicate symmetries
-  //----------------------------------------------------------------------------
-
-  std::cout << "Remove duplicate symmetries..." << std::endl;
-  start = pcl::getTime ();
-  
-  for (size_t segId = 0; segId < reflSymmetryFinal.size(); segId++)
-  {
-    std::vector<int> merged;
-    
-    // Get mean
-    pcl::PointCloud<PointNC>::Ptr segmentCloud (new pcl::PointCloud<PointNC>);
-    pcl::copyPointCloud<PointNC>(*sceneCloud, reflSegmentsFinal[segId], *segmentCloud);
-    Eigen::Vector4f centroid;
-    pcl::compute3DCentroid(*segmentCloud, centroid);
-    
-    sym::mergeDuplicateReflSymmetries ( reflSymmetryFinal[segId],
-                                        std::vector<Eigen::Vector3f> (reflSymmetryFinal[segId].size(), centroid.head(3)),
-                                        std::vector<float> (reflSymmetryFinal[segId].size(), 1.0),
-                                        merged,
-                                        reflDetParams.symmetry_min_angle_diff,
-                                        reflDetParams.symmetry_min_distance_diff,
-                                        reflDetParams.max_reference_point_distance
-                                      );
-    
-    std::vector<sym::ReflectionalSymmetry> symmetriesFiltered;
-    for (size_t i = 0; i < merged.size(); i++)
-      symmetriesFiltered.push_back(reflSymmetryFinal[segId][merged[i]]);
-    
-    reflSymmetryFinal[segId] = symmetriesFiltered;
-  }
-  
-  std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
-
-  //////////////////////////////////////////////////////////////////////////////
-  std::cout << "----------------------------" << std::endl;
-  std::cout << "Total time: " << (pcl::getTime() - totalStart) << " seconds." << std::endl;
+  pcl::PointCloud<PointNC>::Ptr                                sceneCloud              = result.scene_cloud;
+  pcl::PointCloud<PointNC>::Ptr                                sceneCloudAfterRot      = result.scene_cloud_after_rot;
+  const std::vector<utl::SegmentSet>                          &oversegSegments         = result.overseg_segments;
+  const std::vector<utl::SegmentSet>                          &oversegSegmentsAfterRot = result.overseg_segments_after_rot;
+  const std::vector<sym::RotationalSymmetry>                  &rotSymmetry             = result.rot_symmetry;
+  const utl::SegmentSet                                       &rotSymmetrySupport      = result.rot_symmetry_support;
+  const std::vector<sym::RotationalSymmetry>                  &rotSymmetryRefined      = result.rot_symmetry_refined;
+  const utl::Map                                              &rotSegments             = result.rot_segments;
+  const std::vector<int>                                      &rotSegmentFilteredIds   = result.rot_segment_filtered_ids;
+  const std::vector<sym::ReflectionalSymmetry>                &reflSymmetry            = result.refl_symmetry;
+  const utl::SegmentSet                                       &reflSymmetrySupport     = result.refl_symmetry_support;
+  const utl::Map                                              &reflSegmentsFinal       = result.refl_segments;
+  const std::vector<std::vector<sym::ReflectionalSymmetry> >  &reflSymmetryFinal       = result.refl_segment_symmetries;
 
   //////////////////////////////////////////////////////////////////////////////
   /////////////////////           VISUALIZATION           //////////////////////
@@ -726,7 +351,7 @@ int main(int argc, char** argv)
                 visState.cloudDisplay_ == VisState::OVERSEGMENTATION_AFTER_ROT )
       {
         pcl::PointCloud<PointNC>::Ptr cloudDisplay (new pcl::PointCloud<PointNC>);
-        std::vector<utl::Map> segmentationDisplay;
+        std::vector<utl::SegmentSet> segmentationDisplay;
         std::string text;
         if ( visState.cloudDisplay_ == VisState::INITIAL_OVERSEGMENTAION)
         {
@@ -744,7 +369,9 @@ int main(int argc, char** argv)
         visState.segIterator_ = utl::clampValueCircular<int>(visState.segIterator_, 0, segmentationDisplay.size()-1);
         int segParamId = visState.segIterator_;
         
-        utl::showSegmentation<PointNC>(visualizer, cloudDisplay, segmentationDisplay[segParamId], "segment", visState.pointSize_);
+        utl::Map segmentsDisplay;
+        segmentationDisplay[segParamId].toMap(segmentsDisplay);
+        utl::showSegmentation<PointNC>(visualizer, cloudDisplay, segmentsDisplay, "segment", visState.pointSize_);
 
         visualizer.addText(text + std::to_string(segParamId+1) + " / " + std::to_string(sceneOversegParams.smoothness.size()), 0, 150, 24, 1.0, 1.0, 1.0);
         visualizer.addText(std::to_string(segmentationDisplay[segParamId].size()) + " segments", 0, 125, 24, 1.0, 1.0, 1.0);
@@ -762,7 +389,7 @@ int main(int argc, char** argv)
         if (visState.cloudDisplay_ == VisState::ROTATIONAL_SYMMETRIES)
         {
           symmetryDisplay = rotSymmetry;
-          symmetrySegmentsDisplay = rotSymmetrySupport;
+          rotSymmetrySupport.toMap(symmetrySegmentsDisplay);
           for (size_t symId = 0; symId < symmetryDisplay.size(); symId++)
             symmetryDisplayIds.push_back(symId);
           text = "Rotational symmetries";
@@ -798,7 +425,7 @@ int main(int argc, char** argv)
         if (visState.cloudDisplay_ == VisState::REFLECTIONAL_SYMMETRIES)
         {
           symmetryDisplay = reflSymmetry;
-          symmetrySegmentsDisplay = reflSymmetrySupport;
+          reflSymmetrySupport.toMap(symmetrySegmentsDisplay);
           for (size_t symId = 0; symId < symmetryDisplay.size(); symId++)
             symmetryDisplayIds.push_back(symId);
           text = "Reflectional symmetry ";
@@ -825,7 +452,7 @@ int main(int argc, char** argv)
         utl::showFGSegmentationColor<PointNC>(visualizer, sceneCloud, reflSegmentsFinal[segId], "object", visState.pointSize_);
 
         visualizer.addText("Reflectional segments", 0, 150, 24, 1.0, 1.0, 1.0);
-        visualizer.addText("Segment " + std::to_string(segId+1) + " / " + std::to_string(reflSegmentMergedIdsRefined.size()), 15, 125, 24, 1.0, 1.0, 1.0);  
+        visualizer.addText("Segment " + std::to_string(segId+1) + " / " + std::to_string(reflSegmentsFinal.size()), 15, 125, 24, 1.0, 1.0, 1.0);  
       }
       
       else if ( visState.cloudDisplay_ == VisState::FINAL_SEGMENTS )
@@ -8,6 +8,7 @@
 
 // Utilities includes
 #include "filesystem/filesystem.hpp"
+#include "filesystem/cloud_cache.hpp"
 #include "eigen.hpp"
 
 // Occupancy map
@@ -190,7 +191,7 @@ int main(int argc, char** argv)
   std::cout << "Loading data..." << std::endl;
   
   pcl::PointCloud<PointNC>::Ptr sceneCloudHighRes  (new pcl::PointCloud<PointNC>);
-  if (pcl::io::loadPLYFile (sceneCloudFilename, *sceneCloudHighRes))
+  if (!utl::loadPointCloudCached(sceneCloudFilename, *sceneCloudHighRes))
     return -1;
   
   // Read scene octree
@@ -226,10 +227,12 @@ int main(int argc, char** argv)
   
   // Initialize map
   sceneOccupancyMap->setBoundingPlanes(std::vector<Eigen::Vector4f> (1, tablePlaneCoefficients));
-  sceneOccupancyMap->distanceMapFromOccupancy ( bbxMin.head(3), bbxMax.head(3),
-                                                sceneOccupancyMap->getOccupancyTreeDepth(),
-                                                occupancyMapMaxDistance,
-                                                true  );
+  sceneOccupancyMap->distanceMapFromOccupancyCached  ( sceneDirname,
+                                                      bbxMin.head(3), bbxMax.head(3),
+                                                      sceneOccupancyMap->getOccupancyTreeDepth(),
+                                                      occupancyMapMaxDistance,
+                                                      true  );
+  sceneOccupancyMap->enterQueryMode();
       
   std::cout << "  " << (pcl::getTime() - start) << " seconds." << std::endl;
                                     
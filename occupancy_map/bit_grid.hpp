@@ -0,0 +1,171 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef BIT_GRID_HPP
+#define BIT_GRID_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+
+/** \brief A dense 3D boolean grid packed into 64 bit words. Voxels are laid
+ * out in the same order as in ObstacleGrid (z varying fastest).
+ */
+class BitGrid
+{
+public:
+
+  /** \brief Empty constructor. */
+  BitGrid ()
+    : sizeX_ (0)
+    , sizeY_ (0)
+    , sizeZ_ (0)
+  { }
+
+  /** \brief Allocate the grid and set all voxels to a given value.
+   *  \param[in]  size_x    number of voxels along x axis
+   *  \param[in]  size_y    number of voxels along y axis
+   *  \param[in]  size_z    number of voxels along z axis
+   *  \param[in]  value     initial value of the voxels
+   */
+  inline void resize (const int size_x, const int size_y, const int size_z, const bool value = false)
+  {
+    sizeX_ = std::max(size_x, 0);
+    sizeY_ = std::max(size_y, 0);
+    sizeZ_ = std::max(size_z, 0);
+    words_.assign((size() + 63) / 64, value ? ~static_cast<uint64_t>(0) : static_cast<uint64_t>(0));
+  }
+
+  /** \brief Pack a boolean array laid out in the same order as the grid.
+   *  \param[in]  data      boolean array of size_x * size_y * size_z values
+   *  \param[in]  size_x    number of voxels along x axis
+   *  \param[in]  size_y    number of voxels along y axis
+   *  \param[in]  size_z    number of voxels along z axis
+   */
+  inline void assign (const bool *data, const int size_x, const int size_y, const int size_z)
+  {
+    resize(size_x, size_y, size_z);
+    const size_t numVoxels = size();
+
+    #pragma omp parallel for
+    for (int wordId = 0; wordId < static_cast<int>(words_.size()); wordId++)
+    {
+      uint64_t word = 0;
+      const size_t voxelStart = static_cast<size_t>(wordId) * 64;
+      const size_t voxelEnd = std::min(voxelStart + 64, numVoxels);
+      for (size_t voxelId = voxelStart; voxelId < voxelEnd; voxelId++)
+        word |= static_cast<uint64_t>(data[voxelId] ? 1 : 0) << (voxelId - voxelStart);
+      words_[wordId] = word;
+    }
+  }
+
+  /** \brief Release grid memory. */
+  inline void clear ()
+  {
+    sizeX_ = 0;
+    sizeY_ = 0;
+    sizeZ_ = 0;
+    std::vector<uint64_t>().swap(words_);
+  }
+
+  /** \brief Exchange the contents of two grids. */
+  inline void swap (BitGrid &other)
+  {
+    std::swap(sizeX_, other.sizeX_);
+    std::swap(sizeY_, other.sizeY_);
+    std::swap(sizeZ_, other.sizeZ_);
+    words_.swap(other.words_);
+  }
+
+  /** \brief Check if the grid is empty. */
+  inline bool empty () const  { return words_.empty(); }
+
+  /** \brief Get grid dimensions. */
+  inline int getSizeX () const  { return sizeX_; }
+  inline int getSizeY () const  { return sizeY_; }
+  inline int getSizeZ () const  { return sizeZ_; }
+
+  /** \brief Get total number of voxels in the grid. */
+  inline size_t size () const { return static_cast<size_t>(sizeX_) * sizeY_ * sizeZ_; }
+
+  /** \brief Get the linear index of a voxel. */
+  inline size_t getIndex (const int x, const int y, const int z) const
+  {
+    return (static_cast<size_t>(x) * sizeY_ + y) * sizeZ_ + z;
+  }
+
+  /** \brief Check if voxel coordinates fall inside the grid. */
+  inline bool isInside (const int x, const int y, const int z) const
+  {
+    return x >= 0 && x < sizeX_ && y >= 0 && y < sizeY_ && z >= 0 && z < sizeZ_;
+  }
+
+  /** \brief Get voxel value. No bounds checking is performed. */
+  inline bool get (const int x, const int y, const int z) const
+  {
+    size_t index = getIndex(x, y, z);
+    return (words_[index >> 6] >> (index & 63)) & 1;
+  }
+
+  /** \brief Set voxel value. No bounds checking is performed. Not thread safe
+   * since neighboring voxels share a word.
+   */
+  inline void set (const int x, const int y, const int z, const bool value)
+  {
+    size_t index = getIndex(x, y, z);
+    uint64_t mask = static_cast<uint64_t>(1) << (index & 63);
+    if (value)
+      words_[index >> 6] |= mask;
+    else
+      words_[index >> 6] &= ~mask;
+  }
+
+  /** \brief Write the grid to a binary stream in native byte order.
+   *  \param[out] out   output stream
+   */
+  inline void write (std::ostream &out) const
+  {
+    const int32_t size[3] = {sizeX_, sizeY_, sizeZ_};
+    out.write(reinterpret_cast<const char*>(size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(words_.data()), words_.size() * sizeof(uint64_t));
+  }
+
+  /** \brief Read a grid written by write from a memory buffer.
+   *  \param[in,out] data  start of the grid data, advanced past it on success
+   *  \param[in]     end   end of the buffer
+   *  \return FALSE if the buffer does not hold a valid grid
+   */
+  inline bool read (const char *&data, const char *end)
+  {
+    int32_t size[3];
+    if (static_cast<size_t>(end - data) < sizeof(size))
+      return false;
+    std::memcpy(size, data, sizeof(size));
+    if (size[0] < 0 || size[1] < 0 || size[2] < 0)
+      return false;
+
+    resize(size[0], size[1], size[2]);
+    if (static_cast<size_t>(end - data) < sizeof(size) + words_.size() * sizeof(uint64_t))
+    {
+      clear();
+      return false;
+    }
+
+    std::memcpy(words_.data(), data + sizeof(size), words_.size() * sizeof(uint64_t));
+    data += sizeof(size) + words_.size() * sizeof(uint64_t);
+    return true;
+  }
+
+private:
+
+  /** \brief Grid dimensions. */
+  int sizeX_, sizeY_, sizeZ_;
+
+  /** \brief Packed voxel values. */
+  std::vector<uint64_t> words_;
+};
+
+#endif    // BIT_GRID_HPP
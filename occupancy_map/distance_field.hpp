@@ -0,0 +1,315 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef DISTANCE_FIELD_HPP
+#define DISTANCE_FIELD_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ostream>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+/** \brief A sparse 3D grid of truncated metric distances. The grid is split
+ * into bricks of BRICK_SIZE^3 voxels. Only bricks containing different
+ * distances are allocated, bricks where all voxels have the same distance
+ * (e.g. far from any obstacle or deep inside the obstacle space) are stored
+ * as a single tile value. Distances are quantized to 16 bits over the range
+ * [0, max_distance], values above the maximum distance are truncated. In
+ * addition to voxel coordinates the grid can be indexed directly with world
+ * coordinates, voxel (x, y, z) containing points p for which
+ * floor(p * scale + offset) = (x, y, z).
+ */
+class DistanceField
+{
+public:
+
+  /** \brief Number of voxels along each side of a brick. */
+  static const int BRICK_SIZE = 8;
+
+  /** \brief Number of voxels in a brick. */
+  static const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+  /** \brief Empty constructor. */
+  DistanceField ()
+    : sizeX_ (0)
+    , sizeY_ (0)
+    , sizeZ_ (0)
+    , numBricksX_ (0)
+    , numBricksY_ (0)
+    , numBricksZ_ (0)
+    , maxDistance_ (0.0f)
+    , step_ (0.0f)
+    , stepInv_ (0.0f)
+    , scale_ (1.0)
+    , offset_ (Eigen::Vector3d::Zero())
+  { }
+
+  /** \brief Allocate the brick tables and set all voxels to the maximum distance.
+   *  \param[in]  size_x        number of voxels along x axis
+   *  \param[in]  size_y        number of voxels along y axis
+   *  \param[in]  size_z        number of voxels along z axis
+   *  \param[in]  max_distance  maximum distance that can be stored in the grid
+   */
+  inline void resize (const int size_x, const int size_y, const int size_z, const float max_distance)
+  {
+    sizeX_ = std::max(size_x, 0);
+    sizeY_ = std::max(size_y, 0);
+    sizeZ_ = std::max(size_z, 0);
+    numBricksX_ = (sizeX_ + BRICK_SIZE - 1) / BRICK_SIZE;
+    numBricksY_ = (sizeY_ + BRICK_SIZE - 1) / BRICK_SIZE;
+    numBricksZ_ = (sizeZ_ + BRICK_SIZE - 1) / BRICK_SIZE;
+    maxDistance_ = std::max(max_distance, 0.0f);
+    step_ = maxDistance_ / static_cast<float>(std::numeric_limits<uint16_t>::max());
+    stepInv_ = step_ > 0.0f ? 1.0f / step_ : 0.0f;
+
+    size_t numBricks = static_cast<size_t>(numBricksX_) * numBricksY_ * numBricksZ_;
+    brickIds_.assign(numBricks, -1);
+    tiles_.assign(numBricks, std::numeric_limits<uint16_t>::max());
+    bricks_.clear();
+  }
+
+  /** \brief Release grid memory. */
+  inline void clear ()
+  {
+    sizeX_ = 0;
+    sizeY_ = 0;
+    sizeZ_ = 0;
+    numBricksX_ = 0;
+    numBricksY_ = 0;
+    numBricksZ_ = 0;
+    std::vector<int32_t>().swap(brickIds_);
+    std::vector<uint16_t>().swap(tiles_);
+    std::vector<uint16_t>().swap(bricks_);
+  }
+
+  /** \brief Exchange the contents of two grids. */
+  inline void swap (DistanceField &other)
+  {
+    std::swap(sizeX_, other.sizeX_);
+    std::swap(sizeY_, other.sizeY_);
+    std::swap(sizeZ_, other.sizeZ_);
+    std::swap(numBricksX_, other.numBricksX_);
+    std::swap(numBricksY_, other.numBricksY_);
+    std::swap(numBricksZ_, other.numBricksZ_);
+    std::swap(maxDistance_, other.maxDistance_);
+    std::swap(step_, other.step_);
+    std::swap(stepInv_, other.stepInv_);
+    std::swap(scale_, other.scale_);
+    std::swap(offset_, other.offset_);
+    brickIds_.swap(other.brickIds_);
+    tiles_.swap(other.tiles_);
+    bricks_.swap(other.bricks_);
+  }
+
+  /** \brief Set the transformation from world coordinates to voxel coordinates.
+   *  \param[in]  scale     number of voxels per unit length
+   *  \param[in]  offset    voxel coordinates of the world origin
+   */
+  inline void setWorldToVoxel (const double scale, const Eigen::Vector3d &offset)
+  {
+    scale_ = scale;
+    offset_ = offset;
+  }
+
+  /** \brief Check if the grid is empty. */
+  inline bool empty () const  { return brickIds_.empty(); }
+
+  /** \brief Get grid dimensions. */
+  inline int getSizeX () const  { return sizeX_; }
+  inline int getSizeY () const  { return sizeY_; }
+  inline int getSizeZ () const  { return sizeZ_; }
+
+  /** \brief Get brick grid dimensions. */
+  inline int getNumBricksX () const  { return numBricksX_; }
+  inline int getNumBricksY () const  { return numBricksY_; }
+  inline int getNumBricksZ () const  { return numBricksZ_; }
+
+  /** \brief Get the number of allocated (non uniform) bricks. */
+  inline size_t getNumAllocatedBricks () const  { return bricks_.size() / BRICK_VOXELS; }
+
+  /** \brief Get the maximum distance that can be stored in the grid. */
+  inline float getMaxDistance () const  { return maxDistance_; }
+
+  /** \brief Get the index of a voxel inside its brick. */
+  static inline int getBrickVoxelIndex (const int x, const int y, const int z)
+  {
+    return ((x % BRICK_SIZE) * BRICK_SIZE + (y % BRICK_SIZE)) * BRICK_SIZE + (z % BRICK_SIZE);
+  }
+
+  /** \brief Check if voxel coordinates fall inside the grid. */
+  inline bool isInside (const int x, const int y, const int z) const
+  {
+    return x >= 0 && x < sizeX_ && y >= 0 && y < sizeY_ && z >= 0 && z < sizeZ_;
+  }
+
+  /** \brief Set the distances of all voxels of a brick. The brick is stored as
+   * a tile if all distances quantize to the same value. Can be called from
+   * multiple threads as long as they set different bricks.
+   *  \param[in]  brick_x     brick coordinate along x axis
+   *  \param[in]  brick_y     brick coordinate along y axis
+   *  \param[in]  brick_z     brick coordinate along z axis
+   *  \param[in]  distances   BRICK_VOXELS distances ordered by getBrickVoxelIndex
+   */
+  inline void setBrick (const int brick_x, const int brick_y, const int brick_z, const float *distances)
+  {
+    uint16_t brick[BRICK_VOXELS];
+    bool uniform = true;
+    for (int voxelId = 0; voxelId < BRICK_VOXELS; voxelId++)
+    {
+      float distanceClamped = std::min(std::max(distances[voxelId], 0.0f), maxDistance_);
+      brick[voxelId] = static_cast<uint16_t>(distanceClamped * stepInv_ + 0.5f);
+      uniform = uniform && brick[voxelId] == brick[0];
+    }
+
+    size_t brickLinearId = getBrickLinearIndex(brick_x, brick_y, brick_z);
+    if (uniform)
+    {
+      tiles_[brickLinearId] = brick[0];
+      return;
+    }
+
+    #pragma omp critical (distance_field_bricks)
+    {
+      brickIds_[brickLinearId] = static_cast<int32_t>(bricks_.size() / BRICK_VOXELS);
+      bricks_.insert(bricks_.end(), brick, brick + BRICK_VOXELS);
+    }
+  }
+
+  /** \brief Get voxel distance.
+   *  \return distance or a negative value if voxel is outside of the grid
+   */
+  inline float getDistance (const int x, const int y, const int z) const
+  {
+    if (!isInside(x, y, z))
+      return -1.0f;
+
+    size_t brickLinearId = getBrickLinearIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+    int32_t brickId = brickIds_[brickLinearId];
+    if (brickId < 0)
+      return static_cast<float>(tiles_[brickLinearId]) * step_;
+
+    return static_cast<float>(bricks_[static_cast<size_t>(brickId) * BRICK_VOXELS + getBrickVoxelIndex(x, y, z)]) * step_;
+  }
+
+  /** \brief Get distance at a point in world coordinates.
+   *  \return distance or a negative value if point is outside of the grid
+   */
+  inline float getDistance (const Eigen::Vector3f &point) const
+  {
+    Eigen::Vector3d voxel = (point.cast<double>() * scale_ + offset_).array().floor();
+    return getDistance(static_cast<int>(voxel[0]), static_cast<int>(voxel[1]), static_cast<int>(voxel[2]));
+  }
+
+  /** \brief Write the grid to a binary stream in native byte order.
+   *  \param[out] out   output stream
+   */
+  inline void write (std::ostream &out) const
+  {
+    const int32_t size[3] = {sizeX_, sizeY_, sizeZ_};
+    const uint64_t numAllocatedBricks = getNumAllocatedBricks();
+    out.write(reinterpret_cast<const char*>(size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(&maxDistance_), sizeof(maxDistance_));
+    out.write(reinterpret_cast<const char*>(&scale_), sizeof(scale_));
+    out.write(reinterpret_cast<const char*>(offset_.data()), 3 * sizeof(double));
+    out.write(reinterpret_cast<const char*>(&numAllocatedBricks), sizeof(numAllocatedBricks));
+    out.write(reinterpret_cast<const char*>(brickIds_.data()), brickIds_.size() * sizeof(int32_t));
+    out.write(reinterpret_cast<const char*>(tiles_.data()), tiles_.size() * sizeof(uint16_t));
+    out.write(reinterpret_cast<const char*>(bricks_.data()), bricks_.size() * sizeof(uint16_t));
+  }
+
+  /** \brief Read a grid written by write from a memory buffer.
+   *  \param[in,out] data  start of the grid data, advanced past it on success
+   *  \param[in]     end   end of the buffer
+   *  \return FALSE if the buffer does not hold a valid grid
+   */
+  inline bool read (const char *&data, const char *end)
+  {
+    int32_t size[3];
+    float maxDistance;
+    double scale;
+    Eigen::Vector3d offset;
+    uint64_t numAllocatedBricks;
+    const size_t fixedSize = sizeof(size) + sizeof(maxDistance) + sizeof(scale) + 3 * sizeof(double) + sizeof(numAllocatedBricks);
+    if (static_cast<size_t>(end - data) < fixedSize)
+      return false;
+
+    const char *pos = data;
+    std::memcpy(size, pos, sizeof(size));                               pos += sizeof(size);
+    std::memcpy(&maxDistance, pos, sizeof(maxDistance));                pos += sizeof(maxDistance);
+    std::memcpy(&scale, pos, sizeof(scale));                            pos += sizeof(scale);
+    std::memcpy(offset.data(), pos, 3 * sizeof(double));                pos += 3 * sizeof(double);
+    std::memcpy(&numAllocatedBricks, pos, sizeof(numAllocatedBricks));  pos += sizeof(numAllocatedBricks);
+
+    if (size[0] < 0 || size[1] < 0 || size[2] < 0)
+      return false;
+
+    resize(size[0], size[1], size[2], maxDistance);
+    setWorldToVoxel(scale, offset);
+
+    const size_t numBricks = brickIds_.size();
+    if (numAllocatedBricks > numBricks || static_cast<size_t>(end - pos) < numBricks * (sizeof(int32_t) + sizeof(uint16_t)) + numAllocatedBricks * BRICK_VOXELS * sizeof(uint16_t))
+    {
+      clear();
+      return false;
+    }
+
+    bricks_.resize(numAllocatedBricks * BRICK_VOXELS);
+    std::memcpy(brickIds_.data(), pos, numBricks * sizeof(int32_t));      pos += numBricks * sizeof(int32_t);
+    std::memcpy(tiles_.data(), pos, numBricks * sizeof(uint16_t));        pos += numBricks * sizeof(uint16_t);
+    std::memcpy(bricks_.data(), pos, bricks_.size() * sizeof(uint16_t));  pos += bricks_.size() * sizeof(uint16_t);
+
+    for (size_t brickId = 0; brickId < numBricks; brickId++)
+    {
+      if (brickIds_[brickId] >= static_cast<int64_t>(numAllocatedBricks))
+      {
+        clear();
+        return false;
+      }
+    }
+
+    data = pos;
+    return true;
+  }
+
+private:
+
+  /** \brief Get the linear index of a brick. */
+  inline size_t getBrickLinearIndex (const int brick_x, const int brick_y, const int brick_z) const
+  {
+    return (static_cast<size_t>(brick_x) * numBricksY_ + brick_y) * numBricksZ_ + brick_z;
+  }
+
+  /** \brief Grid dimensions. */
+  int sizeX_, sizeY_, sizeZ_;
+
+  /** \brief Brick grid dimensions. */
+  int numBricksX_, numBricksY_, numBricksZ_;
+
+  /** \brief Maximum distance that can be stored. */
+  float maxDistance_;
+
+  /** \brief Quantization step and its inverse. */
+  float step_, stepInv_;
+
+  /** \brief World to voxel coordinate transformation. */
+  double scale_;
+  Eigen::Vector3d offset_;
+
+  /** \brief Index of the allocated brick for every brick of the grid, -1 for tiles. */
+  std::vector<int32_t> brickIds_;
+
+  /** \brief Quantized distance of the uniform bricks. */
+  std::vector<uint16_t> tiles_;
+
+  /** \brief Quantized voxel distances of the allocated bricks. */
+  std::vector<uint16_t> bricks_;
+};
+
+#endif    // DISTANCE_FIELD_HPP
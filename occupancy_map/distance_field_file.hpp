@@ -0,0 +1,242 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef DISTANCE_FIELD_FILE_HPP
+#define DISTANCE_FIELD_FILE_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// POSIX includes
+#include <unistd.h>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+// Utilities includes
+#include <filesystem/mapped_file.hpp>
+
+// Occupancy map includes
+#include "distance_field.hpp"
+#include "bit_grid.hpp"
+
+/** \brief Header of a distance field file. A distance field file stores the
+ * state of an occupancy map in query mode and consists of the header
+ * followed by:
+ *  1. bounding planes    (4 floats per plane)
+ *  2. distance field     (see DistanceField::write)
+ *  3. occluded voxels    (see BitGrid::write, empty if not available)
+ *  4. obstacle voxels    (see BitGrid::write, empty if not available)
+ * All values are stored in native byte order.
+ */
+struct DistanceFieldFileHeader
+{
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  header_size;
+  uint64_t  key;
+  float     resolution;
+  float     max_distance;
+  uint32_t  tree_depth;
+  uint32_t  depth;
+  uint32_t  voxel_size;
+  uint32_t  offset[3];
+  float     bbx_min[3];
+  float     bbx_max[3];
+  uint32_t  inflate_obstacle_space;
+  uint32_t  baked_bounding_planes;
+  uint32_t  num_bounding_planes;
+};
+
+/** \brief Reads and writes distance field files. */
+class DistanceFieldFile
+{
+public:
+
+  /** \brief Current version of the distance field file format. */
+  static const uint32_t VERSION = 1;
+
+  /** \brief Read a distance field file written by DistanceFieldFile::write.
+   *  \param[in]  filename          file name
+   *  \param[out] header            file header
+   *  \param[out] bounding_planes   bounding planes
+   *  \param[out] distance_field    distance field
+   *  \param[out] occluded_grid     occluded voxels
+   *  \param[out] obstacle_grid     obstacle voxels
+   *  \return TRUE if file was read and is a valid distance field file
+   */
+  static bool read  ( const std::string &filename,
+                      DistanceFieldFileHeader &header,
+                      std::vector<Eigen::Vector4f> &bounding_planes,
+                      DistanceField &distance_field,
+                      BitGrid &occluded_grid,
+                      BitGrid &obstacle_grid
+                    );
+
+  /** \brief Write a distance field to a file.
+   *  \param[in]  filename          file name
+   *  \param[in]  header            file header. Magic, version, header size and number of planes are filled in automatically
+   *  \param[in]  bounding_planes   bounding planes
+   *  \param[in]  distance_field    distance field
+   *  \param[in]  occluded_grid     occluded voxels
+   *  \param[in]  obstacle_grid     obstacle voxels
+   *  \return TRUE if file was written successfully
+   */
+  static bool write ( const std::string &filename,
+                      DistanceFieldFileHeader header,
+                      const std::vector<Eigen::Vector4f> &bounding_planes,
+                      const DistanceField &distance_field,
+                      const BitGrid &occluded_grid,
+                      const BitGrid &obstacle_grid
+                    );
+
+private:
+
+  /** \brief Magic string identifying a distance field file. */
+  static const char* getMagic ()  { return "SYMSEGDF"; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+bool DistanceFieldFile::read  ( const std::string &filename,
+                                DistanceFieldFileHeader &header,
+                                std::vector<Eigen::Vector4f> &bounding_planes,
+                                DistanceField &distance_field,
+                                BitGrid &occluded_grid,
+                                BitGrid &obstacle_grid
+                              )
+{
+  utl::MappedFile file;
+  if (!file.open(filename))
+    return false;
+
+  // Check header
+  if (file.size() < sizeof(DistanceFieldFileHeader))
+  {
+    std::cout << "[DistanceFieldFile::read] file '" << filename << "' is too small to be a distance field file." << std::endl;
+    return false;
+  }
+
+  std::memcpy(&header, file.data(), sizeof(DistanceFieldFileHeader));
+
+  if (std::strncmp(header.magic, getMagic(), sizeof(header.magic)) != 0)
+  {
+    std::cout << "[DistanceFieldFile::read] file '" << filename << "' is not a distance field file." << std::endl;
+    return false;
+  }
+
+  if (header.version != VERSION || header.header_size != sizeof(DistanceFieldFileHeader))
+  {
+    std::cout << "[DistanceFieldFile::read] file '" << filename << "' has version " << header.version << ", expected version " << VERSION << "." << std::endl;
+    return false;
+  }
+
+  // Bounding planes
+  const char *data = file.data() + sizeof(DistanceFieldFileHeader);
+  const char *end = file.data() + file.size();
+  if (static_cast<size_t>(end - data) < header.num_bounding_planes * 4 * sizeof(float))
+  {
+    std::cout << "[DistanceFieldFile::read] file '" << filename << "' is truncated." << std::endl;
+    return false;
+  }
+
+  bounding_planes.resize(header.num_bounding_planes);
+  for (size_t planeId = 0; planeId < bounding_planes.size(); planeId++)
+  {
+    std::memcpy(bounding_planes[planeId].data(), data, 4 * sizeof(float));
+    data += 4 * sizeof(float);
+  }
+
+  // Grids
+  if (!distance_field.read(data, end) || !occluded_grid.read(data, end) || !obstacle_grid.read(data, end) || data != end)
+  {
+    std::cout << "[DistanceFieldFile::read] file '" << filename << "' is truncated or corrupted." << std::endl;
+    distance_field.clear();
+    occluded_grid.clear();
+    obstacle_grid.clear();
+    return false;
+  }
+
+  // Occluded and obstacle grids are optional
+  if (distance_field.empty() ||
+      (!occluded_grid.empty() && (occluded_grid.getSizeX() != distance_field.getSizeX() || occluded_grid.getSizeY() != distance_field.getSizeY() || occluded_grid.getSizeZ() != distance_field.getSizeZ())) ||
+      (!obstacle_grid.empty() && (obstacle_grid.getSizeX() != distance_field.getSizeX() || obstacle_grid.getSizeY() != distance_field.getSizeY() || obstacle_grid.getSizeZ() != distance_field.getSizeZ())))
+  {
+    std::cout << "[DistanceFieldFile::read] file '" << filename << "' contains grids of different sizes." << std::endl;
+    distance_field.clear();
+    occluded_grid.clear();
+    obstacle_grid.clear();
+    return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DistanceFieldFile::write  ( const std::string &filename,
+                                 DistanceFieldFileHeader header,
+                                 const std::vector<Eigen::Vector4f> &bounding_planes,
+                                 const DistanceField &distance_field,
+                                 const BitGrid &occluded_grid,
+                                 const BitGrid &obstacle_grid
+                               )
+{
+  // Write to a temporary file first so that readers never see a partially
+  // written distance field
+  std::stringstream tmpFilename;
+  tmpFilename << filename << ".tmp." << getpid() << "." << std::this_thread::get_id();
+  std::ofstream out(tmpFilename.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+  {
+    std::cout << "[DistanceFieldFile::write] Could not open file '" << tmpFilename.str() << "' for writing." << std::endl;
+    return false;
+  }
+
+  // Header
+  std::memcpy(header.magic, getMagic(), sizeof(header.magic));
+  header.version = VERSION;
+  header.header_size = sizeof(DistanceFieldFileHeader);
+  header.num_bounding_planes = bounding_planes.size();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(DistanceFieldFileHeader));
+
+  // Bounding planes
+  for (size_t planeId = 0; planeId < bounding_planes.size(); planeId++)
+    out.write(reinterpret_cast<const char*>(bounding_planes[planeId].data()), 4 * sizeof(float));
+
+  // Grids
+  distance_field.write(out);
+  occluded_grid.write(out);
+  obstacle_grid.write(out);
+
+  if (!out.good())
+  {
+    std::cout << "[DistanceFieldFile::write] Could not write distance field to file '" << tmpFilename.str() << "'." << std::endl;
+    out.close();
+    std::remove(tmpFilename.str().c_str());
+    return false;
+  }
+
+  out.close();
+  if (out.fail())
+  {
+    std::cout << "[DistanceFieldFile::write] Could not close file '" << tmpFilename.str() << "'." << std::endl;
+    std::remove(tmpFilename.str().c_str());
+    return false;
+  }
+
+  if (std::rename(tmpFilename.str().c_str(), filename.c_str()) != 0)
+  {
+    std::cout << "[DistanceFieldFile::write] Could not rename file '" << tmpFilename.str() << "' to '" << filename << "'." << std::endl;
+    std::remove(tmpFilename.str().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+#endif    // DISTANCE_FIELD_FILE_HPP
@@ -0,0 +1,374 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef DISTANCE_MAP_FILE_HPP
+#define DISTANCE_MAP_FILE_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// POSIX includes
+#include <unistd.h>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+// Utilities includes
+#include <filesystem/mapped_file.hpp>
+
+// Occupancy map includes
+#include "obstacle_grid.hpp"
+
+/** \brief Header of a distance map file. A distance map file consists of
+ * the header followed by:
+ *  1. bounding planes    (4 floats per plane)
+ *  2. distances          (1 float per voxel, measured in voxels)
+ *  3. closest obstacles  (3 int32 per voxel, distance map voxel coordinates)
+ *  4. obstacle voxels    (1 byte per voxel)
+ * Voxel data is stored in the same order as in ObstacleGrid. All values are
+ * stored in native byte order.
+ */
+struct DistanceMapFileHeader
+{
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  header_size;
+  uint64_t  key;
+  float     resolution;
+  float     max_distance;
+  uint32_t  tree_depth;
+  uint32_t  depth;
+  uint32_t  voxel_size;
+  uint32_t  offset[3];
+  float     bbx_min[3];
+  float     bbx_max[3];
+  int32_t   size[3];
+  uint32_t  num_bounding_planes;
+};
+
+/** \brief Read-only distance map loaded from a file written by
+ * DistanceMapFile::write. The file is memory mapped and queried in place.
+ */
+class DistanceMapFile
+{
+public:
+
+  /** \brief Current version of the distance map file format. */
+  static const uint32_t VERSION = 1;
+
+  /** \brief Empty constructor. */
+  DistanceMapFile ()
+    : distances_ (NULL)
+    , closestObstacles_ (NULL)
+    , obstacles_ (NULL)
+    , boundingPlanes_ (NULL)
+  { }
+
+  /** \brief Map a distance map file into memory.
+   *  \param[in]  filename    file name
+   *  \return TRUE if file was mapped and is a valid distance map file
+   */
+  bool open (const std::string &filename);
+
+  /** \brief Release the mapped file. */
+  void close ();
+
+  /** \brief Check if a distance map file is currently mapped. */
+  inline bool isOpen () const { return file_.isOpen(); }
+
+  /** \brief Get file header. Only valid if the file is open. */
+  inline const DistanceMapFileHeader& getHeader () const  { return header_; }
+
+  /** \brief Get the bounding planes stored in the file. */
+  std::vector<Eigen::Vector4f> getBoundingPlanes () const;
+
+  /** \brief Get grid dimensions. */
+  inline int getSizeX () const  { return header_.size[0]; }
+  inline int getSizeY () const  { return header_.size[1]; }
+  inline int getSizeZ () const  { return header_.size[2]; }
+
+  /** \brief Get the distance to the closest obstacle (in voxels).
+   *  \return distance to the closest obstacle or a negative value if voxel is outside of the map
+   */
+  inline float getDistance (const int x, const int y, const int z) const
+  {
+    if (!isInside(x, y, z))
+      return -1.0f;
+
+    return distances_[getIndex(x, y, z)];
+  }
+
+  /** \brief Get the coordinates of the closest obstacle voxel.
+   *  \return coordinates of the obstacle voxel or (-1, -1, -1) if voxel is outside of the map
+   */
+  inline IntPoint3D getClosestObstacle (const int x, const int y, const int z) const
+  {
+    if (!isInside(x, y, z))
+      return IntPoint3D(-1, -1, -1);
+
+    const int32_t *obstacle = closestObstacles_ + 3 * getIndex(x, y, z);
+    return IntPoint3D(obstacle[0], obstacle[1], obstacle[2]);
+  }
+
+  /** \brief Copy obstacle voxels into an obstacle grid. */
+  void getObstacleGrid (ObstacleGrid &grid) const;
+
+  /** \brief Write a distance map to a file.
+   *  \param[in]  filename          file name
+   *  \param[in]  header            file header. Magic, version, header size and number of planes are filled in automatically
+   *  \param[in]  bounding_planes   bounding planes
+   *  \param[in]  distance_map      distance map
+   *  \param[in]  obstacle_grid     obstacle grid used to construct the distance map
+   *  \return TRUE if file was written successfully
+   */
+  static bool write ( const std::string &filename,
+                      DistanceMapFileHeader header,
+                      const std::vector<Eigen::Vector4f> &bounding_planes,
+                      const DynamicEDT3D &distance_map,
+                      const ObstacleGrid &obstacle_grid
+                    );
+
+private:
+
+  /** \brief Check if voxel coordinates fall inside the grid. */
+  inline bool isInside (const int x, const int y, const int z) const
+  {
+    return x >= 0 && x < header_.size[0] && y >= 0 && y < header_.size[1] && z >= 0 && z < header_.size[2];
+  }
+
+  /** \brief Get the linear index of a voxel. */
+  inline size_t getIndex (const int x, const int y, const int z) const
+  {
+    return (static_cast<size_t>(x) * header_.size[1] + y) * header_.size[2] + z;
+  }
+
+  /** \brief Magic string identifying a distance map file. */
+  static const char* getMagic ()  { return "SYMSEGDM"; }
+
+  /** \brief Mapped file. */
+  utl::MappedFile file_;
+
+  /** \brief Copy of the file header. */
+  DistanceMapFileHeader header_;
+
+  /** \brief Pointers to the sections of the mapped file. */
+  const float*    distances_;
+  const int32_t*  closestObstacles_;
+  const uint8_t*  obstacles_;
+  const float*    boundingPlanes_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+bool DistanceMapFile::open (const std::string &filename)
+{
+  close();
+
+  if (!file_.open(filename))
+    return false;
+
+  // Check header
+  if (file_.size() < sizeof(DistanceMapFileHeader))
+  {
+    std::cout << "[DistanceMapFile::open] file '" << filename << "' is too small to be a distance map file." << std::endl;
+    close();
+    return false;
+  }
+
+  std::memcpy(&header_, file_.data(), sizeof(DistanceMapFileHeader));
+
+  if (std::strncmp(header_.magic, getMagic(), sizeof(header_.magic)) != 0)
+  {
+    std::cout << "[DistanceMapFile::open] file '" << filename << "' is not a distance map file." << std::endl;
+    close();
+    return false;
+  }
+
+  if (header_.version != VERSION || header_.header_size != sizeof(DistanceMapFileHeader))
+  {
+    std::cout << "[DistanceMapFile::open] file '" << filename << "' has version " << header_.version << ", expected version " << VERSION << "." << std::endl;
+    close();
+    return false;
+  }
+
+  if (header_.size[0] <= 0 || header_.size[1] <= 0 || header_.size[2] <= 0)
+  {
+    std::cout << "[DistanceMapFile::open] file '" << filename << "' contains an empty distance map." << std::endl;
+    close();
+    return false;
+  }
+
+  // Check that file contains all of the data
+  size_t numVoxels = static_cast<size_t>(header_.size[0]) * header_.size[1] * header_.size[2];
+  size_t planesOffset     = sizeof(DistanceMapFileHeader);
+  size_t distancesOffset  = planesOffset + header_.num_bounding_planes * 4 * sizeof(float);
+  size_t obstaclesOffset  = distancesOffset + numVoxels * sizeof(float);
+  size_t occupancyOffset  = obstaclesOffset + numVoxels * 3 * sizeof(int32_t);
+  size_t fileSize         = occupancyOffset + numVoxels * sizeof(uint8_t);
+
+  if (file_.size() != fileSize)
+  {
+    std::cout << "[DistanceMapFile::open] file '" << filename << "' has size " << file_.size() << ", expected " << fileSize << "." << std::endl;
+    close();
+    return false;
+  }
+
+  boundingPlanes_   = reinterpret_cast<const float*>(file_.data() + planesOffset);
+  distances_        = reinterpret_cast<const float*>(file_.data() + distancesOffset);
+  closestObstacles_ = reinterpret_cast<const int32_t*>(file_.data() + obstaclesOffset);
+  obstacles_        = reinterpret_cast<const uint8_t*>(file_.data() + occupancyOffset);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DistanceMapFile::close ()
+{
+  file_.close();
+  distances_        = NULL;
+  closestObstacles_ = NULL;
+  obstacles_        = NULL;
+  boundingPlanes_   = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+std::vector<Eigen::Vector4f> DistanceMapFile::getBoundingPlanes () const
+{
+  std::vector<Eigen::Vector4f> boundingPlanes;
+  if (!isOpen())
+    return boundingPlanes;
+
+  boundingPlanes.resize(header_.num_bounding_planes);
+  for (size_t planeId = 0; planeId < boundingPlanes.size(); planeId++)
+    boundingPlanes[planeId] = Eigen::Map<const Eigen::Vector4f>(boundingPlanes_ + planeId * 4);
+
+  return boundingPlanes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DistanceMapFile::getObstacleGrid (ObstacleGrid &grid) const
+{
+  if (!isOpen())
+  {
+    grid.clear();
+    return;
+  }
+
+  grid.resize(getSizeX(), getSizeY(), getSizeZ());
+  bool *gridData = grid.data();
+  for (size_t voxelId = 0; voxelId < grid.size(); voxelId++)
+    gridData[voxelId] = obstacles_[voxelId] != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DistanceMapFile::write  ( const std::string &filename,
+                               DistanceMapFileHeader header,
+                               const std::vector<Eigen::Vector4f> &bounding_planes,
+                               const DynamicEDT3D &distance_map,
+                               const ObstacleGrid &obstacle_grid
+                             )
+{
+  // Check input
+  if (obstacle_grid.empty() ||
+      static_cast<int>(distance_map.getSizeX()) != obstacle_grid.getSizeX() ||
+      static_cast<int>(distance_map.getSizeY()) != obstacle_grid.getSizeY() ||
+      static_cast<int>(distance_map.getSizeZ()) != obstacle_grid.getSizeZ())
+  {
+    std::cout << "[DistanceMapFile::write] distance map and obstacle grid have different sizes." << std::endl;
+    return false;
+  }
+
+  // Write to a temporary file first so that readers never see a partially
+  // written distance map
+  std::stringstream tmpFilename;
+  tmpFilename << filename << ".tmp." << getpid() << "." << std::this_thread::get_id();
+  std::ofstream out(tmpFilename.str().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+  {
+    std::cout << "[DistanceMapFile::write] Could not open file '" << tmpFilename.str() << "' for writing." << std::endl;
+    return false;
+  }
+
+  // Header
+  std::memcpy(header.magic, getMagic(), sizeof(header.magic));
+  header.version = VERSION;
+  header.header_size = sizeof(DistanceMapFileHeader);
+  header.num_bounding_planes = bounding_planes.size();
+  header.size[0] = obstacle_grid.getSizeX();
+  header.size[1] = obstacle_grid.getSizeY();
+  header.size[2] = obstacle_grid.getSizeZ();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(DistanceMapFileHeader));
+
+  // Bounding planes
+  for (size_t planeId = 0; planeId < bounding_planes.size(); planeId++)
+    out.write(reinterpret_cast<const char*>(bounding_planes[planeId].data()), 4 * sizeof(float));
+
+  // Distances and closest obstacles are written one (x, y) column at a time
+  const int sizeX = obstacle_grid.getSizeX(), sizeY = obstacle_grid.getSizeY(), sizeZ = obstacle_grid.getSizeZ();
+  std::vector<float>    distanceColumn (sizeZ);
+  std::vector<int32_t>  obstacleColumn (sizeZ * 3);
+
+  for (int x = 0; x < sizeX; x++)
+  {
+    for (int y = 0; y < sizeY; y++)
+    {
+      for (int z = 0; z < sizeZ; z++)
+        distanceColumn[z] = distance_map.getDistance(x, y, z);
+      out.write(reinterpret_cast<const char*>(&distanceColumn[0]), sizeZ * sizeof(float));
+    }
+  }
+
+  for (int x = 0; x < sizeX; x++)
+  {
+    for (int y = 0; y < sizeY; y++)
+    {
+      for (int z = 0; z < sizeZ; z++)
+      {
+        IntPoint3D obstacle = distance_map.getClosestObstacle(x, y, z);
+        obstacleColumn[z * 3 + 0] = obstacle.x;
+        obstacleColumn[z * 3 + 1] = obstacle.y;
+        obstacleColumn[z * 3 + 2] = obstacle.z;
+      }
+      out.write(reinterpret_cast<const char*>(&obstacleColumn[0]), sizeZ * 3 * sizeof(int32_t));
+    }
+  }
+
+  // Obstacle voxels
+  std::vector<uint8_t> obstacles (obstacle_grid.size());
+  const bool *gridData = obstacle_grid.data();
+  for (size_t voxelId = 0; voxelId < obstacles.size(); voxelId++)
+    obstacles[voxelId] = gridData[voxelId] ? 1 : 0;
+  out.write(reinterpret_cast<const char*>(&obstacles[0]), obstacles.size());
+
+  if (!out.good())
+  {
+    std::cout << "[DistanceMapFile::write] Could not write distance map to file '" << tmpFilename.str() << "'." << std::endl;
+    out.close();
+    std::remove(tmpFilename.str().c_str());
+    return false;
+  }
+
+  out.close();
+  if (out.fail())
+  {
+    std::cout << "[DistanceMapFile::write] Could not close file '" << tmpFilename.str() << "'." << std::endl;
+    std::remove(tmpFilename.str().c_str());
+    return false;
+  }
+
+  if (std::rename(tmpFilename.str().c_str(), filename.c_str()) != 0)
+  {
+    std::cout << "[DistanceMapFile::write] Could not rename file '" << tmpFilename.str() << "' to '" << filename << "'." << std::endl;
+    std::remove(tmpFilename.str().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+#endif    // DISTANCE_MAP_FILE_HPP
@@ -0,0 +1,153 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef OBSTACLE_BRICK_GRID_HPP
+#define OBSTACLE_BRICK_GRID_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "distance_field.hpp"
+
+/** \brief A sparse 3D boolean grid split into the same bricks as
+ * DistanceField. Bricks where all voxels have the same value are stored as a
+ * single state, only the bricks containing both values are stored as packed
+ * bits. Used to construct a DistanceField without allocating a dense grid
+ * over the whole bounding box.
+ */
+class ObstacleBrickGrid
+{
+public:
+
+  /** \brief State of a brick. */
+  enum BrickState
+  {
+    EMPTY = 0,    // all voxels are FALSE
+    FULL  = 1,    // all voxels are TRUE
+    MIXED = 2     // voxels are stored as packed bits
+  };
+
+  /** \brief Empty constructor. */
+  ObstacleBrickGrid ()
+    : sizeX_ (0)
+    , sizeY_ (0)
+    , sizeZ_ (0)
+    , numBricksX_ (0)
+    , numBricksY_ (0)
+    , numBricksZ_ (0)
+  { }
+
+  /** \brief Allocate the brick tables and set all voxels to FALSE.
+   *  \param[in]  size_x    number of voxels along x axis
+   *  \param[in]  size_y    number of voxels along y axis
+   *  \param[in]  size_z    number of voxels along z axis
+   */
+  inline void resize (const int size_x, const int size_y, const int size_z)
+  {
+    sizeX_ = std::max(size_x, 0);
+    sizeY_ = std::max(size_y, 0);
+    sizeZ_ = std::max(size_z, 0);
+    numBricksX_ = (sizeX_ + BRICK_SIZE - 1) / BRICK_SIZE;
+    numBricksY_ = (sizeY_ + BRICK_SIZE - 1) / BRICK_SIZE;
+    numBricksZ_ = (sizeZ_ + BRICK_SIZE - 1) / BRICK_SIZE;
+
+    size_t numBricks = static_cast<size_t>(numBricksX_) * numBricksY_ * numBricksZ_;
+    states_.assign(numBricks, EMPTY);
+    brickIds_.assign(numBricks, -1);
+    words_.clear();
+  }
+
+  /** \brief Get grid dimensions. */
+  inline int getSizeX () const  { return sizeX_; }
+  inline int getSizeY () const  { return sizeY_; }
+  inline int getSizeZ () const  { return sizeZ_; }
+
+  /** \brief Get brick grid dimensions. */
+  inline int getNumBricksX () const  { return numBricksX_; }
+  inline int getNumBricksY () const  { return numBricksY_; }
+  inline int getNumBricksZ () const  { return numBricksZ_; }
+
+  /** \brief Set the values of all voxels of a brick. Voxels of the bricks
+   * outside of the grid should replicate the boundary voxels, so that such
+   * bricks are stored as uniform if all their voxels inside the grid are. Can
+   * be called from multiple threads as long as they set different bricks.
+   *  \param[in]  brick_x     brick coordinate along x axis
+   *  \param[in]  brick_y     brick coordinate along y axis
+   *  \param[in]  brick_z     brick coordinate along z axis
+   *  \param[in]  values      DistanceField::BRICK_VOXELS values ordered by DistanceField::getBrickVoxelIndex
+   */
+  inline void setBrick (const int brick_x, const int brick_y, const int brick_z, const bool *values)
+  {
+    uint64_t brick[BRICK_WORDS] = {0};
+    bool uniform = true;
+    for (int voxelId = 0; voxelId < DistanceField::BRICK_VOXELS; voxelId++)
+    {
+      brick[voxelId >> 6] |= static_cast<uint64_t>(values[voxelId] ? 1 : 0) << (voxelId & 63);
+      uniform = uniform && values[voxelId] == values[0];
+    }
+
+    size_t brickLinearId = getBrickLinearIndex(brick_x, brick_y, brick_z);
+    if (uniform)
+    {
+      states_[brickLinearId] = values[0] ? FULL : EMPTY;
+      return;
+    }
+
+    states_[brickLinearId] = MIXED;
+    #pragma omp critical (obstacle_brick_grid_words)
+    {
+      brickIds_[brickLinearId] = static_cast<int32_t>(words_.size() / BRICK_WORDS);
+      words_.insert(words_.end(), brick, brick + BRICK_WORDS);
+    }
+  }
+
+  /** \brief Get the state of a brick. */
+  inline BrickState getBrickState (const int brick_x, const int brick_y, const int brick_z) const
+  {
+    return static_cast<BrickState>(states_[getBrickLinearIndex(brick_x, brick_y, brick_z)]);
+  }
+
+  /** \brief Get voxel value. No bounds checking is performed. */
+  inline bool get (const int x, const int y, const int z) const
+  {
+    size_t brickLinearId = getBrickLinearIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+    if (states_[brickLinearId] != MIXED)
+      return states_[brickLinearId] == FULL;
+
+    int voxelId = DistanceField::getBrickVoxelIndex(x, y, z);
+    return (words_[static_cast<size_t>(brickIds_[brickLinearId]) * BRICK_WORDS + (voxelId >> 6)] >> (voxelId & 63)) & 1;
+  }
+
+private:
+
+  /** \brief Number of voxels along each side of a brick. */
+  static const int BRICK_SIZE = DistanceField::BRICK_SIZE;
+
+  /** \brief Number of 64 bit words in a packed brick. */
+  static const int BRICK_WORDS = (DistanceField::BRICK_VOXELS + 63) / 64;
+
+  /** \brief Get the linear index of a brick. */
+  inline size_t getBrickLinearIndex (const int brick_x, const int brick_y, const int brick_z) const
+  {
+    return (static_cast<size_t>(brick_x) * numBricksY_ + brick_y) * numBricksZ_ + brick_z;
+  }
+
+  /** \brief Grid dimensions. */
+  int sizeX_, sizeY_, sizeZ_;
+
+  /** \brief Brick grid dimensions. */
+  int numBricksX_, numBricksY_, numBricksZ_;
+
+  /** \brief State of every brick of the grid. */
+  std::vector<uint8_t> states_;
+
+  /** \brief Index of the packed brick for every brick of the grid, -1 for uniform bricks. */
+  std::vector<int32_t> brickIds_;
+
+  /** \brief Packed voxel values of the mixed bricks. */
+  std::vector<uint64_t> words_;
+};
+
+#endif    // OBSTACLE_BRICK_GRID_HPP
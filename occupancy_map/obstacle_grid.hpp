@@ -0,0 +1,194 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef OBSTACLE_GRID_HPP
+#define OBSTACLE_GRID_HPP
+
+#include <vector>
+#include <algorithm>
+
+// Octomap includes
+#include <dynamicEDT3D/dynamicEDT3D.h>
+
+/** \brief A dense 3D boolean grid stored in a single contiguous buffer. Voxels
+ * are laid out with z varying fastest, i.e. voxel (x, y, z) is stored at
+ * position (x * sizeY + y) * sizeZ + z. In addition to the buffer the grid
+ * keeps two small tables of pointers into it so that it can be passed to code
+ * expecting a bool*** array (e.g. DynamicEDT3D) without any copying.
+ * \note the grid is not bit-packed because DynamicEDT3D writes to the grid
+ * through bool references (occupyCell/clearCell).
+ */
+class ObstacleGrid
+{
+public:
+
+  /** \brief Empty constructor. */
+  ObstacleGrid ()
+    : sizeX_ (0)
+    , sizeY_ (0)
+    , sizeZ_ (0)
+    , data_ (NULL)
+  { }
+
+  /** \brief Destructor. */
+  ~ObstacleGrid ()
+  {
+    clear();
+  }
+
+  /** \brief Allocate the grid and set all voxels to a given value. Previous
+   * contents of the grid are discarded.
+   *  \param[in]  size_x    number of voxels along x axis
+   *  \param[in]  size_y    number of voxels along y axis
+   *  \param[in]  size_z    number of voxels along z axis
+   *  \param[in]  value     initial value of the voxels
+   */
+  void resize (const int size_x, const int size_y, const int size_z, const bool value = false);
+
+  /** \brief Release grid memory. */
+  void clear ();
+
+  /** \brief Exchange the contents of two grids. */
+  void swap (ObstacleGrid &other);
+
+  /** \brief Check if the grid is empty. */
+  inline bool empty () const  { return data_ == NULL; }
+
+  /** \brief Get grid dimensions. */
+  inline int getSizeX () const  { return sizeX_; }
+  inline int getSizeY () const  { return sizeY_; }
+  inline int getSizeZ () const  { return sizeZ_; }
+
+  /** \brief Get total number of voxels in the grid. */
+  inline size_t size () const { return static_cast<size_t>(sizeX_) * sizeY_ * sizeZ_; }
+
+  /** \brief Get the linear index of a voxel. */
+  inline size_t getIndex (const int x, const int y, const int z) const
+  {
+    return (static_cast<size_t>(x) * sizeY_ + y) * sizeZ_ + z;
+  }
+
+  /** \brief Check if voxel coordinates fall inside the grid. */
+  inline bool isInside (const int x, const int y, const int z) const
+  {
+    return x >= 0 && x < sizeX_ && y >= 0 && y < sizeY_ && z >= 0 && z < sizeZ_;
+  }
+
+  /** \brief Get voxel value. No bounds checking is performed. */
+  inline bool get (const int x, const int y, const int z) const  { return data_[getIndex(x, y, z)]; }
+
+  /** \brief Set voxel value. No bounds checking is performed. */
+  inline void set (const int x, const int y, const int z, const bool value)  { data_[getIndex(x, y, z)] = value; }
+
+  /** \brief Get a pointer to the underlying contiguous buffer. */
+  inline bool* data ()              { return data_; }
+  inline const bool* data () const  { return data_; }
+
+  /** \brief Get a bool*** view of the grid. The view points into the grid
+   * buffer and remains valid until the grid is resized or cleared.
+   */
+  inline bool*** getGridMap ()  { return rows_.empty() ? NULL : &rows_[0]; }
+
+private:
+
+  /** \brief Copying is not allowed since the pointer tables point into the buffer. */
+  ObstacleGrid (const ObstacleGrid &);
+  ObstacleGrid& operator= (const ObstacleGrid &);
+
+  /** \brief Grid dimensions. */
+  int sizeX_, sizeY_, sizeZ_;
+
+  /** \brief Contiguous voxel buffer. */
+  bool* data_;
+
+  /** \brief Pointers to the start of each (x, y) column of the buffer. */
+  std::vector<bool*> columns_;
+
+  /** \brief Pointers to the start of each x slice of the column table. */
+  std::vector<bool**> rows_;
+};
+
+/** \brief Euclidean distance transform that operates on an ObstacleGrid
+ * owned by the caller. DynamicEDT3D takes ownership of the grid passed to
+ * initializeMap and frees it column by column in its destructor. This class
+ * releases the grid before the base class destructor runs so that the
+ * contiguous buffer is left to ObstacleGrid.
+ * \note the grid must outlive the distance transform.
+ */
+class ObstacleGridEDT3D final : public DynamicEDT3D
+{
+public:
+
+  /** \brief Constructor.
+   *  \param[in]  maxdist_squared   maximum squared distance (in cells) to be computed
+   */
+  ObstacleGridEDT3D (const int maxdist_squared)
+    : DynamicEDT3D (maxdist_squared)
+  { }
+
+  /** \brief Destructor. */
+  ~ObstacleGridEDT3D ()
+  {
+    gridMap = NULL;
+  }
+
+  /** \brief Initialize the distance transform from an obstacle grid.
+   *  \param[in]  grid    obstacle grid
+   */
+  void initializeMap (ObstacleGrid &grid)
+  {
+    DynamicEDT3D::initializeMap(grid.getSizeX(), grid.getSizeY(), grid.getSizeZ(), grid.getGridMap());
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+void ObstacleGrid::resize (const int size_x, const int size_y, const int size_z, const bool value)
+{
+  clear();
+
+  if (size_x <= 0 || size_y <= 0 || size_z <= 0)
+    return;
+
+  sizeX_ = size_x;
+  sizeY_ = size_y;
+  sizeZ_ = size_z;
+
+  data_ = new bool[size()];
+  std::fill(data_, data_ + size(), value);
+
+  columns_.resize(static_cast<size_t>(sizeX_) * sizeY_);
+  for (size_t colId = 0; colId < columns_.size(); colId++)
+    columns_[colId] = data_ + colId * sizeZ_;
+
+  rows_.resize(sizeX_);
+  for (int x = 0; x < sizeX_; x++)
+    rows_[x] = &columns_[static_cast<size_t>(x) * sizeY_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ObstacleGrid::clear ()
+{
+  if (data_)
+    delete[] data_;
+
+  data_ = NULL;
+  columns_.clear();
+  rows_.clear();
+  sizeX_ = 0;
+  sizeY_ = 0;
+  sizeZ_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ObstacleGrid::swap (ObstacleGrid &other)
+{
+  std::swap(sizeX_, other.sizeX_);
+  std::swap(sizeY_, other.sizeY_);
+  std::swap(sizeZ_, other.sizeZ_);
+  std::swap(data_, other.data_);
+  columns_.swap(other.columns_);
+  rows_.swap(other.rows_);
+}
+
+#endif    // OBSTACLE_GRID_HPP
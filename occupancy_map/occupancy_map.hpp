@@ -6,7 +6,9 @@
 #define OCCUPANCY_MAP_HPP
 
 #include <mutex>
+#include <ctime>
 #include <omp.h>
+#include <iomanip>
 
 // PCL includes
 #include <pcl/common/common.h>
@@ -18,6 +20,17 @@
 
 // Utilities
 #include "geometry/geometry.hpp"
+#include "filesystem/filesystem.hpp"
+#include "hash.hpp"
+#include "profiling.hpp"
+
+// Occupancy map includes
+#include "obstacle_grid.hpp"
+#include "distance_field.hpp"
+#include "obstacle_brick_grid.hpp"
+#include "bit_grid.hpp"
+#include "distance_map_file.hpp"
+#include "distance_field_file.hpp"
 
 class OccupancyMap
 {
@@ -27,7 +40,12 @@ public:
   OccupancyMap()
     : occupancyTree_ (0.0)
     , distanceMap_ (NULL)
-    , obstacleMap_ (NULL)
+    , occupancyTreeFileSize_ (0)
+    , occupancyTreeFileTime_ (0)
+    , occupancyTreeHash_ (utl::HASH_SEED)
+    , occupancyTreeHashed_ (false)
+    , inflateObstacleSpace_ (false)
+    , distanceFieldPlanes_ (false)
   { }
   
   /** \brief Destructor. */
@@ -67,11 +85,118 @@ public:
    *  \return TRUE if distance map was constructed successfully
    */
   bool distanceMapFromOccupancy (const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space);
+
+  /** \brief Same as distanceMapFromOccupancy but instead of a dense distance
+   * transform a sparse brick distance field is constructed and the occupancy
+   * map is left in query mode. The obstacle space is rasterized brick by brick
+   * from the occupancy tree leaves and only the bricks containing both
+   * obstacle and free voxels are stored, so no dense grid is allocated over
+   * the bounding box. Distances are only computed for bricks within
+   * max_distance of the obstacle space, all other bricks are stored as single
+   * tiles. Suitable for large scenes where most of the bounding box is far
+   * from any surface. Point occlusion is looked up in the occupancy tree and
+   * the obstacle space boundary mesh is not available.
+   *  \param[in]  bbx_min                 minimum point of the distance map bounding box
+   *  \param[in]  bbx_max                 maximum point of the distance map bounding box
+   *  \param[in]  depth                   depth at which the distance map is constructed
+   *  \param[in]  max_distance            maximum distance in the distance map
+   *  \param[in]  inflate_obstacle_space  inflate occupied space by one voxel at the boundary between occluded and free space
+   *  \return TRUE if distance field was constructed successfully
+   */
+  bool distanceFieldFromOccupancy (const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space);
+
+  /** \brief Update the distance map after the occupancy tree has changed.
+   * Only the distance map voxels containing the changed keys (and their
+   * neighbors if obstacle space is inflated) are updated and distances are 
+   * propagated locally. Changed keys can be obtained from the occupancy tree 
+   * change detection (see octomap::OcTree::enableChangeDetection).
+   *  \param[in]  changed_keys    occupancy tree keys (at maximum tree depth) that were changed
+   *  \param[in]  grow_bbx        grow the distance map if changed keys fall outside of it. Otherwise such keys are ignored.
+   *  \return TRUE if distance map was updated successfully
+   *  \note growing the distance map requires to reinitialize the distance 
+   * transform. The map is grown with a margin to make this infrequent.
+   */
+  bool updateFromOccupancyDelta (const std::vector<octomap::OcTreeKey> &changed_keys, const bool grow_bbx = true);
+  
+  /** \brief Get the occupancy tree. The tree can be modified, but the 
+   * distance map has to be updated afterwards using updateFromOccupancyDelta.
+   *  \return occupancy tree
+   */
+  octomap::OcTree& getOccupancyTree ();
+  
+  /** \brief Same as distanceMapFromOccupancy followed by enterQueryMode, but
+   * first looks for a distance field file in the cache directory. If a file
+   * constructed from the same occupancy tree file, distance map parameters and
+   * bounding planes is found the query mode distance field is read from it
+   * instead of constructing the distance map. Otherwise a distance map is
+   * constructed, the occupancy map enters query mode and the distance field is
+   * written to the cache directory (see writeDistanceField).
+   *  \param[in]  cache_dirname           directory where distance map files are stored
+   *  \param[in]  bbx_min                 distance map bounding box minimum point
+   *  \param[in]  bbx_max                 distance map bounding box maximum point
+   *  \param[in]  depth                   depth at which the distance map is constructed
+   *  \param[in]  max_distance            maximum distance in the distance map
+   *  \param[in]  inflate_obstacle_space  inflate occupied space by one voxel at the boundary between occluded 
+   *  \return TRUE if distance field was loaded or constructed successfully
+   *  \note bounding planes must be set before calling this function
+   */
+  bool distanceMapFromOccupancyCached (const std::string &cache_dirname, const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space);
+  
+  /** \brief Get a key identifying a distance map constructed from the current
+   * occupancy tree file, bounding planes and given distance map parameters.
+   * The occupancy tree file is hashed on the first call.
+   *  \param[out] key   distance map key
+   *  \return FALSE if the occupancy tree does not match a hashed file (e.g.
+   *  the file could not be hashed, was changed after it was read or the tree
+   *  may have been modified), in which case distance maps constructed from it
+   *  can not be identified
+   */
+  bool getDistanceMapCacheKey (const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space, uint64_t &key) const;
+  
+  /** \brief Write the distance map, its parameters and the bounding planes to
+   * a binary file.
+   *  \param[in]  filename    output filename
+   *  \param[in]  key         distance map key stored in the file
+   *  \return TRUE if file was written successfully
+   */
+  bool writeDistanceMap (const std::string &filename, const uint64_t key = 0) const;
+  
+  /** \brief Read a distance map written by writeDistanceMap. The file is 
+   * memory mapped read-only and queried in place. Bounding planes are restored
+   * from the file.
+   *  \param[in]  filename    input filename
+   *  \param[in]  key         expected distance map key (0 to accept any key)
+   *  \return TRUE if distance map was read successfully
+   */
+  bool readDistanceMap (const std::string &filename, const uint64_t key = 0);
+  
+  /** \brief Write the query mode state of the occupancy map to a binary file:
+   * the distance field, its parameters, the bounding planes and the packed
+   * occluded and obstacle voxels. The file is a fraction of the size of a
+   * distance map file.
+   *  \param[in]  filename    output filename
+   *  \param[in]  key         distance map key stored in the file
+   *  \return FALSE if the occupancy map is not in query mode or the file could not be written
+   */
+  bool writeDistanceField (const std::string &filename, const uint64_t key = 0) const;
+  
+  /** \brief Read a distance field written by writeDistanceField. The
+   * occupancy map is left in query mode. Bounding planes are restored from
+   * the file.
+   *  \param[in]  filename    input filename
+   *  \param[in]  key         expected distance map key (0 to accept any key)
+   *  \return TRUE if distance field was read successfully
+   */
+  bool readDistanceField (const std::string &filename, const uint64_t key = 0);
+  
+  /** \brief Check if a distance map was constructed or read from a file. */
+  bool hasDistanceMap () const;
     
   /** \brief Set scene bounding planes
    *  \param[in]  bounding_planes  a vector of coefficients of the bounding planes of the scene
    *  \param[in]  offsets           an offset of the plane along the normal
    *  \note: the normal of the bounding planes matters
+   *  \note: fails without changing the planes in query mode when the planes are baked into the distance field
    */ 
   bool setBoundingPlanes  (const std::vector<Eigen::Vector4f> &bounding_planes, const std::vector<float> &offsets = std::vector<float>(0));
   
@@ -94,6 +219,60 @@ public:
    */
   float getNearestObstacleDistance (const Eigen::Vector3f &point) const;
 
+  /** \brief Get the euclidean distances of a set of points to the nearest
+   * obstacle. Equivalent to calling getNearestObstacleDistance for every point
+   * but distance map keys and bounding plane distances are computed for 
+   * blocks of points at once.
+   *  \param[in]  xyz         point coordinates stored as x1 y1 z1 x2 y2 z2 ...
+   *  \param[in]  num_points  number of points
+   *  \param[out] distances   Euclidean distances to the closest obstacle (must hold num_points values)
+   *  \return FALSE if distance map was not initialized
+   */
+  bool getNearestObstacleDistances (const float *xyz, const size_t num_points, float *distances) const;
+
+  /** \brief Get the euclidean distances of a set of points to the nearest
+   * obstacle.
+   *  \param[in]  points      3xN matrix of point coordinates
+   *  \param[out] distances   Euclidean distances to the closest obstacle
+   *  \return FALSE if distance map was not initialized
+   */
+  bool getNearestObstacleDistances (const Eigen::Matrix3Xf &points, std::vector<float> &distances) const;
+
+  /** \brief Bake the bounding plane distances into a dense distance field.
+   * Every distance map voxel stores the maximum of its distance to the closest
+   * obstacle voxel and the depth of its center below the bounding planes, so
+   * that getNearestObstacleDistance(s) reduce to a single grid lookup. Plane
+   * distances are then only accurate up to the distance map voxel size and are
+   * truncated at the maximum distance of the distance map. If the bounding
+   * planes or the distance map change the field is baked again.
+   *  \return FALSE if distance map was not initialized
+   */
+  bool bakeBoundingPlanes ();
+  
+  /** \brief Discard the baked bounding plane distances. Obstacle distance
+   * queries use the exact analytic bounding plane distances afterwards. Not
+   * possible in query mode.
+   */
+  void clearBakedBoundingPlanes ();
+  
+  /** \brief Check if bounding plane distances are baked into the distance field. */
+  bool hasBakedBoundingPlanes () const;
+  
+  /** \brief Switch to read-only query mode. Distances to the closest obstacle
+   * voxel are snapshot into a dense 16 bit truncated distance field indexed
+   * directly with world coordinates and the distance transform (or the 
+   * distance map file) is released. Bounding planes baked with
+   * bakeBoundingPlanes remain baked, in which case 
+   * getNearestOccludedOccupiedDistance includes the bounding plane distances.
+   * In query mode getNearestObstacle, updateFromOccupancyDelta and 
+   * writeDistanceMap are not available.
+   *  \return FALSE if distance map was not initialized
+   */
+  bool enterQueryMode ();
+  
+  /** \brief Check if occupancy map is in query mode. */
+  bool isQueryMode () const;
+
   /** \brief Get the euclidean distance of the point to the nearest obstacle.
    *  \param[in]  point   point
    *  \return Coordinates of the nearest obstacle
@@ -106,6 +285,15 @@ public:
    */
   bool isPointOccluded (const Eigen::Vector3f &point) const;
   
+  /** \brief Check if points are occluded or not. Points inside the distance
+   * map are checked against a packed occlusion bitmap, other points are
+   * looked up in the occupancy tree.
+   *  \param[in]  points      3xN matrix of point coordinates
+   *  \param[out] occluded    TRUE for points that fall into occluded space
+   *  \return FALSE if distance map was not initialized
+   */
+  bool arePointsOccluded (const Eigen::Matrix3Xf &points, std::vector<bool> &occluded) const;
+  
   /** \brief Visualize the outer layer of the occluded space.
    *  \param[in]  visualizer  visualizer object
    *  \param[in]  id          point cloud object id prefix (default: occluded_space)
@@ -147,6 +335,126 @@ private:
    */
   octomap::OcTreeKey getDistanceMapKey (const Eigen::Vector3f &point) const;
   
+  /** \brief Get the distance from a distance map voxel to the closest obstacle voxel.
+   *  \param[in]  key_dm   distance map key
+   *  \return distance in voxels or a negative value if voxel is outside the distance map
+   */
+  float getVoxelDistance (const octomap::OcTreeKey &key_dm) const;
+  float getVoxelDistance (const int dx, const int dy, const int dz) const;
+  
+  /** \brief Get the closest obstacle voxel of a distance map voxel.
+   *  \param[in]  key_dm   distance map key
+   *  \return closest obstacle voxel in distance map coordinates
+   */
+  IntPoint3D getVoxelClosestObstacle (const octomap::OcTreeKey &key_dm) const;
+  
+  /** \brief Get the range of distance map voxels covered by an occupancy
+   * tree leaf, clipped to a range of voxels.
+   *  \param[in]  leaf_key      index key of the leaf
+   *  \param[in]  leaf_depth    depth of the leaf
+   *  \param[in]  voxel_min     minimum voxel of the range
+   *  \param[in]  voxel_max     maximum voxel of the range
+   *  \param[out] voxel_range   minimum and maximum voxel covered by the leaf along each axis
+   */
+  void getLeafVoxelRange (const octomap::OcTreeKey &leaf_key, const unsigned int leaf_depth, const int voxel_min[3], const int voxel_max[3], int voxel_range[3][2]) const;
+  
+  /** \brief Mark distance map voxels covered by the occupancy tree leaves as
+   * known. Occupied leaves are added to the obstacle space, free leaves are 
+   * removed from it.
+   *  \param[in]  voxel_min   minimum voxel of the range to be updated
+   *  \param[in]  voxel_max   maximum voxel of the range to be updated
+   */
+  void carveKnownSpace (const int voxel_min[3], const int voxel_max[3]);
+  
+  /** \brief Add free voxels adjacent to the occluded space to the obstacle space.
+   *  \param[in]  voxel_min   minimum voxel of the range to be updated
+   *  \param[in]  voxel_max   maximum voxel of the range to be updated
+   */
+  void inflateObstacleSpace (const int voxel_min[3], const int voxel_max[3]);
+  
+  /** \brief Check if a point is occluded without checking that distance map was initialized. */
+  bool isPointOccludedUnchecked (const Eigen::Vector3f &point) const;
+  
+  /** \brief Check if a distance map voxel is occluded. Voxel may lie outside of the distance map. */
+  bool isVoxelOccluded (const int dx, const int dy, const int dz) const;
+  
+  /** \brief Check if any of the 6 neighbors of a distance map voxel is occluded. */
+  bool hasOccludedNeighbor (const int dx, const int dy, const int dz) const;
+  
+  /** \brief Grow the distance map grids to include a range of voxels. The
+   * distance map is deleted and has to be reconstructed afterwards.
+   *  \param[in]  voxel_min   minimum voxel to include (current distance map coordinates)
+   *  \param[in]  voxel_max   maximum voxel to include (current distance map coordinates)
+   *  \param[out] shift       offset of the old voxels in the grown grid
+   *  \return TRUE if the distance map was grown
+   */
+  bool growDistanceMap (const int voxel_min[3], const int voxel_max[3], int shift[3]);
+  
+  /** \brief Release existing distance maps and set up the distance map
+   * grid covering a bounding box of the occupancy tree.
+   *  \param[out] size    dimensions of the distance map grid
+   *  \return FALSE if occupancy tree is empty or depth is invalid
+   */
+  bool initializeGrid (const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space, int size[3]);
+  
+  /** \brief Release existing distance maps and construct the occluded and 
+   * obstacle grids from the occupancy tree.
+   *  \return FALSE if occupancy tree is empty or depth is invalid
+   */
+  bool constructObstacleMap (const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space);
+  
+  /** \brief Get the obstacle space of a distance field brick directly from
+   * the occupancy tree leaves, without the dense occluded and obstacle grids.
+   * Gives the same voxels as constructObstacleMap. Voxels of the bricks
+   * outside of the grid replicate the boundary voxels.
+   *  \param[in]  brick       brick coordinates
+   *  \param[in]  size        dimensions of the distance map grid
+   *  \param[out] obstacles   DistanceField::BRICK_VOXELS values ordered by DistanceField::getBrickVoxelIndex
+   */
+  void rasterizeObstacleBrick (const int brick[3], const int size[3], bool *obstacles) const;
+  
+  /** \brief Construct the distance transform from the obstacle grid. */
+  void constructDistanceMap ();
+  
+  /** \brief Compute truncated distances of the voxels of a distance field 
+   * brick directly from the obstacle space. Squared distances are computed
+   * with a separable exact distance transform over the brick padded by
+   * max_cells.
+   *  \param[in]  obstacles   obstacle space
+   *  \param[in]  brick       brick coordinates
+   *  \param[in]  max_cells   maximum distance in voxels
+   *  \param[out] distances   DistanceField::BRICK_VOXELS metric distances
+   */
+  void computeBrickDistances (const ObstacleBrickGrid &obstacles, const int brick[3], const int max_cells, float *distances) const;
+  
+  /** \brief One dimensional squared distance transform of a sampled function
+   * (Felzenszwalb and Huttenlocher). Transform is performed in place.
+   *  \param[in,out]  f     function values
+   *  \param[in]      n     number of samples
+   *  \param[in]      d     temporary storage for n values
+   *  \param[in]      z     temporary storage for n + 1 values
+   *  \param[in]      v     temporary storage for n values
+   */
+  static void distanceTransform1D (float *f, const int n, float *d, float *z, int *v);
+  
+  /** \brief Allocate a distance field covering the distance map grid.
+   *  \param[out] distance_field  distance field
+   *  \param[in]  size            dimensions of the distance map grid
+   */
+  void initializeDistanceField (DistanceField &distance_field, const int size[3]) const;
+  
+  /** \brief Get the dimensions of the distance map grid. The obstacle grid is
+   * not kept by distanceFieldFromOccupancy, in which case the dimensions of the
+   * distance field are used.
+   */
+  void getGridSize (int size[3]) const;
+  
+  /** \brief Snapshot the distance map into the dense distance field.
+   *  \param[in]  bake_planes   bake bounding plane distances into the field
+   *  \return FALSE if distance map was not initialized or was released
+   */
+  bool buildDistanceField (const bool bake_planes);
+  
   /** \brief Construct a polygon mesh corresponding to the boundary of the 
    * occluded space.
    *  \param[out] vertices   mesh vertices
@@ -170,27 +478,67 @@ private:
    *  \param[out] vertices   mesh vertices
    *  \param[out] cloud   mesh polygons
    */
-  void generateVoxelBoundaryMesh  ( const std::vector<std::pair<octomap::point3d, int> > voxel_neighbor_list,
+  void generateVoxelBoundaryMesh  ( const std::vector<std::pair<octomap::point3d, int> > &voxel_neighbor_list,
                                     pcl::PointCloud<pcl::PointXYZ> &vertices,
                                     std::vector<pcl::Vertices> &polygons
                                   ) const;
+  
+  /** \brief Find the faces between the voxels set in a grid and their 6
+   * neighbors that are not set. The grid is swept in parallel, every thread
+   * collects faces of its own range of slices and the results are 
+   * concatenated in slice order. Voxels at the grid boundary are skipped.
+   *  \param[in]  grid    grid with the same dimensions as the distance map (ObstacleGrid or BitGrid)
+   *  \param[out] voxel_neighbor_list   list of voxel centers and their neigbors
+   */
+  template <typename GridT>
+  void getGridBoundaryFaces (const GridT &grid, std::vector<std::pair<octomap::point3d, int> > &voxel_neighbor_list) const;
                                   
   /** \brief Neighborhood used to find adjacent voxels. */
   static std::vector<std::vector<int> > createVoxelNeighborhood26 ();
   static std::vector<std::vector<int> > createVoxelNeighborhood18 ();
   static std::vector<std::vector<int> > createVoxelNeighborhood6 ();
+  
+  /** \brief Neighborhoods created once on first use. */
+  static const std::vector<std::vector<int> >& getVoxelNeighborhood26 ();
+  static const std::vector<std::vector<int> >& getVoxelNeighborhood18 ();
+  static const std::vector<std::vector<int> >& getVoxelNeighborhood6 ();
                                   
   /** \brief Occupancy tree. Stores scene occupancy information. */
   octomap::OcTree occupancyTree_;
   
   /** \brief Distance map. Stores distance to the nearest surface for all scene voxels. */
-  DynamicEDT3D* distanceMap_;
+  ObstacleGridEDT3D* distanceMap_;
+  
+  /** \brief Distance map read from a file. Used instead of the distance map when it is not constructed. */
+  DistanceMapFile distanceMapFile_;
+  
+  /** \brief File the occupancy tree was read from. Empty if the tree may have been modified. */
+  std::string occupancyTreeFilename_;
+  
+  /** \brief Size and modification time of the occupancy tree file when it was read. */
+  uintmax_t occupancyTreeFileSize_;
+  std::time_t occupancyTreeFileTime_;
+  
+  /** \brief Hash of the occupancy tree file, computed on first use. */
+  mutable uint64_t occupancyTreeHash_;
+  
+  /** \brief Flag indicating whether the occupancy tree file was hashed. */
+  mutable bool occupancyTreeHashed_;
   
   /** \brief Maximum distance in the distance map. */
   float distanceMapMaxDist_;
   
-  /** \brief A 3D boolean array storing the locations of obstacle voxels in the scene. */
-  bool*** obstacleMap_;
+  /** \brief A 3D boolean grid storing the locations of obstacle voxels in the scene. */
+  ObstacleGrid obstacleMap_;
+  
+  /** \brief A 3D boolean grid storing the locations of occluded voxels in the scene. */
+  ObstacleGrid occludedMap_;
+  
+  /** \brief Packed copy of the occluded voxel grid used for point occlusion queries. Kept in query mode. */
+  BitGrid occlusionBitmap_;
+  
+  /** \brief Flag indicating whether obstacle space was inflated. */
+  bool inflateObstacleSpace_;
   
   /** \brief Depth of the occupancy map. */
   uint16_t depth_;
@@ -209,6 +557,12 @@ private:
   
   /** \brief Bounding planes of the scene. */
   std::vector<Eigen::Vector4f> boundingPlanes_;
+  
+  /** \brief Snapshot of the metric distances to the nearest obstacle. Empty unless bounding planes are baked or in query mode. */
+  DistanceField distanceField_;
+  
+  /** \brief Flag indicating whether bounding plane distances are baked into the distance field. */
+  bool distanceFieldPlanes_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -262,16 +616,41 @@ std::vector<std::vector<int> > OccupancyMap::createVoxelNeighborhood18 ()
   return std::vector<std::vector<int> > (voxelNeighborhood.begin(), voxelNeighborhood.begin()+18);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+const std::vector<std::vector<int> >& OccupancyMap::getVoxelNeighborhood26 ()
+{
+  static const std::vector<std::vector<int> > voxelNeighborhood = createVoxelNeighborhood26();
+  return voxelNeighborhood;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const std::vector<std::vector<int> >& OccupancyMap::getVoxelNeighborhood18 ()
+{
+  static const std::vector<std::vector<int> > voxelNeighborhood = createVoxelNeighborhood18();
+  return voxelNeighborhood;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const std::vector<std::vector<int> >& OccupancyMap::getVoxelNeighborhood6 ()
+{
+  static const std::vector<std::vector<int> > voxelNeighborhood = createVoxelNeighborhood6();
+  return voxelNeighborhood;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 bool OccupancyMap::readOccupancyTree(const std::string& filename)
 {
   // Delete distance map if it already exists
   if (distanceMap_)
   {
-    distanceMap_->~DynamicEDT3D();
     delete distanceMap_;
     distanceMap_ = NULL;
   }
+  distanceMapFile_.close();
+  obstacleMap_.clear();
+  occludedMap_.clear();
+  occlusionBitmap_.clear();
+  distanceField_.clear();
   
   // Read occupancy tree
   if (!occupancyTree_.readBinary(filename))
@@ -279,6 +658,16 @@ bool OccupancyMap::readOccupancyTree(const std::string& filename)
     std::cout << "[OccupancyMap::readOccupancyTree] Could not read octomap file '" + filename + "'" << std::endl;
     return false;
   }
+  
+  // Remember the file so that distance maps constructed from it can be
+  // identified. The file is only hashed once a distance map key is needed.
+  boost::system::error_code sizeError, timeError;
+  occupancyTreeFileSize_ = boost::filesystem::file_size(filename, sizeError);
+  occupancyTreeFileTime_ = boost::filesystem::last_write_time(filename, timeError);
+  occupancyTreeFilename_ = (sizeError || timeError) ? "" : filename;
+  occupancyTreeHash_ = utl::HASH_SEED;
+  occupancyTreeHashed_ = false;
+  
   return true;
 }
 
@@ -294,6 +683,16 @@ float OccupancyMap::getOccupancyTreeResolution() const
   return occupancyTree_.getResolution();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+octomap::OcTree& OccupancyMap::getOccupancyTree()
+{
+  // The tree may be modified through the reference and no longer match the
+  // file it was read from
+  occupancyTreeFilename_.clear();
+  occupancyTreeHashed_ = false;
+  return occupancyTree_;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 octomap::OcTreeKey OccupancyMap::occupancyTreeKeyToDistanceMapKey (const octomap::OcTreeKey &key_oct) const
 {
@@ -328,7 +727,7 @@ octomap::OcTreeKey OccupancyMap::getDistanceMapKey  (const Eigen::Vector3f &poin
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void OccupancyMap::generateVoxelBoundaryMesh(const std::vector<std::pair<octomap::point3d, int> > voxel_neighbor_list, pcl::PointCloud< pcl::PointXYZ >& vertices, std::vector< pcl::Vertices >& polygons) const
+void OccupancyMap::generateVoxelBoundaryMesh(const std::vector<std::pair<octomap::point3d, int> > &voxel_neighbor_list, pcl::PointCloud< pcl::PointXYZ >& vertices, std::vector< pcl::Vertices >& polygons) const
 {
   vertices.resize(voxel_neighbor_list.size() * 4);
   polygons.resize(voxel_neighbor_list.size() * 2);
@@ -414,237 +813,1468 @@ void OccupancyMap::generateVoxelBoundaryMesh(const std::vector<std::pair<octomap
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool OccupancyMap::distanceMapFromOccupancy(const Eigen::Vector3f& bbx_min, const Eigen::Vector3f& bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space)
+template <typename GridT>
+void OccupancyMap::getGridBoundaryFaces (const GridT &grid, std::vector<std::pair<octomap::point3d, int> > &voxel_neighbor_list) const
 {
-  // Check that occupancy tree exists
-  if (occupancyTree_.getTreeDepth() == 0)
-  {
-    std::cout << "[OccupancyMap::distanceMapFromOccupancy] occupancy tree is empty. Can't compute a distance map." << std::endl;
-    return false;
-  }
-  
-  // Delete distance map if it already exists
-  if (distanceMap_)
-  {
-    distanceMap_->~DynamicEDT3D();
-    delete distanceMap_;
-    distanceMap_ = NULL;
-  }
-  
-  // Check depth
-  if (depth < 0 || depth > occupancyTree_.getTreeDepth())
-  {
-    std::cout << "[OccupancyMap::distanceMapFromOccupancy] depth must be greater than 0 and smaller than occupancy tree depth." << std::endl;
-    return false;
-  }
-  
-  distanceMapMaxDist_ = max_distance;
-  depth_ = depth;
-  dmVoxelSize_ = pow (2, occupancyTree_.getTreeDepth() - depth_);
-  
-  // Get bounding box size
-  bbxMin_ = octomap::point3d (bbx_min[0], bbx_min[1], bbx_min[2]);
-  bbxMax_ = octomap::point3d (bbx_max[0], bbx_max[1], bbx_max[2]);
-
-  octomap::OcTreeKey bbxMinKey = occupancyTree_.coordToKey(bbxMin_, depth_);
-  octomap::OcTreeKey bbxMaxKey = occupancyTree_.coordToKey(bbxMax_, depth_);
-  octToDmOffset_ = bbxMinKey;  
+  const std::vector<std::vector<int> > &voxelNeighborhood = getVoxelNeighborhood6();
+  std::vector<std::vector<std::pair<octomap::point3d, int> > > threadVoxelNeighborLists (omp_get_max_threads());
   
-  // Initialize an obstacle map
-  int sizeX = (bbxMaxKey[0] / dmVoxelSize_) - (bbxMinKey[0] / dmVoxelSize_) + 1;
-  int sizeY = (bbxMaxKey[1] / dmVoxelSize_) - (bbxMinKey[1] / dmVoxelSize_) + 1;
-  int sizeZ = (bbxMaxKey[2] / dmVoxelSize_) - (bbxMinKey[2] / dmVoxelSize_) + 1;
-  
-  obstacleMap_ = new bool**[sizeX];
-  # pragma omp parallel for    
-  for (int x=0; x<sizeX; x++) {
-    obstacleMap_[x] = new bool*[sizeY];
-    for (int y=0; y<sizeY; y++) {
-      obstacleMap_[x][y] = new bool[sizeZ];
-      for(int z=0; z<sizeZ; z++)
-        obstacleMap_[x][y][z] = false;
-    }
-  }
-
-  // Fill occupancy data
-  const std::vector<std::vector<int> > voxelNeighborhood = createVoxelNeighborhood6();
-  # pragma omp parallel for
-  for(int dx=0; dx<sizeX; dx++)
+  #pragma omp parallel
   {
-    for(int dy=0; dy<sizeY; dy++)
+    std::vector<std::pair<octomap::point3d, int> > &curVoxelNeighborList = threadVoxelNeighborLists[omp_get_thread_num()];
+    
+    // Static schedule assigns consecutive slices to consecutive threads
+    #pragma omp for schedule(static)
+    for (int dx = 1; dx < grid.getSizeX()-1; dx++)
     {
-      for(int dz=0; dz<sizeZ; dz++)
+      for (int dy = 1; dy < grid.getSizeY()-1; dy++)
       {
-        octomap::OcTreeKey key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz));
-        octomap::OcTreeNode *node = occupancyTree_.search(key, depth);
-        
-        // If voxel is occupied or occluded add it to obstacle space
-        if(!node || (node && occupancyTree_.isNodeOccupied(node)))
-        {
-          obstacleMap_[dx][dy][dz] = true;
-        }
-        
-        // If voxel is free and one of it's neighbors is occluded - add it to obstacle space
-        else if (inflate_obstacle_space)
+        for (int dz = 1; dz < grid.getSizeZ()-1; dz++)
         {
+          if (!grid.get(dx, dy, dz))
+            continue;
+          
+          // Add a face for each neighbor voxel that is not set
           for (size_t nbrId = 0; nbrId < voxelNeighborhood.size(); nbrId++)
           {
-            int nbrDx = dx + voxelNeighborhood[nbrId][0];
-            int nbrDy = dy + voxelNeighborhood[nbrId][1];
-            int nbrDz = dz + voxelNeighborhood[nbrId][2];
-            
-            octomap::OcTreeKey nbr_oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(nbrDx, nbrDy, nbrDz));
-            octomap::OcTreeNode *nbr_node = occupancyTree_.search(nbr_oct_key, depth_);
-            
-            if (!nbr_node)
+            if (!grid.get(dx + voxelNeighborhood[nbrId][0], dy + voxelNeighborhood[nbrId][1], dz + voxelNeighborhood[nbrId][2]))
             {
-              obstacleMap_[dx][dy][dz] = true;
-              continue;
+              octomap::OcTreeKey oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz));
+              curVoxelNeighborList.push_back(std::make_pair(occupancyTree_.keyToCoord(oct_key, depth_), static_cast<int>(nbrId)));
             }
-          }            
+          }
         }
       }
     }
   }
   
-  // Construct distance map
-  float cellMaxDistSquared = pow  ( std::ceil(max_distance / (occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_))), 2);
-  distanceMap_ = new DynamicEDT3D (static_cast<int>(cellMaxDistSquared));
-  distanceMap_->initializeMap (sizeX, sizeY, sizeZ, obstacleMap_);
-  distanceMap_->update(true);
+  // Concatenate thread lists
+  size_t numFaces = 0;
+  for (size_t threadId = 0; threadId < threadVoxelNeighborLists.size(); threadId++)
+    numFaces += threadVoxelNeighborLists[threadId].size();
   
-  return true;
+  voxel_neighbor_list.clear();
+  voxel_neighbor_list.reserve(numFaces);
+  for (size_t threadId = 0; threadId < threadVoxelNeighborLists.size(); threadId++)
+    voxel_neighbor_list.insert(voxel_neighbor_list.end(), threadVoxelNeighborLists[threadId].begin(), threadVoxelNeighborLists[threadId].end());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool OccupancyMap::setBoundingPlanes (const std::vector<Eigen::Vector4f> &bounding_planes, const std::vector<float> &offsets)
+void OccupancyMap::getLeafVoxelRange (const octomap::OcTreeKey &leaf_key, const unsigned int leaf_depth, const int voxel_min[3], const int voxel_max[3], int voxel_range[3][2]) const
 {
-  if (offsets.size() == 0)
-  {
-    boundingPlanes_ = bounding_planes;
-  }
-  else if (bounding_planes.size() != offsets.size())
+  int leafSize = 1 << (occupancyTree_.getTreeDepth() - leaf_depth);
+  for (size_t axis = 0; axis < 3; axis++)
   {
-    std::cout << "[OccupancyMap::setBoundingPlanes] bounding plane vector and offset vector have different sizes." << std::endl;
-    return false;
+    int leafOffset = static_cast<int>(leaf_key[axis]) - static_cast<int>(octToDmOffset_[axis]);
+    voxel_range[axis][0] = std::max(static_cast<int>(std::ceil (static_cast<double>(leafOffset) / dmVoxelSize_)), voxel_min[axis]);
+    voxel_range[axis][1] = std::min(static_cast<int>(std::floor(static_cast<double>(leafOffset + leafSize - 1) / dmVoxelSize_)), voxel_max[axis]);
   }
-  else
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::carveKnownSpace (const int voxel_min[3], const int voxel_max[3])
+{
+  // Loop over the occupancy tree leaves that intersect the voxel range. Leaves
+  // deeper than the distance map depth are visited as their parent at that 
+  // depth. Leaves that are shallower cover a block of distance map voxels.
+  octomap::OcTreeKey rangeMinKey = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(voxel_min[0], voxel_min[1], voxel_min[2]));
+  octomap::OcTreeKey rangeMaxKey = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(voxel_max[0], voxel_max[1], voxel_max[2]));
+  
+  for (octomap::OcTree::leaf_bbx_iterator leafIt = occupancyTree_.begin_leafs_bbx(rangeMinKey, rangeMaxKey, depth_), leafEnd = occupancyTree_.end_leafs_bbx(); leafIt != leafEnd; ++leafIt)
   {
-    boundingPlanes_.resize(bounding_planes.size());
+    bool leafOccupied = occupancyTree_.isNodeOccupied(*leafIt);
+    int voxelRange[3][2];
+    getLeafVoxelRange(leafIt.getIndexKey(), leafIt.getDepth(), voxel_min, voxel_max, voxelRange);
     
-    for (size_t planeId = 0; planeId < offsets.size(); planeId++)
+    for (int dx = voxelRange[0][0]; dx <= voxelRange[0][1]; dx++)
     {
-      Eigen::Vector3f pTMP, nTMP;
-      utl::planeCoefficientsToPointNormal(bounding_planes[planeId], pTMP, nTMP);
-      pTMP += nTMP * offsets[planeId];
-      utl::pointNormalToPlaneCoefficients(pTMP, nTMP, boundingPlanes_[planeId]);
+      for (int dy = voxelRange[1][0]; dy <= voxelRange[1][1]; dy++)
+      {
+        for (int dz = voxelRange[2][0]; dz <= voxelRange[2][1]; dz++)
+        {
+          occludedMap_.set(dx, dy, dz, false);
+          obstacleMap_.set(dx, dy, dz, leafOccupied);
+        }
+      }
     }
   }
-  
-  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-float OccupancyMap::getPointBoundingPlaneMinSignedDistance(const Eigen::Vector3f& point) const
+void OccupancyMap::inflateObstacleSpace (const int voxel_min[3], const int voxel_max[3])
 {
-  // Check bounding planes first
-  float planeDistance = std::numeric_limits<float>::max();
-  
-  for (size_t planeId = 0; planeId < boundingPlanes_.size(); planeId++)
-    planeDistance = std::min(planeDistance, utl::pointToPlaneSignedDistance(point, boundingPlanes_[planeId]));
-  
-  return planeDistance;
+  // If voxel is free and one of it's neighbors is occluded - add it to obstacle space
+  # pragma omp parallel for
+  for(int dx=voxel_min[0]; dx<=voxel_max[0]; dx++)
+  {
+    for(int dy=voxel_min[1]; dy<=voxel_max[1]; dy++)
+    {
+      for(int dz=voxel_min[2]; dz<=voxel_max[2]; dz++)
+      {
+        if (!obstacleMap_.get(dx, dy, dz) && hasOccludedNeighbor(dx, dy, dz))
+          obstacleMap_.set(dx, dy, dz, true);
+      }
+    }
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-float OccupancyMap::getNearestOccludedOccupiedDistance(const Eigen::Vector3f& point) const
+bool OccupancyMap::isVoxelOccluded (const int dx, const int dy, const int dz) const
 {
-  octomap::OcTreeKey key_dm = getDistanceMapKey(point);
-  float distance = distanceMap_->getDistance(key_dm[0], key_dm[1], key_dm[2]) * occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
-  if (distance < 0)
-    return distanceMapMaxDist_;
+  // Voxels outside of the distance map are looked up in the occupancy tree
+  if (occludedMap_.isInside(dx, dy, dz))
+    return occludedMap_.get(dx, dy, dz);
   
-  return distance;
+  octomap::OcTreeKey oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz));
+  return !occupancyTree_.search(oct_key, depth_);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-float OccupancyMap::getNearestObstacleDistance(const Eigen::Vector3f& point) const
+bool OccupancyMap::hasOccludedNeighbor (const int dx, const int dy, const int dz) const
 {
-  // Check that distance map was initialized
-  if (!distanceMap_)
+  static const int voxelNeighborhood[6][3] = { { 1,  0,  0}, {-1,  0,  0},
+                                               { 0,  1,  0}, { 0, -1,  0},
+                                               { 0,  0,  1}, { 0,  0, -1} };
+  
+  for (size_t nbrId = 0; nbrId < 6; nbrId++)
   {
-    std::cout << "[OccupancyMap::getNearestObstacleDistance] distance map was not initialized." << std::endl;
-    return std::numeric_limits<float>::quiet_NaN();
+    if (isVoxelOccluded(dx + voxelNeighborhood[nbrId][0], dy + voxelNeighborhood[nbrId][1], dz + voxelNeighborhood[nbrId][2]))
+      return true;
   }
-
-  // Calculate distance to the occluded/occupied cell
-  float cellDistance = getNearestOccludedOccupiedDistance(point);
   
-  // Calculate distance to the bounding planes
-  float planeDistance = getPointBoundingPlaneMinSignedDistance(point);
-  planeDistance = std::max(-planeDistance, 0.0f);
-    
-  // Otherwise return cell distance
-  return std::max(cellDistance, planeDistance);
+  return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-Eigen::Vector3f OccupancyMap::getNearestObstacle(const Eigen::Vector3f& point) const
+bool OccupancyMap::growDistanceMap (const int voxel_min[3], const int voxel_max[3], int shift[3])
 {
-  // Check that distance map was initialized
-  if (!distanceMap_)
+  // Get the new extent of the distance map in current distance map coordinates.
+  // The map is grown by an extra margin so that a map that keeps growing 
+  // doesn't have to be reallocated after every update.
+  const int oldSize[3] = {obstacleMap_.getSizeX(), obstacleMap_.getSizeY(), obstacleMap_.getSizeZ()};
+  const int maxKey = std::numeric_limits<octomap::key_type>::max();
+  int newMin[3], newMax[3], newSize[3];
+  for (size_t axis = 0; axis < 3; axis++)
   {
-    std::cout << "[OccupancyMap::getNearestObstacle] distance map was not initialized." << std::endl;
-    return Eigen::Vector3f::Ones() * std::numeric_limits<float>::quiet_NaN();
+    int margin = std::max(oldSize[axis] / 4, 1);
+    int minAllowed = - ((static_cast<int>(octToDmOffset_[axis]) - dmVoxelSize_ / 2) / dmVoxelSize_);
+    int maxAllowed = (maxKey - static_cast<int>(octToDmOffset_[axis])) / dmVoxelSize_;
+    
+    newMin[axis] = voxel_min[axis] < 0 ? std::max(voxel_min[axis] - margin, minAllowed) : 0;
+    newMax[axis] = voxel_max[axis] >= oldSize[axis] ? std::min(voxel_max[axis] + margin, maxAllowed) : oldSize[axis]-1;
+    newSize[axis] = newMax[axis] - newMin[axis] + 1;
+    shift[axis] = -newMin[axis];
   }
   
-  // Get the distance to the nearest bounding plane
-  float planeDistance = 0;
-  float nearestPlaneId = 0;
-  for (size_t planeId = 0; planeId < boundingPlanes_.size(); planeId++)
+  if (newSize[0] == oldSize[0] && newSize[1] == oldSize[1] && newSize[2] == oldSize[2])
+    return false;
+  
+  // Copy existing voxels into the grown grids
+  ObstacleGrid obstacleMapNew, occludedMapNew;
+  obstacleMapNew.resize(newSize[0], newSize[1], newSize[2], true);
+  occludedMapNew.resize(newSize[0], newSize[1], newSize[2], true);
+  
+  # pragma omp parallel for
+  for (int dx = 0; dx < oldSize[0]; dx++)
   {
-    float curDistance = utl::pointToPlaneSignedDistance(point, boundingPlanes_[planeId]);
-    if (curDistance < planeDistance)
+    for (int dy = 0; dy < oldSize[1]; dy++)
     {
-      planeDistance = curDistance;
-      nearestPlaneId = planeId;
+      for (int dz = 0; dz < oldSize[2]; dz++)
+      {
+        obstacleMapNew.set(dx + shift[0], dy + shift[1], dz + shift[2], obstacleMap_.get(dx, dy, dz));
+        occludedMapNew.set(dx + shift[0], dy + shift[1], dz + shift[2], occludedMap_.get(dx, dy, dz));
+      }
     }
   }
-  planeDistance = std::abs(planeDistance);
   
-  // Get the distance to the nearest occluded/occupied cell
-  octomap::OcTreeKey key_dm = getDistanceMapKey(point);
-  float cellDistance = distanceMap_->getDistance(key_dm[0], key_dm[1], key_dm[2]) * occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
-
-  // Get the closest point
-  Eigen::Vector3f nearestPoint;
-  if (cellDistance > planeDistance)
+  // Distance map refers to the old obstacle grid
+  if (distanceMap_)
   {
-    IntPoint3D closest_point_dm = distanceMap_->getClosestObstacle(key_dm[0], key_dm[1], key_dm[2]);
-    octomap::OcTreeKey closest_key_dm(closest_point_dm.x, closest_point_dm.y, closest_point_dm.z);
-    octomap::OcTreeKey closest_key_oct = distanceMapKeyToOccupancyTreeKey(closest_key_dm);
-    octomap::point3d closestPoint_oct = occupancyTree_.keyToCoord(closest_key_oct, depth_);    
-    nearestPoint = Eigen::Vector3f (closestPoint_oct.x(), closestPoint_oct.y(), closestPoint_oct.z());
+    delete distanceMap_;
+    distanceMap_ = NULL;
   }
-  else
+  obstacleMap_.swap(obstacleMapNew);
+  occludedMap_.swap(occludedMapNew);
+  
+  // Update distance map origin
+  for (size_t axis = 0; axis < 3; axis++)
+    octToDmOffset_[axis] = static_cast<int>(octToDmOffset_[axis]) + newMin[axis] * dmVoxelSize_;
+  bbxMin_ = occupancyTree_.keyToCoord(distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(0, 0, 0)), depth_);
+  bbxMax_ = occupancyTree_.keyToCoord(distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(newSize[0]-1, newSize[1]-1, newSize[2]-1)), depth_);
+  
+  // Fill the new part of the grid. It is split into six non-overlapping slabs
+  // around the old part of the grid.
+  const int oldMin[3] = {shift[0], shift[1], shift[2]};
+  const int oldMax[3] = {shift[0] + oldSize[0] - 1, shift[1] + oldSize[1] - 1, shift[2] + oldSize[2] - 1};
+  for (size_t axis = 0; axis < 3; axis++)
   {
-    nearestPoint = utl::projectPointToPlane<float>(point, boundingPlanes_[nearestPlaneId]);
+    for (size_t side = 0; side < 2; side++)
+    {
+      int slabMin[3], slabMax[3];
+      for (size_t axisOther = 0; axisOther < 3; axisOther++)
+      {
+        // Axes before the current one are already covered by previous slabs
+        slabMin[axisOther] = axisOther < axis ? oldMin[axisOther] : 0;
+        slabMax[axisOther] = axisOther < axis ? oldMax[axisOther] : newSize[axisOther]-1;
+      }
+      slabMin[axis] = side == 0 ? 0                 : oldMax[axis] + 1;
+      slabMax[axis] = side == 0 ? oldMin[axis] - 1  : newSize[axis] - 1;
+      
+      if (slabMin[axis] > slabMax[axis])
+        continue;
+      
+      carveKnownSpace(slabMin, slabMax);
+      if (inflateObstacleSpace_)
+        inflateObstacleSpace(slabMin, slabMax);
+    }
   }
   
-  return nearestPoint;
+  occlusionBitmap_.assign(occludedMap_.data(), newSize[0], newSize[1], newSize[2]);
+  
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool OccupancyMap::isPointOccluded(const Eigen::Vector3f& point) const
+bool OccupancyMap::initializeGrid (const Eigen::Vector3f& bbx_min, const Eigen::Vector3f& bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space, int size[3])
 {
-  // Check that distance map was initialized
+  // Check that occupancy tree exists
+  if (occupancyTree_.getTreeDepth() == 0)
+  {
+    std::cout << "[OccupancyMap::initializeGrid] occupancy tree is empty. Can't compute a distance map." << std::endl;
+    return false;
+  }
+  
+  // Delete distance map if it already exists
+  if (distanceMap_)
+  {
+    delete distanceMap_;
+    distanceMap_ = NULL;
+  }
+  distanceMapFile_.close();
+  obstacleMap_.clear();
+  occludedMap_.clear();
+  occlusionBitmap_.clear();
+  distanceField_.clear();
+  
+  // Check depth
+  if (depth < 0 || depth > occupancyTree_.getTreeDepth())
+  {
+    std::cout << "[OccupancyMap::initializeGrid] depth must be greater than 0 and smaller than occupancy tree depth." << std::endl;
+    return false;
+  }
+  
+  distanceMapMaxDist_ = max_distance;
+  depth_ = depth;
+  inflateObstacleSpace_ = inflate_obstacle_space;
+  dmVoxelSize_ = pow (2, occupancyTree_.getTreeDepth() - depth_);
+  
+  // Get bounding box size
+  bbxMin_ = octomap::point3d (bbx_min[0], bbx_min[1], bbx_min[2]);
+  bbxMax_ = octomap::point3d (bbx_max[0], bbx_max[1], bbx_max[2]);
+
+  octomap::OcTreeKey bbxMinKey = occupancyTree_.coordToKey(bbxMin_, depth_);
+  octomap::OcTreeKey bbxMaxKey = occupancyTree_.coordToKey(bbxMax_, depth_);
+  octToDmOffset_ = bbxMinKey;  
+  
+  // Grid dimensions
+  for (size_t axis = 0; axis < 3; axis++)
+    size[axis] = (bbxMaxKey[axis] / dmVoxelSize_) - (bbxMinKey[axis] / dmVoxelSize_) + 1;
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::constructObstacleMap (const Eigen::Vector3f& bbx_min, const Eigen::Vector3f& bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space)
+{
+  int size[3];
+  if (!initializeGrid(bbx_min, bbx_max, depth, max_distance, inflate_obstacle_space, size))
+    return false;
+  
+  const int sizeX = size[0], sizeY = size[1], sizeZ = size[2];
+  
+  // All voxels are considered occluded until they are found in the occupancy tree
+  occludedMap_.resize(sizeX, sizeY, sizeZ, true);
+  obstacleMap_.resize(sizeX, sizeY, sizeZ, true);
+  
+  const int voxelMin[3] = {0, 0, 0};
+  const int voxelMax[3] = {sizeX-1, sizeY-1, sizeZ-1};
+  carveKnownSpace(voxelMin, voxelMax);
+  
+  if (inflateObstacleSpace_)
+    inflateObstacleSpace(voxelMin, voxelMax);
+  
+  occlusionBitmap_.assign(occludedMap_.data(), sizeX, sizeY, sizeZ);
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::distanceMapFromOccupancy(const Eigen::Vector3f& bbx_min, const Eigen::Vector3f& bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space)
+{
+  if (!constructObstacleMap(bbx_min, bbx_max, depth, max_distance, inflate_obstacle_space))
+    return false;
+  
+  // Construct distance map
+  constructDistanceMap();
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::distanceFieldFromOccupancy (const Eigen::Vector3f& bbx_min, const Eigen::Vector3f& bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space)
+{
+  int size[3];
+  if (!initializeGrid(bbx_min, bbx_max, depth, max_distance, inflate_obstacle_space, size))
+    return false;
+  
+  const float voxelSizeMetric = occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+  const int maxCells = static_cast<int>(std::ceil(distanceMapMaxDist_ / voxelSizeMetric));
+  
+  DistanceField distanceField;
+  initializeDistanceField(distanceField, size);
+  const int numBricks[3] = {distanceField.getNumBricksX(), distanceField.getNumBricksY(), distanceField.getNumBricksZ()};
+  const int numBricksTotal = numBricks[0] * numBricks[1] * numBricks[2];
+  
+  //----------------------------------------------------------------------------
+  // Rasterize the obstacle space brick by brick
+  //----------------------------------------------------------------------------
+  
+  ObstacleBrickGrid obstacles;
+  obstacles.resize(size[0], size[1], size[2]);
+  
+  #pragma omp parallel for schedule(dynamic)
+  for (int brickId = 0; brickId < numBricksTotal; brickId++)
+  {
+    const int brick[3] = { brickId / (numBricks[1] * numBricks[2]),
+                           (brickId / numBricks[2]) % numBricks[1],
+                           brickId % numBricks[2] };
+    bool brickObstacles[DistanceField::BRICK_VOXELS];
+    rasterizeObstacleBrick(brick, size, brickObstacles);
+    obstacles.setBrick(brick[0], brick[1], brick[2], brickObstacles);
+  }
+  
+  //----------------------------------------------------------------------------
+  // Compute distances of the bricks near the obstacle space 
+  //----------------------------------------------------------------------------
+  
+  // Bricks that can contain obstacles closer than the maximum distance
+  const int B = DistanceField::BRICK_SIZE;
+  const int brickRadius = (maxCells + B - 1) / B;
+  
+  #pragma omp parallel for schedule(dynamic)
+  for (int brickId = 0; brickId < numBricksTotal; brickId++)
+  {
+    const int brick[3] = { brickId / (numBricks[1] * numBricks[2]),
+                           (brickId / numBricks[2]) % numBricks[1],
+                           brickId % numBricks[2] };
+    float distances[DistanceField::BRICK_VOXELS];
+    
+    // Brick inside the obstacle space
+    if (obstacles.getBrickState(brick[0], brick[1], brick[2]) == ObstacleBrickGrid::FULL)
+    {
+      std::fill(distances, distances + DistanceField::BRICK_VOXELS, 0.0f);
+      distanceField.setBrick(brick[0], brick[1], brick[2], distances);
+      continue;
+    }
+    
+    // Brick far from the obstacle space keeps the maximum distance tile
+    bool nearObstacles = false;
+    for (int bx = std::max(brick[0] - brickRadius, 0); bx <= std::min(brick[0] + brickRadius, numBricks[0]-1) && !nearObstacles; bx++)
+      for (int by = std::max(brick[1] - brickRadius, 0); by <= std::min(brick[1] + brickRadius, numBricks[1]-1) && !nearObstacles; by++)
+        for (int bz = std::max(brick[2] - brickRadius, 0); bz <= std::min(brick[2] + brickRadius, numBricks[2]-1) && !nearObstacles; bz++)
+          nearObstacles = obstacles.getBrickState(bx, by, bz) != ObstacleBrickGrid::EMPTY;
+    
+    if (!nearObstacles)
+      continue;
+    
+    computeBrickDistances(obstacles, brick, maxCells, distances);
+    distanceField.setBrick(brick[0], brick[1], brick[2], distances);
+  }
+  
+  distanceField_.swap(distanceField);
+  distanceFieldPlanes_ = false;
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::rasterizeObstacleBrick (const int brick[3], const int size[3], bool *obstacles) const
+{
+  const int B = DistanceField::BRICK_SIZE;
+  
+  // Brick clipped to the grid and padded by the neighbors checked by the
+  // obstacle space inflation
+  const int padding = inflateObstacleSpace_ ? 1 : 0;
+  int windowMin[3], windowMax[3], windowSize[3];
+  for (size_t axis = 0; axis < 3; axis++)
+  {
+    windowMin[axis] = std::max(brick[axis] * B - padding, 0);
+    windowMax[axis] = std::min((brick[axis] + 1) * B - 1 + padding, size[axis] - 1);
+    windowSize[axis] = windowMax[axis] - windowMin[axis] + 1;
+  }
+  
+  // All voxels are considered occluded until they are found in the occupancy tree
+  const size_t numWindowVoxels = static_cast<size_t>(windowSize[0]) * windowSize[1] * windowSize[2];
+  std::vector<char> windowOccluded (numWindowVoxels, 1), windowObstacles (numWindowVoxels, 1);
+  
+  octomap::OcTreeKey rangeMinKey = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(windowMin[0], windowMin[1], windowMin[2]));
+  octomap::OcTreeKey rangeMaxKey = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(windowMax[0], windowMax[1], windowMax[2]));
+  
+  for (octomap::OcTree::leaf_bbx_iterator leafIt = occupancyTree_.begin_leafs_bbx(rangeMinKey, rangeMaxKey, depth_), leafEnd = occupancyTree_.end_leafs_bbx(); leafIt != leafEnd; ++leafIt)
+  {
+    bool leafOccupied = occupancyTree_.isNodeOccupied(*leafIt);
+    int voxelRange[3][2];
+    getLeafVoxelRange(leafIt.getIndexKey(), leafIt.getDepth(), windowMin, windowMax, voxelRange);
+    
+    for (int dx = voxelRange[0][0]; dx <= voxelRange[0][1]; dx++)
+    {
+      for (int dy = voxelRange[1][0]; dy <= voxelRange[1][1]; dy++)
+      {
+        for (int dz = voxelRange[2][0]; dz <= voxelRange[2][1]; dz++)
+        {
+          const size_t windowId = (static_cast<size_t>(dx - windowMin[0]) * windowSize[1] + (dy - windowMin[1])) * windowSize[2] + (dz - windowMin[2]);
+          windowOccluded[windowId] = 0;
+          windowObstacles[windowId] = leafOccupied;
+        }
+      }
+    }
+  }
+  
+  // Voxels of the bricks outside of the grid replicate the boundary voxels
+  static const int voxelNeighborhood[6][3] = { { 1,  0,  0}, {-1,  0,  0},
+                                               { 0,  1,  0}, { 0, -1,  0},
+                                               { 0,  0,  1}, { 0,  0, -1} };
+  
+  for (int lx = 0; lx < B; lx++)
+  {
+    for (int ly = 0; ly < B; ly++)
+    {
+      for (int lz = 0; lz < B; lz++)
+      {
+        const int voxel[3] = { std::min(brick[0] * B + lx, size[0] - 1),
+                               std::min(brick[1] * B + ly, size[1] - 1),
+                               std::min(brick[2] * B + lz, size[2] - 1) };
+        const size_t windowId = (static_cast<size_t>(voxel[0] - windowMin[0]) * windowSize[1] + (voxel[1] - windowMin[1])) * windowSize[2] + (voxel[2] - windowMin[2]);
+        bool isObstacle = windowObstacles[windowId] != 0;
+        
+        // If voxel is free and one of it's neighbors is occluded - add it to
+        // obstacle space. Neighbors outside of the grid are looked up in the
+        // occupancy tree.
+        for (size_t nbrId = 0; nbrId < 6 && inflateObstacleSpace_ && !isObstacle; nbrId++)
+        {
+          int nbrVoxel[3];
+          bool nbrInside = true;
+          for (size_t axis = 0; axis < 3; axis++)
+          {
+            nbrVoxel[axis] = voxel[axis] + voxelNeighborhood[nbrId][axis];
+            nbrInside = nbrInside && nbrVoxel[axis] >= 0 && nbrVoxel[axis] < size[axis];
+          }
+          
+          if (nbrInside)
+            isObstacle = windowOccluded[(static_cast<size_t>(nbrVoxel[0] - windowMin[0]) * windowSize[1] + (nbrVoxel[1] - windowMin[1])) * windowSize[2] + (nbrVoxel[2] - windowMin[2])] != 0;
+          else
+            isObstacle = isVoxelOccluded(nbrVoxel[0], nbrVoxel[1], nbrVoxel[2]);
+        }
+        
+        obstacles[DistanceField::getBrickVoxelIndex(lx, ly, lz)] = isObstacle;
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::constructDistanceMap ()
+{
+  float cellMaxDistSquared = pow  ( std::ceil(distanceMapMaxDist_ / (occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_))), 2);
+  distanceMap_ = new ObstacleGridEDT3D (static_cast<int>(cellMaxDistSquared));
+  distanceMap_->initializeMap (obstacleMap_);
+  distanceMap_->update(true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::distanceTransform1D (float *f, const int n, float *d, float *z, int *v)
+{
+  const float inf = std::numeric_limits<float>::max();
+
+  // Lower envelope of the parabolas rooted at the samples
+  int k = 0;
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] = inf;
+  for (int q = 1; q < n; q++)
+  {
+    if (f[q] == inf)
+      continue;
+    
+    if (f[v[k]] == inf)
+    {
+      v[k] = q;
+      continue;
+    }
+    
+    float intersection = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+    while (k > 0 && intersection <= z[k])
+    {
+      k--;
+      intersection = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = intersection;
+    z[k+1] = inf;
+  }
+  
+  // Sample the lower envelope
+  if (f[v[0]] == inf)
+    return;
+  
+  k = 0;
+  for (int q = 0; q < n; q++)
+  {
+    while (z[k+1] < q)
+      k++;
+    d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+  
+  std::copy(d, d + n, f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::computeBrickDistances (const ObstacleBrickGrid &obstacles, const int brick[3], const int max_cells, float *distances) const
+{
+  const int B = DistanceField::BRICK_SIZE;
+  const int size[3] = {obstacles.getSizeX(), obstacles.getSizeY(), obstacles.getSizeZ()};
+  const float voxelSizeMetric = occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+  const float inf = std::numeric_limits<float>::max();
+  
+  // Brick padded by the maximum distance and clipped to the grid
+  int windowMin[3], windowSize[3];
+  for (size_t axis = 0; axis < 3; axis++)
+  {
+    windowMin[axis] = std::max(brick[axis] * B - max_cells, 0);
+    windowSize[axis] = std::min((brick[axis] + 1) * B + max_cells, size[axis]) - windowMin[axis];
+  }
+  
+  std::vector<float> window (static_cast<size_t>(windowSize[0]) * windowSize[1] * windowSize[2]);
+  for (int wx = 0; wx < windowSize[0]; wx++)
+    for (int wy = 0; wy < windowSize[1]; wy++)
+      for (int wz = 0; wz < windowSize[2]; wz++)
+        window[(static_cast<size_t>(wx) * windowSize[1] + wy) * windowSize[2] + wz] = obstacles.get(windowMin[0] + wx, windowMin[1] + wy, windowMin[2] + wz) ? 0.0f : inf;
+  
+  // Separable squared distance transform
+  const int maxWindowSize = std::max(windowSize[0], std::max(windowSize[1], windowSize[2]));
+  std::vector<float> line (maxWindowSize), d (maxWindowSize), z (maxWindowSize + 1);
+  std::vector<int> v (maxWindowSize);
+  const size_t stride[3] = {static_cast<size_t>(windowSize[1]) * windowSize[2], static_cast<size_t>(windowSize[2]), 1};
+  
+  for (size_t axis = 0; axis < 3; axis++)
+  {
+    const size_t axisU = (axis + 1) % 3, axisV = (axis + 2) % 3;
+    for (int wu = 0; wu < windowSize[axisU]; wu++)
+    {
+      for (int wv = 0; wv < windowSize[axisV]; wv++)
+      {
+        const size_t start = wu * stride[axisU] + wv * stride[axisV];
+        for (int i = 0; i < windowSize[axis]; i++)
+          line[i] = window[start + i * stride[axis]];
+        distanceTransform1D(&line[0], windowSize[axis], &d[0], &z[0], &v[0]);
+        for (int i = 0; i < windowSize[axis]; i++)
+          window[start + i * stride[axis]] = line[i];
+      }
+    }
+  }
+  
+  // Voxels of the bricks outside of the grid replicate the boundary voxels
+  for (int lx = 0; lx < B; lx++)
+  {
+    for (int ly = 0; ly < B; ly++)
+    {
+      for (int lz = 0; lz < B; lz++)
+      {
+        const int wx = std::min(brick[0] * B + lx, size[0] - 1) - windowMin[0];
+        const int wy = std::min(brick[1] * B + ly, size[1] - 1) - windowMin[1];
+        const int wz = std::min(brick[2] * B + lz, size[2] - 1) - windowMin[2];
+        const float distanceSquared = window[(static_cast<size_t>(wx) * windowSize[1] + wy) * windowSize[2] + wz];
+        distances[DistanceField::getBrickVoxelIndex(lx, ly, lz)] = distanceSquared == inf ? inf : std::sqrt(distanceSquared) * voxelSizeMetric;
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::updateFromOccupancyDelta (const std::vector<octomap::OcTreeKey> &changed_keys, const bool grow_bbx)
+{
+  // Check that distance map was constructed from the occupancy tree
+  if (!distanceMap_ || occludedMap_.empty())
+  {
+    std::cout << "[OccupancyMap::updateFromOccupancyDelta] distance map was not constructed from the occupancy tree." << std::endl;
+    return false;
+  }
+  
+  if (changed_keys.empty())
+    return true;
+  
+  //----------------------------------------------------------------------------
+  // Get changed distance map voxels
+  //----------------------------------------------------------------------------
+  
+  // Changed keys are at the maximum depth of the occupancy tree. A distance map
+  // voxel covers the keys centered around its own key.
+  std::vector<Eigen::Vector3i> changedVoxels (changed_keys.size());
+  Eigen::Vector3i changedMin = Eigen::Vector3i::Constant(std::numeric_limits<int>::max());
+  Eigen::Vector3i changedMax = Eigen::Vector3i::Constant(std::numeric_limits<int>::min());
+  for (size_t keyId = 0; keyId < changed_keys.size(); keyId++)
+  {
+    for (size_t axis = 0; axis < 3; axis++)
+    {
+      int keyOffset = static_cast<int>(changed_keys[keyId][axis]) - static_cast<int>(octToDmOffset_[axis]) + dmVoxelSize_ / 2;
+      changedVoxels[keyId][axis] = static_cast<int>(std::floor(static_cast<double>(keyOffset) / dmVoxelSize_));
+    }
+    changedMin = changedMin.cwiseMin(changedVoxels[keyId]);
+    changedMax = changedMax.cwiseMax(changedVoxels[keyId]);
+  }
+  
+  // Grow the distance map if changes fall outside of it
+  bool grown = false;
+  if (grow_bbx && (!occludedMap_.isInside(changedMin[0], changedMin[1], changedMin[2]) || !occludedMap_.isInside(changedMax[0], changedMax[1], changedMax[2])))
+  {
+    int shift[3];
+    grown = growDistanceMap(changedMin.data(), changedMax.data(), shift);
+    if (grown)
+    {
+      for (size_t voxelId = 0; voxelId < changedVoxels.size(); voxelId++)
+        changedVoxels[voxelId] += Eigen::Vector3i(shift[0], shift[1], shift[2]);
+    }
+  }
+  
+  //----------------------------------------------------------------------------
+  // Update occluded space
+  //----------------------------------------------------------------------------
+  
+  std::vector<size_t> affectedVoxelIds;
+  for (size_t voxelId = 0; voxelId < changedVoxels.size(); voxelId++)
+  {
+    const Eigen::Vector3i &voxel = changedVoxels[voxelId];
+    if (!occludedMap_.isInside(voxel[0], voxel[1], voxel[2]))
+      continue;
+    
+    octomap::OcTreeKey oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(voxel[0], voxel[1], voxel[2]));
+    occludedMap_.set(voxel[0], voxel[1], voxel[2], !occupancyTree_.search(oct_key, depth_));
+    occlusionBitmap_.set(voxel[0], voxel[1], voxel[2], occludedMap_.get(voxel[0], voxel[1], voxel[2]));
+    affectedVoxelIds.push_back(occludedMap_.getIndex(voxel[0], voxel[1], voxel[2]));
+    
+    // Inflation of the neighboring voxels depends on the occlusion of this voxel
+    if (inflateObstacleSpace_)
+    {
+      static const int voxelNeighborhood[6][3] = { { 1,  0,  0}, {-1,  0,  0},
+                                                   { 0,  1,  0}, { 0, -1,  0},
+                                                   { 0,  0,  1}, { 0,  0, -1} };
+      for (size_t nbrId = 0; nbrId < 6; nbrId++)
+      {
+        Eigen::Vector3i nbrVoxel = voxel + Eigen::Vector3i(voxelNeighborhood[nbrId][0], voxelNeighborhood[nbrId][1], voxelNeighborhood[nbrId][2]);
+        if (occludedMap_.isInside(nbrVoxel[0], nbrVoxel[1], nbrVoxel[2]))
+          affectedVoxelIds.push_back(occludedMap_.getIndex(nbrVoxel[0], nbrVoxel[1], nbrVoxel[2]));
+      }
+    }
+  }
+  
+  std::sort(affectedVoxelIds.begin(), affectedVoxelIds.end());
+  affectedVoxelIds.erase(std::unique(affectedVoxelIds.begin(), affectedVoxelIds.end()), affectedVoxelIds.end());
+  
+  //----------------------------------------------------------------------------
+  // Update obstacle space
+  //----------------------------------------------------------------------------
+  
+  const int sizeY = obstacleMap_.getSizeY(), sizeZ = obstacleMap_.getSizeZ();
+  for (size_t voxelIdIt = 0; voxelIdIt < affectedVoxelIds.size(); voxelIdIt++)
+  {
+    size_t voxelId = affectedVoxelIds[voxelIdIt];
+    int dx = voxelId / (sizeY * sizeZ);
+    int dy = (voxelId / sizeZ) % sizeY;
+    int dz = voxelId % sizeZ;
+    
+    // Voxel is an obstacle if it is occluded, occupied or is inflated
+    bool isObstacle = occludedMap_.get(dx, dy, dz);
+    if (!isObstacle)
+    {
+      octomap::OcTreeKey oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz));
+      octomap::OcTreeNode *node = occupancyTree_.search(oct_key, depth_);
+      isObstacle = (node && occupancyTree_.isNodeOccupied(node)) || (inflateObstacleSpace_ && hasOccludedNeighbor(dx, dy, dz));
+    }
+    
+    if (isObstacle == obstacleMap_.get(dx, dy, dz))
+      continue;
+    
+    // If the distance map was deleted while growing only the grid is updated,
+    // otherwise the distance map propagates the change
+    if (grown)
+      obstacleMap_.set(dx, dy, dz, isObstacle);
+    else if (isObstacle)
+      distanceMap_->occupyCell(dx, dy, dz);
+    else
+      distanceMap_->clearCell(dx, dy, dz);
+  }
+  
+  //----------------------------------------------------------------------------
+  // Update distance map
+  //----------------------------------------------------------------------------
+  
+  if (grown)
+    constructDistanceMap();
+  else
+    distanceMap_->update(true);
+  
+  if (hasBakedBoundingPlanes())
+    bakeBoundingPlanes();
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::getDistanceMapCacheKey (const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space, uint64_t &key) const
+{
+  key = utl::HASH_SEED;
+  if (occupancyTreeFilename_.empty())
+    return false;
+  
+  // Hash the occupancy tree file unless it was changed after it was read
+  if (!occupancyTreeHashed_)
+  {
+    boost::system::error_code sizeError, timeError;
+    const uintmax_t fileSize = boost::filesystem::file_size(occupancyTreeFilename_, sizeError);
+    const std::time_t fileTime = boost::filesystem::last_write_time(occupancyTreeFilename_, timeError);
+    if (sizeError || timeError || fileSize != occupancyTreeFileSize_ || fileTime != occupancyTreeFileTime_)
+    {
+      std::cout << "[OccupancyMap::getDistanceMapCacheKey] octomap file '" << occupancyTreeFilename_ << "' was changed after it was read." << std::endl;
+      return false;
+    }
+    
+    if (!utl::hashFile(occupancyTreeFilename_, occupancyTreeHash_))
+    {
+      std::cout << "[OccupancyMap::getDistanceMapCacheKey] could not hash octomap file '" << occupancyTreeFilename_ << "'." << std::endl;
+      return false;
+    }
+    occupancyTreeHashed_ = true;
+  }
+  
+  key = occupancyTreeHash_;
+  
+  key = utl::hashBytes(bbx_min.data(), 3 * sizeof(float), key);
+  key = utl::hashBytes(bbx_max.data(), 3 * sizeof(float), key);
+  key = utl::hashBytes(&depth, sizeof(depth), key);
+  key = utl::hashBytes(&max_distance, sizeof(max_distance), key);
+  key = utl::hashBytes(&inflate_obstacle_space, sizeof(inflate_obstacle_space), key);
+  for (size_t planeId = 0; planeId < boundingPlanes_.size(); planeId++)
+    key = utl::hashBytes(boundingPlanes_[planeId].data(), 4 * sizeof(float), key);
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::distanceMapFromOccupancyCached (const std::string &cache_dirname, const Eigen::Vector3f &bbx_min, const Eigen::Vector3f &bbx_max, const uint16_t depth, const float max_distance, const bool inflate_obstacle_space)
+{
+  // Without a key the distance map is constructed and not cached, otherwise
+  // it could be confused with the distance map of another occupancy tree
+  uint64_t key;
+  if (!getDistanceMapCacheKey(bbx_min, bbx_max, depth, max_distance, inflate_obstacle_space, key))
+  {
+    std::cout << "[OccupancyMap::distanceMapFromOccupancyCached] occupancy tree does not match a hashed file, distance map is not cached." << std::endl;
+    return distanceMapFromOccupancy(bbx_min, bbx_max, depth, max_distance, inflate_obstacle_space);
+  }
+  
+  // Generate cache filename
+  std::stringstream cacheBasename;
+  cacheBasename << "distance_field_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+  std::string cacheFilename = utl::fullfile(cache_dirname, cacheBasename.str());
+  
+  // Try reading the distance field from cache
+  if (utl::isFile(cacheFilename) && readDistanceField(cacheFilename, key))
+    return true;
+  
+  // Otherwise construct it and write it to cache
+  if (!distanceMapFromOccupancy(bbx_min, bbx_max, depth, max_distance, inflate_obstacle_space) || !enterQueryMode())
+    return false;
+  
+  if (!writeDistanceField(cacheFilename, key))
+    std::cout << "[OccupancyMap::distanceMapFromOccupancyCached] could not write distance field to cache." << std::endl;
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::writeDistanceMap (const std::string &filename, const uint64_t key) const
+{
+  // Check that distance map was constructed
   if (!distanceMap_)
+  {
+    std::cout << "[OccupancyMap::writeDistanceMap] distance map was not constructed." << std::endl;
+    return false;
+  }
+  
+  DistanceMapFileHeader header;
+  header.key            = key;
+  header.resolution     = occupancyTree_.getResolution();
+  header.max_distance   = distanceMapMaxDist_;
+  header.tree_depth     = occupancyTree_.getTreeDepth();
+  header.depth          = depth_;
+  header.voxel_size     = dmVoxelSize_;
+  for (size_t axis = 0; axis < 3; axis++)
+  {
+    header.offset[axis]   = octToDmOffset_[axis];
+    header.bbx_min[axis]  = bbxMin_(axis);
+    header.bbx_max[axis]  = bbxMax_(axis);
+  }
+  
+  return DistanceMapFile::write(filename, header, boundingPlanes_, *distanceMap_, obstacleMap_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::readDistanceMap (const std::string &filename, const uint64_t key)
+{
+  // Delete distance map if it already exists
+  if (distanceMap_)
+  {
+    delete distanceMap_;
+    distanceMap_ = NULL;
+  }
+  obstacleMap_.clear();
+  occludedMap_.clear();
+  occlusionBitmap_.clear();
+  distanceField_.clear();
+  
+  if (!distanceMapFile_.open(filename))
+    return false;
+  
+  const DistanceMapFileHeader &header = distanceMapFile_.getHeader();
+  if (key != 0 && header.key != key)
+  {
+    std::cout << "[OccupancyMap::readDistanceMap] distance map file '" << filename << "' was constructed with different parameters." << std::endl;
+    distanceMapFile_.close();
+    return false;
+  }
+  
+  // Distance map keys are computed using the occupancy tree, make sure it has
+  // the same geometry as the one used to construct the distance map
+  if (occupancyTree_.size() == 0)
+    occupancyTree_.setResolution(header.resolution);
+  
+  if (occupancyTree_.getResolution() != header.resolution || occupancyTree_.getTreeDepth() != header.tree_depth)
+  {
+    std::cout << "[OccupancyMap::readDistanceMap] distance map file '" << filename << "' was constructed from an occupancy tree with different resolution or depth." << std::endl;
+    distanceMapFile_.close();
+    return false;
+  }
+  
+  distanceMapMaxDist_ = header.max_distance;
+  depth_              = header.depth;
+  dmVoxelSize_        = header.voxel_size;
+  octToDmOffset_      = octomap::OcTreeKey(header.offset[0], header.offset[1], header.offset[2]);
+  bbxMin_             = octomap::point3d(header.bbx_min[0], header.bbx_min[1], header.bbx_min[2]);
+  bbxMax_             = octomap::point3d(header.bbx_max[0], header.bbx_max[1], header.bbx_max[2]);
+  boundingPlanes_     = distanceMapFile_.getBoundingPlanes();
+  distanceMapFile_.getObstacleGrid(obstacleMap_);
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::writeDistanceField (const std::string &filename, const uint64_t key) const
+{
+  if (!isQueryMode())
+  {
+    std::cout << "[OccupancyMap::writeDistanceField] occupancy map is not in query mode." << std::endl;
+    return false;
+  }
+  
+  DistanceFieldFileHeader header;
+  header.key                    = key;
+  header.resolution             = occupancyTree_.getResolution();
+  header.max_distance           = distanceMapMaxDist_;
+  header.tree_depth             = occupancyTree_.getTreeDepth();
+  header.depth                  = depth_;
+  header.voxel_size             = dmVoxelSize_;
+  header.inflate_obstacle_space = inflateObstacleSpace_ ? 1 : 0;
+  header.baked_bounding_planes  = distanceFieldPlanes_ ? 1 : 0;
+  for (size_t axis = 0; axis < 3; axis++)
+  {
+    header.offset[axis]   = octToDmOffset_[axis];
+    header.bbx_min[axis]  = bbxMin_(axis);
+    header.bbx_max[axis]  = bbxMax_(axis);
+  }
+  
+  BitGrid obstacleBitmap;
+  if (!obstacleMap_.empty())
+    obstacleBitmap.assign(obstacleMap_.data(), obstacleMap_.getSizeX(), obstacleMap_.getSizeY(), obstacleMap_.getSizeZ());
+  
+  return DistanceFieldFile::write(filename, header, boundingPlanes_, distanceField_, occlusionBitmap_, obstacleBitmap);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::readDistanceField (const std::string &filename, const uint64_t key)
+{
+  DistanceFieldFileHeader header;
+  std::vector<Eigen::Vector4f> boundingPlanes;
+  DistanceField distanceField;
+  BitGrid occlusionBitmap, obstacleBitmap;
+  if (!DistanceFieldFile::read(filename, header, boundingPlanes, distanceField, occlusionBitmap, obstacleBitmap))
+    return false;
+  
+  if (key != 0 && header.key != key)
+  {
+    std::cout << "[OccupancyMap::readDistanceField] distance field file '" << filename << "' was constructed with different parameters." << std::endl;
+    return false;
+  }
+  
+  // Distance map keys are computed using the occupancy tree, make sure it has
+  // the same geometry as the one used to construct the distance field
+  if (occupancyTree_.size() == 0)
+    occupancyTree_.setResolution(header.resolution);
+  
+  if (occupancyTree_.getResolution() != header.resolution || occupancyTree_.getTreeDepth() != header.tree_depth)
+  {
+    std::cout << "[OccupancyMap::readDistanceField] distance field file '" << filename << "' was constructed from an occupancy tree with different resolution or depth." << std::endl;
+    return false;
+  }
+  
+  // Release the distance map
+  if (distanceMap_)
+  {
+    delete distanceMap_;
+    distanceMap_ = NULL;
+  }
+  distanceMapFile_.close();
+  occludedMap_.clear();
+  
+  distanceMapMaxDist_   = header.max_distance;
+  depth_                = header.depth;
+  dmVoxelSize_          = header.voxel_size;
+  inflateObstacleSpace_ = header.inflate_obstacle_space != 0;
+  distanceFieldPlanes_  = header.baked_bounding_planes != 0;
+  octToDmOffset_        = octomap::OcTreeKey(header.offset[0], header.offset[1], header.offset[2]);
+  bbxMin_               = octomap::point3d(header.bbx_min[0], header.bbx_min[1], header.bbx_min[2]);
+  bbxMax_               = octomap::point3d(header.bbx_max[0], header.bbx_max[1], header.bbx_max[2]);
+  boundingPlanes_.swap(boundingPlanes);
+  distanceField_.swap(distanceField);
+  occlusionBitmap_.swap(occlusionBitmap);
+  
+  obstacleMap_.clear();
+  if (!obstacleBitmap.empty())
+  {
+    obstacleMap_.resize(obstacleBitmap.getSizeX(), obstacleBitmap.getSizeY(), obstacleBitmap.getSizeZ());
+    #pragma omp parallel for
+    for (int dx = 0; dx < obstacleBitmap.getSizeX(); dx++)
+      for (int dy = 0; dy < obstacleBitmap.getSizeY(); dy++)
+        for (int dz = 0; dz < obstacleBitmap.getSizeZ(); dz++)
+          obstacleMap_.set(dx, dy, dz, obstacleBitmap.get(dx, dy, dz));
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::hasDistanceMap () const
+{
+  return distanceMap_ || distanceMapFile_.isOpen() || !distanceField_.empty();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+float OccupancyMap::getVoxelDistance (const octomap::OcTreeKey &key_dm) const
+{
+  return getVoxelDistance(key_dm[0], key_dm[1], key_dm[2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+float OccupancyMap::getVoxelDistance (const int dx, const int dy, const int dz) const
+{
+  if (distanceMap_)
+    return distanceMap_->getDistance(dx, dy, dz);
+  
+  if (distanceMapFile_.isOpen())
+    return distanceMapFile_.getDistance(dx, dy, dz);
+  
+  // Query mode
+  float distance = distanceField_.getDistance(dx, dy, dz);
+  if (distance < 0)
+    return distance;
+  
+  return distance / (occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+IntPoint3D OccupancyMap::getVoxelClosestObstacle (const octomap::OcTreeKey &key_dm) const
+{
+  if (distanceMap_)
+    return distanceMap_->getClosestObstacle(key_dm[0], key_dm[1], key_dm[2]);
+  
+  return distanceMapFile_.getClosestObstacle(key_dm[0], key_dm[1], key_dm[2]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::setBoundingPlanes (const std::vector<Eigen::Vector4f> &bounding_planes, const std::vector<float> &offsets)
+{
+  // Baked planes can't be re-baked once the distance map was released
+  if (isQueryMode() && hasBakedBoundingPlanes())
+  {
+    std::cout << "[OccupancyMap::setBoundingPlanes] bounding planes baked into the distance field can't be changed in query mode." << std::endl;
+    return false;
+  }
+  
+  if (offsets.size() == 0)
+  {
+    boundingPlanes_ = bounding_planes;
+  }
+  else if (bounding_planes.size() != offsets.size())
+  {
+    std::cout << "[OccupancyMap::setBoundingPlanes] bounding plane vector and offset vector have different sizes." << std::endl;
+    return false;
+  }
+  else
+  {
+    boundingPlanes_.resize(bounding_planes.size());
+    
+    for (size_t planeId = 0; planeId < offsets.size(); planeId++)
+    {
+      Eigen::Vector3f pTMP, nTMP;
+      utl::planeCoefficientsToPointNormal(bounding_planes[planeId], pTMP, nTMP);
+      pTMP += nTMP * offsets[planeId];
+      utl::pointNormalToPlaneCoefficients(pTMP, nTMP, boundingPlanes_[planeId]);
+    }
+  }
+  
+  if (hasBakedBoundingPlanes())
+    return bakeBoundingPlanes();
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::initializeDistanceField (DistanceField &distance_field, const int size[3]) const
+{
+  // Field must be able to store the largest distance of the distance transform
+  const float voxelSizeMetric = occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+  const float maxDistance = std::max(std::ceil(distanceMapMaxDist_ / voxelSizeMetric) * voxelSizeMetric, distanceMapMaxDist_);
+  distance_field.resize(size[0], size[1], size[2], maxDistance);
+  
+  // Voxel i covers occupancy tree keys [offset - voxel_size/2 + i * voxel_size, offset + voxel_size/2 + i * voxel_size)
+  const int treeMaxVal = 1 << (occupancyTree_.getTreeDepth() - 1);
+  Eigen::Vector3d worldToVoxelOffset;
+  for (size_t axis = 0; axis < 3; axis++)
+    worldToVoxelOffset[axis] = static_cast<double>(treeMaxVal - static_cast<int>(octToDmOffset_[axis]) + dmVoxelSize_ / 2) / static_cast<double>(dmVoxelSize_);
+  distance_field.setWorldToVoxel(1.0 / (static_cast<double>(occupancyTree_.getResolution()) * dmVoxelSize_), worldToVoxelOffset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::getGridSize (int size[3]) const
+{
+  if (obstacleMap_.empty())
+  {
+    size[0] = distanceField_.getSizeX();
+    size[1] = distanceField_.getSizeY();
+    size[2] = distanceField_.getSizeZ();
+  }
+  else
+  {
+    size[0] = obstacleMap_.getSizeX();
+    size[1] = obstacleMap_.getSizeY();
+    size[2] = obstacleMap_.getSizeZ();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::buildDistanceField (const bool bake_planes)
+{
+  // Check that distance map was initialized
+  if (!hasDistanceMap())
+  {
+    std::cout << "[OccupancyMap::buildDistanceField] distance map was not initialized." << std::endl;
+    return false;
+  }
+  
+  // In query mode the distance field is the only source of cell distances
+  if (!distanceMap_ && !distanceMapFile_.isOpen() && distanceFieldPlanes_)
+  {
+    std::cout << "[OccupancyMap::buildDistanceField] distance map was released in query mode, can't rebuild the distance field." << std::endl;
+    return false;
+  }
+  
+  int size[3];
+  getGridSize(size);
+  const int sizeX = size[0], sizeY = size[1], sizeZ = size[2];
+  const float voxelSizeMetric = occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+  const int B = DistanceField::BRICK_SIZE;
+  
+  DistanceField distanceField;
+  initializeDistanceField(distanceField, size);
+  const int numBricks[3] = {distanceField.getNumBricksX(), distanceField.getNumBricksY(), distanceField.getNumBricksZ()};
+  const int numBricksTotal = numBricks[0] * numBricks[1] * numBricks[2];
+  
+  #pragma omp parallel for schedule(dynamic)
+  for (int brickId = 0; brickId < numBricksTotal; brickId++)
+  {
+    const int bx = brickId / (numBricks[1] * numBricks[2]);
+    const int by = (brickId / numBricks[2]) % numBricks[1];
+    const int bz = brickId % numBricks[2];
+    float distances[DistanceField::BRICK_VOXELS];
+    
+    // Voxels of the bricks outside of the grid replicate the boundary voxels
+    for (int lx = 0; lx < B; lx++)
+    {
+      for (int ly = 0; ly < B; ly++)
+      {
+        for (int lz = 0; lz < B; lz++)
+        {
+          const int dx = std::min(bx * B + lx, sizeX - 1);
+          const int dy = std::min(by * B + ly, sizeY - 1);
+          const int dz = std::min(bz * B + lz, sizeZ - 1);
+          
+          float cellDistance = getVoxelDistance(dx, dy, dz);
+          cellDistance = cellDistance < 0 ? distanceMapMaxDist_ : cellDistance * voxelSizeMetric;
+          
+          // Bounding plane distance is evaluated at the voxel center
+          float planeDistance = 0.0f;
+          if (bake_planes)
+          {
+            octomap::point3d voxelCenter = occupancyTree_.keyToCoord(distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz)), depth_);
+            planeDistance = getPointBoundingPlaneMinSignedDistance(Eigen::Vector3f(voxelCenter.x(), voxelCenter.y(), voxelCenter.z()));
+            planeDistance = std::max(-planeDistance, 0.0f);
+          }
+          
+          distances[DistanceField::getBrickVoxelIndex(lx, ly, lz)] = std::max(cellDistance, planeDistance);
+        }
+      }
+    }
+    
+    distanceField.setBrick(bx, by, bz, distances);
+  }
+  
+  distanceField_.swap(distanceField);
+  distanceFieldPlanes_ = bake_planes;
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::bakeBoundingPlanes ()
+{
+  return buildDistanceField(true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::clearBakedBoundingPlanes ()
+{
+  if (!hasBakedBoundingPlanes())
+    return;
+  
+  if (isQueryMode())
+  {
+    std::cout << "[OccupancyMap::clearBakedBoundingPlanes] bounding planes can't be removed from the distance field in query mode." << std::endl;
+    return;
+  }
+  
+  distanceField_.clear();
+  distanceFieldPlanes_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::hasBakedBoundingPlanes () const
+{
+  return !distanceField_.empty() && distanceFieldPlanes_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::enterQueryMode ()
+{
+  if (isQueryMode())
+    return true;
+  
+  if (!hasDistanceMap())
+  {
+    std::cout << "[OccupancyMap::enterQueryMode] distance map was not initialized." << std::endl;
+    return false;
+  }
+  
+  // Snapshot the distance map unless baked bounding planes already did it
+  if (!hasBakedBoundingPlanes() && !buildDistanceField(false))
+    return false;
+  
+  if (distanceMap_)
+  {
+    delete distanceMap_;
+    distanceMap_ = NULL;
+  }
+  distanceMapFile_.close();
+  occludedMap_.clear();
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::isQueryMode () const
+{
+  return !distanceMap_ && !distanceMapFile_.isOpen() && !distanceField_.empty();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+float OccupancyMap::getPointBoundingPlaneMinSignedDistance(const Eigen::Vector3f& point) const
+{
+  // Check bounding planes first
+  float planeDistance = std::numeric_limits<float>::max();
+  
+  for (size_t planeId = 0; planeId < boundingPlanes_.size(); planeId++)
+    planeDistance = std::min(planeDistance, utl::pointToPlaneSignedDistance(point, boundingPlanes_[planeId]));
+  
+  return planeDistance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+float OccupancyMap::getNearestOccludedOccupiedDistance(const Eigen::Vector3f& point) const
+{
+  octomap::OcTreeKey key_dm = getDistanceMapKey(point);
+  float distance = getVoxelDistance(key_dm) * occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+  if (distance < 0)
+    return distanceMapMaxDist_;
+  
+  return distance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+float OccupancyMap::getNearestObstacleDistance(const Eigen::Vector3f& point) const
+{
+  UTL_PROFILE_COUNT(utl::PROFILE_OCCUPANCY_QUERIES, 1);
+  
+  // Check that distance map was initialized
+  if (!hasDistanceMap())
+  {
+    std::cout << "[OccupancyMap::getNearestObstacleDistance] distance map was not initialized." << std::endl;
+    return std::numeric_limits<float>::quiet_NaN();
+  }
+  
+  // Use baked distances if point falls inside the distance map
+  if (hasBakedBoundingPlanes())
+  {
+    float bakedDistance = distanceField_.getDistance(point);
+    if (bakedDistance >= 0)
+      return bakedDistance;
+  }
+
+  // Calculate distance to the occluded/occupied cell
+  float cellDistance = getNearestOccludedOccupiedDistance(point);
+  
+  // Calculate distance to the bounding planes
+  float planeDistance = getPointBoundingPlaneMinSignedDistance(point);
+  planeDistance = std::max(-planeDistance, 0.0f);
+    
+  // Otherwise return cell distance
+  return std::max(cellDistance, planeDistance);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::getNearestObstacleDistances (const float *xyz, const size_t num_points, float *distances) const
+{
+  UTL_PROFILE_COUNT(utl::PROFILE_OCCUPANCY_QUERIES, num_points);
+  
+  // Check that distance map was initialized
+  if (!hasDistanceMap())
+  {
+    std::cout << "[OccupancyMap::getNearestObstacleDistances] distance map was not initialized." << std::endl;
+    for (size_t pointId = 0; pointId < num_points; pointId++)
+      distances[pointId] = std::numeric_limits<float>::quiet_NaN();
+    return false;
+  }
+  
+  if (num_points == 0)
+    return true;
+  
+  //----------------------------------------------------------------------------
+  // Precompute conversion constants
+  //----------------------------------------------------------------------------
+  
+  // Occupancy tree keys are computed as floor(coordinate / resolution) + 
+  // tree_max_val (same as octomap::OcTree::coordToKey). Distance map voxel i
+  // covers occupancy tree keys [offset - voxel_size/2 + i * voxel_size, offset + voxel_size/2 + i * voxel_size).
+  const double resolutionFactor = 1.0 / occupancyTree_.getResolution();
+  const int treeMaxVal = 1 << (occupancyTree_.getTreeDepth() - 1);
+  Eigen::Array3d keyToVoxelOffset;
+  for (size_t axis = 0; axis < 3; axis++)
+    keyToVoxelOffset[axis] = static_cast<double>(treeMaxVal - (static_cast<int>(octToDmOffset_[axis]) - dmVoxelSize_ / 2));
+  const double voxelSizeInv = 1.0 / static_cast<double>(dmVoxelSize_);
+  const float voxelSizeMetric = occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+
+  // Normalize bounding planes so that signed distance is a dot product
+  Eigen::Matrix<float, Eigen::Dynamic, 4> planes (boundingPlanes_.size(), 4);
+  for (size_t planeId = 0; planeId < boundingPlanes_.size(); planeId++)
+    planes.row(planeId) = boundingPlanes_[planeId].transpose() / boundingPlanes_[planeId].head(3).norm();
+  
+  //----------------------------------------------------------------------------
+  // Process points in blocks
+  //----------------------------------------------------------------------------
+  
+  const size_t blockSize = 256;
+  const bool bakedPlanes = hasBakedBoundingPlanes();
+  Eigen::Array<int, 3, Eigen::Dynamic> voxels (3, blockSize);
+  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> planeDistances (planes.rows(), blockSize);
+  
+  for (size_t blockStart = 0; blockStart < num_points; blockStart += blockSize)
+  {
+    const size_t curBlockSize = std::min(blockSize, num_points - blockStart);
+    Eigen::Map<const Eigen::Matrix<float, 3, Eigen::Dynamic> > points (xyz + 3 * blockStart, 3, curBlockSize);
+    
+    // Distance map voxels
+    voxels.leftCols(curBlockSize) = (((points.cast<double>().array() * resolutionFactor).floor().colwise() + keyToVoxelOffset) * voxelSizeInv).floor().cast<int>();
+
+    // Baked distances only need a lookup
+    if (bakedPlanes)
+    {
+      for (size_t pointIdIt = 0; pointIdIt < curBlockSize; pointIdIt++)
+      {
+        float bakedDistance = distanceField_.getDistance(voxels(0, pointIdIt), voxels(1, pointIdIt), voxels(2, pointIdIt));
+        if (bakedDistance < 0)
+          bakedDistance = std::max(distanceMapMaxDist_, std::max(-getPointBoundingPlaneMinSignedDistance(points.col(pointIdIt)), 0.0f));
+        
+        distances[blockStart + pointIdIt] = bakedDistance;
+      }
+      continue;
+    }
+    
+    // Signed distances to the bounding planes
+    if (planes.rows() > 0)
+      planeDistances.leftCols(curBlockSize) = (planes.leftCols(3) * points).colwise() + planes.col(3);
+    
+    for (size_t pointIdIt = 0; pointIdIt < curBlockSize; pointIdIt++)
+    {
+      // Distance to the occluded/occupied cell
+      float cellDistance = getVoxelDistance(voxels(0, pointIdIt), voxels(1, pointIdIt), voxels(2, pointIdIt));
+      if (cellDistance < 0)
+        cellDistance = distanceMapMaxDist_;
+      else
+        cellDistance *= voxelSizeMetric;
+      
+      // Distance to the bounding planes
+      float planeDistance = 0.0f;
+      if (planes.rows() > 0)
+        planeDistance = std::max(-planeDistances.col(pointIdIt).minCoeff(), 0.0f);
+      
+      distances[blockStart + pointIdIt] = std::max(cellDistance, planeDistance);
+    }
+  }
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::getNearestObstacleDistances (const Eigen::Matrix3Xf &points, std::vector<float> &distances) const
+{
+  distances.resize(points.cols());
+  if (points.cols() == 0)
+    return hasDistanceMap();
+  
+  return getNearestObstacleDistances(points.data(), points.cols(), &distances[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+Eigen::Vector3f OccupancyMap::getNearestObstacle(const Eigen::Vector3f& point) const
+{
+  // Check that distance map was initialized
+  if (!hasDistanceMap())
+  {
+    std::cout << "[OccupancyMap::getNearestObstacle] distance map was not initialized." << std::endl;
+    return Eigen::Vector3f::Ones() * std::numeric_limits<float>::quiet_NaN();
+  }
+  
+  // Closest obstacle voxels are not stored in the distance field
+  if (isQueryMode())
+  {
+    std::cout << "[OccupancyMap::getNearestObstacle] nearest obstacle is not available in query mode." << std::endl;
+    return Eigen::Vector3f::Ones() * std::numeric_limits<float>::quiet_NaN();
+  }
+  
+  // Get the distance to the nearest bounding plane
+  float planeDistance = 0;
+  float nearestPlaneId = 0;
+  for (size_t planeId = 0; planeId < boundingPlanes_.size(); planeId++)
+  {
+    float curDistance = utl::pointToPlaneSignedDistance(point, boundingPlanes_[planeId]);
+    if (curDistance < planeDistance)
+    {
+      planeDistance = curDistance;
+      nearestPlaneId = planeId;
+    }
+  }
+  planeDistance = std::abs(planeDistance);
+  
+  // Get the distance to the nearest occluded/occupied cell
+  octomap::OcTreeKey key_dm = getDistanceMapKey(point);
+  float cellDistance = getVoxelDistance(key_dm) * occupancyTree_.getResolution() * static_cast<float>(dmVoxelSize_);
+
+  // Get the closest point
+  Eigen::Vector3f nearestPoint;
+  if (cellDistance > planeDistance)
+  {
+    IntPoint3D closest_point_dm = getVoxelClosestObstacle(key_dm);
+    octomap::OcTreeKey closest_key_dm(closest_point_dm.x, closest_point_dm.y, closest_point_dm.z);
+    octomap::OcTreeKey closest_key_oct = distanceMapKeyToOccupancyTreeKey(closest_key_dm);
+    octomap::point3d closestPoint_oct = occupancyTree_.keyToCoord(closest_key_oct, depth_);    
+    nearestPoint = Eigen::Vector3f (closestPoint_oct.x(), closestPoint_oct.y(), closestPoint_oct.z());
+  }
+  else
+  {
+    nearestPoint = utl::projectPointToPlane<float>(point, boundingPlanes_[nearestPlaneId]);
+  }
+  
+  return nearestPoint;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::isPointOccluded(const Eigen::Vector3f& point) const
+{
+  UTL_PROFILE_COUNT(utl::PROFILE_OCCUPANCY_QUERIES, 1);
+  
+  // Check that distance map was initialized
+  if (!hasDistanceMap())
   {
     std::cout << "[OccupancyMap::getPointDistance] distance map was not initialized." << std::endl;
     return std::numeric_limits<float>::quiet_NaN();
   }
   
+  return isPointOccludedUnchecked(point);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::arePointsOccluded (const Eigen::Matrix3Xf &points, std::vector<bool> &occluded) const
+{
+  UTL_PROFILE_COUNT(utl::PROFILE_OCCUPANCY_QUERIES, points.cols());
+  
+  // Check that distance map was initialized
+  if (!hasDistanceMap())
+  {
+    std::cout << "[OccupancyMap::arePointsOccluded] distance map was not initialized." << std::endl;
+    occluded.assign(points.cols(), false);
+    return false;
+  }
+  
+  occluded.resize(points.cols());
+  for (int pointId = 0; pointId < points.cols(); pointId++)
+    occluded[pointId] = isPointOccludedUnchecked(points.col(pointId));
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::isPointOccludedUnchecked (const Eigen::Vector3f &point) const
+{
+  // Distance map voxels have the same keys as the occupancy tree nodes at the
+  // distance map depth
   octomap::OcTreeKey key = getOccupanyTreeKey(point);
+  if (!occlusionBitmap_.empty())
+  {
+    int voxel[3];
+    for (size_t axis = 0; axis < 3; axis++)
+      voxel[axis] = static_cast<int>(std::floor(static_cast<double>(static_cast<int>(key[axis]) - static_cast<int>(octToDmOffset_[axis]) + dmVoxelSize_ / 2) / dmVoxelSize_));
+    
+    if (occlusionBitmap_.isInside(voxel[0], voxel[1], voxel[2]))
+      return occlusionBitmap_.get(voxel[0], voxel[1], voxel[2]);
+  }
+  
   octomap::OcTreeNode *node = occupancyTree_.search(key, depth_);
   return !node;
 }
@@ -653,7 +2283,7 @@ bool OccupancyMap::isPointOccluded(const Eigen::Vector3f& point) const
 bool OccupancyMap::getOccludedSpaceBoundaryMesh (pcl::PointCloud<pcl::PointXYZ> &vertices, std::vector<pcl::Vertices> &polygons) const
 {
   // Check that grid map was initialized
-  if (!obstacleMap_ || occupancyTree_.getTreeDepth() == 0)
+  if ((obstacleMap_.empty() && distanceField_.empty()) || occupancyTree_.getTreeDepth() == 0)
   {
     std::cout << "[OccupancyMap::getOccludedSpaceBoundaryMesh] either occupancy tree or distance map have not been initialized." << std::endl;
     return false;
@@ -667,42 +2297,27 @@ bool OccupancyMap::getOccludedSpaceBoundaryMesh (pcl::PointCloud<pcl::PointXYZ>
 
   // Get a list of voxel neigbors on the boundary
   std::vector<std::pair<octomap::point3d, int> > voxelNeighborList;
-  std::mutex voxelNeighborListMutex;
-  const std::vector<std::vector<int> > voxelNeighborhood = createVoxelNeighborhood6();
-  
-  #pragma omp parallel for
-  for(int dx=1; dx<distanceMap_->getSizeX()-1; dx++)
+  if (!occlusionBitmap_.empty())
   {
-    for(int dy=1; dy<distanceMap_->getSizeY()-1; dy++)
-    {
-      for(int dz=1; dz<distanceMap_->getSizeZ()-1; dz++)
-      {
-        // Check if this is an occluded voxel
-        octomap::OcTreeKey oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz));
-        octomap::OcTreeNode *node = occupancyTree_.search(oct_key, depth_);
-        if (!node)
-        {
-          // Add polygons for each neighbor voxel that doesn't belong to the occluded space
-          for (size_t nbrId = 0; nbrId < voxelNeighborhood.size(); nbrId++)
-          {
-            int nbrDx = dx + voxelNeighborhood[nbrId][0];
-            int nbrDy = dy + voxelNeighborhood[nbrId][1];
-            int nbrDz = dz + voxelNeighborhood[nbrId][2];
-            
-            octomap::OcTreeKey nbr_oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(nbrDx, nbrDy, nbrDz));
-            octomap::OcTreeNode *nbr_node = occupancyTree_.search(nbr_oct_key, depth_);
-            octomap::point3d pointOct = occupancyTree_.keyToCoord(oct_key, depth_);
-            
-            if (nbr_node)
-            {
-              voxelNeighborListMutex.lock();
-              voxelNeighborList.push_back(std::make_pair(pointOct, nbrId));
-              voxelNeighborListMutex.unlock();
-            }
-          }
-        }
-      }
-    }
+    getGridBoundaryFaces(occlusionBitmap_, voxelNeighborList);
+  }
+  else
+  {
+    // Distance maps read from a file and distance fields constructed directly
+    // from the occupancy tree don't store occlusion, look it up in the tree
+    int size[3];
+    getGridSize(size);
+    const int sizeX = size[0], sizeY = size[1], sizeZ = size[2];
+    ObstacleGrid occludedMap;
+    occludedMap.resize(sizeX, sizeY, sizeZ);
+    
+    #pragma omp parallel for
+    for (int dx = 0; dx < sizeX; dx++)
+      for (int dy = 0; dy < sizeY; dy++)
+        for (int dz = 0; dz < sizeZ; dz++)
+          occludedMap.set(dx, dy, dz, isVoxelOccluded(dx, dy, dz));
+    
+    getGridBoundaryFaces(occludedMap, voxelNeighborList);
   }
     
   // Generate mesh
@@ -744,7 +2359,7 @@ bool OccupancyMap::getOccludedSpaceBoundaryMesh (pcl::PointCloud<pcl::PointXYZ>
 bool OccupancyMap::getObstacleSpaceBoundaryMesh (pcl::PointCloud<pcl::PointXYZ> &vertices, std::vector<pcl::Vertices> &polygons) const
 {
   // Check that obstacle map was initialized
-  if (!obstacleMap_ || occupancyTree_.getTreeDepth() == 0)
+  if (obstacleMap_.empty() || occupancyTree_.getTreeDepth() == 0)
   {
     std::cout << "[OccupancyMap::getOccludedOccupiedSpaceCloud] either occupancy tree or distance map have not been initialized." << std::endl;
     return false;
@@ -758,36 +2373,7 @@ bool OccupancyMap::getObstacleSpaceBoundaryMesh (pcl::PointCloud<pcl::PointXYZ>
   
   // Get a list of voxel neigbors on the boundary
   std::vector<std::pair<octomap::point3d, int> > voxelNeighborList;
-  std::mutex voxelNeighborListMutex;
-  const std::vector<std::vector<int> > voxelNeighborhood = createVoxelNeighborhood6();
-  
-  #pragma omp parallel for
-  for(size_t dx=1; dx<distanceMap_->getSizeX()-1; dx++) {
-    for(size_t dy=1; dy<distanceMap_->getSizeY()-1; dy++) {
-      for(size_t dz=1; dz<distanceMap_->getSizeZ()-1; dz++) {
-        if (obstacleMap_[dx][dy][dz])
-        {
-          octomap::OcTreeKey oct_key = distanceMapKeyToOccupancyTreeKey(octomap::OcTreeKey(dx, dy, dz));
-          octomap::point3d pointOct = occupancyTree_.keyToCoord(oct_key, depth_);
-          
-          // Add polygons for each neighbor voxel that doesn't belong to the occluded space
-          for (size_t nbrId = 0; nbrId < voxelNeighborhood.size(); nbrId++)
-          {
-            int nbrDx = dx + voxelNeighborhood[nbrId][0];
-            int nbrDy = dy + voxelNeighborhood[nbrId][1];
-            int nbrDz = dz + voxelNeighborhood[nbrId][2];
-            
-            if (!obstacleMap_[nbrDx][nbrDy][nbrDz])
-            {
-              voxelNeighborListMutex.lock();
-              voxelNeighborList.push_back(std::make_pair(pointOct, nbrId));
-              voxelNeighborListMutex.unlock();
-            }
-          }
-        }
-      }
-    }
-  }
+  getGridBoundaryFaces(obstacleMap_, voxelNeighborList);
   
   // Generate mesh
   generateVoxelBoundaryMesh(voxelNeighborList, vertices, polygons);
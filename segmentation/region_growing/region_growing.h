@@ -18,6 +18,33 @@ namespace utl
   typedef std::vector<pcl::PointIndices> IndicesClusters;
   typedef boost::shared_ptr<std::vector<pcl::PointIndices> > IndicesClustersPtr;
 
+  /** \brief @b RegionGrowingNeighborhood Precomputed neighbors of the points
+   * of a cloud. Neighbors of a point are stored in the same order as returned
+   * by the search, i.e. the query point itself comes first. Neighbors of point
+   * i are stored in positions [offsets_[i], offsets_[i+1]) of the neighbor
+   * arrays. Optional per neighbor attributes are stored in the same positions.
+   * A neighborhood is only read by region growing, so it can be shared by
+   * several region growing instances running in parallel.
+   */
+  struct RegionGrowingNeighborhood
+  {
+    typedef boost::shared_ptr<RegionGrowingNeighborhood> Ptr;
+    typedef boost::shared_ptr<const RegionGrowingNeighborhood> ConstPtr;
+
+    /** \brief Position of the first neighbor of every point of the cloud, followed by the total number of neighbors. */
+    std::vector<int>    offsets_;
+
+    /** \brief Neighbor indices and their squared distances to the query point. */
+    std::vector<int>    neighbors_;
+    std::vector<float>  distances_;
+
+    /** \brief Angles between the normals of the query point and the neighbors (empty if not computed). */
+    std::vector<float>  normal_angles_;
+
+    /** \brief Flag indicating whether normal angles were computed assuming consistently oriented normals. */
+    bool normals_consistently_oriented_;
+  };
+
   /** \brief @b RegionGrowing Performs region growing segmentation on a
    * pointcloud using a user-defined condition function.
    * 
@@ -128,6 +155,39 @@ namespace utl
       inline int
       getMaxSegmentSize () const;
             
+      /** \brief Precompute the neighbors of all input points with the current
+       * search parameters. The result can be passed to every region growing
+       * instance with the same input cloud, indices and search parameters.
+       * \param[out] neighborhood  neighbors of the input points
+       * \return false if neighbors could not be computed
+       */
+      bool
+      computeNeighborhood (utl::RegionGrowingNeighborhood &neighborhood);
+
+      /** \brief Use precomputed neighbors instead of searching for them during
+       * segmentation. Pass an empty pointer to search for neighbors again.
+       * \param[in] neighborhood  neighbors of the input points
+       */
+      inline void
+      setNeighborhood (const utl::RegionGrowingNeighborhood::ConstPtr &neighborhood);
+
+      /** \brief Set if segmentation runs in parallel. Parallel mode evaluates the
+       * unary and binary conditions of all neighbor pairs in parallel and
+       * merges the accepted pairs with a concurrent union-find. It requires a
+       * symmetric binary condition, a radius search without a neighbor limit
+       * and zero neighbor fractions, so that segments do not depend on the
+       * order in which points are visited. Segments are then the same as in
+       * serial mode and are returned in the same order, but the points of a
+       * segment are in the order of the input indices. Otherwise segmentation
+       * falls back to serial mode.
+       */
+      inline void
+      setParallel (const bool parallel);
+
+      /** \brief Check if segmentation runs in parallel. */
+      inline bool
+      getParallel () const;
+
       /** \brief Segment the pointcloud.
        * \param[out] segments  a vector of segments where each segment is represented by the indices of points belonging to it
        */
@@ -136,6 +196,18 @@ namespace utl
 
     protected:
       
+      /** \brief Check the binary condition between a point and its neighbor.
+       * \param[in] point_id      index of the point
+       * \param[in] neighbor_id   index of the neighbor
+       * \param[in] dist_squared  squared distance between the points
+       * \param[in] neighbor_pos  position of the neighbor in the precomputed neighborhood (-1 if neighbors were searched)
+       */
+      virtual bool
+      binaryCondition (const int point_id, const int neighbor_id, const float dist_squared, const int neighbor_pos) const;
+
+      /** \brief Precomputed neighbors of the input points (if any). */
+      utl::RegionGrowingNeighborhood::ConstPtr neighborhood_;
+      
       /** \brief This method simply checks if it is possible to execute the segmentation algorithm with
        * the current settings. If it is possible then it returns true.
        */
@@ -143,6 +215,30 @@ namespace utl
       prepareForSegmentation ();
       
     private:
+      
+      /** \brief Create the search object if it does not exist and set its input. */
+      void
+      initSearcher ();
+
+      /** \brief Search for the neighbors of a point with the current search parameters.
+       * \param[in]  point_id      index of the point
+       * \param[out] nn_indices    neighbor indices
+       * \param[out] nn_distances  squared neighbor distances
+       * \return number of neighbors found
+       */
+      int
+      searchNeighbors (const int point_id, std::vector<int> &nn_indices, std::vector<float> &nn_distances) const;
+
+      /** \brief Search for the neighbors of all input points in parallel.
+       * \param[out] neighborhood  neighbors of the input points
+       */
+      void
+      searchAllNeighbors (utl::RegionGrowingNeighborhood &neighborhood) const;
+
+      /** \brief Segment the pointcloud with a concurrent union-find. */
+      void
+      segmentParallel (std::vector<std::vector<int> > &segments);
+
       /** \brief A pointer to the spatial search object */
       SearcherPtr searcher_;
 
@@ -170,6 +266,9 @@ namespace utl
       /** \brief The maximum cluster size (default = unlimited) */
       int max_cluster_size_;
 
+      /** \brief Flag indicating whether segmentation runs in parallel (default = false) */
+      bool parallel_;
+
     public:
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
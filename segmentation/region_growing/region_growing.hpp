@@ -43,6 +43,9 @@
 
 #include "region_growing.h"
 
+// Utilities includes
+#include <graph/graph_algorithms.hpp>
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 utl::RegionGrowing<PointT>::RegionGrowing () :
@@ -54,7 +57,8 @@ utl::RegionGrowing<PointT>::RegionGrowing () :
     min_valid_unary_neighbor_fraction_ (0.0),
     min_valid_binary_neighbor_fraction_ (0.0),
     min_cluster_size_ (1),
-    max_cluster_size_ (std::numeric_limits<int>::max ())
+    max_cluster_size_ (std::numeric_limits<int>::max ()),
+    parallel_ (false)
 {
 }
       
@@ -211,6 +215,109 @@ utl::RegionGrowing<PointT>::getMaxSegmentSize () const
   return max_cluster_size_;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline void
+utl::RegionGrowing<PointT>::setNeighborhood (const utl::RegionGrowingNeighborhood::ConstPtr &neighborhood)
+{
+  neighborhood_ = neighborhood;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline void
+utl::RegionGrowing<PointT>::initSearcher ()
+{
+  if (!searcher_)
+  {
+    if (input_->isOrganized ())
+      searcher_.reset (new pcl::search::OrganizedNeighbor<PointT> ());
+    else
+      searcher_.reset (new pcl::search::KdTree<PointT> ());
+  }
+  searcher_->setInputCloud (input_, indices_);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline int
+utl::RegionGrowing<PointT>::searchNeighbors (const int point_id, std::vector<int> &nn_indices, std::vector<float> &nn_distances) const
+{
+  if (search_radius_ > 0 && num_neighbors_ > 0)
+    return searcher_->radiusSearch (input_->points[point_id], search_radius_, nn_indices, nn_distances, num_neighbors_+1);
+  else if (search_radius_ > 0 && num_neighbors_ == 0)
+    return searcher_->radiusSearch (input_->points[point_id], search_radius_, nn_indices, nn_distances);
+  else if (search_radius_ == 0 && num_neighbors_ > 0)
+    return searcher_->nearestKSearch (input_->points[point_id], num_neighbors_+1, nn_indices, nn_distances);
+
+  std::cout << "[utl::RegionGrowing::searchNeighbors] unknown combination of search radius and number of neighbors." << std::endl;
+  abort();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline bool
+utl::RegionGrowing<PointT>::binaryCondition (const int point_id, const int neighbor_id, const float dist_squared, const int neighbor_pos) const
+{
+  return binary_condition_function_ (input_->points[point_id], input_->points[neighbor_id], dist_squared);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline bool
+utl::RegionGrowing<PointT>::computeNeighborhood (utl::RegionGrowingNeighborhood &neighborhood)
+{
+  if (!initCompute () || !prepareForSegmentation ())
+  {
+    std::cout << "[utl::RegionGrowing::computeNeighborhood] could not initialize neighbor search." << std::endl;
+    deinitCompute ();
+    return false;
+  }
+  
+  initSearcher ();
+  searchAllNeighbors (neighborhood);
+  
+  deinitCompute ();
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline void
+utl::RegionGrowing<PointT>::searchAllNeighbors (utl::RegionGrowingNeighborhood &neighborhood) const
+{
+  // Search neighbors of all indexed points in parallel
+  std::vector<std::vector<int> > pointNeighbors (indices_->size ());
+  std::vector<std::vector<float> > pointDistances (indices_->size ());
+  
+  #pragma omp parallel for schedule(dynamic, 256)
+  for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii)
+  {
+    if ((*indices_)[iii] != -1)
+      searchNeighbors ((*indices_)[iii], pointNeighbors[iii], pointDistances[iii]);
+  }
+  
+  // Store neighbors in input point order
+  std::vector<int> pointIndexIds (input_->size (), -1);
+  for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii)
+    if ((*indices_)[iii] != -1)
+      pointIndexIds[(*indices_)[iii]] = iii;
+  
+  neighborhood.offsets_.assign (input_->size () + 1, 0);
+  for (size_t pointId = 0; pointId < input_->size (); pointId++)
+  {
+    int numNeighbors = pointIndexIds[pointId] == -1 ? 0 : pointNeighbors[pointIndexIds[pointId]].size ();
+    neighborhood.offsets_[pointId + 1] = neighborhood.offsets_[pointId] + numNeighbors;
+  }
+  
+  neighborhood.neighbors_.resize (neighborhood.offsets_.back ());
+  neighborhood.distances_.resize (neighborhood.offsets_.back ());
+  for (size_t pointId = 0; pointId < input_->size (); pointId++)
+  {
+    if (pointIndexIds[pointId] == -1)
+      continue;
+    
+    std::copy (pointNeighbors[pointIndexIds[pointId]].begin (), pointNeighbors[pointIndexIds[pointId]].end (), neighborhood.neighbors_.begin () + neighborhood.offsets_[pointId]);
+    std::copy (pointDistances[pointIndexIds[pointId]].begin (), pointDistances[pointIndexIds[pointId]].end (), neighborhood.distances_.begin () + neighborhood.offsets_[pointId]);
+  }
+  neighborhood.normal_angles_.clear ();
+  neighborhood.normals_consistently_oriented_ = false;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 template<typename PointT> inline void
 utl::RegionGrowing<PointT>::segment (std::vector<std::vector<int> > &segments)
@@ -235,15 +342,21 @@ utl::RegionGrowing<PointT>::segment (std::vector<std::vector<int> > &segments)
   // Prepare output (going to use push_back)
   segments.clear ();
 
-  // Initialize the search class
-  if (!searcher_)
+  if (parallel_)
   {
-    if (input_->isOrganized ())
-      searcher_.reset (new pcl::search::OrganizedNeighbor<PointT> ());
-    else
-      searcher_.reset (new pcl::search::KdTree<PointT> ());
+    if (min_valid_unary_neighbor_fraction_ == 0.0f && min_valid_binary_neighbor_fraction_ == 0.0f && num_neighbors_ == 0)
+    {
+      segmentParallel (segments);
+      deinitCompute ();
+      return;
+    }
+    
+    std::cout << "[utl::RegionGrowing::segment] parallel mode requires zero neighbor fractions and a radius search without a neighbor limit, segmenting serially." << std::endl;
   }
-  searcher_->setInputCloud (input_, indices_);  
+  
+  // Initialize the search class. Precomputed neighbors make it unnecessary
+  if (!neighborhood_)
+    initSearcher ();
   
   // Temp variables used by search class
   std::vector<int> nn_indices (num_neighbors_+1);
@@ -274,20 +387,26 @@ utl::RegionGrowing<PointT>::segment (std::vector<std::vector<int> > &segments)
     // Process the current cluster (it can be growing in size as it is being processed)
     while (cii < static_cast<int> (current_cluster.size ()))
     {
-      // Search for neighbors around the current seed point of the current cluster
-      int num_neighbors_found;
-      if (search_radius_ > 0 && num_neighbors_ > 0)
-        num_neighbors_found = searcher_->radiusSearch (input_->points[current_cluster[cii]], search_radius_, nn_indices, nn_distances, num_neighbors_+1);
-      else if (search_radius_ > 0 && num_neighbors_ == 0)
-        num_neighbors_found = searcher_->radiusSearch (input_->points[current_cluster[cii]], search_radius_, nn_indices, nn_distances);
-      else if (search_radius_ == 0 && num_neighbors_ > 0)
-        num_neighbors_found = searcher_->nearestKSearch (input_->points[current_cluster[cii]], num_neighbors_+1, nn_indices, nn_distances);
+      // Get the neighbors of the current seed point of the current cluster
+      const int *nbrIndices, *nbrIndicesEnd;
+      const float *nbrDistances;
+      int nbrOffset = -1;
+      if (neighborhood_)
+      {
+        nbrOffset = neighborhood_->offsets_[current_cluster[cii]];
+        nbrIndices = neighborhood_->neighbors_.data () + nbrOffset;
+        nbrIndicesEnd = neighborhood_->neighbors_.data () + neighborhood_->offsets_[current_cluster[cii] + 1];
+        nbrDistances = neighborhood_->distances_.data () + nbrOffset;
+      }
       else
       {
-        std::cout << "[utl::RegionGrowing::segment] unknown combination of search radius and number of neighbors." << std::endl;
-        abort();
+        searchNeighbors (current_cluster[cii], nn_indices, nn_distances);
+        nbrIndices = nn_indices.data ();
+        nbrIndicesEnd = nn_indices.data () + nn_indices.size ();
+        nbrDistances = nn_distances.data ();
       }
       
+      const int num_neighbors_found = nbrIndicesEnd - nbrIndices;
       if (num_neighbors_found < 1)
       {
         cii++;
@@ -299,24 +418,24 @@ utl::RegionGrowing<PointT>::segment (std::vector<std::vector<int> > &segments)
       int numUnprocessed = 0;
       int numValidUnary = 0;
       int numValidBinary = 0;      
-      for (int nii = 1; nii < static_cast<int> (nn_indices.size ()); ++nii)  // nii = neighbor indices iterator
+      for (int nii = 1; nii < num_neighbors_found; ++nii)  // nii = neighbor indices iterator
       {
         // If this point has already been processed - ignore it
-        if (nn_indices[nii] == -1 || processed[nn_indices[nii]])
+        if (nbrIndices[nii] == -1 || processed[nbrIndices[nii]])
           continue;
         numUnprocessed++;
         
         //  If this point does not satisfy unary constraint - ignore it
-        if (unary_condition_function_ && !unary_condition_function_(input_->points[nn_indices[nii]]))
+        if (unary_condition_function_ && !unary_condition_function_(input_->points[nbrIndices[nii]]))
           continue;
         numValidUnary++;
         
         // If binary condition exists and is not satisfied - ignore this neighbor
-        if (  binary_condition_function_ && !binary_condition_function_ (input_->points[current_cluster[cii]], input_->points[nn_indices[nii]], nn_distances[nii]))
+        if (  binary_condition_function_ && !binaryCondition (current_cluster[cii], nbrIndices[nii], nbrDistances[nii], nbrOffset == -1 ? -1 : nbrOffset + nii))
           continue;
         numValidBinary++;
         
-        valid_point_indices.push_back(nn_indices[nii]);
+        valid_point_indices.push_back(nbrIndices[nii]);
       }
       
       float validUnaryFraction = static_cast<float>(numValidUnary) / static_cast<float>(numUnprocessed);
@@ -341,6 +460,101 @@ utl::RegionGrowing<PointT>::segment (std::vector<std::vector<int> > &segments)
   deinitCompute ();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline void
+utl::RegionGrowing<PointT>::setParallel (const bool parallel)
+{
+  parallel_ = parallel;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline bool
+utl::RegionGrowing<PointT>::getParallel () const
+{
+  return parallel_;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template<typename PointT> inline void
+utl::RegionGrowing<PointT>::segmentParallel (std::vector<std::vector<int> > &segments)
+{
+  // Get the neighbors of all points
+  utl::RegionGrowingNeighborhood::ConstPtr neighborhood = neighborhood_;
+  if (!neighborhood)
+  {
+    initSearcher ();
+    utl::RegionGrowingNeighborhood::Ptr neighborhoodSearched (new utl::RegionGrowingNeighborhood);
+    searchAllNeighbors (*neighborhoodSearched);
+    neighborhood = neighborhoodSearched;
+  }
+  
+  // Find the points that satisfy the unary condition
+  std::vector<char> valid (input_->points.size (), 0);
+  
+  #pragma omp parallel for
+  for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii)
+  {
+    const int pointId = (*indices_)[iii];
+    if (pointId != -1)
+      valid[pointId] = !unary_condition_function_ || unary_condition_function_ (input_->points[pointId]);
+  }
+  
+  // Merge the points of every edge that satisfies the binary condition
+  std::vector<std::atomic<int> > parents (input_->points.size ());
+  for (size_t pointId = 0; pointId < input_->points.size (); pointId++)
+    parents[pointId].store (pointId, std::memory_order_relaxed);
+  
+  #pragma omp parallel for schedule(dynamic, 256)
+  for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii)
+  {
+    const int pointId = (*indices_)[iii];
+    if (pointId == -1 || !valid[pointId])
+      continue;
+    
+    // The first neighbor is the point itself
+    for (int nbrPos = neighborhood->offsets_[pointId] + 1; nbrPos < neighborhood->offsets_[pointId + 1]; nbrPos++)
+    {
+      const int nbrId = neighborhood->neighbors_[nbrPos];
+      if (nbrId == -1 || nbrId <= pointId || !valid[nbrId])
+        continue;
+      
+      // Precomputed neighbor attributes can only be used with the precomputed neighborhood
+      if (  binary_condition_function_ && !binaryCondition (pointId, nbrId, neighborhood->distances_[nbrPos], neighborhood_ ? nbrPos : -1))
+        continue;
+      
+      utl::unionFindLink (parents, pointId, nbrId);
+    }
+  }
+  
+  // Collect segments in the order in which the serial mode seeds them: by the
+  // position of their first point in the input indices
+  std::vector<int> rootSegIds (input_->points.size (), -1);
+  std::vector<std::vector<int> > segmentsAll;
+  for (int iii = 0; iii < static_cast<int> (indices_->size ()); ++iii)
+  {
+    const int pointId = (*indices_)[iii];
+    if (pointId == -1 || !valid[pointId])
+      continue;
+    
+    const int rootId = utl::unionFindRoot (parents, pointId);
+    if (rootSegIds[rootId] == -1)
+    {
+      rootSegIds[rootId] = segmentsAll.size ();
+      segmentsAll.push_back (std::vector<int> ());
+    }
+    segmentsAll[rootSegIds[rootId]].push_back (pointId);
+  }
+  
+  for (size_t segId = 0; segId < segmentsAll.size (); segId++)
+  {
+    if (segmentsAll[segId].size () >= min_cluster_size_ && segmentsAll[segId].size () <= max_cluster_size_)
+    {
+      segments.push_back (std::vector<int> ());
+      segments.back ().swap (segmentsAll[segId]);
+    }
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 template <typename PointT> inline bool
 utl::RegionGrowing<PointT>::prepareForSegmentation ()
@@ -358,6 +572,12 @@ utl::RegionGrowing<PointT>::prepareForSegmentation ()
     return false;
   }  
   
+  if (neighborhood_ && neighborhood_->offsets_.size () != input_->points.size () + 1)
+  {
+    std::cout << "[utl::RegionGrowing::prepareForSegmentation] precomputed neighborhood does not match the input cloud!" << std::endl;
+    return false;
+  }
+  
   if (!unary_condition_function_ && !binary_condition_function_)
   {
     std::cout << "[utl::RegionGrowing::prepareForSegmentation] Both unary and binary condition functions are empty! One of them has to be defined." << std::endl;
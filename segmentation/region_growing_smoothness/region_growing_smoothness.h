@@ -65,6 +65,25 @@ namespace utl
       inline bool
       getConsistentNormals () const;
       
+      /** \brief Precompute the neighbors of all input points and the angles
+       * between their normals. Neighbors and angles do not depend on the normal
+       * angle threshold, so the result can be shared by instances with
+       * different thresholds.
+       * \param[out] neighborhood  neighbors of the input points
+       * \return false if neighbors could not be computed
+       */
+      bool
+      computeNeighborhood (utl::RegionGrowingNeighborhood &neighborhood);
+      
+    protected:
+      using utl::RegionGrowing<PointT>::neighborhood_;
+      
+      /** \brief Check the binary condition between a point and its neighbor.
+       * Precomputed normal angles are used if they are available.
+       */
+      virtual bool
+      binaryCondition (const int point_id, const int neighbor_id, const float dist_squared, const int neighbor_pos) const;
+      
     private:
 
       /** \brief Update the binary condition function to make sure it corresponds to the value of consistent normals flag. */
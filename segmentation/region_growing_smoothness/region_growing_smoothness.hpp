@@ -51,6 +51,51 @@ utl::RegionGrowingSmoothness<PointT>::getConsistentNormals () const
   return normals_consistently_oriented_;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline bool
+utl::RegionGrowingSmoothness<PointT>::computeNeighborhood (utl::RegionGrowingNeighborhood &neighborhood)
+{
+  if (!utl::RegionGrowing<PointT>::computeNeighborhood (neighborhood))
+    return false;
+  
+  // Compute the angles between the normals of all neighbors
+  neighborhood.normal_angles_.resize (neighborhood.neighbors_.size ());
+  neighborhood.normals_consistently_oriented_ = normals_consistently_oriented_;
+  
+  #pragma omp parallel for schedule(dynamic, 256)
+  for (int pointId = 0; pointId < static_cast<int> (input_->size ()); pointId++)
+  {
+    Eigen::Vector3f n1 = input_->points[pointId].getNormalVector3fMap();
+    for (int nbrPos = neighborhood.offsets_[pointId]; nbrPos < neighborhood.offsets_[pointId + 1]; nbrPos++)
+    {
+      float &angle = neighborhood.normal_angles_[nbrPos];
+      if (neighborhood.neighbors_[nbrPos] == -1)
+      {
+        angle = static_cast<float>(M_PI);
+        continue;
+      }
+      
+      Eigen::Vector3f n2 = input_->points[neighborhood.neighbors_[nbrPos]].getNormalVector3fMap();
+      if (normals_consistently_oriented_)
+        angle = std::acos (utl::clampValue (n1.dot (n2), 0.0f, 1.0f));
+      else
+        angle = std::acos (utl::clampValue (std::abs (n1.dot (n2)), 0.0f, 1.0f));
+    }
+  }
+  
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+template <typename PointT> inline bool
+utl::RegionGrowingSmoothness<PointT>::binaryCondition (const int point_id, const int neighbor_id, const float dist_squared, const int neighbor_pos) const
+{
+  if (neighbor_pos != -1 && !neighborhood_->normal_angles_.empty () && neighborhood_->normals_consistently_oriented_ == normals_consistently_oriented_)
+    return neighborhood_->normal_angles_[neighbor_pos] < normal_angle_threshold_;
+  
+  return utl::RegionGrowing<PointT>::binaryCondition (point_id, neighbor_id, dist_squared, neighbor_pos);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 template <typename PointT> inline void
 utl::RegionGrowingSmoothness<PointT>::updateBinaryConditionFunction ()
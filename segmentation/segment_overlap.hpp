@@ -0,0 +1,217 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SEGMENT_OVERLAP_HPP
+#define SEGMENT_OVERLAP_HPP
+
+// STD includes
+#include <vector>
+#include <algorithm>
+
+// Utilities includes
+#include <map.hpp>
+#include <segment_set.hpp>
+
+namespace utl
+{
+  /** \brief Find all pairs of segments whose intersection over union is
+   * greater than a threshold. Segments are given in compressed form: points
+   * of segment i are segment_points[segment_offsets[i]] to
+   * segment_points[segment_offsets[i+1]-1]. Point indices within a segment
+   * must be unique. An inverted index from points to the segments containing
+   * them is built once. Intersection sizes are then accumulated only for the
+   * segments that share points with a segment, so the cost depends on the
+   * overlap between segments rather than on the number of segment pairs.
+   *  \param[in]  segment_offsets offset of the first point of every segment (number of segments + 1 values)
+   *  \param[in]  segment_points  point indices of all segments
+   *  \param[in]  num_points      number of points (greater than the largest point index)
+   *  \param[out] segment_pairs   pairs of similar segments. The first segment
+   *                              of a pair is the one with the smaller index.
+   *                              Pairs are sorted.
+   *  \param[in]  iou_threshold   minimum intersection over union of similar segments
+   *  \param[in]  segment_groups  group of every segment. If not empty, segments
+   *                              of the same group are never paired.
+   */
+  inline
+  void getSimilarSegmentPairsCSR  ( const std::vector<int> &segment_offsets,
+                                    const std::vector<int> &segment_points,
+                                    const int num_points,
+                                    std::vector<std::pair<int, int> > &segment_pairs,
+                                    const float iou_threshold,
+                                    const std::vector<int> &segment_groups = std::vector<int> ()
+                                  )
+  {
+    segment_pairs.clear();
+    const int numSegments = segment_offsets.empty() ? 0 : segment_offsets.size() - 1;
+
+    //--------------------------------------------------------------------------
+    // Build the inverted index. Segments are added to the list of a point in
+    // increasing order
+
+    std::vector<int> pointOffsets (num_points + 1, 0);
+    for (size_t pointIdIt = 0; pointIdIt < segment_points.size(); pointIdIt++)
+      pointOffsets[segment_points[pointIdIt] + 1]++;
+
+    for (int pointId = 0; pointId < num_points; pointId++)
+      pointOffsets[pointId + 1] += pointOffsets[pointId];
+
+    std::vector<int> pointSegments (pointOffsets[num_points]);
+    std::vector<int> pointFill (pointOffsets.begin(), pointOffsets.end() - 1);
+    for (int segId = 0; segId < numSegments; segId++)
+      for (int pointIdIt = segment_offsets[segId]; pointIdIt < segment_offsets[segId + 1]; pointIdIt++)
+        pointSegments[pointFill[segment_points[pointIdIt]]++] = segId;
+
+    //--------------------------------------------------------------------------
+    // Accumulate the intersections of every segment with the segments of
+    // higher index that share points with it
+
+    std::vector<std::vector<std::pair<int, int> > > segmentPairs (numSegments);
+
+    #pragma omp parallel
+    {
+      std::vector<int> intersections (numSegments, 0);
+      std::vector<int> overlappingSegIds;
+
+      #pragma omp for schedule(dynamic)
+      for (int srcSegId = 0; srcSegId < numSegments; srcSegId++)
+      {
+        overlappingSegIds.clear();
+
+        for (int pointIdIt = segment_offsets[srcSegId]; pointIdIt < segment_offsets[srcSegId + 1]; pointIdIt++)
+        {
+          const int pointId = segment_points[pointIdIt];
+
+          // Only count the segments listed after the source segment
+          const int *pointSegBegin = pointSegments.data() + pointOffsets[pointId];
+          const int *pointSegEnd = pointSegments.data() + pointOffsets[pointId + 1];
+          const int *pointSegIt = std::lower_bound(pointSegBegin, pointSegEnd, srcSegId);
+          for (pointSegIt++; pointSegIt < pointSegEnd; pointSegIt++)
+          {
+            if (intersections[*pointSegIt]++ == 0)
+              overlappingSegIds.push_back(*pointSegIt);
+          }
+        }
+
+        std::sort(overlappingSegIds.begin(), overlappingSegIds.end());
+        for (size_t tgtSegIdIt = 0; tgtSegIdIt < overlappingSegIds.size(); tgtSegIdIt++)
+        {
+          const int tgtSegId = overlappingSegIds[tgtSegIdIt];
+          const int segIntersection = intersections[tgtSegId];
+          intersections[tgtSegId] = 0;
+
+          if (!segment_groups.empty() && segment_groups[srcSegId] == segment_groups[tgtSegId])
+            continue;
+
+          const int segUnion =  segment_offsets[srcSegId + 1] - segment_offsets[srcSegId] +
+                                segment_offsets[tgtSegId + 1] - segment_offsets[tgtSegId] - segIntersection;
+          const float iou = static_cast<float>(segIntersection) / static_cast<float>(segUnion);
+          if (iou > iou_threshold)
+            segmentPairs[srcSegId].push_back(std::pair<int, int> (srcSegId, tgtSegId));
+        }
+      }
+    }
+
+    for (int segId = 0; segId < numSegments; segId++)
+      segment_pairs.insert(segment_pairs.end(), segmentPairs[segId].begin(), segmentPairs[segId].end());
+  }
+
+  /** \brief Find all pairs of segments whose intersection over union is
+   * greater than a threshold. See getSimilarSegmentPairsCSR for details.
+   * Duplicate point indices within a segment are counted once.
+   *  \param[in]  segments        pointers to the segments (indices of their points)
+   *  \param[out] segment_pairs   sorted pairs of similar segments
+   *  \param[in]  iou_threshold   minimum intersection over union of similar segments
+   *  \param[in]  segment_groups  group of every segment. If not empty, segments
+   *                              of the same group are never paired.
+   */
+  inline
+  void getSimilarSegmentPairs ( const std::vector<const std::vector<int>*> &segments,
+                                std::vector<std::pair<int, int> > &segment_pairs,
+                                const float iou_threshold,
+                                const std::vector<int> &segment_groups = std::vector<int> ()
+                              )
+  {
+    const int numSegments = segments.size();
+
+    int numPoints = 0;
+    for (int segId = 0; segId < numSegments; segId++)
+      for (size_t pointIdIt = 0; pointIdIt < segments[segId]->size(); pointIdIt++)
+        numPoints = std::max(numPoints, (*segments[segId])[pointIdIt] + 1);
+
+    // Remove duplicate points of the segments
+    std::vector<int> pointLastSegment (numPoints, -1);
+    std::vector<int> segmentOffsets (numSegments + 1, 0);
+    std::vector<int> segmentPoints;
+    for (int segId = 0; segId < numSegments; segId++)
+    {
+      for (size_t pointIdIt = 0; pointIdIt < segments[segId]->size(); pointIdIt++)
+      {
+        const int pointId = (*segments[segId])[pointIdIt];
+        if (pointLastSegment[pointId] != segId)
+        {
+          pointLastSegment[pointId] = segId;
+          segmentPoints.push_back(pointId);
+        }
+      }
+      segmentOffsets[segId + 1] = segmentPoints.size();
+    }
+
+    getSimilarSegmentPairsCSR(segmentOffsets, segmentPoints, numPoints, segment_pairs, iou_threshold, segment_groups);
+  }
+
+  /** \brief Find all pairs of segments of a segment set whose intersection
+   * over union is greater than a threshold. Indices of the set are already
+   * sorted and unique so no duplicate removal is needed.
+   *  \param[in]  segments        segments
+   *  \param[out] segment_pairs   sorted pairs of similar segments
+   *  \param[in]  iou_threshold   minimum intersection over union of similar segments
+   *  \param[in]  segment_groups  group of every segment. If not empty, segments
+   *                              of the same group are never paired.
+   */
+  inline
+  void getSimilarSegmentPairs ( const utl::SegmentSet &segments,
+                                std::vector<std::pair<int, int> > &segment_pairs,
+                                const float iou_threshold,
+                                const std::vector<int> &segment_groups = std::vector<int> ()
+                              )
+  {
+    int numPoints = 0;
+    std::vector<int> segmentOffsets (segments.size() + 1, 0);
+    std::vector<int> segmentPoints;
+    for (size_t segId = 0; segId < segments.size(); segId++)
+    {
+      const utl::SegmentView segment = segments[segId];
+      segmentPoints.insert(segmentPoints.end(), segment.begin(), segment.end());
+      segmentOffsets[segId + 1] = segmentPoints.size();
+      if (!segment.empty())
+        numPoints = std::max(numPoints, static_cast<int>(*(segment.end() - 1)) + 1);
+    }
+
+    getSimilarSegmentPairsCSR(segmentOffsets, segmentPoints, numPoints, segment_pairs, iou_threshold, segment_groups);
+  }
+
+  /** \brief Find all pairs of segments whose intersection over union is
+   * greater than a threshold.
+   *  \param[in]  segments        segments (indices of their points)
+   *  \param[out] segment_pairs   sorted pairs of similar segments
+   *  \param[in]  iou_threshold   minimum intersection over union of similar segments
+   *  \param[in]  segment_groups  group of every segment. If not empty, segments
+   *                              of the same group are never paired.
+   */
+  inline
+  void getSimilarSegmentPairs ( const utl::Map &segments,
+                                std::vector<std::pair<int, int> > &segment_pairs,
+                                const float iou_threshold,
+                                const std::vector<int> &segment_groups = std::vector<int> ()
+                              )
+  {
+    std::vector<const std::vector<int>*> segmentPtrs (segments.size());
+    for (size_t segId = 0; segId < segments.size(); segId++)
+      segmentPtrs[segId] = &segments[segId];
+
+    getSimilarSegmentPairs(segmentPtrs, segment_pairs, iou_threshold, segment_groups);
+  }
+}
+
+#endif    // SEGMENT_OVERLAP_HPP
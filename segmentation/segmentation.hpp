@@ -5,8 +5,8 @@
 #ifndef SEGMENTATION_HPP
 #define SEGMENTATION_HPP
 
+#include <atomic>
 #include <omp.h>
-#include <mutex>
 
 // Utilities
 #include <pointcloud/pointcloud.hpp>
@@ -14,6 +14,9 @@
 #include <graph/min_cut.hpp>
 #include <graph/bron_kerbosch.hpp>
 
+// Segmentation
+#include <segment_overlap.hpp>
+
 namespace utl
 {
   //----------------------------------------------------------------------------
@@ -35,67 +38,40 @@ namespace utl
   // Segment merging
   //----------------------------------------------------------------------------
 
-  /** \brief Merge duplicate segments from multiple oversegmentations of a scene.
-  * Two segments are considered duplicate if their intersection over overlap is
-  * greater than a threshold. Individual input segmentations are expected to be
-  * non-overlapping.
-  *  \param[in]  segmentations   vector of segmentations of a scene. Each individual segmentation is assumed to contain non-overlapping segments.
-  *  \param[out] segments_merged merged segments
-  *  \param[in]  iou_threshold   minimum intersection over union score of two duplicate segments
-  *  \return maximum value
-  * NOTE: this function should be replaced by findSimilarSegments function.
-  * after that, the calling applications can decide which criteria to use for 
-  * segment merging.
-  */        
-  void  mergeDuplicateSegments  ( const std::vector<utl::Map> &segmentations, std::vector<std::vector<int> > &segmentation_merged_ids, const float iou_threshold = 0.9f)
+  /** \brief Group similar segments and keep the largest segment of every
+   * group. Used by mergeDuplicateSegments.
+   *  \param[in]  similar_segment_pairs   pairs of similar segments (linear segment ids)
+   *  \param[in]  segment_sizes           number of points of every segment
+   *  \param[in]  segmentation_ids        index of the segmentation of every segment. Segments of a segmentation are consecutive.
+   *  \param[in]  num_segmentations       number of segmentations
+   *  \param[out] segmentation_merged_ids indices of the remaining segments of every segmentation
+   */
+  inline
+  void  mergeSimilarSegmentPairs  ( const std::vector<std::pair<int, int> > &similar_segment_pairs,
+                                    const std::vector<int> &segment_sizes,
+                                    const std::vector<int> &segmentation_ids,
+                                    const int num_segmentations,
+                                    std::vector<std::vector<int> > &segmentation_merged_ids
+                                  )
   {
-    std::mutex graphMutex;
-
-    // Get number of segments
-    int numSegs = 0;
-    for (size_t segSetId = 0; segSetId < segmentations.size(); segSetId++)
-      numSegs += segmentations[segSetId].size();
+    // Index of every segment within its segmentation
+    std::vector<int> segmentIds (segment_sizes.size());
+    for (size_t segLinId = 0; segLinId < segment_sizes.size(); segLinId++)
+      segmentIds[segLinId] = (segLinId == 0 || segmentation_ids[segLinId] != segmentation_ids[segLinId - 1]) ? 0 : segmentIds[segLinId - 1] + 1;
     
     // Construct a graph where vertices represent object segments and edges
     // indicate segments that are similar
-    utl::Graph segmentSimilarityGraph (numSegs);
-    
-    for (size_t srcSegSetId = 0; srcSegSetId < segmentations.size()-1; srcSegSetId++)
-    {
-      utl::Map srcSegmentation = segmentations[srcSegSetId];
-      for (size_t tgtSegSetId = srcSegSetId+1; tgtSegSetId < segmentations.size(); tgtSegSetId++)
-      {
-        utl::Map tgtSegmentation = segmentations[tgtSegSetId];
-        
-        #pragma omp parallel for
-        for (size_t srcSegId = 0; srcSegId < srcSegmentation.size(); srcSegId++)
-        {
-          for (size_t tgtSegId = 0; tgtSegId < tgtSegmentation.size(); tgtSegId++)
-          {
-            int segIntersection = utl::vectorIntersection<int>(srcSegmentation[srcSegId], tgtSegmentation[tgtSegId]).size();
-            int segUnion        = utl::vectorUnion<int>(srcSegmentation[srcSegId], tgtSegmentation[tgtSegId]).size();
-            float iou           = static_cast<float>(segIntersection) / static_cast<float>(segUnion);
-            
-            if (iou > iou_threshold)
-            {
-              int srcSegLinId, tgtSegLinId;
-              utl::vector2dSubToLinearId(segmentations, srcSegSetId, srcSegId, srcSegLinId);
-              utl::vector2dSubToLinearId(segmentations, tgtSegSetId, tgtSegId, tgtSegLinId);
-              graphMutex.lock();
-              segmentSimilarityGraph.addEdge(srcSegLinId, tgtSegLinId);
-              graphMutex.unlock();
-            }
-          }
-        }
-      }
-    }
+    utl::Graph segmentSimilarityGraph (segment_sizes.size());
+    for (size_t pairId = 0; pairId < similar_segment_pairs.size(); pairId++)
+      segmentSimilarityGraph.addEdge(similar_segment_pairs[pairId].first, similar_segment_pairs[pairId].second);
 
     // Find all connected components in the segment graph (this should be replaced by finding maximal cliques)
     utl::Map segmentCCs;
     segmentCCs = utl::getConnectedComponents  (segmentSimilarityGraph);
       
     // Select best hypothesis for each cluster
-    segmentation_merged_ids.resize(segmentations.size());
+    segmentation_merged_ids.clear();
+    segmentation_merged_ids.resize(num_segmentations);
     
     for (size_t clusterId = 0; clusterId < segmentCCs.size(); clusterId++)
     {
@@ -105,9 +81,9 @@ namespace utl
       for (size_t segLinIdIt = 0; segLinIdIt < segmentCCs[clusterId].size(); segLinIdIt++)
       {      
         int segLinId = segmentCCs[clusterId][segLinIdIt];
-        int segSetId, segId;
-        utl::vector2dLinearId2Sub(segmentations, segLinId, segSetId, segId);
-        int segSize = segmentations[segSetId][segId].size();
+        int segSetId = segmentation_ids[segLinId];
+        int segId = segmentIds[segLinId];
+        int segSize = segment_sizes[segLinId];
         
         if (segSize > maxSize)
         {
@@ -123,6 +99,62 @@ namespace utl
     }
   }
   
+  /** \brief Merge duplicate segments from multiple oversegmentations of a scene.
+  * Two segments are considered duplicate if their intersection over overlap is
+  * greater than a threshold. Individual input segmentations are expected to be
+  * non-overlapping.
+  *  \param[in]  segmentations   vector of segmentations of a scene. Each individual segmentation is assumed to contain non-overlapping segments.
+  *  \param[out] segments_merged merged segments
+  *  \param[in]  iou_threshold   minimum intersection over union score of two duplicate segments
+  *  \return maximum value
+  * NOTE: this function should be replaced by findSimilarSegments function.
+  * after that, the calling applications can decide which criteria to use for 
+  * segment merging.
+  */        
+  void  mergeDuplicateSegments  ( const std::vector<utl::Map> &segmentations, std::vector<std::vector<int> > &segmentation_merged_ids, const float iou_threshold = 0.9f)
+  {
+    // Linear segment ids enumerate the segments of all segmentations in order.
+    // Segments of the same segmentation are never compared
+    std::vector<const std::vector<int>*> segments;
+    std::vector<int> segmentSetIds, segmentSizes;
+    for (size_t segSetId = 0; segSetId < segmentations.size(); segSetId++)
+    {
+      for (size_t segId = 0; segId < segmentations[segSetId].size(); segId++)
+      {
+        segments.push_back(&segmentations[segSetId][segId]);
+        segmentSetIds.push_back(segSetId);
+        segmentSizes.push_back(segmentations[segSetId][segId].size());
+      }
+    }
+    
+    std::vector<std::pair<int, int> > similarSegmentPairs;
+    utl::getSimilarSegmentPairs(segments, similarSegmentPairs, iou_threshold, segmentSetIds);
+    mergeSimilarSegmentPairs(similarSegmentPairs, segmentSizes, segmentSetIds, segmentations.size(), segmentation_merged_ids);
+  }
+  
+  /** \brief Merge duplicate segments from multiple oversegmentations of a
+   * scene stored in a single segment set. Same as the utl::Map version but
+   * segments are not copied or deduplicated.
+   *  \param[in]  segments          segments of all segmentations, grouped by segmentation
+   *  \param[in]  segmentation_ids  index of the segmentation of every segment
+   *  \param[out] segmentation_merged_ids indices of the remaining segments of every segmentation, relative to the first segment of the segmentation
+   *  \param[in]  iou_threshold     minimum intersection over union score of two duplicate segments
+   */
+  void  mergeDuplicateSegments  ( const utl::SegmentSet &segments, const std::vector<int> &segmentation_ids, std::vector<std::vector<int> > &segmentation_merged_ids, const float iou_threshold = 0.9f)
+  {
+    std::vector<int> segmentSizes (segments.size());
+    int numSegmentations = 0;
+    for (size_t segId = 0; segId < segments.size(); segId++)
+    {
+      segmentSizes[segId] = segments[segId].size();
+      numSegmentations = std::max(numSegmentations, segmentation_ids[segId] + 1);
+    }
+    
+    std::vector<std::pair<int, int> > similarSegmentPairs;
+    utl::getSimilarSegmentPairs(segments, similarSegmentPairs, iou_threshold, segmentation_ids);
+    mergeSimilarSegmentPairs(similarSegmentPairs, segmentSizes, segmentation_ids, numSegmentations, segmentation_merged_ids);
+  }
+  
   /** \brief Merge duplicate segments from multiple oversegmentations of a scene.
    * Two segments are considered duplicate if their intersection over overlap is
    * greater than a threshold. Individual input segmentations are expected to be
@@ -146,39 +178,55 @@ namespace utl
     // indicate segments that are similar
     utl::Graph segmentSimilarityGraph (segments.size());
 
-    for (size_t srcSegId = 0; srcSegId < segments.size()-1; srcSegId++)
-    {
-      for (size_t tgtSegId = srcSegId+1; tgtSegId < segments.size(); tgtSegId++)
-      {
-        int segIntersection = utl::vectorIntersection<int>(segments[srcSegId], segments[tgtSegId]).size();
-        int segUnion        = utl::vectorUnion<int>(segments[srcSegId], segments[tgtSegId]).size();
-        float iou           = static_cast<float>(segIntersection) / static_cast<float>(segUnion);
-        
-        if (iou > iou_threshold)
-          segmentSimilarityGraph.addEdge(srcSegId, tgtSegId);
-      }
-    }
+    std::vector<std::pair<int, int> > similarSegmentPairs;
+    utl::getSimilarSegmentPairs(segments, similarSegmentPairs, iou_threshold);
+    for (size_t pairId = 0; pairId < similarSegmentPairs.size(); pairId++)
+      segmentSimilarityGraph.addEdge(similarSegmentPairs[pairId].first, similarSegmentPairs[pairId].second);
 
     // Find all connected components in the segment graph (this should be replaced by finding maximal cliques)
-    std::list<std::list<int> > segment_similarity_list;
-    utl::bronKerbosch (segmentSimilarityGraph, segment_similarity_list, 1);
-    
-    segment_similarity.resize(segment_similarity_list.size());
-    int c = 0;
-    for (std::list<std::list<int> >::iterator it1=segment_similarity_list.begin(); it1 != segment_similarity_list.end(); ++it1)
-    {
-      for (std::list<int>::iterator it2=it1->begin(); it2 != it1->end(); ++it2)
-      {
-        segment_similarity[c].push_back(*it2);
-      }
-      c++;
-    }
+    utl::bronKerbosch (segmentSimilarityGraph, segment_similarity, 1);
   }  
   
   //----------------------------------------------------------------------------
   // Foreground segmentation
   //----------------------------------------------------------------------------  
   
+  /** \brief Similarity weight between two adjacent points, based on the angle
+   * between their normals. Convex arrangements are penalized less than
+   * concave ones.
+   *  \param[in]  point1            first point
+   *  \param[in]  point2            second point
+   *  \param[in]  sigma_convex      sigma for calculating similarity between two points in a convex arrangement
+   *  \param[in]  sigma_concave     sigma for calculating similarity between two points in a concave arrangement
+   *  \note the sigmas are currently fixed to 2 and 0.15
+   */
+  template <typename PointT>
+  inline
+  float pointAdjacencyWeight  ( const PointT &point1,
+                                const PointT &point2,
+                                const float sigma_convex,
+                                const float sigma_concave
+                              )
+  {
+    Eigen::Vector3f p1 = point1.getVector3fMap();
+    Eigen::Vector3f p2 = point2.getVector3fMap();
+    Eigen::Vector3f n1 = point1.getNormalVector3fMap();
+    Eigen::Vector3f n2 = point2.getNormalVector3fMap();
+
+    // Get angle per distance
+    float dotProd = utl::clampValue(n1.dot(n2), -1.0f, 1.0f);   // Get the cosine of the angle between the normals
+    dotProd = -dotProd + 1.0f;
+    
+    // Get dissimilarity measure
+    float sigmaConvex   = 2;
+    float sigmaConcave  = 0.15;
+    
+    if (n1.dot(p1-p2) > 0)
+      return std::exp(- dotProd / sigmaConvex);
+    else
+      return std::exp(- dotProd / sigmaConcave);
+  }
+  
   /** \brief Compute the cloud adjacency weights. This consists of two steps:
    *  1. Computing the adjacency between points of the cloud
    *  2. Caclulating the similarity weights between adjacent points. Similarity
@@ -208,36 +256,26 @@ namespace utl
     if (!utl::getCloudConnectivityRadius<PointT>(cloud, search_tree, graph_weighted, radius, num_neighbors))
       return false;
     
-    // Calculate weights 
-    for (size_t edgeId = 0; edgeId < graph_weighted.getNumEdges(); edgeId++)
+    // Calculate weights. Every edge is updated in place, so edges are
+    // processed in parallel
+    const int numEdges = graph_weighted.getNumEdges();
+    std::atomic<bool> edgeLookupFailed (false);
+    #pragma omp parallel for
+    for (int edgeId = 0; edgeId < numEdges; edgeId++)
     {
       int vtx1Id, vtx2Id;
       float weight;
       if (!graph_weighted.getEdge(edgeId, vtx1Id, vtx2Id, weight))
-        return false;
-            
-      Eigen::Vector3f p1 = cloud->points[vtx1Id].getVector3fMap();
-      Eigen::Vector3f p2 = cloud->points[vtx2Id].getVector3fMap();
-      Eigen::Vector3f n1 = cloud->points[vtx1Id].getNormalVector3fMap();
-      Eigen::Vector3f n2 = cloud->points[vtx2Id].getNormalVector3fMap();
-
-      // Get angle per distance
-      float dotProd = utl::clampValue(n1.dot(n2), -1.0f, 1.0f);   // Get the cosine of the angle between the normals
-      dotProd = -dotProd + 1.0f;
-      
-      // Get dissimilarity measure
-      float sigmaConvex   = 2;
-      float sigmaConcave  = 0.15;
-      
-      float similarity;
-      if (n1.dot(p1-p2) > 0)
-        similarity = std::exp(- dotProd / sigmaConvex);
-      else
-        similarity = std::exp(- dotProd / sigmaConcave);
+      {
+        edgeLookupFailed = true;
+        continue;
+      }
             
-      if (!graph_weighted.setEdgeWeight(vtx1Id, vtx2Id, similarity))
-        return false;
+      graph_weighted.setEdgeWeight(edgeId, pointAdjacencyWeight(cloud->points[vtx1Id], cloud->points[vtx2Id], sigma_convex, sigma_concave));
     }
+    
+    if (edgeLookupFailed)
+      return false;
 
     return true;
   }
@@ -269,44 +307,202 @@ namespace utl
     // Get adjacency
     utl::getCloudConnectivityRadius<PointT>(cloud, graph_weighted, radius, num_neighbors);
     
-    // Calculate weights 
-    for (size_t edgeId = 0; edgeId < graph_weighted.getNumEdges(); edgeId++)
+    // Calculate weights. Every edge is updated in place, so edges are
+    // processed in parallel
+    const int numEdges = graph_weighted.getNumEdges();
+    std::atomic<bool> edgeLookupFailed (false);
+    #pragma omp parallel for
+    for (int edgeId = 0; edgeId < numEdges; edgeId++)
     {
       int vtx1Id, vtx2Id;
       float weight;
       if (!graph_weighted.getEdge(edgeId, vtx1Id, vtx2Id, weight))
-        return false;
+      {
+        edgeLookupFailed = true;
+        continue;
+      }
             
-      Eigen::Vector3f p1 = cloud->points[vtx1Id].getVector3fMap();
-      Eigen::Vector3f p2 = cloud->points[vtx2Id].getVector3fMap();
-      Eigen::Vector3f n1 = cloud->points[vtx1Id].getNormalVector3fMap();
-      Eigen::Vector3f n2 = cloud->points[vtx2Id].getNormalVector3fMap();
+      graph_weighted.setEdgeWeight(edgeId, pointAdjacencyWeight(cloud->points[vtx1Id], cloud->points[vtx2Id], sigma_convex, sigma_concave));
+    }
+    
+    if (edgeLookupFailed)
+      return false;
 
-      // Get angle per distance
-      float dotProd = utl::clampValue(n1.dot(n2), -1.0f, 1.0f);   // Get the cosine of the angle between the normals
-      dotProd = -dotProd + 1.0f;
+    return true;
+  }
+  
+  /** \brief Compute the adjacency weights of a subset of the cloud points from
+   * an adjacency of the whole cloud, such that they match the weights
+   * cloudAdjacencyWeights computes on the subset cloud. With a neighbor limit,
+   * the num_neighbors closest points of a point are recovered from the
+   * adjacency. Only the points that lose one of them are searched again among
+   * the subset points.
+   *  \param[in]  cloud             input pointcloud
+   *  \param[in]  adjacency         adjacency of the input pointcloud computed with the same radius and neighbor limit
+   *  \param[in]  point_mask        mask of the subset points
+   *  \param[in]  radius            maximum distance between adjacent points
+   *  \param[in]  num_neighbors     maximum number of neighbors of a point
+   *  \param[in]  sigma_convex      sigma for calculating similarity between two points in a convex arrangement
+   *  \param[in]  sigma_concave     sigma for calculating similarity between two points in a concave arrangement
+   *  \param[out] graph_weighted    adjacency of the subset points
+   *  \param[out] point_ids         input cloud index of every subset point
+   */  
+  template <typename PointT>
+  inline
+  bool cloudAdjacencyWeightsSubset  ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
+                                      const utl::GraphWeighted &adjacency,
+                                      const std::vector<bool> &point_mask,
+                                      const float radius,
+                                      const int   num_neighbors,
+                                      const float sigma_convex,
+                                      const float sigma_concave,
+                                      utl::GraphWeighted &graph_weighted,
+                                      std::vector<int> &point_ids
+                                    )
+  {
+    graph_weighted.clear();
+    point_ids.clear();
+    
+    if (adjacency.getNumVertices() != static_cast<int>(cloud->size()) || point_mask.size() != cloud->size())
+    {
+      std::cout << "[utl::cloudAdjacencyWeightsSubset] adjacency, point mask and cloud sizes are different (" << adjacency.getNumVertices() << ", " << point_mask.size() << ", " << cloud->size() << ")." << std::endl;
+      return false;
+    }
+    
+    // Map cloud points to subset points
+    std::vector<int> subsetPointIds (cloud->size(), -1);
+    for (size_t pointId = 0; pointId < cloud->size(); pointId++)
+    {
+      if (point_mask[pointId])
+      {
+        subsetPointIds[pointId] = point_ids.size();
+        point_ids.push_back(pointId);
+      }
+    }
+    
+    // A radius search limited to num_neighbors points also returns the query
+    // point itself
+    const int maxNumOtherNeighbors = num_neighbors - 1;
+    
+    // Get the subset neighbors of every subset point from the adjacency. A
+    // point that has at least maxNumOtherNeighbors neighbors in the adjacency
+    // may have been capped, so if one of its maxNumOtherNeighbors closest
+    // neighbors is not in the subset it has to be searched again.
+    const int numSubsetPoints = point_ids.size();
+    std::vector<std::vector<int> > subsetNeighbors (numSubsetPoints);
+    std::vector<char> searchAgain (numSubsetPoints, 0);
+    
+    #pragma omp parallel
+    {
+      std::vector<int> neighbors;
+      std::vector<std::pair<float, int> > neighborDistances;
       
-      // Get dissimilarity measure
-      float sigmaConvex   = 2;
-      float sigmaConcave  = 0.15;
+      #pragma omp for schedule(dynamic, 256)
+      for (int subsetPointId = 0; subsetPointId < numSubsetPoints; subsetPointId++)
+      {
+        const int pointId = point_ids[subsetPointId];
+        adjacency.getVertexNeighbors(pointId, neighbors);
+        
+        if (num_neighbors > 0 && static_cast<int>(neighbors.size()) >= maxNumOtherNeighbors)
+        {
+          neighborDistances.clear();
+          for (size_t nbrIt = 0; nbrIt < neighbors.size(); nbrIt++)
+            neighborDistances.push_back(std::pair<float, int> ((cloud->points[neighbors[nbrIt]].getVector3fMap() - cloud->points[pointId].getVector3fMap()).squaredNorm(), neighbors[nbrIt]));
+          std::partial_sort(neighborDistances.begin(), neighborDistances.begin() + maxNumOtherNeighbors, neighborDistances.end());
+          
+          for (int nbrIt = 0; nbrIt < maxNumOtherNeighbors; nbrIt++)
+          {
+            const int subsetNeighborId = subsetPointIds[neighborDistances[nbrIt].second];
+            if (subsetNeighborId == -1)
+            {
+              searchAgain[subsetPointId] = 1;
+              break;
+            }
+            subsetNeighbors[subsetPointId].push_back(subsetNeighborId);
+          }
+          
+          if (searchAgain[subsetPointId])
+            subsetNeighbors[subsetPointId].clear();
+        }
+        else
+        {
+          for (size_t nbrIt = 0; nbrIt < neighbors.size(); nbrIt++)
+            if (subsetPointIds[neighbors[nbrIt]] != -1)
+              subsetNeighbors[subsetPointId].push_back(subsetPointIds[neighbors[nbrIt]]);
+        }
+      }
+    }
+    
+    // Search the neighbors of the remaining points among the subset points
+    if (std::find(searchAgain.begin(), searchAgain.end(), 1) != searchAgain.end())
+    {
+      pcl::search::KdTree<PointT> searchTree;
+      searchTree.setInputCloud(cloud, boost::make_shared<std::vector<int> > (point_ids));
       
-      float similarity;
-      if (n1.dot(p1-p2) > 0)
-        similarity = std::exp(- dotProd / sigmaConvex);
-      else
-        similarity = std::exp(- dotProd / sigmaConcave);
-            
-      if (!graph_weighted.setEdgeWeight(vtx1Id, vtx2Id, similarity))
-        return false;
+      #pragma omp parallel
+      {
+        std::vector<int> neighbors;
+        std::vector<float> distances;
+        
+        #pragma omp for schedule(dynamic, 256)
+        for (int subsetPointId = 0; subsetPointId < numSubsetPoints; subsetPointId++)
+        {
+          if (!searchAgain[subsetPointId])
+            continue;
+          
+          searchTree.radiusSearch(cloud->points[point_ids[subsetPointId]], radius, neighbors, distances, num_neighbors);
+          for (size_t nbrIt = 0; nbrIt < neighbors.size(); nbrIt++)
+            if (neighbors[nbrIt] != point_ids[subsetPointId])
+              subsetNeighbors[subsetPointId].push_back(subsetPointIds[neighbors[nbrIt]]);
+        }
+      }
     }
-
+    
+    // Build the graph
+    std::vector<std::pair<int, int> > edges;
+    for (int subsetPointId = 0; subsetPointId < numSubsetPoints; subsetPointId++)
+      for (size_t nbrIt = 0; nbrIt < subsetNeighbors[subsetPointId].size(); nbrIt++)
+        edges.push_back(std::pair<int, int> (std::min(subsetPointId, subsetNeighbors[subsetPointId][nbrIt]), std::max(subsetPointId, subsetNeighbors[subsetPointId][nbrIt])));
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    graph_weighted.setEdges(numSubsetPoints, edges);
+    
+    // Calculate weights
+    const int numEdges = graph_weighted.getNumEdges();
+    std::atomic<bool> edgeLookupFailed (false);
+    #pragma omp parallel for
+    for (int edgeId = 0; edgeId < numEdges; edgeId++)
+    {
+      int vtx1Id, vtx2Id;
+      float weight;
+      if (!graph_weighted.getEdge(edgeId, vtx1Id, vtx2Id, weight))
+      {
+        edgeLookupFailed = true;
+        continue;
+      }
+      
+      graph_weighted.setEdgeWeight(edgeId, pointAdjacencyWeight(cloud->points[point_ids[vtx1Id]], cloud->points[point_ids[vtx2Id]], sigma_convex, sigma_concave));
+    }
+    
+    if (edgeLookupFailed)
+      return false;
+    
     return true;
   }
   
+  /** \brief Segment the foreground of a cloud with a min cut.
+   *  \param[in]  fg_weights          foreground weights of the points
+   *  \param[in]  bg_weights          background weights of the points
+   *  \param[in]  min_cut_solver      min cut solver with the binary weights already set
+   *  \param[in]  downsample_map      map from downsampled points to full resolution points
+   *  \param[out] fg_points           foreground points
+   *  \param[out] fg_points_full_res  full resolution foreground points
+   *  \return FALSE if the number of weights does not match the number of points in the graph
+   */
   inline
   bool segmentCloudFG ( const std::vector<float> &fg_weights,
                         const std::vector<float> &bg_weights,
-                        const utl::GraphWeighted &edge_weights,
+                        utl::MinCutSolver &min_cut_solver,
                         const utl::Map &downsample_map,
                         std::vector<int> &fg_points,
                         std::vector<int> &fg_points_full_res
@@ -314,10 +510,9 @@ namespace utl
   {
     // Segment
     std::vector<int> bgPoints;
-    if (utl::mincut(fg_weights, bg_weights, edge_weights, bgPoints, fg_points) < 0.0f)
-    {
+    if (!min_cut_solver.setUnaryPotentials(fg_weights, bg_weights))
       return false;
-    }
+    min_cut_solver.solve(bgPoints, fg_points);
     
     // Get high res object segments
     for (size_t lrPtId = 0; lrPtId < fg_points.size(); lrPtId++)
@@ -325,6 +520,30 @@ namespace utl
     
     return true;
   }
+  
+  template <typename GraphT>
+  inline
+  bool segmentCloudFG ( const std::vector<float> &fg_weights,
+                        const std::vector<float> &bg_weights,
+                        const GraphT &edge_weights,
+                        const utl::Map &downsample_map,
+                        std::vector<int> &fg_points,
+                        std::vector<int> &fg_points_full_res
+                      )
+  {
+    if (! (   (fg_weights.size() == bg_weights.size()) && 
+              (static_cast<int>(fg_weights.size()) == edge_weights.getNumVertices())))
+    {
+      std::cout << "[utl::segmentCloudFG] number of vertices in foreground weights, background weights and edge weights are not equal." << std::endl;
+      return false;
+    }
+    
+    utl::MinCutSolver minCutSolver;
+    if (!minCutSolver.setBinaryPotentials(edge_weights))
+      return false;
+    
+    return segmentCloudFG(fg_weights, bg_weights, minCutSolver, downsample_map, fg_points, fg_points_full_res);
+  }
 }
 
 #endif    // SEGMENTATION_HPP
@@ -7,54 +7,446 @@
 
 // Symmetry includes
 #include <symmetry/reflectional_symmetry_detection.hpp>
+#include <segment_detection_cache.hpp>
 
-template <typename PointT>
-bool detectReflectionalSymmetryScene  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
-                                        const OccupancyMapConstPtr                        &scene_occupancy_map,
-                                        const utl::Map                                    &segments,
-                                        const sym::ReflSymDetectParams                    &sym_detect_params,
-                                        std::vector<sym::ReflectionalSymmetry>            &symmetry,
-                                        std::vector<std::vector<int> >                    &symmetry_support_segments
-                                      )
+// STD includes
+#include <algorithm>
+#include <functional>
+
+// Utilities includes
+#include <pointcloud/indices_search.hpp>
+#include <segment_set.hpp>
+#include <profiling.hpp>
+
+namespace sym
 {
-  symmetry.resize(0);
-  symmetry_support_segments.resize(0);
-  
-  if (scene_cloud->size() < 3)
-    return true;
+  /** \brief Reflectional symmetries detected in a single segment of a scene.
+   * Symmetries are kept together with their filtered and merged indices and
+   * scores, and with the size and the centroid of the segment that are needed
+   * to merge the symmetries of all segments.
+   */
+  struct ReflSymSegmentDetection
+  {
+    /** \brief Constructor. */
+    ReflSymSegmentDetection ()
+      : detected (false)
+      , partial (false)
+      , num_points (0)
+      , reference_point (Eigen::Vector3f::Zero())
+    { }
 
-  //----------------------------------------------------------------------------
-  // Reflectional symmetry detection
-  //----------------------------------------------------------------------------
+    bool                                    detected;               // Detection was run for the segment
+    bool                                    partial;                // Detection was skipped or cut short by the deadline
+    std::vector<sym::ReflectionalSymmetry>  symmetries;
+    std::vector<int>                        filtered_ids;
+    std::vector<int>                        merged_ids;
+    std::vector<float>                      occlusion_scores;
+    std::vector<float>                      cloud_inlier_scores;
+    std::vector<float>                      corresp_inlier_scores;
+    size_t                                  num_points;             // Number of points in the segment
+    Eigen::Vector3f                         reference_point;        // Centroid of the segment
+  };
+
+  /** \brief Cache of reflectional segment detections. */
+  typedef SegmentDetectionCache<ReflSymSegmentDetection> ReflSymDetectionCache;
+
+  /** \brief Get a key of the reflectional detection parameters. Two sets of
+   * parameters with the same key give the same detections.
+   *  \param[in]  params  detection parameters
+   */
+  inline
+  uint64_t getReflSymDetectParamsKey (const ReflSymDetectParams &params)
+  {
+    uint64_t key = utl::HASH_SEED;
+    key = hashValue(params.voxel_size, key);
+    key = hashValue(params.num_angle_divisions, key);
+    key = hashValue(params.flatness_threshold, key);
+    key = hashValue(params.voting_num_pairs, key);
+    key = hashValue(params.voting_max_hypotheses, key);
+    key = hashValue(params.voting_angle_step, key);
+    key = hashValue(params.voting_distance_step, key);
+    key = hashValue(params.voting_max_normal_fit_error, key);
+    key = hashValue(params.cascade_num_samples, key);
+    key = hashValue(params.cascade_max_hypotheses, key);
+    key = hashValue(params.cascade_min_inlier_score, key);
+    key = hashValue(params.cascade_max_occlusion_score, key);
+    key = hashValue(params.cascade_max_correspondence_reflected_distance, key);
+    key = hashValue(params.cascade_max_normal_fit_error, key);
+    key = hashValue(params.warm_start_min_iou, key);
+    key = hashValue(params.refine_iterations, key);
+    key = hashValue(params.pyramid_levels, key);
+    key = hashValue(params.pyramid_voxel_size, key);
+    key = hashValue(params.pyramid_iterations, key);
+    key = hashValue(params.pyramid_max_angle_change, key);
+    key = hashValue(params.pyramid_max_distance_change, key);
+    key = hashValue(params.max_correspondence_reflected_distance, key);
+    key = hashValue(params.min_occlusion_distance, key);
+    key = hashValue(params.max_occlusion_distance, key);
+    key = hashValue(params.min_inlier_normal_angle, key);
+    key = hashValue(params.max_inlier_normal_angle, key);
+    key = hashValue(params.max_occlusion_score, key);
+    key = hashValue(params.min_cloud_inlier_score, key);
+    key = hashValue(params.min_corresp_inlier_score, key);
+    key = hashValue(params.symmetry_min_angle_diff, key);
+    key = hashValue(params.symmetry_min_distance_diff, key);
+    key = hashValue(params.max_reference_point_distance, key);
+    return key;
+  }
+
+  /** \brief Get the validation scores of reflectional symmetries of a
+   * segment used by the detection cache: the mean occlusion score of the
+   * segment points reflected by every symmetry.
+   *  \param[in]  cloud               structure of arrays view of the segment cloud
+   *  \param[in]  occupancy_map       scene occupancy map
+   *  \param[in]  symmetries          symmetries of the segment
+   *  \param[in]  params              detection parameters
+   *  \param[out] validation_scores   validation score of every symmetry
+   */
+  template <typename PointT>
+  inline
+  void getReflSymValidationScores ( const utl::PointCloudSoA &cloud,
+                                    const OccupancyMapConstPtr &occupancy_map,
+                                    const std::vector<ReflectionalSymmetry> &symmetries,
+                                    const ReflSymDetectParams &params,
+                                    std::vector<float> &validation_scores
+                                  )
+  {
+    validation_scores.resize(symmetries.size());
+    std::vector<float> pointOcclusionScores;
+    for (size_t symId = 0; symId < symmetries.size(); symId++)
+    {
+      if (reflSymPointOcclusionScores<PointT>(cloud, occupancy_map, symmetries[symId], pointOcclusionScores, params.min_occlusion_distance, params.max_occlusion_distance))
+        validation_scores[symId] = static_cast<float>(utl::mean(pointOcclusionScores));
+      else
+        validation_scores[symId] = -1.0f;
+    }
+  }
+}
+
+/** \brief For every segment find a larger segment that overlaps it enough
+ * for the symmetries of the larger segment to be used as the initial
+ * symmetries of the segment. Only segments that are not warm started
+ * themselves are used as warm start sources.
+ *  \param[in]  num_points        number of points in the scene cloud
+ *  \param[in]  segments          segments
+ *  \param[in]  segment_sizes     segment sizes and indices sorted by size in descending order
+ *  \param[in]  min_iou           minimum intersection over union of the two segments (warm start is disabled if not positive)
+ *  \param[out] warm_start_seg_ids index of the warm start segment for every segment (-1 if a segment is not warm started)
+ */
+template <typename SegmentsT>
+inline
+void getReflSymWarmStartSegments  ( const size_t num_points,
+                                    const SegmentsT &segments,
+                                    const std::vector<std::pair<size_t, int> > &segment_sizes,
+                                    const float min_iou,
+                                    std::vector<int> &warm_start_seg_ids
+                                  )
+{
+  warm_start_seg_ids.assign(segments.size(), -1);
+  if (min_iou <= 0.0f)
+    return;
   
-  std::vector<typename pcl::PointCloud<PointT>::Ptr>    segmentClouds                 (segments.size());
-  std::vector<std::vector<sym::ReflectionalSymmetry> >  symmetry_TMP                  (segments.size());
-  std::vector<std::vector<int> >                        symmetryFilteredIds_TMP       (segments.size());
-  std::vector<std::vector<int> >                        symmetryMergedIds_TMP         (segments.size());
-  std::vector<std::vector<float> >                      occlusionScores_TMP           (segments.size());
-  std::vector<std::vector<float> >                      cloudInlierScores_TMP         (segments.size());  
-  std::vector<std::vector<float> >                      correspInlierScores_TMP       (segments.size());
+  // Segments that are warm start sources that each point belongs to
+  std::vector<std::vector<int> > pointSourceSegIds (num_points);
+  std::vector<int> intersectionSizes (segments.size(), 0);
+  std::vector<int> overlapSegIds;
   
-  # pragma omp parallel for
-  for (size_t segId = 0; segId < segments.size(); segId++)
+  for (size_t segIdIt = 0; segIdIt < segment_sizes.size(); segIdIt++)
   {
-    segmentClouds[segId].reset(new pcl::PointCloud<PointT>);
-    pcl::copyPointCloud(*scene_cloud, segments[segId], *segmentClouds[segId]);
+    const int segId = segment_sizes[segIdIt].second;
     
-    sym::ReflectionalSymmetryDetection<PointT> rsd (sym_detect_params);
-    rsd.setInputCloud(segmentClouds[segId]);
-    rsd.setInputOcuppancyMap(scene_occupancy_map);
-    rsd.detect();
-    rsd.filter();
-    rsd.merge();
-    rsd.getSymmetries(symmetry_TMP[segId], symmetryFilteredIds_TMP[segId], symmetryMergedIds_TMP[segId]);
-    rsd.getScores(occlusionScores_TMP[segId], cloudInlierScores_TMP[segId], correspInlierScores_TMP[segId]);
+    // Count points shared with the source segments processed so far
+    overlapSegIds.clear();
+    for (size_t pointIdIt = 0; pointIdIt < segments[segId].size(); pointIdIt++)
+    {
+      const std::vector<int> &sourceSegIds = pointSourceSegIds[segments[segId][pointIdIt]];
+      for (size_t srcSegIdIt = 0; srcSegIdIt < sourceSegIds.size(); srcSegIdIt++)
+      {
+        if (intersectionSizes[sourceSegIds[srcSegIdIt]]++ == 0)
+          overlapSegIds.push_back(sourceSegIds[srcSegIdIt]);
+      }
+    }
+    
+    // Select the source segment with the largest intersection over union
+    float bestIou = min_iou;
+    for (size_t ovlSegIdIt = 0; ovlSegIdIt < overlapSegIds.size(); ovlSegIdIt++)
+    {
+      const int ovlSegId = overlapSegIds[ovlSegIdIt];
+      const int segIntersection = intersectionSizes[ovlSegId];
+      const int segUnion = segments[segId].size() + segments[ovlSegId].size() - segIntersection;
+      const float iou = static_cast<float>(segIntersection) / static_cast<float>(segUnion);
+      if (iou >= bestIou)
+      {
+        bestIou = iou;
+        warm_start_seg_ids[segId] = ovlSegId;
+      }
+      intersectionSizes[ovlSegId] = 0;
+    }
+    
+    // Segments that are not warm started become warm start sources
+    if (warm_start_seg_ids[segId] == -1)
+    {
+      for (size_t pointIdIt = 0; pointIdIt < segments[segId].size(); pointIdIt++)
+        pointSourceSegIds[segments[segId][pointIdIt]].push_back(segId);
+    }
   }
+}
 
-  //----------------------------------------------------------------------------
-  // Merge symmetries for the whole cloud
-  //----------------------------------------------------------------------------
+/** \brief Detect and filter the symmetries of a reflectional symmetry
+ * detection object, refining every symmetry hypothesis as a separate task.
+ *  \param[in,out] rsd     reflectional symmetry detection object with the input set
+ *  \param[in]     seg_id  index of the segment the hypotheses are attributed to when profiling
+ */
+template <typename PointT>
+inline
+void detectReflSymTasks (sym::ReflectionalSymmetryDetection<PointT> &rsd, const int seg_id)
+{
+  if (rsd.initialize())
+  {
+    for (int hypId = 0; hypId < rsd.getNumHypotheses(); hypId++)
+    {
+      # pragma omp task shared(rsd)
+      {
+        UTL_PROFILE_SEGMENT("reflectional_detection", seg_id);
+        rsd.refineHypothesis(hypId);
+      }
+    }
+    
+    # pragma omp taskwait
+    rsd.finalize();
+  }
+  rsd.filter();
+}
+
+/** \brief Get the sizes of segments sorted in descending order together with
+ * the segment indices. This is the order in which segments are processed.
+ *  \param[in]  segments        segments
+ *  \param[out] segment_sizes   segment sizes and indices
+ */
+template <typename SegmentsT>
+inline
+void getReflSymSegmentSizes ( const SegmentsT &segments,
+                              std::vector<std::pair<size_t, int> > &segment_sizes
+                            )
+{
+  segment_sizes.resize(segments.size());
+  for (size_t segId = 0; segId < segments.size(); segId++)
+    segment_sizes[segId] = std::pair<size_t, int>(segments[segId].size(), segId);
+  std::sort(segment_sizes.begin(), segment_sizes.end(), std::greater<std::pair<size_t, int> >());
+}
+
+/** \brief Detect the symmetries of every segment of a scene. Segments are
+ * either a utl::Map or a utl::SegmentSet. Segments whose detection is already
+ * marked as detected are kept as they are and may warm start other segments.
+ * This allows to reuse the detections of segments that did not change since
+ * an earlier call. Segments whose detection would start after the deadline
+ * are left undetected. Detections that were skipped or cut short by the
+ * deadline are marked as partial.
+ * If a detection cache is given, segments found in the cache whose
+ * validation scores still match the occupancy map are not detected again.
+ * Warm started segments are keyed together with their warm start symmetries.
+ * Complete detections are added to the cache.
+ *  \param[in]     scene_cloud          scene cloud
+ *  \param[in]     scene_occupancy_map  scene occupancy map
+ *  \param[in]     segments             segments
+ *  \param[in]     sym_detect_params    detection parameters
+ *  \param[in,out] segment_detections   detections of every segment
+ *  \param[in]     deadline             detection deadline
+ *  \param[in,out] cache                detection cache (NULL - no caching)
+ */
+template <typename PointT, typename SegmentsT>
+void detectReflSymSegments  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                              const OccupancyMapConstPtr                        &scene_occupancy_map,
+                              const SegmentsT                                   &segments,
+                              const sym::ReflSymDetectParams                    &sym_detect_params,
+                              std::vector<sym::ReflSymSegmentDetection>         &segment_detections,
+                              const utl::Deadline                               &deadline = utl::Deadline (),
+                              sym::ReflSymDetectionCache                        *cache = NULL
+                            )
+{
+  segment_detections.resize(segments.size());
+
+  if (scene_cloud->size() < 3)
+    return;
+  
+  // Build a single search tree for the scene. Each segment is searched through
+  // a view of this tree that only returns the points of the segment.
+  typename pcl::search::KdTree<PointT>::Ptr sceneSearchTree (new pcl::search::KdTree<PointT>);
+  sceneSearchTree->setInputCloud(scene_cloud);
   
+  // Segments are processed as tasks, largest segments first. Every segment
+  // task spawns a task for each of its symmetry hypotheses and filters and
+  // merges the refined hypotheses once all of them are done. This keeps all
+  // threads busy even when segment sizes are very different.
+  std::vector<std::pair<size_t, int> > segmentSizes;
+  getReflSymSegmentSizes(segments, segmentSizes);
+  
+  // Find segments that overlap a larger segment enough to be warm started
+  // with its symmetries. Such segments are processed after all of the others.
+  std::vector<int> warmStartSegIds;
+  getReflSymWarmStartSegments(scene_cloud->size(), segments, segmentSizes, sym_detect_params.warm_start_min_iou, warmStartSegIds);
+  
+  // Cache state of every segment. The cache is only read while the segments
+  // are processed and is updated afterwards.
+  const uint64_t paramsKey = cache ? sym::getReflSymDetectParamsKey(sym_detect_params) : 0;
+  std::vector<uint64_t> segmentKeys (segments.size(), 0);
+  std::vector<std::vector<float> > segmentValidationScores (segments.size());
+  std::vector<char> segmentCached (segments.size(), 0), segmentCacheable (segments.size(), 0);
+  
+  # pragma omp parallel
+  {
+    # pragma omp single
+    {
+      for (int pass = 0; pass < 2; pass++)
+      {
+        for (size_t segIdIt = 0; segIdIt < segmentSizes.size(); segIdIt++)
+        {
+          const int segId = segmentSizes[segIdIt].second;
+          const int warmStartSegId = warmStartSegIds[segId];
+          if ((warmStartSegId == -1) != (pass == 0) || segment_detections[segId].detected)
+            continue;
+          
+          # pragma omp task
+          {
+            UTL_PROFILE_SEGMENT("reflectional_detection", segId);
+            
+            // Segments that start after the deadline are left undetected
+            if (deadline.expired())
+            {
+              segment_detections[segId].partial = true;
+            }
+            else
+            {
+              sym::ReflSymSegmentDetection &detection = segment_detections[segId];
+            
+              std::vector<int> segmentIndicesBuffer;
+              const std::vector<int> &segmentIndices = utl::getSegmentIndices(segments[segId], segmentIndicesBuffer);
+            
+              // Warm start with the filtered symmetries of the overlapping segment
+              std::vector<sym::ReflectionalSymmetry> warmStartSymmetries;
+              if (warmStartSegId != -1)
+              {
+                const sym::ReflSymSegmentDetection &warmStartDetection = segment_detections[warmStartSegId];
+                for (size_t symIdIt = 0; symIdIt < warmStartDetection.filtered_ids.size(); symIdIt++)
+                  warmStartSymmetries.push_back(warmStartDetection.symmetries[warmStartDetection.filtered_ids[symIdIt]]);
+              }
+              
+              // Use the cached detection of the segment if its symmetries
+              // still agree with the occupancy map
+              if (cache)
+              {
+                uint64_t &segmentKey = segmentKeys[segId];
+                segmentKey = cache->getSegmentKey(*scene_cloud, segmentIndices, paramsKey);
+                for (size_t symIdIt = 0; symIdIt < warmStartSymmetries.size(); symIdIt++)
+                {
+                  const Eigen::Vector3f origin = warmStartSymmetries[symIdIt].getOrigin();
+                  const Eigen::Vector3f normal = warmStartSymmetries[symIdIt].getNormal();
+                  segmentKey = utl::hashBytes(origin.data(), 3 * sizeof(float), segmentKey);
+                  segmentKey = utl::hashBytes(normal.data(), 3 * sizeof(float), segmentKey);
+                }
+                
+                const sym::ReflSymDetectionCache::Entry *entry = cache->find(segmentKey);
+                if (entry)
+                {
+                  utl::PointCloudSoA segmentCloudSoA;
+                  segmentCloudSoA.setInputCloud(*scene_cloud, segmentIndices);
+                  sym::getReflSymValidationScores<PointT>(segmentCloudSoA, scene_occupancy_map, entry->detection.symmetries, sym_detect_params, segmentValidationScores[segId]);
+                  if (cache->isValid(*entry, segmentValidationScores[segId]))
+                  {
+                    detection = entry->detection;
+                    segmentCached[segId] = 1;
+                  }
+                }
+              }
+              
+              if (!segmentCached[segId])
+              {
+                typename utl::IndicesSearch<PointT>::Ptr segmentSearch (new utl::IndicesSearch<PointT> (sceneSearchTree, segmentIndices));
+                typename pcl::PointCloud<PointT>::ConstPtr segmentCloud = segmentSearch->getInputCloud();
+                
+                sym::ReflectionalSymmetryDetection<PointT> rsd (sym_detect_params);
+                rsd.setInputCloud(segmentCloud);
+                rsd.setInputOcuppancyMap(scene_occupancy_map);
+                rsd.setSearchMethod(segmentSearch);
+                rsd.setInputSymmetries(warmStartSymmetries);
+                rsd.setDeadline(deadline);
+                detectReflSymTasks(rsd, segId);
+                bool complete = !rsd.isPartial();
+              
+                // Fall back to the full set of initial symmetries if warm start
+                // did not produce any good symmetries
+                std::vector<sym::ReflectionalSymmetry> symmetries;
+                std::vector<int> symmetryFilteredIds, symmetryMergedIds;
+                rsd.getSymmetries(symmetries, symmetryFilteredIds, symmetryMergedIds);
+                if (!warmStartSymmetries.empty() && symmetryFilteredIds.empty())
+                {
+                  if (!deadline.expired())
+                  {
+                    rsd.setInputSymmetries(std::vector<sym::ReflectionalSymmetry>());
+                    detectReflSymTasks(rsd, segId);
+                    complete = !rsd.isPartial();
+                  }
+                  else
+                  {
+                    complete = false;
+                  }
+                }
+              
+                rsd.merge();
+                rsd.getSymmetries(detection.symmetries, detection.filtered_ids, detection.merged_ids);
+                rsd.getScores(detection.occlusion_scores, detection.cloud_inlier_scores, detection.corresp_inlier_scores);
+              
+                Eigen::Vector4f centroid;
+                pcl::compute3DCentroid(*segmentCloud, centroid);
+                detection.num_points = segmentCloud->size();
+                detection.reference_point = centroid.head(3);
+                detection.detected = true;
+                detection.partial = !complete;
+                
+                // Only complete detections are cached
+                if (cache && complete)
+                {
+                  const utl::PointCloudSoA segmentCloudSoA (*segmentCloud);
+                  sym::getReflSymValidationScores<PointT>(segmentCloudSoA, scene_occupancy_map, detection.symmetries, sym_detect_params, segmentValidationScores[segId]);
+                  segmentCacheable[segId] = 1;
+                }
+              }
+            }
+          }
+        }
+        
+        // Warm started segments need the results of the segments they overlap
+        # pragma omp taskwait
+      }
+    }
+  }
+  
+  // Update the cache
+  if (cache)
+  {
+    for (size_t segId = 0; segId < segments.size(); segId++)
+    {
+      if (segmentCached[segId])
+        cache->touch(segmentKeys[segId]);
+      else if (segmentCacheable[segId])
+        cache->insert(segmentKeys[segId], segment_detections[segId], segmentValidationScores[segId]);
+    }
+  }
+}
+
+/** \brief Merge similar symmetries of all segments of a scene.
+ *  \param[in]  segment_detections        detections of every segment
+ *  \param[in]  sym_detect_params         detection parameters
+ *  \param[out] symmetry                  merged symmetries
+ *  \param[out] symmetry_support_seg_ids  index of the segment supporting every symmetry
+ */
+inline
+void mergeReflSymSegments ( const std::vector<sym::ReflSymSegmentDetection> &segment_detections,
+                            const sym::ReflSymDetectParams                  &sym_detect_params,
+                            std::vector<sym::ReflectionalSymmetry>          &symmetry,
+                            std::vector<int>                                &symmetry_support_seg_ids
+                          )
+{
   // Linearize symmetry data
   std::vector<sym::ReflectionalSymmetry>  symmetry_linear;
   std::vector<std::pair<int,int> >        symmetry_linearMap;    // A map from linear ID to corresponding segment and symmetry IDs
@@ -62,20 +454,18 @@ bool detectReflectionalSymmetryScene  ( const typename pcl::PointCloud<PointT>::
   std::vector<float>                      occlusionScores_linear;
   
   std::vector<Eigen::Vector3f> referencePoints_linear;
-  for (size_t segId = 0; segId < symmetryMergedIds_TMP.size(); segId++)
+  for (size_t segId = 0; segId < segment_detections.size(); segId++)
   {
-    for (size_t symIdIt = 0; symIdIt < symmetryMergedIds_TMP[segId].size(); symIdIt++)
+    const sym::ReflSymSegmentDetection &detection = segment_detections[segId];
+    for (size_t symIdIt = 0; symIdIt < detection.merged_ids.size(); symIdIt++)
     {
-      int symId = symmetryMergedIds_TMP[segId][symIdIt];
-      symmetry_linear.push_back(symmetry_TMP[segId][symId]);
+      int symId = detection.merged_ids[symIdIt];
+      symmetry_linear.push_back(detection.symmetries[symId]);
       symmetry_linearMap.push_back(std::pair<int,int>(segId, symId));
       
-      occlusionScores_linear.push_back(occlusionScores_TMP[segId][symId]);
-      supportSizes_linear.push_back(static_cast<float>(segmentClouds[segId]->size()));
-      
-      Eigen::Vector4f centroid;
-      pcl::compute3DCentroid(*segmentClouds[segId], centroid);
-      referencePoints_linear.push_back(centroid.head(3));
+      occlusionScores_linear.push_back(detection.occlusion_scores[symId]);
+      supportSizes_linear.push_back(static_cast<float>(detection.num_points));
+      referencePoints_linear.push_back(detection.reference_point);
     }
   }
   
@@ -95,7 +485,7 @@ bool detectReflectionalSymmetryScene  ( const typename pcl::PointCloud<PointT>::
   //----------------------------------------------------------------------------
   
   symmetry.resize(symmetryMergedGlobalIds_linear.size());
-  symmetry_support_segments.resize(symmetryMergedGlobalIds_linear.size());
+  symmetry_support_seg_ids.resize(symmetryMergedGlobalIds_linear.size());
   
   for (size_t symIdIt = 0; symIdIt < symmetryMergedGlobalIds_linear.size(); symIdIt++)
   {
@@ -103,10 +493,104 @@ bool detectReflectionalSymmetryScene  ( const typename pcl::PointCloud<PointT>::
     int segId     = symmetry_linearMap[symLinId].first;
     int symId     = symmetry_linearMap[symLinId].second;
     
-    symmetry[symIdIt] = symmetry_TMP[segId][symId];
-    symmetry_support_segments[symIdIt] = segments[segId];
+    symmetry[symIdIt] = segment_detections[segId].symmetries[symId];
+    symmetry_support_seg_ids[symIdIt] = segId;
+  }
+}
+
+/** \brief Detect the symmetries of every segment of a scene and merge
+ * similar symmetries of all segments. Segments are either a utl::Map or a
+ * utl::SegmentSet.
+ *  \param[in]  scene_cloud               scene cloud
+ *  \param[in]  scene_occupancy_map       scene occupancy map
+ *  \param[in]  segments                  segments
+ *  \param[in]  sym_detect_params         detection parameters
+ *  \param[out] symmetry                  detected symmetries
+ *  \param[out] symmetry_support_seg_ids  index of the segment supporting every symmetry
+ *  \param[in]  deadline                  detection deadline (see detectReflSymSegments)
+ *  \param[in,out] cache                  detection cache (see detectReflSymSegments)
+ */
+template <typename PointT, typename SegmentsT>
+bool detectReflSymSceneSupport  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                                  const OccupancyMapConstPtr                        &scene_occupancy_map,
+                                  const SegmentsT                                   &segments,
+                                  const sym::ReflSymDetectParams                    &sym_detect_params,
+                                  std::vector<sym::ReflectionalSymmetry>            &symmetry,
+                                  std::vector<int>                                  &symmetry_support_seg_ids,
+                                  const utl::Deadline                               &deadline = utl::Deadline (),
+                                  sym::ReflSymDetectionCache                        *cache = NULL
+                                )
+{
+  symmetry.resize(0);
+  symmetry_support_seg_ids.resize(0);
+  
+  if (scene_cloud->size() < 3)
+    return true;
+
+  //----------------------------------------------------------------------------
+  // Reflectional symmetry detection
+  //----------------------------------------------------------------------------
+  
+  std::vector<sym::ReflSymSegmentDetection> segmentDetections;
+  detectReflSymSegments<PointT> (scene_cloud, scene_occupancy_map, segments, sym_detect_params, segmentDetections, deadline, cache);
+
+  //----------------------------------------------------------------------------
+  // Merge symmetries for the whole cloud
+  //----------------------------------------------------------------------------
+  
+  mergeReflSymSegments(segmentDetections, sym_detect_params, symmetry, symmetry_support_seg_ids);
+  
+  return true;
+}
+
+/** \brief Detect the symmetries of a scene. See detectReflSymSceneSupport for details.
+ *  \param[out] symmetry_support_segments   segment supporting every symmetry
+ */
+template <typename PointT>
+bool detectReflectionalSymmetryScene  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                                        const OccupancyMapConstPtr                        &scene_occupancy_map,
+                                        const utl::Map                                    &segments,
+                                        const sym::ReflSymDetectParams                    &sym_detect_params,
+                                        std::vector<sym::ReflectionalSymmetry>            &symmetry,
+                                        std::vector<std::vector<int> >                    &symmetry_support_segments,
+                                        const utl::Deadline                               &deadline = utl::Deadline (),
+                                        sym::ReflSymDetectionCache                        *cache = NULL
+                                      )
+{
+  std::vector<int> symmetrySupportSegIds;
+  if (!detectReflSymSceneSupport<PointT> (scene_cloud, scene_occupancy_map, segments, sym_detect_params, symmetry, symmetrySupportSegIds, deadline, cache))
+    return false;
+  
+  symmetry_support_segments.resize(symmetrySupportSegIds.size());
+  for (size_t symId = 0; symId < symmetrySupportSegIds.size(); symId++)
+    symmetry_support_segments[symId] = segments[symmetrySupportSegIds[symId]];
+  
+  return true;
+}
+
+/** \brief Detect the symmetries of a scene. See detectReflSymSceneSupport for details. Support
+ * segments share the storage of the input segments.
+ *  \param[out] symmetry_support_segments   segment supporting every symmetry
+ */
+template <typename PointT>
+bool detectReflectionalSymmetryScene  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                                        const OccupancyMapConstPtr                        &scene_occupancy_map,
+                                        const utl::SegmentSet                             &segments,
+                                        const sym::ReflSymDetectParams                    &sym_detect_params,
+                                        std::vector<sym::ReflectionalSymmetry>            &symmetry,
+                                        utl::SegmentSet                                   &symmetry_support_segments,
+                                        const utl::Deadline                               &deadline = utl::Deadline (),
+                                        sym::ReflSymDetectionCache                        *cache = NULL
+                                      )
+{
+  std::vector<int> symmetrySupportSegIds;
+  if (!detectReflSymSceneSupport<PointT> (scene_cloud, scene_occupancy_map, segments, sym_detect_params, symmetry, symmetrySupportSegIds, deadline, cache))
+  {
+    symmetry_support_segments = utl::SegmentSet ();
+    return false;
   }
   
+  symmetry_support_segments = segments.select(symmetrySupportSegIds);
   return true;
 }
 
@@ -7,48 +7,247 @@
 
 // Symmetry includes
 #include <symmetry/rotational_symmetry_detection.hpp>
+#include <segment_detection_cache.hpp>
 
-template <typename PointT>
-bool detectRotationalSymmetryScene  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
-                                      const OccupancyMapConstPtr                        &scene_occupancy_map,
-                                      const utl::Map                                    &segments,
-                                      const sym::RotSymDetectParams                     &sym_detect_params,
-                                      std::vector<sym::RotationalSymmetry>              &symmetry,
-                                      std::vector<std::vector<int> >                    &symmetry_support_segments
-                                    )
+// STD includes
+#include <algorithm>
+#include <functional>
+
+// Utilities includes
+#include <pointcloud/indices_search.hpp>
+#include <segment_set.hpp>
+#include <profiling.hpp>
+
+namespace sym
+{
+  /** \brief Rotational symmetries detected in a single segment of a scene
+   * together with their filtered and merged indices and scores.
+   */
+  struct RotSymSegmentDetection
+  {
+    std::vector<sym::RotationalSymmetry>  symmetries;
+    std::vector<int>                      filtered_ids;
+    std::vector<int>                      merged_ids;
+    std::vector<float>                    symmetry_scores;
+    std::vector<float>                    occlusion_scores;
+    std::vector<float>                    perpendicular_scores;
+    std::vector<float>                    coverage_scores;
+  };
+
+  /** \brief Cache of rotational segment detections. */
+  typedef SegmentDetectionCache<RotSymSegmentDetection> RotSymDetectionCache;
+
+  /** \brief Get a key of the rotational detection parameters. Two sets of
+   * parameters with the same key give the same detections.
+   *  \param[in]  params  detection parameters
+   */
+  inline
+  uint64_t getRotSymDetectParamsKey (const RotSymDetectParams &params)
+  {
+    uint64_t key = utl::HASH_SEED;
+    key = hashValue(params.voting_num_pairs, key);
+    key = hashValue(params.voting_max_hypotheses, key);
+    key = hashValue(params.voting_angle_step, key);
+    key = hashValue(params.voting_distance_step, key);
+    key = hashValue(params.voting_max_line_distance, key);
+    key = hashValue(params.ref_max_fit_angle, key);
+    key = hashValue(params.min_normal_fit_angle, key);
+    key = hashValue(params.max_normal_fit_angle, key);
+    key = hashValue(params.min_occlusion_distance, key);
+    key = hashValue(params.max_occlusion_distance, key);
+    key = hashValue(params.precise_coverage, key);
+    key = hashValue(params.max_symmetry_score, key);
+    key = hashValue(params.max_occlusion_score, key);
+    key = hashValue(params.max_perpendicular_score, key);
+    key = hashValue(params.min_coverage_score, key);
+    return key;
+  }
+
+  /** \brief Get the validation scores of rotational symmetries of a segment
+   * used by the detection cache: the occlusion score of the segment points
+   * rotated around every symmetry axis.
+   *  \param[in]  cloud               structure of arrays view of the segment cloud
+   *  \param[in]  occupancy_map       scene occupancy map
+   *  \param[in]  symmetries          symmetries of the segment
+   *  \param[in]  params              detection parameters
+   *  \param[out] validation_scores   validation score of every symmetry
+   */
+  inline
+  void getRotSymValidationScores  ( const utl::PointCloudSoA &cloud,
+                                    const OccupancyMapConstPtr &occupancy_map,
+                                    const std::vector<RotationalSymmetry> &symmetries,
+                                    const RotSymDetectParams &params,
+                                    std::vector<float> &validation_scores
+                                  )
+  {
+    validation_scores.resize(symmetries.size());
+    std::vector<float> pointOcclusionScores;
+    for (size_t symId = 0; symId < symmetries.size(); symId++)
+      validation_scores[symId] = rotSymCloudOcclusionScore(cloud, occupancy_map, symmetries[symId], pointOcclusionScores, params.min_occlusion_distance, params.max_occlusion_distance);
+  }
+}
+
+/** \brief Detect the symmetries of every segment of a scene and merge
+ * similar symmetries of all segments. Segments are either a utl::Map or a
+ * utl::SegmentSet. Segments whose detection would start after the deadline
+ * are skipped.
+ * If a detection cache is given, segments found in the cache whose
+ * validation scores still match the occupancy map are not detected again.
+ * Complete detections are added to the cache.
+ *  \param[in]  scene_cloud               scene cloud
+ *  \param[in]  scene_occupancy_map       scene occupancy map
+ *  \param[in]  segments                  segments
+ *  \param[in]  sym_detect_params         detection parameters
+ *  \param[out] symmetry                  detected symmetries
+ *  \param[out] symmetry_support_seg_ids  index of the segment supporting every symmetry
+ *  \param[in]  deadline                  detection deadline
+ *  \param[in,out] cache                  detection cache (NULL - no caching)
+ *  \param[out] partial                   set to TRUE if a segment detection was skipped or cut short by the deadline (NULL - not reported)
+ */
+template <typename PointT, typename SegmentsT>
+bool detectRotSymSceneSupport  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                                 const OccupancyMapConstPtr                        &scene_occupancy_map,
+                                 const SegmentsT                                   &segments,
+                                 const sym::RotSymDetectParams                     &sym_detect_params,
+                                 std::vector<sym::RotationalSymmetry>              &symmetry,
+                                 std::vector<int>                                  &symmetry_support_seg_ids,
+                                 const utl::Deadline                               &deadline = utl::Deadline (),
+                                 sym::RotSymDetectionCache                         *cache = NULL,
+                                 bool                                              *partial = NULL
+                               )
 {
   symmetry.resize(0);
-  symmetry_support_segments.resize(0);
+  symmetry_support_seg_ids.resize(0);
 
   //----------------------------------------------------------------------------
   // Rotational symmetry detection
   //----------------------------------------------------------------------------
 
-  std::vector<typename pcl::PointCloud<PointT>::Ptr>  segmentClouds                 (segments.size());
-  std::vector<std::vector<sym::RotationalSymmetry> >  symmetry_TMP                  (segments.size());
-  std::vector<std::vector<int> >                      symmetryFilteredIds_TMP       (segments.size());
-  std::vector<std::vector<int> >                      symmetryMergedIds_TMP         (segments.size());
-  std::vector<std::vector<float> >                    symmetryScores_TMP            (segments.size());
-  std::vector<std::vector<float> >                    occlusionScores_TMP           (segments.size());
-  std::vector<std::vector<float> >                    perpendicularScores_TMP       (segments.size());
-  std::vector<std::vector<float> >                    coverageScores_TMP            (segments.size());
+  std::vector<sym::RotSymSegmentDetection>                 segmentDetections             (segments.size());
+  
+  // Build a single search tree for the scene. Each segment is searched through
+  // a view of this tree that only returns the points of the segment.
+  typename pcl::search::KdTree<PointT>::Ptr sceneSearchTree (new pcl::search::KdTree<PointT>);
+  sceneSearchTree->setInputCloud(scene_cloud);
   
-  # pragma omp parallel for
+  // Segments are processed as tasks, largest segments first. Every segment
+  // task spawns a task for each of its symmetry hypotheses and filters and
+  // merges the refined hypotheses once all of them are done. This keeps all
+  // threads busy even when segment sizes are very different.
+  std::vector<std::pair<size_t, int> > segmentSizes (segments.size());
   for (size_t segId = 0; segId < segments.size(); segId++)
+    segmentSizes[segId] = std::pair<size_t, int>(segments[segId].size(), segId);
+  std::sort(segmentSizes.begin(), segmentSizes.end(), std::greater<std::pair<size_t, int> >());
+  
+  // Cache state of every segment. The cache is only read while the segments
+  // are processed and is updated afterwards.
+  const uint64_t paramsKey = cache ? sym::getRotSymDetectParamsKey(sym_detect_params) : 0;
+  std::vector<uint64_t> segmentKeys (segments.size(), 0);
+  std::vector<std::vector<float> > segmentValidationScores (segments.size());
+  std::vector<char> segmentCached (segments.size(), 0), segmentCacheable (segments.size(), 0);
+  std::vector<char> segmentPartial (segments.size(), 0);
+  
+  # pragma omp parallel
   {
-    segmentClouds[segId].reset(new pcl::PointCloud<PointT>);
-    pcl::copyPointCloud(*scene_cloud, segments[segId], *segmentClouds[segId]);
-    
-    sym::RotationalSymmetryDetection<PointT> rsd (sym_detect_params);
-    rsd.setInputCloud(segmentClouds[segId]);
-    rsd.setInputOcuppancyMap(scene_occupancy_map);
-    rsd.detect();
-    rsd.filter();
-    rsd.merge();
-    rsd.getSymmetries(symmetry_TMP[segId], symmetryFilteredIds_TMP[segId], symmetryMergedIds_TMP[segId]);
-    rsd.getScores(symmetryScores_TMP[segId], occlusionScores_TMP[segId], perpendicularScores_TMP[segId], coverageScores_TMP[segId]);
+    # pragma omp single
+    {
+      for (size_t segIdIt = 0; segIdIt < segmentSizes.size(); segIdIt++)
+      {
+        const int segId = segmentSizes[segIdIt].second;
+        
+        # pragma omp task
+        {
+          UTL_PROFILE_SEGMENT("rotational_detection", segId);
+          
+          // Segments that start after the deadline are skipped
+          if (deadline.expired())
+          {
+            segmentPartial[segId] = 1;
+          }
+          else
+          {
+            sym::RotSymSegmentDetection &detection = segmentDetections[segId];
+            
+            std::vector<int> segmentIndicesBuffer;
+            const std::vector<int> &segmentIndices = utl::getSegmentIndices(segments[segId], segmentIndicesBuffer);
+            
+            // Use the cached detection of the segment if its symmetries still
+            // agree with the occupancy map
+            if (cache)
+            {
+              segmentKeys[segId] = cache->getSegmentKey(*scene_cloud, segmentIndices, paramsKey);
+              const sym::RotSymDetectionCache::Entry *entry = cache->find(segmentKeys[segId]);
+              if (entry)
+              {
+                utl::PointCloudSoA segmentCloudSoA;
+                segmentCloudSoA.setInputCloud(*scene_cloud, segmentIndices);
+                sym::getRotSymValidationScores(segmentCloudSoA, scene_occupancy_map, entry->detection.symmetries, sym_detect_params, segmentValidationScores[segId]);
+                if (cache->isValid(*entry, segmentValidationScores[segId]))
+                {
+                  detection = entry->detection;
+                  segmentCached[segId] = 1;
+                }
+              }
+            }
+            
+            if (!segmentCached[segId])
+            {
+              typename utl::IndicesSearch<PointT>::Ptr segmentSearch (new utl::IndicesSearch<PointT> (sceneSearchTree, segmentIndices));
+              typename pcl::PointCloud<PointT>::ConstPtr segmentCloud = segmentSearch->getInputCloud();
+              
+              sym::RotationalSymmetryDetection<PointT> rsd (sym_detect_params);
+              rsd.setInputCloud(segmentCloud);
+              rsd.setInputOcuppancyMap(scene_occupancy_map);
+              rsd.setSearchMethod(segmentSearch);
+              rsd.setDeadline(deadline);
+              if (rsd.initialize())
+              {
+                for (int hypId = 0; hypId < rsd.getNumHypotheses(); hypId++)
+                {
+                  # pragma omp task shared(rsd)
+                  {
+                    UTL_PROFILE_SEGMENT("rotational_detection", segId);
+                    rsd.refineHypothesis(hypId);
+                  }
+                }
+              
+                # pragma omp taskwait
+              }
+              rsd.filter();
+              rsd.merge();
+              rsd.getSymmetries(detection.symmetries, detection.filtered_ids, detection.merged_ids);
+              rsd.getScores(detection.symmetry_scores, detection.occlusion_scores, detection.perpendicular_scores, detection.coverage_scores);
+              
+              // Only complete detections are cached
+              segmentPartial[segId] = rsd.isPartial();
+              if (cache && !segmentPartial[segId])
+              {
+                const utl::PointCloudSoA segmentCloudSoA (*segmentCloud);
+                sym::getRotSymValidationScores(segmentCloudSoA, scene_occupancy_map, detection.symmetries, sym_detect_params, segmentValidationScores[segId]);
+                segmentCacheable[segId] = 1;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  
+  // Update the cache
+  if (cache)
+  {
+    for (size_t segId = 0; segId < segments.size(); segId++)
+    {
+      if (segmentCached[segId])
+        cache->touch(segmentKeys[segId]);
+      else if (segmentCacheable[segId])
+        cache->insert(segmentKeys[segId], segmentDetections[segId], segmentValidationScores[segId]);
+    }
   }
 
+  if (partial)
+    *partial = std::find(segmentPartial.begin(), segmentPartial.end(), 1) != segmentPartial.end();
+
   //----------------------------------------------------------------------------
   // Merge symmetries for the whole cloud
   //----------------------------------------------------------------------------
@@ -60,19 +259,22 @@ bool detectRotationalSymmetryScene  ( const typename pcl::PointCloud<PointT>::Co
   std::vector<float>                    occlusionScores_linear;
   
   std::vector<Eigen::Vector3f> referencePoints_linear;
-  for (size_t segId = 0; segId < symmetryMergedIds_TMP.size(); segId++)
+  std::vector<int> segmentIndicesBuffer;
+  for (size_t segId = 0; segId < segmentDetections.size(); segId++)
   {
-    for (size_t symIdIt = 0; symIdIt < symmetryMergedIds_TMP[segId].size(); symIdIt++)
+    const sym::RotSymSegmentDetection &detection = segmentDetections[segId];
+    const std::vector<int> &segmentIndices = utl::getSegmentIndices(segments[segId], segmentIndicesBuffer);
+    for (size_t symIdIt = 0; symIdIt < detection.merged_ids.size(); symIdIt++)
     {
-      int symId = symmetryMergedIds_TMP[segId][symIdIt];
-      symmetry_linear.push_back(symmetry_TMP[segId][symId]);
+      int symId = detection.merged_ids[symIdIt];
+      symmetry_linear.push_back(detection.symmetries[symId]);
       symmetry_linearMap.push_back(std::pair<int,int>(segId, symId));
       
-      occlusionScores_linear.push_back(occlusionScores_TMP[segId][symId]);
+      occlusionScores_linear.push_back(detection.occlusion_scores[symId]);
       supportSizes_linear.push_back(static_cast<float>(segments[segId].size()));
       
       Eigen::Vector4f centroid;
-      pcl::compute3DCentroid(*segmentClouds[segId], centroid);
+      pcl::compute3DCentroid(*scene_cloud, segmentIndices, centroid);
       referencePoints_linear.push_back(centroid.head(3));
     }
   }
@@ -91,7 +293,7 @@ bool detectRotationalSymmetryScene  ( const typename pcl::PointCloud<PointT>::Co
   //----------------------------------------------------------------------------
   
   symmetry.resize(symmetryMergedGlobalIds_linear.size());
-  symmetry_support_segments.resize(symmetryMergedGlobalIds_linear.size());
+  symmetry_support_seg_ids.resize(symmetryMergedGlobalIds_linear.size());
   
   for (size_t symIdIt = 0; symIdIt < symmetryMergedGlobalIds_linear.size(); symIdIt++)
   {
@@ -99,10 +301,63 @@ bool detectRotationalSymmetryScene  ( const typename pcl::PointCloud<PointT>::Co
     int segId     = symmetry_linearMap[symLinId].first;
     int symId     = symmetry_linearMap[symLinId].second;
     
-    symmetry[symIdIt] = symmetry_TMP[segId][symId];
-    symmetry_support_segments[symIdIt] = segments[segId];
+    symmetry[symIdIt] = segmentDetections[segId].symmetries[symId];
+    symmetry_support_seg_ids[symIdIt] = segId;
+  }
+  
+  return true;
+}
+
+/** \brief Detect the symmetries of a scene. See detectRotSymSceneSupport for details.
+ *  \param[out] symmetry_support_segments   segment supporting every symmetry
+ */
+template <typename PointT>
+bool detectRotationalSymmetryScene  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                                      const OccupancyMapConstPtr                        &scene_occupancy_map,
+                                      const utl::Map                                    &segments,
+                                      const sym::RotSymDetectParams                     &sym_detect_params,
+                                      std::vector<sym::RotationalSymmetry>              &symmetry,
+                                      std::vector<std::vector<int> >                    &symmetry_support_segments,
+                                      const utl::Deadline                               &deadline = utl::Deadline (),
+                                      sym::RotSymDetectionCache                         *cache = NULL,
+                                      bool                                              *partial = NULL
+                                    )
+{
+  std::vector<int> symmetrySupportSegIds;
+  if (!detectRotSymSceneSupport<PointT> (scene_cloud, scene_occupancy_map, segments, sym_detect_params, symmetry, symmetrySupportSegIds, deadline, cache, partial))
+    return false;
+  
+  symmetry_support_segments.resize(symmetrySupportSegIds.size());
+  for (size_t symId = 0; symId < symmetrySupportSegIds.size(); symId++)
+    symmetry_support_segments[symId] = segments[symmetrySupportSegIds[symId]];
+  
+  return true;
+}
+
+/** \brief Detect the symmetries of a scene. See detectRotSymSceneSupport for details. Support
+ * segments share the storage of the input segments.
+ *  \param[out] symmetry_support_segments   segment supporting every symmetry
+ */
+template <typename PointT>
+bool detectRotationalSymmetryScene  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                                      const OccupancyMapConstPtr                        &scene_occupancy_map,
+                                      const utl::SegmentSet                             &segments,
+                                      const sym::RotSymDetectParams                     &sym_detect_params,
+                                      std::vector<sym::RotationalSymmetry>              &symmetry,
+                                      utl::SegmentSet                                   &symmetry_support_segments,
+                                      const utl::Deadline                               &deadline = utl::Deadline (),
+                                      sym::RotSymDetectionCache                         *cache = NULL,
+                                      bool                                              *partial = NULL
+                                    )
+{
+  std::vector<int> symmetrySupportSegIds;
+  if (!detectRotSymSceneSupport<PointT> (scene_cloud, scene_occupancy_map, segments, sym_detect_params, symmetry, symmetrySupportSegIds, deadline, cache, partial))
+  {
+    symmetry_support_segments = utl::SegmentSet ();
+    return false;
   }
   
+  symmetry_support_segments = segments.select(symmetrySupportSegIds);
   return true;
 }
 
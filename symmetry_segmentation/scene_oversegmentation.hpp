@@ -13,17 +13,31 @@
 #include <region_growing_smoothness/region_growing_smoothness.hpp>
 #include <segmentation.hpp>
 
+// Utilities includes
+#include <segment_set.hpp>
 
+/** \brief Downsample a scene and segment it into smooth segments for every
+ * smoothness threshold. Duplicate segments are not removed.
+ *  \param[in]  scene_cloud       input scene cloud
+ *  \param[in]  overseg_params    oversegmentation parameters
+ *  \param[out] scene_cloud_ds    downsampled scene cloud
+ *  \param[out] downsample_map    map from downsampled points to the points of the input cloud
+ *  \param[out] overseg_segments_raw  segments for every smoothness threshold (including duplicates)
+ */
 template <typename PointT>
-bool oversegmentScene ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
-                        const utl::SmoothSegParams                        &overseg_params,
-                        typename pcl::PointCloud<PointT>::Ptr             &scene_cloud_ds,
-                        utl::Map                                          &downsample_map,
-                        std::vector<utl::Map>                             &overseg_segments,
-                        utl::Map                                          &overseg_segments_linear
-                      )
+bool oversegmentSceneSmooth ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                              const utl::SmoothSegParams                        &overseg_params,
+                              typename pcl::PointCloud<PointT>::Ptr             &scene_cloud_ds,
+                              utl::Map                                          &downsample_map,
+                              std::vector<utl::Map>                             &overseg_segments_raw
+                            )
 {
-  scene_cloud_ds.reset(new pcl::PointCloud<PointT>);
+  // Reuse the output cloud unless someone else still holds it
+  if (!scene_cloud_ds || !scene_cloud_ds.unique())
+    scene_cloud_ds.reset(new pcl::PointCloud<PointT>);
+  else
+    scene_cloud_ds->clear();
+  overseg_segments_raw.clear();
   
   if (scene_cloud->size() < 3)
     return true;
@@ -49,9 +63,22 @@ bool oversegmentScene ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene
     ds.getDownsampleMap (downsample_map);
   }
   
+  // Neighbors and the angles between their normals do not depend on the
+  // smoothness thresholds. Compute them once and share them between all
+  // thresholds
+  utl::RegionGrowingNeighborhood::Ptr neighborhood (new utl::RegionGrowingNeighborhood);
+  {
+    utl::RegionGrowingSmoothness<PointT> rg;
+    rg.setInputCloud(scene_cloud_ds);
+    rg.setConsistentNormals(true);
+    rg.setSearchRadius (overseg_params.voxel_size * std::sqrt (3));
+    if (!rg.computeNeighborhood(*neighborhood))
+      return false;
+  }
+  
   // Segment
   int numSmoothThresholds = overseg_params.smoothness.size();
-  std::vector<utl::Map> oversegSegmentsRaw(numSmoothThresholds);
+  overseg_segments_raw.resize(numSmoothThresholds);
   
   #pragma omp parallel for
   for (size_t segParamId = 0; segParamId < numSmoothThresholds; segParamId++)
@@ -60,18 +87,65 @@ bool oversegmentScene ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene
     rg.setInputCloud(scene_cloud_ds);
     rg.setConsistentNormals(true);
     rg.setSearchRadius (overseg_params.voxel_size * std::sqrt (3));
+    rg.setNeighborhood(neighborhood);
     rg.setMinSegmentSize(overseg_params.min_segment_size);
     float normalVariation   = overseg_params.smoothness[segParamId].first;
     float validBinFraction  = overseg_params.smoothness[segParamId].second;
     rg.setNormalAngleThreshold(normalVariation);
     rg.setMinValidBinaryNeighborsFraction(validBinFraction);
-    rg.segment(oversegSegmentsRaw[segParamId]);
+    rg.segment(overseg_segments_raw[segParamId]);
   }
   
+  return true;
+}
+
+/** \brief Downsample a scene and segment it into smooth segments for every
+ * smoothness threshold. Duplicate segments are removed. See
+ * oversegmentSceneSmooth for details.
+ *  \param[out] overseg_segments_raw  segments for every smoothness threshold (including duplicates)
+ *  \param[out] seg_merged_ids    indices of the segments of every smoothness threshold that remain after duplicate removal
+ */
+template <typename PointT>
+bool oversegmentSceneRaw  ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                            const utl::SmoothSegParams                        &overseg_params,
+                            typename pcl::PointCloud<PointT>::Ptr             &scene_cloud_ds,
+                            utl::Map                                          &downsample_map,
+                            std::vector<utl::Map>                             &overseg_segments_raw,
+                            std::vector<std::vector<int> >                    &seg_merged_ids
+                          )
+{
+  seg_merged_ids.clear();
+  if (!oversegmentSceneSmooth<PointT>(scene_cloud, overseg_params, scene_cloud_ds, downsample_map, overseg_segments_raw))
+    return false;
+  
   // Merge similar segments
-  std::vector<std::vector<int> > seg_merged_ids (numSmoothThresholds);
-  utl::mergeDuplicateSegments  (oversegSegmentsRaw, seg_merged_ids, overseg_params.max_iou);
+  seg_merged_ids.resize(overseg_segments_raw.size());
+  utl::mergeDuplicateSegments  (overseg_segments_raw, seg_merged_ids, overseg_params.max_iou);
+  
+  return true;
+}
 
+/** \brief Oversegment a scene. See oversegmentSceneRaw for details.
+ *  \param[out] overseg_segments         segments for every smoothness threshold
+ *  \param[out] overseg_segments_linear  segments of all smoothness thresholds
+ */
+template <typename PointT>
+bool oversegmentScene ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                        const utl::SmoothSegParams                        &overseg_params,
+                        typename pcl::PointCloud<PointT>::Ptr             &scene_cloud_ds,
+                        utl::Map                                          &downsample_map,
+                        std::vector<utl::Map>                             &overseg_segments,
+                        utl::Map                                          &overseg_segments_linear
+                      )
+{
+  std::vector<utl::Map> oversegSegmentsRaw;
+  std::vector<std::vector<int> > seg_merged_ids;
+  overseg_segments.clear();
+  overseg_segments_linear.clear();
+  if (!oversegmentSceneRaw<PointT>(scene_cloud, overseg_params, scene_cloud_ds, downsample_map, oversegSegmentsRaw, seg_merged_ids))
+    return false;
+  
+  const int numSmoothThresholds = seg_merged_ids.size();
   overseg_segments.resize(numSmoothThresholds);
   for (size_t segParamId = 0; segParamId < numSmoothThresholds; segParamId++)
   {
@@ -82,6 +156,76 @@ bool oversegmentScene ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene
       overseg_segments_linear.push_back(oversegSegmentsRaw[segParamId][segId]);
     }
   }
+  
+  return true;
+}
+
+/** \brief Oversegment a scene. See oversegmentSceneRaw for details. Segments
+ * are stored once: raw segments of all smoothness thresholds are moved into a
+ * single segment set where duplicates are found, the remaining segments are
+ * compacted into the linear segment set and the segments of every smoothness
+ * threshold are slices of it sharing its storage. Point indices of every
+ * segment are sorted.
+ *  \param[out] overseg_segments         segments for every smoothness threshold
+ *  \param[out] overseg_segments_linear  segments of all smoothness thresholds
+ */
+template <typename PointT>
+bool oversegmentScene ( const typename pcl::PointCloud<PointT>::ConstPtr  &scene_cloud,
+                        const utl::SmoothSegParams                        &overseg_params,
+                        typename pcl::PointCloud<PointT>::Ptr             &scene_cloud_ds,
+                        utl::Map                                          &downsample_map,
+                        std::vector<utl::SegmentSet>                      &overseg_segments,
+                        utl::SegmentSet                                   &overseg_segments_linear
+                      )
+{
+  overseg_segments.clear();
+  overseg_segments_linear = utl::SegmentSet ();
+  
+  // Raw segments of all thresholds in a single set
+  utl::SegmentSet segmentsRaw;
+  std::vector<int> segmentThresholdIds;
+  std::vector<size_t> rawThresholdOffsets (1, 0);
+  {
+    std::vector<utl::Map> oversegSegmentsRaw;
+    if (!oversegmentSceneSmooth<PointT>(scene_cloud, overseg_params, scene_cloud_ds, downsample_map, oversegSegmentsRaw))
+      return false;
+    
+    utl::Map segmentsRawLinear;
+    for (size_t segParamId = 0; segParamId < oversegSegmentsRaw.size(); segParamId++)
+    {
+      for (size_t segId = 0; segId < oversegSegmentsRaw[segParamId].size(); segId++)
+      {
+        segmentsRawLinear.push_back(std::vector<int> ());
+        segmentsRawLinear.back().swap(oversegSegmentsRaw[segParamId][segId]);
+        segmentThresholdIds.push_back(segParamId);
+      }
+      rawThresholdOffsets.push_back(segmentsRawLinear.size());
+    }
+    segmentsRaw = utl::SegmentSet (segmentsRawLinear);
+  }
+  
+  // Merge similar segments
+  std::vector<std::vector<int> > seg_merged_ids;
+  utl::mergeDuplicateSegments  (segmentsRaw, segmentThresholdIds, seg_merged_ids, overseg_params.max_iou);
+  
+  // Keep the remaining segments only
+  const int numSmoothThresholds = rawThresholdOffsets.size() - 1;
+  std::vector<size_t> thresholdOffsets (numSmoothThresholds + 1, 0);
+  std::vector<int> segmentsMergedLinearIds;
+  for (size_t segParamId = 0; segParamId < numSmoothThresholds; segParamId++)
+  {
+    if (segParamId < seg_merged_ids.size())
+      for (size_t segIdIt = 0; segIdIt < seg_merged_ids[segParamId].size(); segIdIt++)
+        segmentsMergedLinearIds.push_back(rawThresholdOffsets[segParamId] + seg_merged_ids[segParamId][segIdIt]);
+    thresholdOffsets[segParamId + 1] = segmentsMergedLinearIds.size();
+  }
+  
+  overseg_segments_linear = segmentsRaw.select(segmentsMergedLinearIds).compact();
+  overseg_segments.resize(numSmoothThresholds);
+  for (size_t segParamId = 0; segParamId < numSmoothThresholds; segParamId++)
+    overseg_segments[segParamId] = overseg_segments_linear.slice(thresholdOffsets[segParamId], thresholdOffsets[segParamId + 1]);
+  
+  return true;
 }
 
 #endif     // SCENE_OVERSEGMENTATION_HPP
\ No newline at end of file
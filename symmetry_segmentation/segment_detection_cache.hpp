@@ -0,0 +1,225 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SEGMENT_DETECTION_CACHE_HPP
+#define SEGMENT_DETECTION_CACHE_HPP
+
+// STD includes
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+// PCL includes
+#include <pcl/point_cloud.h>
+
+// Utilities includes
+#include <hash.hpp>
+
+namespace sym
+{
+  /** \brief Update a hash with the bytes of a value. */
+  template <typename T>
+  inline
+  uint64_t hashValue (const T &value, const uint64_t seed)
+  {
+    return utl::hashBytes(&value, sizeof(T), seed);
+  }
+
+  /** \brief @b SegmentDetectionCache Symmetry detections of scene segments
+   * keyed by the content of the segments. The key of a segment is a hash of
+   * its quantized points and normals combined with a key of the detection
+   * parameters, so a segment that did not change between two scenes is found
+   * in the cache regardless of where it is stored in the scene cloud.
+   *
+   * Every entry also stores the validation scores of its symmetries, i.e. the
+   * occlusion scores of the symmetries in the occupancy map the detection was
+   * made in. A cached detection should only be used if the validation scores
+   * computed in the current occupancy map match the stored ones. This catches
+   * occupancy map updates around an unchanged segment.
+   *
+   * Lookups are safe from several threads as long as no entries are added at
+   * the same time. Entries that were not used during the previous scene are
+   * removed when a new scene starts.
+   */
+  template <typename DetectionT>
+  class SegmentDetectionCache
+  {
+  public:
+
+    /** \brief Cached detection of a segment. */
+    struct Entry
+    {
+      DetectionT          detection;
+      std::vector<float>  validation_scores;    // Occlusion scores of the symmetries in the occupancy map of the detection
+      int                 scene_id;             // Last scene the entry was used in
+    };
+
+    /** \brief Constructor.
+     *  \param[in]  position_step         quantization step of point positions
+     *  \param[in]  normal_step           quantization step of point normal coordinates
+     *  \param[in]  validation_tolerance  maximum difference between the stored and the current validation scores of a valid entry
+     */
+    SegmentDetectionCache ( const float position_step = 0.001f,
+                            const float normal_step = 0.01f,
+                            const float validation_tolerance = 0.0001f
+                          )
+      : position_step_ (position_step)
+      , normal_step_ (normal_step)
+      , validation_tolerance_ (validation_tolerance)
+      , scene_id_ (0)
+      , num_hits_ (0)
+      , num_misses_ (0)
+    { }
+
+    /** \brief Start a new scene. Entries that were not used during the scene
+     * that just ended are removed and the statistics are reset.
+     */
+    inline
+    void newScene ()
+    {
+      for (typename EntryMap::iterator entryIt = entries_.begin(); entryIt != entries_.end(); )
+      {
+        if (entryIt->second.scene_id < scene_id_)
+          entryIt = entries_.erase(entryIt);
+        else
+          entryIt++;
+      }
+
+      scene_id_++;
+      num_hits_ = 0;
+      num_misses_ = 0;
+    }
+
+    /** \brief Remove all entries. */
+    inline
+    void clear ()
+    {
+      entries_.clear();
+      num_hits_ = 0;
+      num_misses_ = 0;
+    }
+
+    /** \brief Get the key of a segment. Points are quantized before hashing
+     * and the key does not depend on the order of the points.
+     *  \param[in]  cloud     scene cloud
+     *  \param[in]  indices   indices of the segment points
+     *  \param[in]  seed      key of the detection parameters
+     */
+    template <typename PointT>
+    inline
+    uint64_t getSegmentKey (const pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices, const uint64_t seed) const
+    {
+      std::vector<uint64_t> pointKeys (indices.size());
+      for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
+      {
+        const PointT &point = cloud.points[indices[pointIdIt]];
+        const int32_t quantized[6] = {  static_cast<int32_t>(std::floor(point.x / position_step_)),
+                                        static_cast<int32_t>(std::floor(point.y / position_step_)),
+                                        static_cast<int32_t>(std::floor(point.z / position_step_)),
+                                        static_cast<int32_t>(std::floor(point.normal_x / normal_step_)),
+                                        static_cast<int32_t>(std::floor(point.normal_y / normal_step_)),
+                                        static_cast<int32_t>(std::floor(point.normal_z / normal_step_)) };
+        pointKeys[pointIdIt] = utl::hashBytes(quantized, sizeof(quantized));
+      }
+      std::sort(pointKeys.begin(), pointKeys.end());
+
+      uint64_t key = hashValue(pointKeys.size(), seed);
+      if (!pointKeys.empty())
+        key = utl::hashBytes(pointKeys.data(), pointKeys.size() * sizeof(uint64_t), key);
+      return key;
+    }
+
+    /** \brief Find the entry of a segment.
+     *  \param[in]  key   segment key
+     *  \return pointer to the entry or NULL if the segment is not cached
+     */
+    inline
+    const Entry* find (const uint64_t key) const
+    {
+      typename EntryMap::const_iterator entryIt = entries_.find(key);
+      return entryIt != entries_.end() ? &entryIt->second : NULL;
+    }
+
+    /** \brief Check if the validation scores of an entry match the scores
+     * computed in the current occupancy map.
+     *  \param[in]  entry               cache entry
+     *  \param[in]  validation_scores   validation scores of the entry symmetries in the current occupancy map
+     */
+    inline
+    bool isValid (const Entry &entry, const std::vector<float> &validation_scores) const
+    {
+      if (entry.validation_scores.size() != validation_scores.size())
+        return false;
+
+      for (size_t symId = 0; symId < validation_scores.size(); symId++)
+        if (std::abs(entry.validation_scores[symId] - validation_scores[symId]) > validation_tolerance_)
+          return false;
+
+      return true;
+    }
+
+    /** \brief Mark the entry of a segment as used in the current scene.
+     *  \param[in]  key   segment key
+     */
+    inline
+    void touch (const uint64_t key)
+    {
+      typename EntryMap::iterator entryIt = entries_.find(key);
+      if (entryIt != entries_.end())
+      {
+        entryIt->second.scene_id = scene_id_;
+        num_hits_++;
+      }
+    }
+
+    /** \brief Add or replace the entry of a segment.
+     *  \param[in]  key                 segment key
+     *  \param[in]  detection           detection of the segment
+     *  \param[in]  validation_scores   validation scores of the detected symmetries
+     */
+    inline
+    void insert (const uint64_t key, const DetectionT &detection, const std::vector<float> &validation_scores)
+    {
+      Entry &entry = entries_[key];
+      entry.detection = detection;
+      entry.validation_scores = validation_scores;
+      entry.scene_id = scene_id_;
+      num_misses_++;
+    }
+
+    /** \brief Get the number of entries. */
+    inline size_t size () const { return entries_.size(); }
+
+    /** \brief Get the number of segments found in the cache and the number of
+     * segments that were detected and added to it since the start of the
+     * current scene.
+     */
+    inline int getNumHits ()   const { return num_hits_; }
+    inline int getNumMisses () const { return num_misses_; }
+
+  private:
+
+    typedef std::unordered_map<uint64_t, Entry> EntryMap;
+
+    /** \brief Quantization steps. */
+    float position_step_;
+    float normal_step_;
+
+    /** \brief Validation tolerance. */
+    float validation_tolerance_;
+
+    /** \brief Index of the current scene. */
+    int scene_id_;
+
+    /** \brief Statistics of the current scene. */
+    int num_hits_;
+    int num_misses_;
+
+    /** \brief Entries. */
+    EntryMap entries_;
+  };
+}
+
+#endif  // SEGMENT_DETECTION_CACHE_HPP
@@ -0,0 +1,58 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef CORRESPONDENCE_REJECTION_HPP
+#define CORRESPONDENCE_REJECTION_HPP
+
+// STD includes
+#include <vector>
+
+// PCL includes
+#include <pcl/correspondence.h>
+
+namespace sym
+{
+  /** \brief Reject correspondences such that every match point is used by at
+   * most one correspondence. Out of the correspondences sharing a match point
+   * the one with the smallest distance is kept (the first one if there are
+   * several). This gives the same set of correspondences as
+   * pcl::registration::CorrespondenceRejectorOneToOne, but runs in time linear
+   * in the number of correspondences and leaves the remaining correspondences
+   * in their original order.
+   *  \param[in,out] correspondences  correspondences
+   *  \param[in,out] match_best_ids   buffer indexed by match point index. It must only contain -1 values and is returned in the same state, so it can be reused across calls without clearing. It is grown if it is smaller than the largest match index.
+   */
+  inline
+  void rejectCorrespondencesOneToOne  ( pcl::Correspondences &correspondences,
+                                        std::vector<int> &match_best_ids
+                                      )
+  {
+    // Find the best correspondence of every match point
+    for (size_t crspId = 0; crspId < correspondences.size(); crspId++)
+    {
+      const int matchId = correspondences[crspId].index_match;
+      if (matchId >= static_cast<int>(match_best_ids.size()))
+        match_best_ids.resize(matchId + 1, -1);
+
+      int &bestCrspId = match_best_ids[matchId];
+      if (bestCrspId == -1 || correspondences[crspId].distance < correspondences[bestCrspId].distance)
+        bestCrspId = crspId;
+    }
+
+    // Keep the best correspondences
+    size_t numRemaining = 0;
+    for (size_t crspId = 0; crspId < correspondences.size(); crspId++)
+    {
+      if (match_best_ids[correspondences[crspId].index_match] == static_cast<int>(crspId))
+        correspondences[numRemaining++] = correspondences[crspId];
+    }
+    correspondences.resize(numRemaining);
+
+    // Reset the buffer. Every remaining correspondence has a unique match point
+    for (size_t crspId = 0; crspId < correspondences.size(); crspId++)
+      match_best_ids[correspondences[crspId].index_match] = -1;
+  }
+}
+
+#endif  // CORRESPONDENCE_REJECTION_HPP
@@ -18,6 +18,8 @@
 // utilities
 #include <filesystem/filesystem.hpp>
 #include <pointcloud/pointcloud.hpp>
+#include <pointcloud/cloud_soa.hpp>
+#include <pointcloud/cloud_soa_transform.hpp>
 #include <visualization/pcl_visualization.hpp>
 
 
@@ -276,7 +278,90 @@ namespace sym
     {
       return (normal - 2 * (normal.dot(normal_) * normal_));
     }
-    
+
+    /** \brief Get the affine transformation p' = M p + t that reflects points
+     * around the symmetry plane. Normals are reflected by M alone.
+     *  \param[out] M   reflection matrix
+     *  \param[out] t   translation
+     */
+    inline
+    void getReflectionTransform (Eigen::Matrix3f &M, Eigen::Vector3f &t) const
+    {
+      M = Eigen::Matrix3f::Identity() - 2.0f * normal_ * normal_.transpose();
+      t = 2.0f * normal_.dot(origin_) * normal_;
+    }
+
+    /** \brief Reflect a batch of points around a symmetry plane. Coordinates
+     * are given as separate arrays. The loop is vectorized by the compiler and
+     * dispatched to AVX2 at runtime where available (see
+     * utl::transformPointsSoA). Output arrays may be the same as the input
+     * arrays.
+     *  \param[in]  num_points                number of points
+     *  \param[in]  x, y, z                   point coordinates
+     *  \param[out] x_out, y_out, z_out       reflected point coordinates
+     */
+    inline
+    void reflectPoints  ( const int num_points,
+                          const float *x, const float *y, const float *z,
+                          float *x_out, float *y_out, float *z_out
+                        ) const
+    {
+      Eigen::Matrix3f M;
+      Eigen::Vector3f t;
+      getReflectionTransform(M, t);
+      utl::transformPointsSoA(M.data(), t.data(), num_points, x, y, z, x_out, y_out, z_out);
+    }
+
+    /** \brief Reflect a batch of normals around a symmetry plane. See
+     * reflectPoints for details.
+     *  \param[in]  num_normals               number of normals
+     *  \param[in]  nx, ny, nz                normal components
+     *  \param[out] nx_out, ny_out, nz_out    reflected normal components
+     */
+    inline
+    void reflectNormals ( const int num_normals,
+                          const float *nx, const float *ny, const float *nz,
+                          float *nx_out, float *ny_out, float *nz_out
+                        ) const
+    {
+      Eigen::Matrix3f M;
+      Eigen::Vector3f t;
+      getReflectionTransform(M, t);
+      t.setZero();
+      utl::transformPointsSoA(M.data(), t.data(), num_normals, nx, ny, nz, nx_out, ny_out, nz_out);
+    }
+
+    /** \brief Reflect all points of a structure of arrays cloud around a
+     * symmetry plane.
+     *  \param[in]  cloud             input cloud
+     *  \param[out] points_reflected  reflected points (one per column)
+     */
+    inline
+    void reflectPoints (const utl::PointCloudSoA &cloud, Eigen::Matrix3Xf &points_reflected) const
+    {
+      Eigen::Matrix3f M;
+      Eigen::Vector3f t;
+      getReflectionTransform(M, t);
+      points_reflected.resize(3, cloud.size());
+      utl::transformPointsSoA(M.data(), t.data(), cloud.size(), cloud.x(), cloud.y(), cloud.z(), NULL, points_reflected.data());
+    }
+
+    /** \brief Reflect all normals of a structure of arrays cloud around a
+     * symmetry plane.
+     *  \param[in]  cloud               input cloud
+     *  \param[out] normals_reflected   reflected normals (one per column)
+     */
+    inline
+    void reflectNormals (const utl::PointCloudSoA &cloud, Eigen::Matrix3Xf &normals_reflected) const
+    {
+      Eigen::Matrix3f M;
+      Eigen::Vector3f t;
+      getReflectionTransform(M, t);
+      t.setZero();
+      normals_reflected.resize(3, cloud.size());
+      utl::transformPointsSoA(M.data(), t.data(), cloud.size(), cloud.nx(), cloud.ny(), cloud.nz(), NULL, normals_reflected.data());
+    }
+
     /** \brief Reflect a given pointcloud around a symmetry plane
      *  \param[in] cloud_in original cloud
      *  \param[in] cloud_out reflected cloud
@@ -7,6 +7,9 @@
 
 #include <symmetry/reflectional_symmetry.hpp>
 #include <occupancy_map.hpp>
+#include <pointcloud/neighbor_grid.hpp>
+#include <pointcloud/cloud_soa.hpp>
+#include <deadline.hpp>
 
 namespace sym
 {
@@ -23,9 +26,45 @@ namespace sym
     int num_angle_divisions = 5;
     float flatness_threshold = 0.005f;
     
+    // Voting initialization parameters. Initial symmetries are the peaks of
+    // the votes of random point pairs for their bisecting planes instead of
+    // the sphere sweep. The sweep is still used if voting gives no symmetries.
+    int voting_num_pairs = 0;                                     // Number of sampled point pairs (0 - use the sphere sweep)
+    int voting_max_hypotheses = 8;                                // Maximum number of initial symmetries
+    float voting_angle_step = pcl::deg2rad(10.0f);                // Angular step of the vote accumulator
+    float voting_distance_step = 0.01f;                           // Distance step of the vote accumulator
+    float voting_max_normal_fit_error = pcl::deg2rad(15.0f);      // Maximum normal fit error of a voting pair
+    
+    // Initial symmetry cascade parameters. Initial symmetries are scored on a
+    // sample of the cloud before refinement and only the promising ones are
+    // refined. The defaults refine all of the initial symmetries.
+    int cascade_num_samples = 200;                                // Maximum number of sample points
+    int cascade_max_hypotheses = 0;                               // Maximum number of refined symmetries (0 - no limit)
+    float cascade_min_inlier_score = 0.0f;                        // Minimum fraction of reflected sample points that have a consistent neighbor
+    float cascade_max_occlusion_score = 1.0f;                     // Maximum fraction of reflected sample points that fall into free space
+    float cascade_max_correspondence_reflected_distance = 0.02f;  // Maximum distance between a reflected sample point and its neighbor
+    float cascade_max_normal_fit_error = pcl::deg2rad(30.0f);     // Maximum normal fit error of an inlier sample point
+    
+    // Scene detection warm start parameters. A segment that overlaps a larger
+    // segment by at least this intersection over union is initialized with
+    // the filtered symmetries of the larger segment instead of the initial
+    // symmetry sweep. The sweep is still used if warm start gives no good
+    // symmetries.
+    float warm_start_min_iou = 0.0f;                              // Minimum intersection over union (0 - no warm start)
+    
     // Refinement parameters
     int refine_iterations = 20;
     
+    // Multi-resolution refinement parameters. Global refinement is first run
+    // on coarse downsampled copies of the cloud, from coarsest to finest, and
+    // moves to the next level once the symmetry changes by less than the
+    // level tolerances. Every level is twice as coarse as the next one.
+    int pyramid_levels = 0;                                   // Number of coarse levels (0 - refine at a single resolution)
+    float pyramid_voxel_size = 0.01f;                         // Voxel size of the finest coarse level
+    int pyramid_iterations = 10;                              // Maximum number of refinement iterations at every coarse level
+    float pyramid_max_angle_change = pcl::deg2rad(0.5f);      // Level tolerance on the change of symmetry normal
+    float pyramid_max_distance_change = 0.001f;               // Level tolerance on the change of symmetry position
+    
     // Symmetry scoring parameters
     float max_correspondence_reflected_distance = 0.01f;
     float min_occlusion_distance = 0.01f;
@@ -121,6 +160,14 @@ namespace sym
     inline
     void setInputOcuppancyMap  (const OccupancyMapConstPtr &occupancy_map);
 
+    /** \brief Provide a search object for the input pointcloud (e.g. a view of
+     * a search tree built for the whole scene). If it is not set or its input
+     * cloud is not the input pointcloud, a search tree is built during detection.
+     *  \param search pointer to a search object
+     */
+    inline
+    void setSearchMethod (const typename pcl::search::Search<PointT>::ConstPtr &search);
+
     /** \brief Set initial symmetries.
      *  \param initial_symmetries   vector of initial symmetries
      */
@@ -133,8 +180,44 @@ namespace sym
     inline
     void setParameters (const ReflSymDetectParams &params);
     
-    /** \brief Detect reflectional symmetries in the input pointcloud. */
+    /** \brief Set a deadline for the detection. Once a deadline is set the
+     * hypotheses are ordered by a score of the initial symmetries on a sample
+     * of the cloud, so that the most promising ones are refined first.
+     * Hypotheses whose refinement starts after the deadline are dropped. The
+     * number of iterations of a running refinement is capped adaptively: it
+     * stops once the next iteration is not expected to finish before the
+     * deadline.
+     *  \param deadline  deadline
+     */
+    inline
+    void setDeadline (const utl::Deadline &deadline);
+    
+    /** \brief Check if the last detection was cut short by the deadline. */
+    inline bool isPartial () const;
+    
+    /** \brief Detect reflectional symmetries in the input pointcloud. This is
+     * equivalent to calling initialize(), refineHypothesis() for every
+     * hypothesis and finalize().
+     */
     inline bool detect ();
+    
+    /** \brief Prepare the input pointcloud for refinement and get the symmetry
+     * hypotheses that will be refined.
+     */
+    inline bool initialize ();
+    
+    /** \brief Get the number of symmetry hypotheses found by initialize(). */
+    inline int getNumHypotheses () const;
+    
+    /** \brief Refine and score a single symmetry hypothesis. Different
+     * hypotheses can be refined concurrently, e.g. as separate tasks.
+     *  \param[in] hypothesis_id   index of the hypothesis
+     *  \return false if the hypothesis could not be refined
+     */
+    inline bool refineHypothesis (const int hypothesis_id);
+    
+    /** \brief Collect refined hypotheses once all of them were refined. */
+    inline bool finalize ();
 
     /** \brief Filter detected symmetries. */
     inline void filter ();
@@ -176,10 +259,29 @@ namespace sym
                           std::vector<std::vector<float> > &point_occlusion_scores  );
     
   private:
+    
+    /** \brief Refinement result of a single symmetry hypothesis. */
+    struct Hypothesis
+    {
+      Hypothesis () : valid (false), truncated (false), occlusion_score (0.0f), cloud_inlier_score (0.0f), corresp_inlier_score (0.0f)  {}
+      
+      bool valid;
+      bool truncated;   // Refinement was dropped or cut short by the deadline
+      sym::ReflectionalSymmetry symmetry;
+      float occlusion_score, cloud_inlier_score, corresp_inlier_score;
+      std::vector<float> point_symmetry_scores, point_occlusion_scores;
+      pcl::Correspondences correspondences;
+    };
         
     /** \brief Detection parameters. */
     ReflSymDetectParams params_;
     
+    /** \brief Detection deadline. */
+    utl::Deadline deadline_;
+    
+    /** \brief Last detection was cut short by the deadline. */
+    bool partial_;
+    
     /** \brief Input cloud. */
     typename pcl::PointCloud<PointT>::ConstPtr cloud_;
 
@@ -188,9 +290,27 @@ namespace sym
     
     /** \brief Scene occupancy map. */
     OccupancyMapConstPtr occupancy_map_;
+
+    /** \brief Search object for the input cloud. */
+    typename pcl::search::Search<PointT>::ConstPtr search_;
     
     /** \brief Downsampled input cloud. */
     typename pcl::PointCloud<PointT>::Ptr cloud_ds_;
+    
+    /** \brief Structure of arrays view of the downsampled input cloud used for scoring. */
+    utl::PointCloudSoA cloud_ds_soa_;
+    
+    /** \brief Neighbor search grid for the input cloud. */
+    utl::NeighborGrid<PointT> cloud_grid_;
+    
+    /** \brief Coarse clouds used for multi-resolution refinement, their search grids and correspondence distances. */
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> pyramid_clouds_;
+    std::vector<utl::NeighborGrid<PointT> > pyramid_grids_;
+    std::vector<float> pyramid_corresp_distances_;
+    
+    /** \brief Symmetry hypotheses that are refined and their refinement results. */
+    std::vector<sym::ReflectionalSymmetry> symmetries_candidate_;
+    std::vector<Hypothesis> hypotheses_;
         
     /** \brief Symmetric correspondences. */
     std::vector<pcl::Correspondences> correspondences_;
@@ -10,6 +10,8 @@
 
 // Utilities
 #include <graph/bron_kerbosch.hpp>
+#include <geometry/line_direction_index.hpp>
+#include <profiling.hpp>
 
 // Symmetry
 #include <symmetry/reflectional_symmetry_detection.h>
@@ -35,14 +37,29 @@ void sym::mergeDuplicateReflSymmetries (  const std::vector<sym::ReflectionalSym
   // symmetries that are similar
   utl::Graph symmetryAdjacency (indices.size());
   
+  // Index symmetry normals so that each symmetry is only compared to the
+  // symmetries with similar normals
+  std::vector<Eigen::Vector3f> symmetryNormals (indices.size());
+  for (size_t symIdIt = 0; symIdIt < indices.size(); symIdIt++)
+    symmetryNormals[symIdIt] = symmetries[indices[symIdIt]].getNormal();
+  
+  utl::LineDirectionIndex normalIndex;
+  normalIndex.setInputDirections(symmetryNormals, max_normal_angle_diff);
+  std::vector<int> candidateIdIts;
+  
   for (size_t srcIdIt = 0; srcIdIt < indices.size(); srcIdIt++)
   {
     int srcId = indices[srcIdIt];
     sym::ReflectionalSymmetry srcHypothesis = symmetries[srcId];
     Eigen::Vector3f srcReferencePoint = symmetry_reference_points[srcId];
     
-    for (size_t tgtIdIt = srcIdIt+1; tgtIdIt < indices.size(); tgtIdIt++)
+    normalIndex.getCandidates(symmetryNormals[srcIdIt], candidateIdIts);
+    for (size_t candIdIt = 0; candIdIt < candidateIdIts.size(); candIdIt++)
     {
+      size_t tgtIdIt = candidateIdIts[candIdIt];
+      if (tgtIdIt <= srcIdIt)
+        continue;
+      
       int tgtId = indices[tgtIdIt];
       sym::ReflectionalSymmetry tgtHypothesis = symmetries[tgtId];
       Eigen::Vector3f tgtReferencePoint = symmetry_reference_points[tgtId];
@@ -62,40 +79,42 @@ void sym::mergeDuplicateReflSymmetries (  const std::vector<sym::ReflectionalSym
     
   //----------------------------------------------------------------------------  
   // Find the maximal cliques in the graph
-  std::list<std::list<int> > hypothesisCliques;
+  utl::Map hypothesisCliques;
   utl::bronKerbosch(symmetryAdjacency, hypothesisCliques, 1);
   
   // Find hypothesis clusters that will be merged
-  utl::Map hypothesisClusters;  
+  utl::Map hypothesisClusters;
+  std::vector<bool> clustered (indices.size(), false);
   while (hypothesisCliques.size() > 0)
   {
     // Find the largest clique
-    std::list<std::list<int> >::iterator largestCliqueIt;
-    int maxCliqueSize = 0;
-    for (std::list<std::list<int> >::iterator it = hypothesisCliques.begin(); it != hypothesisCliques.end(); it++)
+    size_t largestCliqueId = 0;
+    for (size_t cliqueId = 1; cliqueId < hypothesisCliques.size(); cliqueId++)
     {
-      if (it->size() > maxCliqueSize)
-      {
-        largestCliqueIt = it;
-        maxCliqueSize = it->size();
-      }
+      if (hypothesisCliques[cliqueId].size() > hypothesisCliques[largestCliqueId].size())
+        largestCliqueId = cliqueId;
     }
     
     // Add hypotheses from the largest clique to the list of hypothesis clusters
-    hypothesisClusters.push_back(std::vector<int>{ std::begin(*largestCliqueIt), std::end(*largestCliqueIt) });
+    hypothesisClusters.push_back(hypothesisCliques[largestCliqueId]);
+    for (size_t hypIdIt = 0; hypIdIt < hypothesisClusters.back().size(); hypIdIt++)
+      clustered[hypothesisClusters.back()[hypIdIt]] = true;
     
     // Remove hyptheses belonging to the largest clique from existing cliques
-    hypothesisCliques.erase(largestCliqueIt);
-    for (std::list<std::list<int> >::iterator it = hypothesisCliques.begin(); it != hypothesisCliques.end();)
+    size_t numRemaining = 0;
+    for (size_t cliqueId = 0; cliqueId < hypothesisCliques.size(); cliqueId++)
     {
-      for (std::vector<int>::const_iterator elIt = hypothesisClusters.back().begin(); elIt != hypothesisClusters.back().end(); elIt++)
-        it->remove(*elIt);
+      std::vector<int> &clique = hypothesisCliques[cliqueId];
+      size_t cliqueSize = 0;
+      for (size_t hypIdIt = 0; hypIdIt < clique.size(); hypIdIt++)
+        if (!clustered[clique[hypIdIt]])
+          clique[cliqueSize++] = clique[hypIdIt];
+      clique.resize(cliqueSize);
       
-      if (it->size() == 0)
-        it = hypothesisCliques.erase(it);
-      else
-        it++;
+      if (cliqueSize > 0)
+        hypothesisCliques[numRemaining++].swap(clique);
     }
+    hypothesisCliques.resize(numRemaining);
   }
   
   //----------------------------------------------------------------------------
@@ -145,6 +164,8 @@ void sym::mergeDuplicateReflSymmetries (  const std::vector<sym::ReflectionalSym
 template <typename PointT>
 sym::ReflectionalSymmetryDetection<PointT>::ReflectionalSymmetryDetection () :
   params_(),
+  deadline_ (),
+  partial_ (false),
   cloud_ds_ (new pcl::PointCloud<PointT>)
 {}
 
@@ -152,6 +173,8 @@ sym::ReflectionalSymmetryDetection<PointT>::ReflectionalSymmetryDetection () :
 template <typename PointT>
 sym::ReflectionalSymmetryDetection<PointT>::ReflectionalSymmetryDetection (const sym::ReflSymDetectParams &params) :
   params_ (params),
+  deadline_ (),
+  partial_ (false),
   cloud_ds_ (new pcl::PointCloud<PointT>)
 {}
 
@@ -176,6 +199,14 @@ sym::ReflectionalSymmetryDetection<PointT>::setInputOcuppancyMap  (const Occupan
   occupancy_map_ = occupancy_map;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::ReflectionalSymmetryDetection<PointT>::setSearchMethod  (const typename pcl::search::Search<PointT>::ConstPtr &search)
+{ 
+  search_ = search;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline void
@@ -192,23 +223,39 @@ sym::ReflectionalSymmetryDetection<PointT>::setParameters  (const ReflSymDetectP
   params_ = params;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::ReflectionalSymmetryDetection<PointT>::setDeadline  (const utl::Deadline &deadline)
+{ 
+  deadline_ = deadline;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline bool
-sym::ReflectionalSymmetryDetection<PointT>::detect ()
+sym::ReflectionalSymmetryDetection<PointT>::isPartial () const
+{
+  return partial_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::ReflectionalSymmetryDetection<PointT>::initialize ()
 {
   //----------------------------------------------------------------------------
   // Initialize computation
   
   if (!cloud_ || cloud_->size() == 0)
   {
-    std::cout << "[sym::ReflectionalSymmetryDetection::detect] input cloud is not set or it is empty." << std::endl;
+    std::cout << "[sym::ReflectionalSymmetryDetection::initialize] input cloud is not set or it is empty." << std::endl;
     return false;
   }
   
   if (!occupancy_map_)
   {
-    std::cout << "[sym::ReflectionalSymmetryDetection::detect] occupancy map is not set." << std::endl;
+    std::cout << "[sym::ReflectionalSymmetryDetection::initialize] occupancy map is not set." << std::endl;
     return false;
   }
   
@@ -223,6 +270,9 @@ sym::ReflectionalSymmetryDetection<PointT>::detect ()
   point_occlusion_scores_.clear();
   symmetry_filtered_ids_.clear();
   symmetry_merged_ids_.clear();
+  symmetries_candidate_.clear();
+  hypotheses_.clear();
+  partial_ = false;
 
   //----------------------------------------------------------------------------
   // Downsample input pointcloud and create a search tree
@@ -238,20 +288,72 @@ sym::ReflectionalSymmetryDetection<PointT>::detect ()
     dc.setLeafSize(params_.voxel_size);
     dc.filter(*cloud_ds_);
   }
+  cloud_ds_soa_.setInputCloud(*cloud_ds_);
+  
+  // Create a search tree for the input cloud unless a search object was provided
+  typename pcl::search::Search<PointT>::ConstPtr cloudSearch = search_;
+  if (!cloudSearch || cloudSearch->getInputCloud() != cloud_)
+  {
+    typename pcl::search::KdTree<PointT>::Ptr cloudSearchTree (new pcl::search::KdTree<PointT>);
+    cloudSearchTree->setInputCloud(cloud_);
+    cloudSearch = cloudSearchTree;
+  }
   
-  // Create a search tree for the input cloud
-  pcl::search::KdTree<PointT> cloud_search_tree;
-  cloud_search_tree.setInputCloud(cloud_);
+  // Create a neighbor search grid for symmetric correspondence estimation. It
+  // has to cover both the scoring distance and the 5mm distance used by
+  // global refinement.
+  if (!cloud_grid_.setInputCloud(cloud_, std::max(params_.max_correspondence_reflected_distance, 0.005f)))
+    return false;
+  
+  // Create coarse clouds used for multi-resolution refinement, ordered from
+  // coarsest to finest. Every level is used both as the source and as the
+  // target of the symmetric correspondences and has its own search grid.
+  // Correspondence rejection distance grows with the point spacing.
+  const int numPyramidLevels = std::max(params_.pyramid_levels, 0);
+  pyramid_clouds_.resize(numPyramidLevels);
+  pyramid_grids_.resize(numPyramidLevels);
+  pyramid_corresp_distances_.resize(numPyramidLevels);
+  for (int levelId = 0; levelId < numPyramidLevels; levelId++)
+  {
+    float levelVoxelSize = params_.pyramid_voxel_size * static_cast<float>(1 << (numPyramidLevels - levelId - 1));
+    pyramid_corresp_distances_[levelId] = std::max(levelVoxelSize, 0.005f);
+
+    pyramid_clouds_[levelId].reset(new pcl::PointCloud<PointT>);
+    utl::Downsample<PointT> dc;
+    dc.setInputCloud(cloud_);
+    dc.setDownsampleMethod(utl::Downsample<PointT>::AVERAGE); 
+    dc.setLeafSize(levelVoxelSize);
+    dc.filter(*pyramid_clouds_[levelId]);
+    
+    if (!pyramid_grids_[levelId].setInputCloud(pyramid_clouds_[levelId], pyramid_corresp_distances_[levelId]))
+      return false;
+  }
 
   //----------------------------------------------------------------------------
   // Get pointcloud boundary
   
   std::vector<int> cloudBoundaryPointIds, cloudNonBoundaryPointIds;
-  utl::getCloudBoundary<PointT>(cloud_, 0.01f, cloudBoundaryPointIds, cloudNonBoundaryPointIds);
+  utl::getCloudBoundary<PointT>(*cloudSearch, 0.01f, cloudBoundaryPointIds, cloudNonBoundaryPointIds);
     
   //----------------------------------------------------------------------------
   // Get initial symmetries
 
+  // Vote for the initial symmetries if requested. The sphere sweep is used if
+  // voting gives no symmetries.
+  if (symmetries_initial_.size() == 0 && params_.voting_num_pairs > 0)
+  {
+    if (!sym::getVotedReflSymmetries<PointT>( *cloud_,
+                                              symmetries_initial_,
+                                              cloud_mean_,
+                                              params_.voting_num_pairs,
+                                              params_.voting_max_hypotheses,
+                                              params_.voting_angle_step,
+                                              params_.voting_distance_step,
+                                              params_.voting_max_normal_fit_error )
+    )
+      return false;
+  }
+  
   if (symmetries_initial_.size() == 0)
   {
     if (!sym::getInitialReflSymmetries<PointT>(cloud_, symmetries_initial_, cloud_mean_, params_.num_angle_divisions, params_.flatness_threshold))
@@ -265,111 +367,219 @@ sym::ReflectionalSymmetryDetection<PointT>::detect ()
   }
 
   //----------------------------------------------------------------------------
-  // Refine initial symmetries
-  
-  // These vectors are required to enable paralllizing symmetry detection loop
-  std::vector<sym::ReflectionalSymmetry> symmetriesTMP      (symmetries_initial_.size());
-  std::vector<float> occlusionScoresTMP                     (symmetries_initial_.size());
-  std::vector<float> cloudInlierScoresTMP                   (symmetries_initial_.size());
-  std::vector<float> correspInlierScoresTMP                 (symmetries_initial_.size());
-  std::vector<std::vector<float> > pointSymmetryScoresTMP   (symmetries_initial_.size());
-  std::vector<std::vector<float> > pointOcclusionScoresTMP  (symmetries_initial_.size());
-  std::vector<bool>  validSymTableTMP                       (symmetries_initial_.size(), false);
-  std::vector<bool>  filteredSymTableTMP                    (symmetries_initial_.size(), false);
-  std::vector<pcl::Correspondences> symmetryCorrespTMP      (symmetries_initial_.size());
+  // Select initial symmetries worth refining. With a deadline the selection
+  // also orders them by their sample score, even if none are discarded.
   
-  // NOTE: it turns out that putting parralel for statement here
-  // runs more that twice faster than parallelizing the loop that calls
-  // reflectional symmetry detection
-  # pragma omp parallel for
-  for (size_t symId = 0; symId < symmetries_initial_.size(); symId++)
+  if (params_.cascade_max_hypotheses > 0 || params_.cascade_min_inlier_score > 0.0f || params_.cascade_max_occlusion_score < 1.0f || deadline_.isSet())
   {
-    sym::ReflectionalSymmetry curSymmetry;
-    pcl::Correspondences curCorrespondences;
-    
-    if (!sym::refineReflSymPosition<PointT> ( cloud_,
-                                              cloud_ds_,
-                                              symmetries_initial_[symId],
-                                              curSymmetry,
-                                              curCorrespondences  )
+    std::vector<int> selectedSymIds;
+    if (!sym::selectReflSymHypotheses<PointT> ( cloud_,
+                                                *cloud_ds_,
+                                                occupancy_map_,
+                                                symmetries_initial_,
+                                                selectedSymIds,
+                                                params_.cascade_num_samples,
+                                                params_.cascade_max_hypotheses,
+                                                params_.cascade_min_inlier_score,
+                                                params_.cascade_max_occlusion_score,
+                                                params_.cascade_max_correspondence_reflected_distance,
+                                                params_.cascade_max_normal_fit_error )
     )
-      continue;
+      return false;
+    
+    for (size_t symIdIt = 0; symIdIt < selectedSymIds.size(); symIdIt++)
+      symmetries_candidate_.push_back(symmetries_initial_[selectedSymIds[symIdIt]]);
+  }
+  else
+  {
+    symmetries_candidate_ = symmetries_initial_;
+  }
+  
+  hypotheses_.resize(symmetries_candidate_.size());
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_GENERATED, hypotheses_.size());
+  
+  return true;
+}
 
-    // Refine symmetry global
-    if (!sym::refineReflSymGlobal<PointT> ( cloud_search_tree,
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline int
+sym::ReflectionalSymmetryDetection<PointT>::getNumHypotheses () const
+{
+  return static_cast<int>(hypotheses_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::ReflectionalSymmetryDetection<PointT>::refineHypothesis (const int hypothesis_id)
+{
+  if (hypothesis_id < 0 || hypothesis_id >= getNumHypotheses())
+  {
+    std::cout << "[sym::ReflectionalSymmetryDetection::refineHypothesis] hypothesis index is out of range." << std::endl;
+    return false;
+  }
+  
+  Hypothesis &hypothesis = hypotheses_[hypothesis_id];
+  hypothesis.valid = false;
+  hypothesis.truncated = false;
+  
+  if (deadline_.expired())
+  {
+    hypothesis.truncated = true;
+    return false;
+  }
+  
+  if (!sym::refineReflSymPosition<PointT> ( cloud_,
                                             cloud_ds_,
+                                            symmetries_candidate_[hypothesis_id],
+                                            hypothesis.symmetry,
+                                            hypothesis.correspondences  )
+  )
+    return false;
+  
+  // Refine symmetry global on the coarse levels. A level that fails to
+  // find correspondences leaves the symmetry unchanged.
+  for (size_t levelId = 0; levelId < pyramid_grids_.size(); levelId++)
+  {
+    sym::ReflectionalSymmetry levelSymmetry;
+    pcl::Correspondences levelCorrespondences;
+    bool levelTruncated = false;
+    if (sym::refineReflSymGlobal<PointT> (  pyramid_grids_[levelId],
+                                            pyramid_clouds_[levelId],
                                             cloud_mean_,
                                             occupancy_map_,
-                                            curSymmetry,
-                                            curSymmetry,
-                                            curCorrespondences,
-                                            params_.refine_iterations )
+                                            hypothesis.symmetry,
+                                            levelSymmetry,
+                                            levelCorrespondences,
+                                            params_.pyramid_iterations,
+                                            pcl::deg2rad(45.0f),
+                                            0.02f,
+                                            pyramid_corresp_distances_[levelId],
+                                            params_.pyramid_max_angle_change,
+                                            params_.pyramid_max_distance_change,
+                                            deadline_,
+                                            &levelTruncated )
     )
-      continue;
+      hypothesis.symmetry = levelSymmetry;
+    hypothesis.truncated = hypothesis.truncated || levelTruncated;
+  }
 
-    // Score symmetry
-    std::vector<float> curPointSymmetryScores, curPointOcclusionScores;
-    float curOcclusionScore, curCloudInlierScore, curCorrespInlierScore;
-    
-    sym::reflSymPointSymmetryScores<PointT> ( cloud_search_tree,
-                                              *cloud_ds_,
-                                              std::vector<int>(),
-                                              std::vector<int>(),
-                                              curSymmetry,
-                                              curCorrespondences,
-                                              curPointSymmetryScores,
-                                              params_.max_correspondence_reflected_distance,
-                                              params_.min_inlier_normal_angle,
-                                              params_.max_inlier_normal_angle
+  // Refine symmetry global. It may be cut short by the deadline
+  bool globalTruncated = false;
+  if (!sym::refineReflSymGlobal<PointT> ( cloud_grid_,
+                                          cloud_ds_,
+                                          cloud_mean_,
+                                          occupancy_map_,
+                                          hypothesis.symmetry,
+                                          hypothesis.symmetry,
+                                          hypothesis.correspondences,
+                                          params_.refine_iterations,
+                                          pcl::deg2rad(45.0f),
+                                          0.02f,
+                                          0.005f,
+                                          pcl::deg2rad(0.05f),
+                                          0.0001f,
+                                          deadline_,
+                                          &globalTruncated )
+  )
+    return false;
+  hypothesis.truncated = hypothesis.truncated || globalTruncated;
+
+  // Score symmetry
+  sym::reflSymPointSymmetryScores<PointT> ( cloud_grid_,
+                                            cloud_ds_soa_,
+                                            std::vector<int>(),
+                                            std::vector<int>(),
+                                            hypothesis.symmetry,
+                                            hypothesis.correspondences,
+                                            hypothesis.point_symmetry_scores,
+                                            params_.max_correspondence_reflected_distance,
+                                            params_.min_inlier_normal_angle,
+                                            params_.max_inlier_normal_angle
+                                          );
+  
+  sym::reflSymPointOcclusionScores<PointT>  ( cloud_ds_soa_,
+                                              occupancy_map_,
+                                              hypothesis.symmetry,
+                                              hypothesis.point_occlusion_scores,
+                                              params_.min_occlusion_distance,
+                                              params_.max_occlusion_distance
                                             );
+  
+  hypothesis.occlusion_score = utl::mean(hypothesis.point_occlusion_scores);
+  
+  float inlierScoreSum = 0;
+  for (size_t crspId = 0; crspId < hypothesis.correspondences.size(); crspId++)
+    inlierScoreSum += (1.0f - hypothesis.point_symmetry_scores[crspId]);
     
-    sym::reflSymPointOcclusionScores<PointT>  ( *cloud_ds_,
-                                                occupancy_map_,
-                                                curSymmetry,
-                                                curPointOcclusionScores,
-                                                params_.min_occlusion_distance,
-                                                params_.max_occlusion_distance
-                                              );
-    
+  hypothesis.cloud_inlier_score    = inlierScoreSum / static_cast<float>(cloud_ds_->size());
+  hypothesis.corresp_inlier_score  = inlierScoreSum / static_cast<float>(hypothesis.correspondences.size());
+  hypothesis.valid = true;
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_REFINED, 1);
+  
+  return true;
+}
 
-    curOcclusionScore = utl::mean(curPointOcclusionScores);
-    
-    float inlierScoreSum = 0;
-    for (size_t crspId = 0; crspId < curCorrespondences.size(); crspId++)
-      inlierScoreSum += (1.0f - curPointSymmetryScores[crspId]);
-      
-    curCloudInlierScore    = inlierScoreSum / static_cast<float>(cloud_ds_->size());
-    curCorrespInlierScore  = inlierScoreSum / static_cast<float>(curCorrespondences.size());
-
-    // Populate temporary result variables
-    symmetriesTMP[symId] = curSymmetry;
-    occlusionScoresTMP[symId] = curOcclusionScore;
-    cloudInlierScoresTMP[symId] = curCloudInlierScore;
-    correspInlierScoresTMP[symId] = curCorrespInlierScore;
-    pointSymmetryScoresTMP[symId] = curPointSymmetryScores;
-    pointOcclusionScoresTMP[symId] = curPointOcclusionScores;
-    validSymTableTMP[symId] = true;
-    symmetryCorrespTMP[symId] = curCorrespondences;
-  }
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::ReflectionalSymmetryDetection<PointT>::finalize ()
+{
+  symmetries_refined_.clear();
+  correspondences_.clear();
+  occlusion_scores_.clear();
+  point_symmetry_scores_.clear();
+  cloud_inlier_scores_.clear();
+  corresp_inlier_scores_.clear();
+  point_occlusion_scores_.clear();
   
   // Extract valid symmetries
-  for (size_t symIdIt = 0; symIdIt < validSymTableTMP.size(); symIdIt++)
+  for (size_t symIdIt = 0; symIdIt < hypotheses_.size(); symIdIt++)
   {
-    if (!validSymTableTMP[symIdIt])
+    Hypothesis &hypothesis = hypotheses_[symIdIt];
+    partial_ = partial_ || hypothesis.truncated;
+    if (!hypothesis.valid)
       continue;
     
-    symmetries_refined_.push_back(symmetriesTMP[symIdIt]);    
-    occlusion_scores_.push_back(occlusionScoresTMP[symIdIt]);
-    cloud_inlier_scores_.push_back(cloudInlierScoresTMP[symIdIt]);
-    corresp_inlier_scores_.push_back(correspInlierScoresTMP[symIdIt]);
-    point_symmetry_scores_.push_back(pointSymmetryScoresTMP[symIdIt]);
-    point_occlusion_scores_.push_back(pointOcclusionScoresTMP[symIdIt]);
-    correspondences_.push_back(symmetryCorrespTMP[symIdIt]);
+    symmetries_refined_.push_back(hypothesis.symmetry);
+    occlusion_scores_.push_back(hypothesis.occlusion_score);
+    cloud_inlier_scores_.push_back(hypothesis.cloud_inlier_score);
+    corresp_inlier_scores_.push_back(hypothesis.corresp_inlier_score);
+    point_symmetry_scores_.push_back(std::vector<float>());
+    point_symmetry_scores_.back().swap(hypothesis.point_symmetry_scores);
+    point_occlusion_scores_.push_back(std::vector<float>());
+    point_occlusion_scores_.back().swap(hypothesis.point_occlusion_scores);
+    correspondences_.push_back(pcl::Correspondences());
+    correspondences_.back().swap(hypothesis.correspondences);
   }
-    
+  hypotheses_.clear();
+  
   return (symmetries_refined_.size() > 0);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::ReflectionalSymmetryDetection<PointT>::detect ()
+{
+  if (!initialize())
+    return false;
+  
+  // NOTE: it turns out that putting parralel for statement here
+  // runs more that twice faster than parallelizing the loop that calls
+  // reflectional symmetry detection. Hypotheses take very different time to
+  // refine, hence the dynamic schedule.
+  const int numHypotheses = getNumHypotheses();
+  # pragma omp parallel for schedule(dynamic)
+  for (int symId = 0; symId < numHypotheses; symId++)
+    refineHypothesis(symId);
+  
+  return finalize();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline void
@@ -386,7 +596,9 @@ sym::ReflectionalSymmetryDetection<PointT>::filter ()
     {
       symmetry_filtered_ids_.push_back(symId);
     }
-  }  
+  }
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_FILTERED, symmetry_filtered_ids_.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -403,6 +615,8 @@ sym::ReflectionalSymmetryDetection<PointT>::merge ()
                                       params_.symmetry_min_angle_diff,
                                       params_.symmetry_min_distance_diff
                                     );
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_MERGED, symmetry_merged_ids_.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
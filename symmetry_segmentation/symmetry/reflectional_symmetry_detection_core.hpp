@@ -5,16 +5,28 @@
 #ifndef REFLECTIONAL_SYMMETRY_DETECTION_CORE_HPP
 #define REFLECTIONAL_SYMMETRY_DETECTION_CORE_HPP
 
+// STD includes
+#include <random>
+#include <chrono>
+
 // PCL
 #include <pcl/search/kdtree.h>
-#include <pcl/registration/correspondence_rejection_one_to_one.h>
 
 // Occupancy map
 #include <occupancy_map.hpp>
 
+// Utilities
+#include <pointcloud/neighbor_grid.hpp>
+#include <pointcloud/cloud_soa.hpp>
+#include <profiling.hpp>
+#include <deadline.hpp>
+
 // Symmetry
 #include <symmetry/refinement_base_functor.hpp>
 #include <symmetry/reflectional_symmetry.hpp>
+#include <symmetry/reflectional_symmetry_workspace.hpp>
+#include <symmetry/correspondence_rejection.hpp>
+#include <symmetry/symmetry_voting.hpp>
 
 namespace sym
 {
@@ -150,6 +162,258 @@ namespace sym
     return true;
   }
 
+  /** \brief Get the initial symmetries used for reflectional symmetry
+   * detection by voting. Random pairs of points vote for the plane bisecting
+   * them if the plane reflects the normal of one point onto the normal of the
+   * other and the normals are not nearly parallel to the plane. Votes are
+   * accumulated in a quantized accumulator and the symmetries are the
+   * strongest peaks of the accumulator.
+   *  \param[in]  cloud               input cloud
+   *  \param[out] symmetries          reflectional symmetries
+   *  \param[out] cloud_mean          mean of the pointcloud
+   *  \param[in]  num_pairs           number of sampled point pairs
+   *  \param[in]  max_symmetries      maximum number of symmetries
+   *  \param[in]  angle_step          angular step of the accumulator
+   *  \param[in]  distance_step       distance step of the accumulator
+   *  \param[in]  max_normal_fit_error  maximum normal fit error of a voting pair
+   *  \return FALSE if input pointcloud has less than two points
+   */
+  template <typename PointT>
+  inline bool
+  getVotedReflSymmetries  ( const pcl::PointCloud<PointT> &cloud,
+                            std::vector<sym::ReflectionalSymmetry> &symmetries,
+                            Eigen::Vector3f &cloud_mean,
+                            const int num_pairs = 2000,
+                            const int max_symmetries = 8,
+                            const float angle_step = pcl::deg2rad(10.0f),
+                            const float distance_step = 0.01f,
+                            const float max_normal_fit_error = pcl::deg2rad(15.0f)
+                          )
+  {
+    symmetries.clear();
+    
+    // Check that input cloud has sufficient number of points
+    if (cloud.size() < 2)
+    {
+      std::cout << "[sym::getVotedReflSymmetries] input cloud has less than two points. Aborting..." << std::endl;
+      return false;
+    }
+    
+    Eigen::Vector4f cloudMeanTMP;
+    pcl::compute3DCentroid<PointT>(cloud, cloudMeanTMP);
+    cloud_mean = cloudMeanTMP.head(3);
+    
+    // Vote. Pairs are sampled with a fixed seed so that detection is repeatable
+    sym::SymmetryVoteAccumulator accumulator (angle_step, distance_step);
+    std::mt19937 gen (0);
+    std::uniform_int_distribution<int> distribution (0, cloud.size() - 1);
+    const float minNormalAngleSin = std::sin(angle_step);
+    for (int pairId = 0; pairId < num_pairs; pairId++)
+    {
+      const PointT &point1 = cloud.points[distribution(gen)];
+      const PointT &point2 = cloud.points[distribution(gen)];
+      
+      Eigen::Vector3f normal = point1.getVector3fMap() - point2.getVector3fMap();
+      if (normal.norm() < distance_step)
+        continue;
+      normal.normalize();
+      
+      // Any plane orthogonal to a flat patch reflects its normals onto
+      // themselves, so pairs with normals nearly parallel to the plane carry
+      // no information about its orientation
+      if (std::abs(normal.dot(point1.getNormalVector3fMap())) < minNormalAngleSin)
+        continue;
+      
+      sym::ReflectionalSymmetry symmetry ((point1.getVector3fMap() + point2.getVector3fMap()) / 2.0f, normal);
+      if (getReflSymNormalFitError(point1.getNormalVector3fMap(), point2.getNormalVector3fMap(), symmetry) > max_normal_fit_error)
+        continue;
+      
+      accumulator.addVote(normal, symmetry.projectPoint(cloud_mean));
+    }
+    
+    // Convert peaks to symmetries
+    std::vector<Eigen::Vector3f> peakNormals, peakPoints;
+    std::vector<int> peakVotes;
+    accumulator.getPeaks(max_symmetries, peakNormals, peakPoints, peakVotes);
+    for (size_t peakId = 0; peakId < peakNormals.size(); peakId++)
+      symmetries.push_back(sym::ReflectionalSymmetry(peakPoints[peakId], peakNormals[peakId]));
+    
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Initial symmetry cascade
+  //----------------------------------------------------------------------------
+  
+  /** \brief Cheaply score an initial reflectional symmetry hypothesis on a
+   * small sample of the input cloud points. The sample points are reflected
+   * with the hypothesis and two scores are calculated:
+   *  1. inlier score - fraction of the reflected sample points that have a
+   *     neighbor in the input cloud with a consistent normal
+   *  2. occlusion score - fraction of the reflected sample points that have
+   *     no neighbor in the input cloud and fall into visible free space
+   *  \param[in]  cloud_grid          neighbor search grid for the input cloud
+   *  \param[in]  sample_points       3xN matrix of sample point coordinates
+   *  \param[in]  sample_normals      3xN matrix of sample point normals
+   *  \param[in]  occupancy_map       scene occupancy map
+   *  \param[in]  symmetry            symmetry hypothesis
+   *  \param[out] inlier_score        inlier score
+   *  \param[out] occlusion_score     occlusion score
+   *  \param[in]  max_sym_corresp_reflected_distance  maximum distance between a reflected sample point and its neighbor
+   *  \param[in]  max_sym_normal_fit_error            maximum normal error of fit for an inlier
+   *  \return FALSE if the sample is empty
+   */
+  template <typename PointT>
+  inline
+  bool reflSymHypothesisScores  ( const utl::NeighborGrid<PointT> &cloud_grid,
+                                  const Eigen::Matrix3Xf &sample_points,
+                                  const Eigen::Matrix3Xf &sample_normals,
+                                  const OccupancyMapConstPtr &occupancy_map,
+                                  const sym::ReflectionalSymmetry &symmetry,
+                                  float &inlier_score,
+                                  float &occlusion_score,
+                                  const float max_sym_corresp_reflected_distance = 0.02f,
+                                  const float max_sym_normal_fit_error = pcl::deg2rad(30.0f)
+                                )
+  {
+    inlier_score = 0.0f;
+    occlusion_score = 0.0f;
+    
+    if (sample_points.cols() == 0 || !cloud_grid.getInputCloud())
+      return false;
+    
+    // Reflect sample points
+    Eigen::Matrix3Xf samplePointsReflected (3, sample_points.cols());
+    for (int pointId = 0; pointId < sample_points.cols(); pointId++)
+      samplePointsReflected.col(pointId) = symmetry.reflectPoint(sample_points.col(pointId));
+    
+    // Find neighbors of the reflected points and check their occlusion
+    std::vector<int>    neighbours;
+    std::vector<float>  distancesSquared;
+    std::vector<bool>   occluded;
+    cloud_grid.nearestSearch(samplePointsReflected, max_sym_corresp_reflected_distance, neighbours, distancesSquared);
+    
+    if (!occupancy_map || !occupancy_map->arePointsOccluded(samplePointsReflected, occluded))
+      occluded.assign(sample_points.cols(), true);
+    
+    // Compute scores
+    int numInliers = 0, numOccluded = 0;
+    for (int pointId = 0; pointId < sample_points.cols(); pointId++)
+    {
+      if (neighbours[pointId] != -1)
+      {
+        Eigen::Vector3f tgtNormal = cloud_grid.getInputCloud()->points[neighbours[pointId]].getNormalVector3fMap();
+        if (sym::getReflSymNormalFitError(sample_normals.col(pointId), tgtNormal, symmetry, true) < max_sym_normal_fit_error)
+          numInliers++;
+      }
+      else if (!occluded[pointId])
+      {
+        numOccluded++;
+      }
+    }
+    
+    inlier_score    = static_cast<float>(numInliers)  / static_cast<float>(sample_points.cols());
+    occlusion_score = static_cast<float>(numOccluded) / static_cast<float>(sample_points.cols());
+    
+    return true;
+  }
+  
+  /** \brief Select the initial reflectional symmetry hypotheses that are
+   * worth refining. Hypotheses are scored with reflSymHypothesisScores on a
+   * sample of the downsampled cloud. Hypotheses with an inlier score below
+   * a threshold or an occlusion score above a threshold are discarded and
+   * out of the remaining ones at most max_hypotheses with the highest inlier
+   * scores are selected.
+   *  \param[in]  cloud               input cloud
+   *  \param[in]  cloud_ds            downsampled input cloud
+   *  \param[in]  occupancy_map       scene occupancy map
+   *  \param[in]  symmetries          initial symmetries
+   *  \param[out] selected_sym_ids    indices of the selected symmetries, ordered by decreasing inlier score
+   *  \param[in]  num_samples         maximum number of sample points
+   *  \param[in]  max_hypotheses      maximum number of selected hypotheses (0 selects all hypotheses passing the thresholds)
+   *  \param[in]  min_inlier_score    minimum inlier score
+   *  \param[in]  max_occlusion_score maximum occlusion score
+   *  \param[in]  max_sym_corresp_reflected_distance  maximum distance between a reflected sample point and its neighbor
+   *  \param[in]  max_sym_normal_fit_error            maximum normal error of fit for an inlier
+   *  \return FALSE if any of the input clouds is empty
+   */
+  template <typename PointT>
+  inline
+  bool selectReflSymHypotheses  ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
+                                  const pcl::PointCloud<PointT> &cloud_ds,
+                                  const OccupancyMapConstPtr &occupancy_map,
+                                  const std::vector<sym::ReflectionalSymmetry> &symmetries,
+                                  std::vector<int> &selected_sym_ids,
+                                  const int num_samples = 200,
+                                  const int max_hypotheses = 0,
+                                  const float min_inlier_score = 0.0f,
+                                  const float max_occlusion_score = 1.0f,
+                                  const float max_sym_corresp_reflected_distance = 0.02f,
+                                  const float max_sym_normal_fit_error = pcl::deg2rad(30.0f)
+                                )
+  {
+    selected_sym_ids.clear();
+    
+    if (cloud->size() == 0 || cloud_ds.size() == 0)
+    {
+      std::cout << "[sym::selectReflSymHypotheses] at least one of the input clouds is empty" << std::endl;
+      return false;
+    }
+    
+    //--------------------------------------------------------------------------
+    // Sample points of the downsampled cloud
+    
+    const size_t sampleStep = std::max<size_t>(1, (cloud_ds.size() + std::max(num_samples, 1) - 1) / std::max(num_samples, 1));
+    const int numSamplePoints = static_cast<int>((cloud_ds.size() + sampleStep - 1) / sampleStep);
+    Eigen::Matrix3Xf samplePoints (3, numSamplePoints), sampleNormals (3, numSamplePoints);
+    for (int sampleId = 0; sampleId < numSamplePoints; sampleId++)
+    {
+      samplePoints.col(sampleId)  = cloud_ds.points[sampleId * sampleStep].getVector3fMap();
+      sampleNormals.col(sampleId) = cloud_ds.points[sampleId * sampleStep].getNormalVector3fMap();
+    }
+    
+    utl::NeighborGrid<PointT> cloudGrid;
+    if (!cloudGrid.setInputCloud(cloud, max_sym_corresp_reflected_distance))
+      return false;
+    
+    //--------------------------------------------------------------------------
+    // Score hypotheses
+    
+    std::vector<float> inlierScores (symmetries.size()), occlusionScores (symmetries.size());
+    
+    # pragma omp parallel for
+    for (size_t symId = 0; symId < symmetries.size(); symId++)
+      reflSymHypothesisScores<PointT> ( cloudGrid,
+                                        samplePoints,
+                                        sampleNormals,
+                                        occupancy_map,
+                                        symmetries[symId],
+                                        inlierScores[symId],
+                                        occlusionScores[symId],
+                                        max_sym_corresp_reflected_distance,
+                                        max_sym_normal_fit_error
+                                      );
+    
+    //--------------------------------------------------------------------------
+    // Select hypotheses
+    
+    std::vector<std::pair<float, int> > candidates;
+    for (size_t symId = 0; symId < symmetries.size(); symId++)
+    {
+      if (inlierScores[symId] >= min_inlier_score && occlusionScores[symId] <= max_occlusion_score)
+        candidates.push_back(std::pair<float, int>(-inlierScores[symId], symId));
+    }
+    std::sort(candidates.begin(), candidates.end());
+    
+    if (max_hypotheses > 0 && candidates.size() > static_cast<size_t>(max_hypotheses))
+      candidates.resize(max_hypotheses);
+    
+    for (size_t candidateId = 0; candidateId < candidates.size(); candidateId++)
+      selected_sym_ids.push_back(candidates[candidateId].second);
+    
+    return true;
+  }
+  
   //----------------------------------------------------------------------------
   // Symmetry position refinement
   //----------------------------------------------------------------------------
@@ -205,11 +469,15 @@ namespace sym
     Eigen::Vector3f symmetryOrigin = symmetry_refined.getOrigin();
     Eigen::Vector3f symmetryNormal = symmetry_refined.getNormal();
     
+    sym::ReflSymWorkspace<PointT> &workspace = sym::getReflSymWorkspace<PointT>();
+    std::vector<float>  &distancesSquared = workspace.distances_;
+    std::vector<int>    &neighbours       = workspace.neighbours_;
+    
     // Project input clouds onto the symmetry plane
-    typename pcl::PointCloud<PointT>::Ptr cloudProjected (new pcl::PointCloud<PointT>);
+    typename pcl::PointCloud<PointT>::Ptr cloudProjected = workspace.cloud_projected_;
     utl::projectCloudToPlane<PointT>(*cloud, symmetryOrigin, symmetryNormal, *cloudProjected);
 
-    typename pcl::PointCloud<PointT>::Ptr cloudDSProjected (new pcl::PointCloud<PointT>);
+    typename pcl::PointCloud<PointT>::Ptr cloudDSProjected = workspace.cloud_ds_projected_;
     utl::projectCloudToPlane<PointT>(*cloud_ds, symmetryOrigin, symmetryNormal, *cloudDSProjected);
         
     // Create a search tree
@@ -224,8 +492,6 @@ namespace sym
       Eigen::Vector3f srcNormal = cloud_ds->points[pointId].getNormalVector3fMap();
         
       // Find neighbours in a radius
-      std::vector<float>  distancesSquared;
-      std::vector<int>    neighbours;
       search_tree.radiusSearch(cloudDSProjected->points[pointId], search_cylinder_radius, neighbours, distancesSquared);
       
       // Find the best match
@@ -268,8 +534,7 @@ namespace sym
     }
     
     // Correspondence rejection one to one
-    pcl::registration::CorrespondenceRejectorOneToOne correspRejectOneToOne;
-    correspRejectOneToOne.getRemainingCorrespondences(correspondences, correspondences);
+    sym::rejectCorrespondencesOneToOne(correspondences, workspace.match_best_ids_);
     
     // Check if there are enough correspondences
     if (correspondences.size() == 0)
@@ -282,7 +547,8 @@ namespace sym
     // Update symmetry postition
         
     // Calculate median symmetry position offset
-    std::vector<float> positionFitErrors (correspondences.size());
+    std::vector<float> &positionFitErrors = workspace.fit_errors_;
+    positionFitErrors.resize(correspondences.size());
     
     for (size_t crspId = 0; crspId < correspondences.size(); crspId++)
     {
@@ -310,9 +576,16 @@ namespace sym
    * find a relfectional symmetry candidate that minimizes the point to plane 
    * distance between the first point corresponding point and the reflection
    * of the second corresponding point.
-   * Symmetry parameters are stored in a 6 dimensional vector
-   * (symmetry origin, symmetry normal).
-   * \note the final refined symmetry vector may have a non-unit normal.
+   * Symmetry plane is parametrized relative to the initial symmetry with a 3
+   * dimensional vector (a, b, delta). Symmetry normal is the normalized
+   * n0 + a * u + b * v where n0 is the initial symmetry normal and u, v are 
+   * orthogonal to it. Symmetry plane offset along the normal is d0 + delta
+   * where d0 is the offset of the initial symmetry.
+   * Given the symmetry plane (n, d) the reflections of the target point t
+   * and normal m are t' = t - 2n(n.t - d) and m' = m - 2n(n.m). The point to
+   * plane distance from the source point s to the reflected target then
+   * simplifies to (s - t).m - 2(n.m)(n.s - d), which allows computing both
+   * the residuals and their derivatives without reflecting any points.
    */
   template <typename PointT>
   struct ReflSymRefineFunctor : BaseFunctor<float>
@@ -320,62 +593,113 @@ namespace sym
     /** \brief Empty constructor */
     ReflSymRefineFunctor ()  {};
     
+    /** \brief Set the symmetry around which the plane is parametrized.
+     *  \param[in]  symmetry  initial symmetry
+     */
+    void setInitialSymmetry (const ReflectionalSymmetry &symmetry)
+    {
+      normal_ = symmetry.getNormal();
+      tangent1_ = normal_.unitOrthogonal();
+      tangent2_ = normal_.cross(tangent1_);
+      offset_ = normal_.dot(symmetry.getOrigin());
+    }
+    
+    /** \brief Set the correspondences used in the optimization. Source points,
+     * target normals and the (s - t).m terms of the correspondences are
+     * gathered into separate arrays once, so that the residuals and the
+     * jacobian are evaluated by vectorized loops over contiguous memory.
+     * Input clouds must be set before the correspondences.
+     *  \param[in]  correspondences   symmetric correspondences (query indices are points of cloud_ds_, match indices are points of cloud_)
+     */
+    void setCorrespondences (const pcl::Correspondences &correspondences)
+    {
+      const size_t numCorrespondences = correspondences.size();
+      src_x_.resize(numCorrespondences);    src_y_.resize(numCorrespondences);    src_z_.resize(numCorrespondences);
+      tgt_nx_.resize(numCorrespondences);   tgt_ny_.resize(numCorrespondences);   tgt_nz_.resize(numCorrespondences);
+      src_tgt_dot_.resize(numCorrespondences);
+      residuals_.resize(numCorrespondences);
+      
+      for (size_t crspId = 0; crspId < numCorrespondences; crspId++)
+      {
+        const Eigen::Vector3f srcPoint  = cloud_ds_->points[correspondences[crspId].index_query].getVector3fMap();
+        const Eigen::Vector3f tgtPoint  = cloud_->points[correspondences[crspId].index_match].getVector3fMap();
+        const Eigen::Vector3f tgtNormal = cloud_->points[correspondences[crspId].index_match].getNormalVector3fMap();
+        
+        src_x_[crspId]  = srcPoint[0];    src_y_[crspId]  = srcPoint[1];    src_z_[crspId]  = srcPoint[2];
+        tgt_nx_[crspId] = tgtNormal[0];   tgt_ny_[crspId] = tgtNormal[1];   tgt_nz_[crspId] = tgtNormal[2];
+        src_tgt_dot_[crspId] = (srcPoint - tgtPoint).dot(tgtNormal);
+      }
+    }
+    
+    /** \brief Convert a parameter vector to a symmetry.
+     *  \param[in]  x  parameter vector
+     *  \return symmetry
+     */
+    ReflectionalSymmetry getSymmetry (const Eigen::VectorXf &x) const
+    {
+      Eigen::Vector3f normal = getNormalUnnormalized(x).normalized();
+      return ReflectionalSymmetry (normal * (offset_ + x[2]), normal);
+    }
+    
     /** \brief Compute fitness for each input point.
      *  \param[in]  x coefficients of the symmetry plane
      *  \param[out] fvec error vector
      */
     int operator()(const Eigen::VectorXf &x, Eigen::VectorXf &fvec) const
     {
-      // Get current rotational symmetry 
-      ReflectionalSymmetry symmetry (x.head(3), x.tail(3));
-
-//       // Compute occlusion scores
-//       for(size_t i = 0; i < this->cloud_ds_->size(); i++)
-//       {
-//         Eigen::Vector3f srcPoint  = cloud_ds_->points[i].getVector3fMap();
-//         Eigen::Vector3f srcPointReflected   = symmetry.reflectPoint(srcPoint);
-//                 
-//         fvec(i) = 0.5 * std::max(0.0f, occupancy_->getNearestObstacleDistance(srcPointReflected) - 0.01f);
-//       }
-//       
-//       // Compute symmetry scores
-//       for(size_t i = 0; i < this->correspondences_.size(); i++)
-//       {
-//         int srcPointIndex = correspondences_[i].index_query;
-//         int tgtPointIndex = correspondences_[i].index_match;
-//         
-//         Eigen::Vector3f srcPoint  = cloud_ds_->points[srcPointIndex].getVector3fMap();
-//         Eigen::Vector3f srcNormal = cloud_ds_->points[srcPointIndex].getNormalVector3fMap();
-//         Eigen::Vector3f tgtPoint  = cloud_->points[tgtPointIndex].getVector3fMap();
-//         Eigen::Vector3f tgtNormal = cloud_->points[tgtPointIndex].getNormalVector3fMap();
-//                 
-//         // Reflect target point and normal
-//         Eigen::Vector3f tgtPointReflected   = symmetry.reflectPoint(tgtPoint);
-//         Eigen::Vector3f tgtNormalReflected  = symmetry.reflectNormal(tgtNormal);
-//                 
-//         fvec(srcPointIndex) += std::abs(utl::pointToPlaneSignedDistance<float>(srcPoint, tgtPointReflected, tgtNormalReflected));
-//       }
+      const Eigen::Vector3f normal = getNormalUnnormalized(x).normalized();
+      const float offset = offset_ + x[2];
+      
+      const int numCorrespondences = values();
+      getSignedResiduals(normal, offset, fvec.data());
+      for (int i = 0; i < numCorrespondences; i++)
+        fvec(i) = std::abs(fvec(i));
+      
+      // NOTE: why not use the symmetry fitness error here? I.e. the angular difference between the reflected normals?
+      // It seems like the point to plane distance works better, but need more checks
+      
+      return 0;
+    }
+    
+    /** \brief Compute the jacobian of the errors.
+     *  \param[in]  x coefficients of the symmetry plane
+     *  \param[out] fjac jacobian
+     */
+    int df(const Eigen::VectorXf &x, Eigen::MatrixXf &fjac) const
+    {
+      const Eigen::Vector3f normalUnnormalized = getNormalUnnormalized(x);
+      const float normalNorm = normalUnnormalized.norm();
+      const Eigen::Vector3f normal = normalUnnormalized / normalNorm;
+      const float offset = offset_ + x[2];
+      
+      // Derivatives of the normalized normal with respect to a and b
+      const Eigen::Matrix3f normalProjector = (Eigen::Matrix3f::Identity() - normal * normal.transpose()) / normalNorm;
+      const Eigen::Vector3f dNormalDa = normalProjector * tangent1_;
+      const Eigen::Vector3f dNormalDb = normalProjector * tangent2_;
+      
+      const int numCorrespondences = values();
+      float *residuals = residuals_.data();
+      getSignedResiduals(normal, offset, residuals);
+      
+      const float nx = normal[0], ny = normal[1], nz = normal[2];
+      const float ax = dNormalDa[0], ay = dNormalDa[1], az = dNormalDa[2];
+      const float bx = dNormalDb[0], by = dNormalDb[1], bz = dNormalDb[2];
+      const float *sx = src_x_.data(), *sy = src_y_.data(), *sz = src_z_.data();
+      const float *mx = tgt_nx_.data(), *my = tgt_ny_.data(), *mz = tgt_nz_.data();
+      float *fjacA = fjac.col(0).data(), *fjacB = fjac.col(1).data(), *fjacDelta = fjac.col(2).data();
       
-      // Compute fitness
-      for(size_t i = 0; i < this->correspondences_.size(); i++)
+      // The derivative of the signed residual with respect to the normal is
+      // -2 (m (n.s - d) + s (n.m))
+      #pragma omp simd
+      for (int i = 0; i < numCorrespondences; i++)
       {
-        int srcPointIndex = correspondences_[i].index_query;
-        int tgtPointIndex = correspondences_[i].index_match;
+        const float normalDotTgtNormal = nx * mx[i] + ny * my[i] + nz * mz[i];
+        const float srcPointSignedDistance = nx * sx[i] + ny * sy[i] + nz * sz[i] - offset;
+        const float sign = residuals[i] < 0.0f ? -1.0f : 1.0f;
         
-        Eigen::Vector3f srcPoint  = cloud_ds_->points[srcPointIndex].getVector3fMap();
-        Eigen::Vector3f srcNormal = cloud_ds_->points[srcPointIndex].getNormalVector3fMap();
-        Eigen::Vector3f tgtPoint  = cloud_->points[tgtPointIndex].getVector3fMap();
-        Eigen::Vector3f tgtNormal = cloud_->points[tgtPointIndex].getNormalVector3fMap();
-                
-        // Reflect target point and normal
-        Eigen::Vector3f tgtPointReflected   = symmetry.reflectPoint(tgtPoint);
-        Eigen::Vector3f tgtNormalReflected  = symmetry.reflectNormal(tgtNormal);
-        
-        fvec(i) = std::abs(utl::pointToPlaneSignedDistance<float>(srcPoint, tgtPointReflected, tgtNormalReflected));
-        
-        // NOTE: why not use the symmetry fitness error here? I.e. the angular difference between the reflected normals?
-        // It seems like the point to plane distance works better, but need more checks
-//         fvec(i) = 1.0f - srcNormal.dot(tgtNormalReflected);
+        fjacA[i]      = -2.0f * sign * (srcPointSignedDistance * (mx[i] * ax + my[i] * ay + mz[i] * az) + normalDotTgtNormal * (sx[i] * ax + sy[i] * ay + sz[i] * az));
+        fjacB[i]      = -2.0f * sign * (srcPointSignedDistance * (mx[i] * bx + my[i] * by + mz[i] * bz) + normalDotTgtNormal * (sx[i] * bx + sy[i] * by + sz[i] * bz));
+        fjacDelta[i]  =  2.0f * sign * normalDotTgtNormal;
       }
       
       return 0;
@@ -390,20 +714,51 @@ namespace sym
     /** \brief Scene occupancy. */
     OccupancyMapConstPtr occupancy_;
     
-    /** \brief Input correspondences. */
-    pcl::Correspondences correspondences_;
+    /** \brief Normal of the initial symmetry and two vectors orthogonal to it. */
+    Eigen::Vector3f normal_, tangent1_, tangent2_;
+    
+    /** \brief Offset of the initial symmetry plane along its normal. */
+    float offset_;
         
     /** \brief Dimensionality of the optimization parameter vector. */
-    int inputs() const { return 6; }
+    int inputs() const { return 3; }
     
     /** \brief Number of points. */
-//     int values() const { return this->cloud_ds_->size(); }
-    int values() const { return this->correspondences_.size(); }
+    int values() const { return src_x_.size(); }
+    
+  private:
+    
+    /** \brief Get the unnormalized symmetry normal corresponding to a parameter vector. */
+    inline Eigen::Vector3f getNormalUnnormalized (const Eigen::VectorXf &x) const
+    {
+      return normal_ + x[0] * tangent1_ + x[1] * tangent2_;
+    }
+    
+    /** \brief Get the signed point to plane distances between the source
+     * points and the reflected target points of all correspondences.
+     */
+    inline void getSignedResiduals (const Eigen::Vector3f &normal, const float offset, float *residuals) const
+    {
+      const int numCorrespondences = values();
+      const float nx = normal[0], ny = normal[1], nz = normal[2];
+      const float *sx = src_x_.data(), *sy = src_y_.data(), *sz = src_z_.data();
+      const float *mx = tgt_nx_.data(), *my = tgt_ny_.data(), *mz = tgt_nz_.data();
+      const float *srcTgtDot = src_tgt_dot_.data();
+      
+      #pragma omp simd
+      for (int i = 0; i < numCorrespondences; i++)
+        residuals[i] = srcTgtDot[i] - 2.0f * (nx * mx[i] + ny * my[i] + nz * mz[i]) * (nx * sx[i] + ny * sy[i] + nz * sz[i] - offset);
+    }
+    
+    /** \brief Source points, target normals and (s - t).m terms of the correspondences. */
+    std::vector<float> src_x_, src_y_, src_z_;
+    std::vector<float> tgt_nx_, tgt_ny_, tgt_nz_;
+    std::vector<float> src_tgt_dot_;
+    
+    /** \brief Signed residuals used by the jacobian. */
+    mutable std::vector<float> residuals_;
   };
   
-  template <typename PointT>
-  struct ReflSymRefineFunctorDiff : Eigen::NumericalDiff<ReflSymRefineFunctor<PointT> > {};
-  
   /** \brief Given a pointcloud with normals and an initial reflectional
    * symmetry candidate, refine the reflectional symmetry such that the cloud
    * "reflects" onto itself. This is done in an ICP-like optimization scheme,
@@ -414,7 +769,10 @@ namespace sym
    *    reflected cloud.
    * 3. Refine symmetry orientation given the correspondences.
    * 4. Repeat until convergence.
-   *  \param[in]  cloud               input cloud
+   * Correspondences are found with a bounded radius nearest neighbor search
+   * on a grid built for the input cloud.
+   *  \param[in]  cloud_grid          neighbor search grid for the input cloud (its radius must be at least max_sym_corresp_reflected_distance)
+   *  \param[in]  cloud_ds            downsampled input cloud
    *  \param[in]  cloud_mean          mean point of the pointcloud
    *  \param[in]  symmetry            input symmetry
    *  \param[out] symmetry_refined    refined symmetry
@@ -423,11 +781,15 @@ namespace sym
    *  \param[in]  max_sym_normal_fit_error  maximum normal error of fit (used for correspondence rejection)
    *  \param[in]  min_sym_corresp_distance  maximum distance between two correspondences (used for correspondence rejection)
    *  \param[in]  max_sym_corresp_reflected_distance  maximum distance between the first point of a symmetric correspondence and a reflection of the second point (used for correspondence rejection)
+   *  \param[in]  max_converged_angle_diff     optimization stops once the symmetry normal changes by less than this angle...
+   *  \param[in]  max_converged_distance_diff  ...and the symmetry position changes by less than this distance in one iteration
+   *  \param[in]  deadline                     optimization stops early if the next iteration is not expected to finish before the deadline. The expected duration of an iteration is the average duration of the previous ones.
+   *  \param[out] truncated                    set to TRUE if the optimization was stopped because of the deadline (optional)
    *  \return     FALSE if input cloud is empty or there were no correspondences found during any iteration
    */
   template <typename PointT>
   inline
-  bool refineReflSymGlobal  ( const typename pcl::search::KdTree<PointT> &search_tree,
+  bool refineReflSymGlobal  ( const utl::NeighborGrid<PointT> &cloud_grid,
                               const typename pcl::PointCloud<PointT>::ConstPtr &cloud_ds,
                               const Eigen::Vector3f &cloud_mean,
                               const OccupancyMapConstPtr &occupancy_map,
@@ -437,25 +799,33 @@ namespace sym
                               const int max_iterations = 20,
                               const float max_sym_normal_fit_error = pcl::deg2rad(45.0f),
                               const float min_sym_corresp_distance = 0.02f,
-                              const float max_sym_corresp_reflected_distance = 0.005f
+                              const float max_sym_corresp_reflected_distance = 0.005f,
+                              const float max_converged_angle_diff = pcl::deg2rad(0.05f),
+                              const float max_converged_distance_diff = 0.0001f,
+                              const utl::Deadline &deadline = utl::Deadline (),
+                              bool *truncated = NULL
                             )
   {    
     //--------------------------------------------------------------------------
     // Entry checks and parameters
     
-    typename pcl::PointCloud<PointT>::ConstPtr cloud (new pcl::PointCloud<PointT>);
-    cloud = search_tree.getInputCloud();
+    typename pcl::PointCloud<PointT>::ConstPtr cloud = cloud_grid.getInputCloud();
     
     symmetry_refined = symmetry;
+    if (truncated)
+      *truncated = false;
     
-    if (cloud->size() == 0 || cloud_ds->size() == 0)
+    if (!cloud || cloud->size() == 0 || cloud_ds->size() == 0)
       return false;
-            
-    // Correspondence rejection
-    pcl::registration::CorrespondenceRejectorOneToOne correspRejectOneToOne;
     
+    if (cloud_grid.getRadius() < max_sym_corresp_reflected_distance)
+    {
+      std::cout << "[sym::refineReflSymGlobal] neighbor grid radius is smaller than the maximum reflected correspondence distance." << std::endl;
+      return false;
+    }
+            
     // Functor object
-    sym::ReflSymRefineFunctorDiff<PointT> functor;
+    sym::ReflSymRefineFunctor<PointT> functor;
     functor.cloud_      = cloud;      
     functor.cloud_ds_   = cloud_ds;
     functor.occupancy_  = occupancy_map;
@@ -466,6 +836,14 @@ namespace sym
     int nrIterations = 0;
     sym::ReflectionalSymmetry symmetry_prev;
     
+    // Reflected points of the downsampled cloud and their nearest neighbors
+    sym::ReflSymWorkspace<PointT> &workspace = sym::getReflSymWorkspace<PointT>();
+    Eigen::Matrix3Xf    &srcPointsReflected = workspace.points_reflected_;
+    std::vector<int>    &neighbours         = workspace.neighbours_;
+    std::vector<float>  &distancesSquared   = workspace.distances_;
+    const utl::PointCloudSoA cloudDsSoA (*cloud_ds);
+    
+    const std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
     bool done = false;
     while (!done)
     {
@@ -477,36 +855,27 @@ namespace sym
       // Reset correspondences
       correspondences.clear();
       
-      // Get symmetry parameters
-      Eigen::Vector3f symmetryOrigin = symmetry_refined.getOrigin();
-      Eigen::Vector3f symmetryNormal = symmetry_refined.getNormal();
-            
+      // Find nearest neighbors of the reflected points
+      symmetry_refined.reflectPoints(cloudDsSoA, srcPointsReflected);
+      cloud_grid.nearestSearch(srcPointsReflected, max_sym_corresp_reflected_distance, neighbours, distancesSquared);
+      
       // Find correspondences
       for (size_t pointId = 0; pointId < cloud_ds->size(); pointId++)
       {
-        // Get point normal
-        Eigen::Vector3f srcPoint  = cloud_ds->points[pointId].getVector3fMap();
-        Eigen::Vector3f srcNormal = cloud_ds->points[pointId].getNormalVector3fMap();
-        
         // NOTE: somehow this gives sliiightly worse results than using the rejection below
 //         // If point is too close to the symmetry plane - don't use it as a correspondence
 //         if (std::abs(symmetry.pointSignedDistance(srcPoint)) < 0.01f)
 //           continue;
         
-        // Reflect point and normal
-        Eigen::Vector3f srcPointReflected   = symmetry_refined.reflectPoint(srcPoint);
-        Eigen::Vector3f srcNormalRefleclted = symmetry_refined.reflectNormal(srcNormal);
-                
-        // Find nearest neighbor
-        std::vector<float>  distancesSquared(1);
-        std::vector<int>    neighbours(1);
-        PointT searchPoint;
-        searchPoint.getVector3fMap() = srcPointReflected;
-        searchPoint.getNormalVector3fMap() = srcNormalRefleclted;        
-        search_tree.nearestKSearch (searchPoint, 1, neighbours, distancesSquared);
+        // If the reflected source point has no neighbors within the maximum reflected distance - reject
+        if (neighbours[pointId] == -1)
+          continue;
         
-        Eigen::Vector3f tgtPoint  = cloud->points[neighbours[0]].getVector3fMap();
-        Eigen::Vector3f tgtNormal = cloud->points[neighbours[0]].getNormalVector3fMap();        
+        // Get point normal
+        Eigen::Vector3f srcPoint  = cloud_ds->points[pointId].getVector3fMap();
+        Eigen::Vector3f srcNormal = cloud_ds->points[pointId].getNormalVector3fMap();
+        Eigen::Vector3f tgtPoint  = cloud->points[neighbours[pointId]].getVector3fMap();
+        Eigen::Vector3f tgtNormal = cloud->points[neighbours[pointId]].getNormalVector3fMap();        
                         
         // NOTE: this is required for faster convergence. Distance along symmetry
         // normal works faster than point to point distnace
@@ -514,10 +883,6 @@ namespace sym
         if (std::abs(symmetry.pointSignedDistance(srcPoint) - symmetry.pointSignedDistance(tgtPoint)) < min_sym_corresp_distance)
           continue;
         
-        // If the distance between the reflected source point and it's nearest neighbor is too big - reject
-        if (distancesSquared[0] > max_sym_corresp_reflected_distance * max_sym_corresp_reflected_distance)
-          continue;        
-        
         // NOTE: it seems like this is required for correct convergence
         // Reject correspondence if normal error is too high
         float error = sym::getReflSymNormalFitError(srcNormal, tgtNormal, symmetry_refined, true);                
@@ -525,11 +890,11 @@ namespace sym
           continue;
         
         // If all checks passed - add correspondence
-        correspondences.push_back(pcl::Correspondence(pointId, neighbours[0], distancesSquared[0]));
+        correspondences.push_back(pcl::Correspondence(pointId, neighbours[pointId], distancesSquared[pointId]));
       }
       
       // Correspondence rejection one to one
-      correspRejectOneToOne.getRemainingCorrespondences(correspondences, correspondences);
+      sym::rejectCorrespondencesOneToOne(correspondences, workspace.match_best_ids_);
       
       // Check if there are enough correspondences
       if (correspondences.size() == 0)
@@ -538,20 +903,21 @@ namespace sym
       //------------------------------------------------------------------------
       // Optimization
       
-      // Construct optimization vector
-      Eigen::VectorXf x (6);
-      x.head(3) = symmetryOrigin;
-      x.tail(3) = symmetryNormal;
+      // Construct optimization vector. Plane is parametrized relative to the
+      // current symmetry
+      Eigen::VectorXf x = Eigen::VectorXf::Zero(3);
             
       // Construct functor object
-      functor.correspondences_ = correspondences;
+      functor.setCorrespondences(correspondences);
+      functor.setInitialSymmetry(symmetry_refined);
       
       // Optimize!
-      Eigen::LevenbergMarquardt<sym::ReflSymRefineFunctorDiff<PointT>, float> lm(functor);      
+      Eigen::LevenbergMarquardt<sym::ReflSymRefineFunctor<PointT>, float> lm(functor);      
       lm.minimize(x);
+      UTL_PROFILE_COUNT(utl::PROFILE_LM_ITERATIONS, lm.iter);
       
       // Convert to symmetry
-      symmetry_refined = sym::ReflectionalSymmetry (x.head(3), x.tail(3));
+      symmetry_refined = functor.getSymmetry(x);
       symmetry_refined.setOriginProjected(cloud_mean);
       
       //------------------------------------------------------------------------
@@ -564,12 +930,72 @@ namespace sym
       // Check if symmetry has changed enough
       float angleDiff, distanceDiff;
       symmetry_refined.reflSymDifference(symmetry_prev, cloud_mean, angleDiff, distanceDiff);
-      if (angleDiff < pcl::deg2rad(0.05f) && distanceDiff < 0.0001f)
+      if (angleDiff < max_converged_angle_diff && distanceDiff < max_converged_distance_diff)
         done = true;
+      
+      // Adaptive iteration cap: stop if another iteration, taking as long as
+      // the average of the previous ones, would not finish before the deadline
+      if (!done && deadline.isSet())
+      {
+        const double iterationTime = std::chrono::duration<double> (std::chrono::steady_clock::now() - loopStart).count() / nrIterations;
+        if (deadline.expiresWithin(iterationTime))
+        {
+          done = true;
+          if (truncated)
+            *truncated = true;
+        }
+      }
     }
     
     return true;
   }
+  
+  /** \brief Refine a reflectional symmetry given a search object for the
+   * input cloud. See the neighbor grid version of refineReflSymGlobal for
+   * details. A neighbor grid is built for the input cloud of the search object
+   * on every call, so callers refining many symmetries of the same cloud
+   * should build the grid once and use the grid version instead.
+   */
+  template <typename PointT>
+  inline
+  bool refineReflSymGlobal  ( const pcl::search::Search<PointT> &search_tree,
+                              const typename pcl::PointCloud<PointT>::ConstPtr &cloud_ds,
+                              const Eigen::Vector3f &cloud_mean,
+                              const OccupancyMapConstPtr &occupancy_map,
+                              const sym::ReflectionalSymmetry &symmetry,
+                              sym::ReflectionalSymmetry &symmetry_refined,
+                              pcl::Correspondences &correspondences,
+                              const int max_iterations = 20,
+                              const float max_sym_normal_fit_error = pcl::deg2rad(45.0f),
+                              const float min_sym_corresp_distance = 0.02f,
+                              const float max_sym_corresp_reflected_distance = 0.005f,
+                              const float max_converged_angle_diff = pcl::deg2rad(0.05f),
+                              const float max_converged_distance_diff = 0.0001f,
+                              const utl::Deadline &deadline = utl::Deadline (),
+                              bool *truncated = NULL
+                            )
+  {
+    utl::NeighborGrid<PointT> cloudGrid;
+    if (!cloudGrid.setInputCloud(search_tree.getInputCloud(), max_sym_corresp_reflected_distance))
+      return false;
+    
+    return refineReflSymGlobal<PointT>  ( cloudGrid,
+                                          cloud_ds,
+                                          cloud_mean,
+                                          occupancy_map,
+                                          symmetry,
+                                          symmetry_refined,
+                                          correspondences,
+                                          max_iterations,
+                                          max_sym_normal_fit_error,
+                                          min_sym_corresp_distance,
+                                          max_sym_corresp_reflected_distance,
+                                          max_converged_angle_diff,
+                                          max_converged_distance_diff,
+                                          deadline,
+                                          truncated
+                                        );
+  }
 }
 
 #endif    // REFLECTIONAL_SYMMETRY_DETECTION_CORE_HPP
\ No newline at end of file
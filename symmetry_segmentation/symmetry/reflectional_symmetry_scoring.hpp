@@ -11,8 +11,13 @@
 // Octomap includes
 #include <occupancy_map.hpp>
 
+// Utilities
+#include <pointcloud/neighbor_grid.hpp>
+#include <pointcloud/cloud_soa.hpp>
+
 // Symmetry
 #include <symmetry/reflectional_symmetry.hpp>
+#include <symmetry/reflectional_symmetry_workspace.hpp>
 
 namespace sym
 {
@@ -23,8 +28,8 @@ namespace sym
    * calculated (angle between the normals of the points making a correspondence).
    *  2. For all of the points of the cloud the occlusion score is calculated 
    * based on the distance to the closest occluded/occupied cell
-   *  \param[in]  cloud_search_tree         a precomputed search tree for the full resolution cloud
-   *  \param[in]  cloud_ds                  a downsampled input cloud
+   *  \param[in]  cloud_grid                a precomputed neighbor search grid for the full resolution cloud (its radius must be at least max_sym_corresp_reflected_distance)
+   *  \param[in]  cloud_ds                  structure of arrays view of a downsampled input cloud
    *  \param[in]  symmetry                  input symmetry
    *  \param[out] symmetric_correspondences symmetric correspondences
    *  \param[out] point_symmetry_scores     symmetry scores for points of the cloud that have symmetric correspondences
@@ -34,8 +39,8 @@ namespace sym
    */  
   template <typename PointT>
   inline
-  float reflSymPointSymmetryScores  ( const typename pcl::search::KdTree<PointT> &cloud_search_tree,
-                                      const pcl::PointCloud<PointT> &cloud_ds,
+  float reflSymPointSymmetryScores  ( const utl::NeighborGrid<PointT> &cloud_grid,
+                                      const utl::PointCloudSoA &cloud_ds,
 //                                       const Eigen::Vector4f &table_plane,
                                       const std::vector<int> &cloud_boundary_point_ids,
                                       const std::vector<int> &cloud_ds_boundary_point_ids,
@@ -50,13 +55,18 @@ namespace sym
     //--------------------------------------------------------------------------
     // Check input
     
-    typename pcl::PointCloud<PointT>::ConstPtr cloud (new pcl::PointCloud<PointT>);
-    cloud = cloud_search_tree.getInputCloud();
+    typename pcl::PointCloud<PointT>::ConstPtr cloud = cloud_grid.getInputCloud();
     
-    if (cloud->size() == 0 || cloud_ds.size() == 0)
+    if (!cloud || cloud->size() == 0 || cloud_ds.size() == 0)
     {
       return false;
     }
+    
+    if (cloud_grid.getRadius() < max_sym_corresp_reflected_distance)
+    {
+      std::cout << "[sym::reflSymPointSymmetryScores] neighbor grid radius is smaller than the maximum reflected correspondence distance." << std::endl;
+      return false;
+    }
 
     symmetric_correspondences.resize(0);
     point_symmetry_scores.resize(0);
@@ -65,34 +75,31 @@ namespace sym
     //--------------------------------------------------------------------------
     // Calculate point errors
     
+    // Reflect the downsampled points and find their nearest neighbours within
+    // the maximum reflected distance
+    sym::ReflSymWorkspace<PointT> &workspace = sym::getReflSymWorkspace<PointT>();
+    Eigen::Matrix3Xf    &srcPointsReflected = workspace.points_reflected_;
+    std::vector<int>    &neighbours         = workspace.neighbours_;
+    std::vector<float>  &distancesSquared   = workspace.distances_;
+    symmetry.reflectPoints(cloud_ds, srcPointsReflected);
+    cloud_grid.nearestSearch(srcPointsReflected, max_sym_corresp_reflected_distance, neighbours, distancesSquared);
+    
     // Loop over downsampled points
     for (size_t pointId = 0; pointId < cloud_ds.size(); pointId++)
     {
-      // Get point normal
-      Eigen::Vector3f srcPoint  = cloud_ds.points[pointId].getVector3fMap();
-      Eigen::Vector3f srcNormal = cloud_ds.points[pointId].getNormalVector3fMap();
-      
-      // Reflect point and normal
-      Eigen::Vector3f srcPointReflected   = symmetry.reflectPoint(srcPoint);
-      Eigen::Vector3f srcNormalRefleclted = symmetry.reflectNormal(srcNormal);
-              
-      // Find neighbours in a radius        
-      std::vector<float>  distancesSquared(1);
-      std::vector<int>    neighbours(1);
-      PointT searchPoint;
-      searchPoint.getVector3fMap() = srcPointReflected;
-      searchPoint.getNormalVector3fMap() = srcNormalRefleclted;        
-      cloud_search_tree.nearestKSearch (searchPoint, 1, neighbours, distancesSquared);
+      const int neighbour = neighbours[pointId];
+      const float distanceSquared = distancesSquared[pointId];
       
       // If a point has a symmetric correspondence
-      if (  distancesSquared[0] <= max_sym_corresp_reflected_distance * max_sym_corresp_reflected_distance  )
+      if (neighbour != -1)
       {
-        Eigen::Vector3f tgtPoint  = cloud->points[neighbours[0]].getVector3fMap();
-        Eigen::Vector3f tgtNormal = cloud->points[neighbours[0]].getNormalVector3fMap();
+        // Get point normal
+        Eigen::Vector3f srcNormal = cloud_ds.getNormal(pointId);
+        Eigen::Vector3f tgtNormal = cloud->points[neighbour].getNormalVector3fMap();
         
         // If point belongs to segment boundary, we reduce it's score in half, since normals at the boundary of the segment are usually noisy
         if (  std::find (cloud_ds_boundary_point_ids.begin(), cloud_ds_boundary_point_ids.end(), pointId) != cloud_ds_boundary_point_ids.end() ||
-              std::find (cloud_boundary_point_ids.begin(), cloud_boundary_point_ids.end(), neighbours[0]) != cloud_boundary_point_ids.end() )
+              std::find (cloud_boundary_point_ids.begin(), cloud_boundary_point_ids.end(), neighbour) != cloud_boundary_point_ids.end() )
           continue;
                 
 //         if (utl::lineLineAngle<float>((srcPoint - tgtPoint).normalized(), symmetry.getNormal()) > pcl::deg2rad(15.0f))
@@ -112,7 +119,7 @@ namespace sym
         symmetryScore = utl::clampValue(symmetryScore, 0.0f, 1.0f);
         
         // If all checks passed - add correspondence
-        symmetric_correspondences.push_back(pcl::Correspondence(pointId, neighbours[0], distancesSquared[0]));
+        symmetric_correspondences.push_back(pcl::Correspondence(pointId, neighbour, distanceSquared));
         point_symmetry_scores.push_back(symmetryScore);
       }
       
@@ -133,6 +140,75 @@ namespace sym
     return true;
   }
   
+  /** \brief Calculate how well a symmetry hypothesis fits the individual points
+   * of a pointcloud. See the structure of arrays version of
+   * reflSymPointSymmetryScores for details. A structure of arrays view of the
+   * downsampled cloud is built on every call.
+   */
+  template <typename PointT>
+  inline
+  float reflSymPointSymmetryScores  ( const utl::NeighborGrid<PointT> &cloud_grid,
+                                      const pcl::PointCloud<PointT> &cloud_ds,
+                                      const std::vector<int> &cloud_boundary_point_ids,
+                                      const std::vector<int> &cloud_ds_boundary_point_ids,
+                                      const sym::ReflectionalSymmetry &symmetry,
+                                      pcl::Correspondences &symmetric_correspondences,
+                                      std::vector<float> &point_symmetry_scores,
+                                      const float max_sym_corresp_reflected_distance = 0.01f,
+                                      const float min_inlier_normal_angle = pcl::deg2rad(10.0f),
+                                      const float max_inlier_normal_angle = pcl::deg2rad(15.0f)
+                                    )
+  {
+    return reflSymPointSymmetryScores<PointT> ( cloud_grid,
+                                                utl::PointCloudSoA(cloud_ds),
+                                                cloud_boundary_point_ids,
+                                                cloud_ds_boundary_point_ids,
+                                                symmetry,
+                                                symmetric_correspondences,
+                                                point_symmetry_scores,
+                                                max_sym_corresp_reflected_distance,
+                                                min_inlier_normal_angle,
+                                                max_inlier_normal_angle
+                                              );
+  }
+  
+  /** \brief Calculate how well a symmetry hypothesis fits the individual points
+   * of a pointcloud given a search object for the full resolution cloud. See
+   * the neighbor grid version of reflSymPointSymmetryScores for details. A
+   * neighbor grid is built for the input cloud of the search object on every
+   * call.
+   */
+  template <typename PointT>
+  inline
+  float reflSymPointSymmetryScores  ( const pcl::search::Search<PointT> &cloud_search_tree,
+                                      const pcl::PointCloud<PointT> &cloud_ds,
+                                      const std::vector<int> &cloud_boundary_point_ids,
+                                      const std::vector<int> &cloud_ds_boundary_point_ids,
+                                      const sym::ReflectionalSymmetry &symmetry,
+                                      pcl::Correspondences &symmetric_correspondences,
+                                      std::vector<float> &point_symmetry_scores,
+                                      const float max_sym_corresp_reflected_distance = 0.01f,
+                                      const float min_inlier_normal_angle = pcl::deg2rad(10.0f),
+                                      const float max_inlier_normal_angle = pcl::deg2rad(15.0f)
+                                    )
+  {
+    utl::NeighborGrid<PointT> cloudGrid;
+    if (!cloudGrid.setInputCloud(cloud_search_tree.getInputCloud(), max_sym_corresp_reflected_distance))
+      return false;
+    
+    return reflSymPointSymmetryScores<PointT> ( cloudGrid,
+                                                utl::PointCloudSoA(cloud_ds),
+                                                cloud_boundary_point_ids,
+                                                cloud_ds_boundary_point_ids,
+                                                symmetry,
+                                                symmetric_correspondences,
+                                                point_symmetry_scores,
+                                                max_sym_corresp_reflected_distance,
+                                                min_inlier_normal_angle,
+                                                max_inlier_normal_angle
+                                              );
+  }
+  
   /** \brief Calculate how well a symmetry hypothesis fits the individual points
    * of a pointcloud.
    * Two measures are calculated:
@@ -140,7 +216,9 @@ namespace sym
    * calculated (angle between the normals of the points making a correspondence).
    *  2. For all of the points of the cloud the occlusion score is calculated 
    * based on the distance to the closest occluded/occupied cell
-   *  \param[in]  cloud                     input cloud
+   * Reflected points are stored in the ReflSymWorkspace<PointT> of the
+   * calling thread.
+   *  \param[in]  cloud                     structure of arrays view of the input cloud
    *  \param[in]  occupancy_map             occupancy map of the scene
    *  \param[in]  symmetry                  input symmetry
    *  \param[out] point_occlusion_scores    occlusion scores for all points of the cloud
@@ -149,7 +227,7 @@ namespace sym
    */  
   template <typename PointT>
   inline
-  bool reflSymPointOcclusionScores  ( const pcl::PointCloud<PointT> &cloud,
+  bool reflSymPointOcclusionScores  ( const utl::PointCloudSoA &cloud,
                                       const OccupancyMapConstPtr &occupancy_map,
                                       const sym::ReflectionalSymmetry &symmetry,
                                       std::vector<float> &point_occlusion_scores,
@@ -170,15 +248,19 @@ namespace sym
     //--------------------------------------------------------------------------
     // Calculate point errors
     
-    // Loop over downsampled points
+    // Reflect points
+    sym::ReflSymWorkspace<PointT> &workspace = sym::getReflSymWorkspace<PointT>();
+    Eigen::Matrix3Xf &pointsReflected = workspace.points_reflected_;
+    symmetry.reflectPoints(cloud, pointsReflected);
+    
+    // Get distances from reflected points to occluded/occupied space
+    std::vector<float> &distances = workspace.distances_;
+    if (!occupancy_map->getNearestObstacleDistances(pointsReflected, distances))
+      return false;
+    
     for (size_t pointId = 0; pointId < cloud.size(); pointId++)
     {
-      // Get point normal
-      Eigen::Vector3f srcPoint            = cloud.points[pointId].getVector3fMap();
-      Eigen::Vector3f srcPointReflected   = symmetry.reflectPoint(srcPoint);
-              
-      float distance = occupancy_map->getNearestObstacleDistance(srcPointReflected);
-      float occupancyScore = (distance - min_occlusion_distance) / (max_occlusion_distance - min_occlusion_distance);
+      float occupancyScore = (distances[pointId] - min_occlusion_distance) / (max_occlusion_distance - min_occlusion_distance);
       occupancyScore = utl::clampValue(occupancyScore, 0.0f, 1.0f);
       point_occlusion_scores[pointId] = occupancyScore;
     }
@@ -186,6 +268,30 @@ namespace sym
     return true;
   }
   
+  /** \brief Calculate the occlusion scores of the individual points of a
+   * pointcloud. See the structure of arrays version of
+   * reflSymPointOcclusionScores for details. A structure of arrays view of the
+   * cloud is built on every call.
+   */
+  template <typename PointT>
+  inline
+  bool reflSymPointOcclusionScores  ( const pcl::PointCloud<PointT> &cloud,
+                                      const OccupancyMapConstPtr &occupancy_map,
+                                      const sym::ReflectionalSymmetry &symmetry,
+                                      std::vector<float> &point_occlusion_scores,
+                                      const float min_occlusion_distance = 0.01f,
+                                      const float max_occlusion_distance = 0.05f
+                                    )
+  {
+    return reflSymPointOcclusionScores<PointT>  ( utl::PointCloudSoA(cloud),
+                                                  occupancy_map,
+                                                  symmetry,
+                                                  point_occlusion_scores,
+                                                  min_occlusion_distance,
+                                                  max_occlusion_distance
+                                                );
+  }
+  
   /** \brief Calculate how well a symmetry hypothesis fits the individual points
    * of a pointcloud.
    * Two measures are calculated:
@@ -193,13 +299,12 @@ namespace sym
    * calculated (angle between the normals of the points making a correspondence).
    *  2. For all of the points of the cloud the occlusion score is calculated 
    * based on the distance to the closest occluded/occupied cell
-   *  \param[in]  cloud                           input cloud
+   *  \param[in]  cloud                           structure of arrays view of the input cloud
    *  \param[in]  symmetry                        input symmetry
    *  \param[out] point_perpendicularity_scores   occlusion scores for all points of the cloud
    */  
-  template <typename PointT>
   inline
-  bool reflSymPointPerpendicularScores  ( const pcl::PointCloud<PointT> &cloud,
+  bool reflSymPointPerpendicularScores  ( const utl::PointCloudSoA &cloud,
                                           const sym::ReflectionalSymmetry &symmetry,
                                           std::vector<float> &point_perpendicular_scores,
                                           const float min_perpendicular_angle = pcl::deg2rad(45.0f),
@@ -222,7 +327,7 @@ namespace sym
     // Loop over downsampled points
     for (size_t pointId = 0; pointId < cloud.size(); pointId++)
     {
-      Eigen::Vector3f pointNormal = cloud.points[pointId].getNormalVector3fMap();
+      Eigen::Vector3f pointNormal = cloud.getNormal(pointId);
       float angle = utl::lineLineAngle<float>(pointNormal, symmetry.getNormal());
       angle = (angle - min_perpendicular_angle) / (max_perpendicular_angle - min_perpendicular_angle);
       angle = utl::clampValue(angle, 0.0f, 1.0f);
@@ -230,7 +335,26 @@ namespace sym
     }
 
     return true;
-  }  
+  }
+  
+  /** \brief Calculate how perpendicular the normals of the individual points
+   * of a pointcloud are to a symmetry plane normal. A structure of arrays view
+   * of the cloud is built on every call.
+   *  \param[in]  cloud                           input cloud
+   *  \param[in]  symmetry                        input symmetry
+   *  \param[out] point_perpendicularity_scores   perpendicularity scores for all points of the cloud
+   */
+  template <typename PointT>
+  inline
+  bool reflSymPointPerpendicularScores  ( const pcl::PointCloud<PointT> &cloud,
+                                          const sym::ReflectionalSymmetry &symmetry,
+                                          std::vector<float> &point_perpendicular_scores,
+                                          const float min_perpendicular_angle = pcl::deg2rad(45.0f),
+                                          const float max_perpendicular_angle = pcl::deg2rad(80.0f)
+                                        )
+  {
+    return reflSymPointPerpendicularScores(utl::PointCloudSoA(cloud), symmetry, point_perpendicular_scores, min_perpendicular_angle, max_perpendicular_angle);
+  }
 }
 
 #endif    // REFLECTIONAL_SYMMETRY_SCORING_HPP
\ No newline at end of file
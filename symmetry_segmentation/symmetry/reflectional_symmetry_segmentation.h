@@ -8,6 +8,9 @@
 // Symmetry includes
 #include <symmetry/reflectional_symmetry.hpp>
 #include <occupancy_map.hpp>
+#include <deadline.hpp>
+#include <segment_set.hpp>
+#include <pointcloud/neighbor_grid.hpp>
 
 namespace sym
 {
@@ -43,6 +46,12 @@ namespace sym
     float bin_weight_importance  = 10.0f;
     float min_occlusion_score     = 0.1f;
     
+    // Region of interest parameters. Every symmetry is scored and segmented
+    // only within the bounding box of its support segment and the reflection of
+    // the support segment dilated by this margin. Points outside of it are
+    // background.
+    float roi_margin              = 0.0f;   // Region of interest margin (0 - segment the whole cloud)
+    
     // Segmentation filtering parameters
     float max_symmetry_score    = 0.005f;
     float max_occlusion_score   = 0.0005f;
@@ -97,12 +106,42 @@ namespace sym
     inline
     void setInputSymmetries  (const std::vector<sym::ReflectionalSymmetry> &symmetries, const std::vector<std::vector<int> > &symmetry_support);
     
+    /** \brief Provide the input symmetries and the segments supporting them
+     * as a segment set.
+     *  \param[in]  symmetries        input symmetries
+     *  \param[in]  symmetry_support  segment supporting every symmetry
+     */
+    inline
+    void setInputSymmetries  (const std::vector<sym::ReflectionalSymmetry> &symmetries, const utl::SegmentSet &symmetry_support);
+    
+    /** \brief Provide a precomputed adjacency of the downsampled cloud, e.g.
+     * the adjacency of another segmentation of the same scene, or its subgraph
+     * induced by the remaining points (see utl::getInducedSubgraph). Edge
+     * weights must be the convex/concave weights computed by
+     * utl::cloudAdjacencyWeights. If set, segmentation does not compute the
+     * adjacency. An empty graph resets it.
+     *  \param adjacency adjacency graph with one vertex per downsampled cloud point
+     */
+    inline
+    void setInputAdjacency (const utl::GraphWeighted &adjacency);
+    
     /** \brief Set detection parameters.
      *  \param params detection parameters
      */
     inline
     void setParameters (const ReflSymSegParams &params);
     
+    /** \brief Set a deadline for the segmentation. Symmetries are segmented in the order of decreasing support size.
+     * Symmetries whose segmentation starts after the deadline get empty
+     * segments that are removed by the filter.
+     *  \param deadline  deadline
+     */
+    inline
+    void setDeadline (const utl::Deadline &deadline);
+    
+    /** \brief Check if the last segmentation was cut short by the deadline. */
+    inline bool isPartial () const;
+    
     /** \brief Segment rotational symmetries. */
     inline bool segment ();
 
@@ -170,14 +209,20 @@ namespace sym
     /** \brief Detection parameters. */
     ReflSymSegParams params_;
     
+    /** \brief Segmentation deadline. */
+    utl::Deadline deadline_;
+    
+    /** \brief Symmetries that were skipped because of the deadline. */
+    std::vector<char> symmetries_skipped_;
+    
     /** \brief Input cloud. */
     typename pcl::PointCloud<PointT>::ConstPtr cloud_;
         
     /** \brief Downsampled input cloud. */
     typename pcl::PointCloud<PointT>::Ptr cloud_ds_;
 
-    /** \brief Search tree over the downsampled input cloud. */
-    pcl::search::KdTree<PointT> cloud_search_tree_;
+    /** \brief Neighbor search grid over the input cloud. */
+    utl::NeighborGrid<PointT> cloud_grid_;
     
     /** \brief Scene occupancy map. */
     OccupancyMapConstPtr occupancy_map_;
@@ -215,6 +260,9 @@ namespace sym
     /** \brief Correspondences. */
     std::vector<pcl::Correspondences> correspondences_;
         
+    /** \brief Precomputed adjacency weights. */
+    utl::GraphWeighted input_adjacency_;
+    
     /** \brief Adjacency weights. */
     utl::GraphWeighted adjacency_;
     
@@ -5,6 +5,11 @@
 #ifndef REFLECTIONAL_SYMMETRY_SEGMENTATION_HPP
 #define REFLECTIONAL_SYMMETRY_SEGMENTATION_HPP
 
+// STD includes
+#include <limits>
+#include <algorithm>
+#include <functional>
+
 // Symmetry
 #include <symmetry/reflectional_symmetry_segmentation.h>
 #include <symmetry/reflectional_symmetry_scoring.hpp>
@@ -14,6 +19,7 @@
 template <typename PointT>
 sym::ReflectionalSymmetrySegmentation<PointT>::ReflectionalSymmetrySegmentation () :
   params_(),
+  deadline_ (),
   cloud_ (new pcl::PointCloud<PointT>),
   cloud_ds_ (new pcl::PointCloud<PointT>)
 {}
@@ -22,6 +28,7 @@ sym::ReflectionalSymmetrySegmentation<PointT>::ReflectionalSymmetrySegmentation
 template <typename PointT>
 sym::ReflectionalSymmetrySegmentation<PointT>::ReflectionalSymmetrySegmentation (const sym::ReflSymSegParams &params) :
   params_ (params),
+  deadline_ (),
   cloud_ (new pcl::PointCloud<PointT>),
   cloud_ds_ (new pcl::PointCloud<PointT>)
 {}
@@ -64,6 +71,39 @@ sym::ReflectionalSymmetrySegmentation<PointT>::setInputSymmetries  (const std::v
   symmetry_support_segments_ = symmetry_support;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::ReflectionalSymmetrySegmentation<PointT>::setInputSymmetries  (const std::vector<sym::ReflectionalSymmetry> &symmetries, const utl::SegmentSet &symmetry_support)
+{ 
+  symmetries_ = symmetries;
+  symmetry_support.toMap(symmetry_support_segments_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::ReflectionalSymmetrySegmentation<PointT>::setInputAdjacency  (const utl::GraphWeighted &adjacency)
+{
+  input_adjacency_ = adjacency;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::ReflectionalSymmetrySegmentation<PointT>::setDeadline  (const utl::Deadline &deadline)
+{
+  deadline_ = deadline;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::ReflectionalSymmetrySegmentation<PointT>::isPartial () const
+{
+  return std::find(symmetries_skipped_.begin(), symmetries_skipped_.end(), 1) != symmetries_skipped_.end();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline void
@@ -140,18 +180,32 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
     dc.getDownsampleMap(downsample_map_);
   }
   
-  cloud_search_tree_.setInputCloud(cloud_);
+  if (!cloud_grid_.setInputCloud(cloud_, params_.max_sym_corresp_reflected_distance))
+    return false;
   
   //----------------------------------------------------------------------------
   // Compute cloud adjacency
   
-  if (!utl::cloudAdjacencyWeights<PointT> ( cloud_ds_,
-                                            params_.aw_radius,
-                                            params_.aw_num_neighbors,
-                                            params_.aw_sigma_convex,
-                                            params_.aw_sigma_concave,
-                                            adjacency_))
-    return false;
+  if (input_adjacency_.getNumVertices() > 0)
+  {
+    if (input_adjacency_.getNumVertices() != static_cast<int>(cloud_ds_->size()))
+    {
+      std::cout << "[sym::ReflectionalSymmetrySegmentation::segment] number of input adjacency vertices is different from the number of downsampled points (" << input_adjacency_.getNumVertices() << " vs " << cloud_ds_->size() << ")." << std::endl;
+      return false;
+    }
+    
+    adjacency_ = input_adjacency_;
+  }
+  else
+  {
+    if (!utl::cloudAdjacencyWeights<PointT> ( cloud_ds_,
+                                              params_.aw_radius,
+                                              params_.aw_num_neighbors,
+                                              params_.aw_sigma_convex,
+                                              params_.aw_sigma_concave,
+                                              adjacency_))
+      return false;
+  }
   
   for (size_t edgeId = 0; edgeId < adjacency_.getNumEdges(); edgeId++)
   {
@@ -183,14 +237,48 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
   symmetry_support_overlap_scores_.resize(symmetries_.size());
   
   std::vector<bool> success (symmetries_.size(), true);
+  symmetries_skipped_.assign(symmetries_.size(), 0);
   
   std::vector<int> cloudBoundaryPointIds, cloudDSBoundaryPointIds, nonBoundaryPointIds;
   utl::getCloudBoundary<PointT>(cloud_, std::max(params_.voxel_size, 0.005f) * 2.0f, cloudBoundaryPointIds, nonBoundaryPointIds);
   utl::getCloudBoundary<PointT>(cloud_ds_, std::max(params_.voxel_size, 0.005f) * 2.0f, cloudDSBoundaryPointIds, nonBoundaryPointIds);
+  
+  // Edges incident on every vertex of the adjacency graph, used to extract
+  // the region of interest subgraphs
+  const bool useRoi = params_.roi_margin > 0.0f;
+  utl::Map vertexEdgeIds;
+  if (useRoi)
+  {
+    vertexEdgeIds.resize(cloud_ds_->size());
+    for (size_t edgeId = 0; edgeId < adjacency_.getNumEdges(); edgeId++)
+    {
+      int vtx1Id, vtx2Id;
+      float weight;
+      adjacency_.getEdge(edgeId, vtx1Id, vtx2Id, weight);
+      vertexEdgeIds[vtx1Id].push_back(edgeId);
+      vertexEdgeIds[vtx2Id].push_back(edgeId);
+    }
+  }
 
-  #pragma omp parallel for
+  // Symmetries with the largest support are segmented first, so that they
+  // are the ones that are done if the deadline expires
+  std::vector<std::pair<size_t, int> > symmetryOrder (symmetries_.size());
   for (size_t symId = 0; symId < symmetries_.size(); symId++)
+    symmetryOrder[symId] = std::pair<size_t, int>(symmetry_support_segments_[symId].size(), symId);
+  std::stable_sort(symmetryOrder.begin(), symmetryOrder.end(), std::greater<std::pair<size_t, int> >());
+
+  #pragma omp parallel for schedule(dynamic)
+  for (size_t symIdIt = 0; symIdIt < symmetryOrder.size(); symIdIt++)
   {
+    const size_t symId = symmetryOrder[symIdIt].second;
+    
+    // Leave the segment empty once the deadline has expired
+    if (deadline_.expired())
+    {
+      symmetries_skipped_[symId] = 1;
+      continue;
+    }
+    
     //--------------------------------------------------------------------------
     // Get symmetry support mask
     
@@ -198,11 +286,49 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
     for (size_t pointIdIt = 0; pointIdIt < symmetry_support_segments_[symId].size(); pointIdIt++)
       symmetrySupportMask[symmetry_support_segments_[symId][pointIdIt]] = true;
     
+    //--------------------------------------------------------------------------
+    // Get the region of interest. It is the bounding box of the symmetry
+    // support and its reflection dilated by the region of interest margin.
+    // Points outside of it are background.
+    
+    std::vector<int> roiPointIds;
+    std::vector<bool> roiMask;
+    typename pcl::PointCloud<PointT>::ConstPtr cloudRoi = cloud_ds_;
+    if (useRoi)
+    {
+      Eigen::Vector3f roiMin = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+      Eigen::Vector3f roiMax = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+      for (size_t pointIdIt = 0; pointIdIt < symmetry_support_segments_[symId].size(); pointIdIt++)
+      {
+        Eigen::Vector3f point = cloud_ds_->points[symmetry_support_segments_[symId][pointIdIt]].getVector3fMap();
+        Eigen::Vector3f pointReflected = symmetries_[symId].reflectPoint(point);
+        roiMin = roiMin.cwiseMin(point).cwiseMin(pointReflected);
+        roiMax = roiMax.cwiseMax(point).cwiseMax(pointReflected);
+      }
+      roiMin.array() -= params_.roi_margin;
+      roiMax.array() += params_.roi_margin;
+      
+      roiMask.resize(cloud_ds_->size(), false);
+      for (size_t pointId = 0; pointId < cloud_ds_->size(); pointId++)
+      {
+        Eigen::Vector3f point = cloud_ds_->points[pointId].getVector3fMap();
+        if ((point.array() >= roiMin.array()).all() && (point.array() <= roiMax.array()).all())
+        {
+          roiPointIds.push_back(pointId);
+          roiMask[pointId] = true;
+        }
+      }
+      
+      typename pcl::PointCloud<PointT>::Ptr cloudRoiTMP (new pcl::PointCloud<PointT>);
+      pcl::copyPointCloud<PointT>(*cloud_ds_, roiPointIds, *cloudRoiTMP);
+      cloudRoi = cloudRoiTMP;
+    }
+    
     //--------------------------------------------------------------------------
     // Compute point scores
     
-    sym::reflSymPointSymmetryScores<PointT> ( cloud_search_tree_,
-                                              *cloud_ds_,
+    sym::reflSymPointSymmetryScores<PointT> ( cloud_grid_,
+                                              *cloudRoi,
 //                                               table_plane_,
                                               std::vector<int>(),
                                               std::vector<int>(),
@@ -216,7 +342,7 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
                                               params_.max_normal_fit_angle
                                             );
     
-    sym::reflSymPointOcclusionScores<PointT>  ( *cloud_ds_,
+    sym::reflSymPointOcclusionScores<PointT>  ( *cloudRoi,
                                                 occupancy_map_,
                                                 symmetries_[symId],
                                                 point_occlusion_scores_[symId],
@@ -224,11 +350,29 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
                                                 params_.max_occlusion_distance
                                               );
     
-    sym::reflSymPointPerpendicularScores<PointT>  ( *cloud_ds_,
+    sym::reflSymPointPerpendicularScores<PointT>  ( *cloudRoi,
                                                     symmetries_[symId],
                                                     point_perpendicular_scores_[symId]
                                                   );
     
+    // Map region of interest scores to the downsampled cloud. Points outside
+    // of the region of interest are fully occluded
+    if (useRoi)
+    {
+      for (size_t crspId = 0; crspId < correspondences_[symId].size(); crspId++)
+        correspondences_[symId][crspId].index_query = roiPointIds[correspondences_[symId][crspId].index_query];
+      
+      std::vector<float> roiOcclusionScores, roiPerpendicularScores;
+      roiOcclusionScores.swap(point_occlusion_scores_[symId]);
+      roiPerpendicularScores.swap(point_perpendicular_scores_[symId]);
+      point_occlusion_scores_[symId].resize(cloud_ds_->size(), 1.0f);
+      point_perpendicular_scores_[symId].resize(cloud_ds_->size(), 0.0f);
+      for (size_t pointIdIt = 0; pointIdIt < roiOcclusionScores.size(); pointIdIt++)
+        point_occlusion_scores_[symId][roiPointIds[pointIdIt]] = roiOcclusionScores[pointIdIt];
+      for (size_t pointIdIt = 0; pointIdIt < roiPerpendicularScores.size(); pointIdIt++)
+        point_perpendicular_scores_[symId][roiPointIds[pointIdIt]] = roiPerpendicularScores[pointIdIt];
+    }
+    
     //--------------------------------------------------------------------------
     // Assemble unary weights
     
@@ -280,6 +424,9 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
       
       int srcPointId = correspondences_[symId][crspId].index_query;
       int tgtPointId = correspondences_[symId][crspId].index_match;
+      if (useRoi && !(tgtPointId < static_cast<int>(roiMask.size()) && roiMask[tgtPointId]))
+        continue;
+      
       if (srcPointId != tgtPointId)
         symmetric_adjacency_[symId].addEdge(srcPointId, tgtPointId, (1.0f - point_symmetry_scores_[symId][crspId]) * params_.symmetric_adjacency_importance);
     }
@@ -287,7 +434,33 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
     //--------------------------------------------------------------------------
     // Assemble binary weights
     
-    binary_weights_[symId] = adjacency_;
+    // Only the adjacency edges incident on the region of interest are used
+    if (useRoi)
+    {
+      binary_weights_[symId].preallocateVertices(cloud_ds_->size());
+      for (size_t pointIdIt = 0; pointIdIt < roiPointIds.size(); pointIdIt++)
+      {
+        const int pointId = roiPointIds[pointIdIt];
+        for (size_t edgeIdIt = 0; edgeIdIt < vertexEdgeIds[pointId].size(); edgeIdIt++)
+        {
+          int vtx1Id, vtx2Id;
+          float weight;
+          adjacency_.getEdge(vertexEdgeIds[pointId][edgeIdIt], vtx1Id, vtx2Id, weight);
+          
+          // Edges inside of the region of interest are visited from both ends
+          const int otherPointId = (vtx1Id == pointId) ? vtx2Id : vtx1Id;
+          if (roiMask[otherPointId] && otherPointId < pointId)
+            continue;
+          
+          binary_weights_[symId].addEdge(vtx1Id, vtx2Id, weight);
+        }
+      }
+    }
+    else
+    {
+      binary_weights_[symId] = adjacency_;
+    }
+    
     for (size_t edgeId = 0; edgeId < symmetric_adjacency_[symId].getNumEdges(); edgeId++)
     {
       utl::EdgeWeighted symAdjEdge;
@@ -314,16 +487,64 @@ sym::ReflectionalSymmetrySegmentation<PointT>::segment ()
     if (success[symId] == false)
       continue;
 
+    // Binary weights are only read from here on
+    const utl::GraphCSR binaryWeights (binary_weights_[symId]);
+
     //--------------------------------------------------------------------------
     // Segment
 
-    if (!utl::segmentCloudFG  ( fg_weights_[symId], bg_weights_[symId], binary_weights_[symId], downsample_map_, segments_ds_[symId], segments_[symId]))
-      success[symId] = false;
+    if (!useRoi)
+    {
+      if (!utl::segmentCloudFG  ( fg_weights_[symId], bg_weights_[symId], binaryWeights, downsample_map_, segments_ds_[symId], segments_[symId]))
+        success[symId] = false;
+    }
+    
+    // Cut the region of interest subgraph. Points outside of the region of
+    // interest are background, so edges between the region of interest and the
+    // rest of the cloud are collapsed into the background weights.
+    else
+    {
+      std::vector<int> roiVertexIds (cloud_ds_->size(), -1);
+      for (size_t pointIdIt = 0; pointIdIt < roiPointIds.size(); pointIdIt++)
+        roiVertexIds[roiPointIds[pointIdIt]] = pointIdIt;
+      
+      std::vector<float> roiFgWeights (roiPointIds.size()), roiBgWeights (roiPointIds.size());
+      utl::Map roiDownsampleMap (roiPointIds.size());
+      for (size_t pointIdIt = 0; pointIdIt < roiPointIds.size(); pointIdIt++)
+      {
+        roiFgWeights[pointIdIt] = fg_weights_[symId][roiPointIds[pointIdIt]];
+        roiBgWeights[pointIdIt] = bg_weights_[symId][roiPointIds[pointIdIt]];
+        roiDownsampleMap[pointIdIt] = downsample_map_[roiPointIds[pointIdIt]];
+      }
+      
+      utl::GraphWeighted roiBinaryWeights (roiPointIds.size());
+      for (int edgeId = 0; edgeId < binaryWeights.getNumEdges(); edgeId++)
+      {
+        int vtx1Id, vtx2Id;
+        float weight;
+        binaryWeights.getEdge(edgeId, vtx1Id, vtx2Id, weight);
+        
+        if (roiVertexIds[vtx1Id] != -1 && roiVertexIds[vtx2Id] != -1)
+          roiBinaryWeights.addEdge(roiVertexIds[vtx1Id], roiVertexIds[vtx2Id], weight);
+        else if (roiVertexIds[vtx1Id] != -1)
+          roiBgWeights[roiVertexIds[vtx1Id]] += weight;
+        else if (roiVertexIds[vtx2Id] != -1)
+          roiBgWeights[roiVertexIds[vtx2Id]] += weight;
+      }
+      
+      std::vector<int> roiSegment;
+      if (!roiPointIds.empty() && !utl::segmentCloudFG  ( roiFgWeights, roiBgWeights, roiBinaryWeights, roiDownsampleMap, roiSegment, segments_[symId]))
+        success[symId] = false;
+      
+      segments_ds_[symId].resize(roiSegment.size());
+      for (size_t pointIdIt = 0; pointIdIt < roiSegment.size(); pointIdIt++)
+        segments_ds_[symId][pointIdIt] = roiPointIds[roiSegment[pointIdIt]];
+    }
 
     if (success[symId] == false)
       continue;    
     
-    utl::getCutEdges(binary_weights_[symId], segments_ds_[symId], cut_edges_[symId]);
+    utl::getCutEdges(binaryWeights, segments_ds_[symId], cut_edges_[symId]);
     
     //--------------------------------------------------------------------------
     // Compute segment scores
@@ -0,0 +1,71 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef REFLECTIONAL_SYMMETRY_WORKSPACE_HPP
+#define REFLECTIONAL_SYMMETRY_WORKSPACE_HPP
+
+// STD includes
+#include <vector>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+// PCL includes
+#include <pcl/point_cloud.h>
+#include <pcl/correspondence.h>
+
+namespace sym
+{
+  /** \brief @b ReflSymWorkspace Scratch buffers used by reflectional symmetry
+   * refinement and scoring. Buffers keep their memory between calls, so once
+   * they have grown to the size of the input clouds refining and scoring more
+   * symmetries of the same clouds does not allocate any memory for them.
+   * A workspace must not be used by more than one thread at a time. Functions
+   * that use a workspace get the workspace of the calling thread with
+   * getReflSymWorkspace() and only use it for the duration of the call.
+   */
+  template <typename PointT>
+  struct ReflSymWorkspace
+  {
+    /** \brief Empty constructor. */
+    ReflSymWorkspace ()
+      : cloud_projected_ (new pcl::PointCloud<PointT>)
+      , cloud_ds_projected_ (new pcl::PointCloud<PointT>)
+    { }
+
+    /** \brief Reflected points. */
+    Eigen::Matrix3Xf points_reflected_;
+
+    /** \brief Neighbor indices and their (squared) distances. */
+    std::vector<int>    neighbours_;
+    std::vector<float>  distances_;
+
+    /** \brief Per correspondence fit errors. */
+    std::vector<float>  fit_errors_;
+
+    /** \brief Best correspondence of every match point used by one to one correspondence rejection (all -1 between calls). */
+    std::vector<int>    match_best_ids_;
+
+    /** \brief Input clouds projected onto a symmetry plane. */
+    typename pcl::PointCloud<PointT>::Ptr cloud_projected_;
+    typename pcl::PointCloud<PointT>::Ptr cloud_ds_projected_;
+
+  private:
+
+    /** \brief Workspaces are per thread and are never copied. */
+    ReflSymWorkspace (const ReflSymWorkspace&);
+    ReflSymWorkspace& operator= (const ReflSymWorkspace&);
+  };
+
+  /** \brief Get the reflectional symmetry workspace of the calling thread. */
+  template <typename PointT>
+  inline
+  ReflSymWorkspace<PointT>& getReflSymWorkspace ()
+  {
+    static thread_local ReflSymWorkspace<PointT> workspace;
+    return workspace;
+  }
+}
+
+#endif  // REFLECTIONAL_SYMMETRY_WORKSPACE_HPP
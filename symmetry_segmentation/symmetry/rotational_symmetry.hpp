@@ -12,6 +12,8 @@
 // Utilities includes
 #include <geometry/geometry.hpp>
 #include <pointcloud/pointcloud.hpp>
+#include <pointcloud/cloud_soa.hpp>
+#include <pointcloud/cloud_soa_transform.hpp>
 #include <visualization/pcl_visualization.hpp>
 
 namespace sym
@@ -251,6 +253,84 @@ namespace sym
       return rotateNormal(normal, getRotationAroundAxis(angle));
     }
     
+    /** \brief Get the affine transformation p' = M p + t that rotates points
+     * around the symmetry axis by a given rotation matrix. Rotating the vector
+     * from the axis to a point is folded into a single affine transform of the
+     * point.
+     *  \param[in]  R   rotation matrix
+     *  \param[out] M   transformation matrix
+     *  \param[out] t   translation
+     */
+    inline
+    void getRotationTransform (const Eigen::Matrix3f &R, Eigen::Matrix3f &M, Eigen::Vector3f &t) const
+    {
+      // p' = o + (d d^T + R (I - d d^T)) (p - o)
+      const Eigen::Vector3f direction = direction_.normalized();
+      const Eigen::Matrix3f axisProjector = direction * direction.transpose();
+      M = axisProjector + R * (Eigen::Matrix3f::Identity() - axisProjector);
+      t = origin_ - M * origin_;
+    }
+    
+    /** \brief Rotate a subset of the points of a structure of arrays cloud
+     * around a symmetry axis by a given rotation matrix. The loop is
+     * vectorized by the compiler and dispatched to AVX2 at runtime where
+     * available (see utl::transformPointsSoA).
+     *  \param[in]  cloud           input cloud
+     *  \param[in]  point_ids       indices of the points to rotate
+     *  \param[in]  R               rotation matrix
+     *  \param[out] points_rotated  rotated points (one per column, ordered as the indices)
+     */
+    inline
+    void rotatePoints ( const utl::PointCloudSoA &cloud,
+                        const std::vector<int> &point_ids,
+                        const Eigen::Matrix3f &R,
+                        Eigen::Matrix3Xf &points_rotated
+                      ) const
+    {
+      Eigen::Matrix3f M;
+      Eigen::Vector3f t;
+      getRotationTransform(R, M, t);
+      points_rotated.resize(3, point_ids.size());
+      utl::transformPointsSoA(M.data(), t.data(), point_ids.size(), cloud.x(), cloud.y(), cloud.z(), point_ids.data(), points_rotated.data());
+    }
+    
+    /** \brief Rotate all points of a structure of arrays cloud around a
+     * symmetry axis by a given rotation matrix. See the indices version of
+     * rotatePoints for details.
+     *  \param[in]  cloud           input cloud
+     *  \param[in]  R               rotation matrix
+     *  \param[out] points_rotated  rotated points (one per column)
+     */
+    inline
+    void rotatePoints ( const utl::PointCloudSoA &cloud,
+                        const Eigen::Matrix3f &R,
+                        Eigen::Matrix3Xf &points_rotated
+                      ) const
+    {
+      Eigen::Matrix3f M;
+      Eigen::Vector3f t;
+      getRotationTransform(R, M, t);
+      points_rotated.resize(3, cloud.size());
+      utl::transformPointsSoA(M.data(), t.data(), cloud.size(), cloud.x(), cloud.y(), cloud.z(), NULL, points_rotated.data());
+    }
+    
+    /** \brief Rotate all normals of a structure of arrays cloud by a given
+     * rotation matrix.
+     *  \param[in]  cloud            input cloud
+     *  \param[in]  R                rotation matrix
+     *  \param[out] normals_rotated  rotated normals (one per column)
+     */
+    inline
+    void rotateNormals  ( const utl::PointCloudSoA &cloud,
+                          const Eigen::Matrix3f &R,
+                          Eigen::Matrix3Xf &normals_rotated
+                        ) const
+    {
+      const Eigen::Vector3f t = Eigen::Vector3f::Zero();
+      normals_rotated.resize(3, cloud.size());
+      utl::transformPointsSoA(R.data(), t.data(), cloud.size(), cloud.nx(), cloud.ny(), cloud.nz(), NULL, normals_rotated.data());
+    }
+    
     /** \brief Rotate a pointcloud around a symmetry axis by a given angle. The 
      * angle is specified clockwise around the symmetry axis.
      *  \param[in] cloud_in original cloud
@@ -263,8 +343,9 @@ namespace sym
       // Prepare output cloud
       pcl::copyPointCloud<PointT>(cloud_in, cloud_out);
       
+      const Eigen::Matrix3f R = getRotationAroundAxis(angle);
       for (size_t i = 0; i < cloud_in.size(); i++)
-        cloud_out.points[i].getVector3fMap() = rotatePoint(cloud_in.points[i].getVector3fMap(), angle);
+        cloud_out.points[i].getVector3fMap() = rotatePoint(cloud_in.points[i].getVector3fMap(), R);
     }
     
     /** \brief Rotate a pointcloud around a symmetry axis by a given angle. The 
@@ -280,8 +361,9 @@ namespace sym
       // Prepare output cloud
       pcl::copyPointCloud<PointT>(cloud_in, indices, cloud_out);
       
+      const Eigen::Matrix3f R = getRotationAroundAxis(angle);
       for (size_t i = 0; i < indices.size(); i++)
-        cloud_out.points[i].getVector3fMap() = rotatePoint(cloud_in.points[indices[i]].getVector3fMap(), angle);
+        cloud_out.points[i].getVector3fMap() = rotatePoint(cloud_in.points[indices[i]].getVector3fMap(), R);
     }
 
     /** \brief Rotate a pointcloud with normals around a symmetry axis by a given angle. The 
@@ -295,9 +377,9 @@ namespace sym
     {
       pcl::copyPointCloud<PointT>(cloud_in, cloud_out);
           
+      const Eigen::Matrix3f R = getRotationAroundAxis(angle);
       for (size_t i = 0; i < cloud_in.size(); i++)
       {
-        Eigen::Matrix3f R = getRotationAroundAxis(angle);
         cloud_out.points[i].getVector3fMap()        = rotatePoint  (cloud_in.points[i].getVector3fMap(), R);
         cloud_out.points[i].getNormalVector3fMap()  = rotateNormal (cloud_in.points[i].getNormalVector3fMap(), R);
       }
@@ -315,9 +397,9 @@ namespace sym
     {
       pcl::copyPointCloud<PointT>(cloud_in, indices, cloud_out);
           
-      for (size_t i = 0; i < cloud_in.size(); i++)
+      const Eigen::Matrix3f R = getRotationAroundAxis(angle);
+      for (size_t i = 0; i < indices.size(); i++)
       {
-        Eigen::Matrix3f R = getRotationAroundAxis(angle);
         cloud_out.points[i].getVector3fMap()        = rotatePoint  (cloud_in.points[indices[i]].getVector3fMap(), R);
         cloud_out.points[i].getNormalVector3fMap()  = rotateNormal (cloud_in.points[indices[i]].getNormalVector3fMap(), R);
       }
@@ -7,6 +7,8 @@
 
 #include <symmetry/rotational_symmetry.hpp>
 #include <occupancy_map.hpp>
+#include <pointcloud/cloud_soa.hpp>
+#include <deadline.hpp>
 
 namespace sym
 {
@@ -16,6 +18,16 @@ namespace sym
 
   struct RotSymDetectParams
   {
+    // Voting initialization. Initial symmetries are the peaks of the votes of
+    // normal line intersections for the axes through them instead of the
+    // major axes of the cloud. The major axes are still used if voting gives
+    // no symmetries.
+    int   voting_num_pairs          = 0;                      // number of sampled point pairs (0 - use the major axes)
+    int   voting_max_hypotheses     = 3;                      // maximum number of initial symmetries
+    float voting_angle_step         = pcl::deg2rad (10.0f);   // angular step of the vote accumulator
+    float voting_distance_step      = 0.01f;                  // distance step of the vote accumulator
+    float voting_max_line_distance  = 0.005f;                 // maximum distance between intersecting normal lines
+    
     // Refinement
     float ref_max_fit_angle         = pcl::deg2rad (45.0f);  
   
@@ -24,6 +36,7 @@ namespace sym
     float max_normal_fit_angle    = pcl::deg2rad(60.0f);
     float min_occlusion_distance  = 0.01f;
     float max_occlusion_distance  = 0.03f;
+    bool  precise_coverage        = false;    // compute coverage angle by sorting point angles instead of an angular histogram
     
     // Filtering
     float max_symmetry_score      = 0.01f;
@@ -107,6 +120,14 @@ namespace sym
      */
     inline
     void setInputOcuppancyMap  (const OccupancyMapConstPtr &occupancy_map);
+
+    /** \brief Provide a search object for the input pointcloud (e.g. a view of
+     * a search tree built for the whole scene). If it is not set or its input
+     * cloud is not the input pointcloud, a search tree is built during detection.
+     *  \param search pointer to a search object
+     */
+    inline
+    void setSearchMethod (const typename pcl::search::Search<PointT>::ConstPtr &search);
     
     /** \brief Set initial symmetries.
      *  \param initial_symmetries   vector of initial symmetries
@@ -120,8 +141,39 @@ namespace sym
     inline
     void setParameters (const RotSymDetectParams &params);
     
-    /** \brief Detect reflectional symmetries in the input pointcloud. */
+    /** \brief Set a deadline for the detection. Hypotheses whose refinement
+     * starts after the deadline are dropped. The number of optimization steps
+     * of a running refinement is capped adaptively: it stops once the next
+     * step is not expected to finish before the deadline. Hypotheses are
+     * refined in the order of the initial symmetries.
+     *  \param deadline  deadline
+     */
+    inline
+    void setDeadline (const utl::Deadline &deadline);
+    
+    /** \brief Check if the last detection was cut short by the deadline. */
+    inline bool isPartial () const;
+    
+    /** \brief Detect reflectional symmetries in the input pointcloud. This is
+     * equivalent to calling initialize() and refineHypothesis() for every
+     * hypothesis.
+     */
     inline bool detect ();
+    
+    /** \brief Remove the boundary of the input pointcloud and get the symmetry
+     * hypotheses that will be refined.
+     */
+    inline bool initialize ();
+    
+    /** \brief Get the number of symmetry hypotheses found by initialize(). */
+    inline int getNumHypotheses () const;
+    
+    /** \brief Refine and score a single symmetry hypothesis. Different
+     * hypotheses can be refined concurrently, e.g. as separate tasks.
+     *  \param[in] hypothesis_id   index of the hypothesis
+     *  \return false if the hypothesis index is out of range
+     */
+    inline bool refineHypothesis (const int hypothesis_id);
 
     /** \brief Filter detected symmetries. */
     inline void filter ();
@@ -168,6 +220,12 @@ namespace sym
     /** \brief Detection parameters. */
     RotSymDetectParams params_;
     
+    /** \brief Detection deadline. */
+    utl::Deadline deadline_;
+    
+    /** \brief Hypotheses that were dropped or cut short by the deadline. */
+    std::vector<char> hypotheses_truncated_;
+    
     /** \brief Input cloud. */
     typename pcl::PointCloud<PointT>::ConstPtr cloud_;
 
@@ -177,12 +235,19 @@ namespace sym
     /** \brief Indices of non-boundary points of the cloud. */
     std::vector<int> cloud_no_boundary_point_ids_;
     
+    /** \brief Structure of arrays views of the input cloud and of the cloud with boundary points removed used for scoring. */
+    utl::PointCloudSoA cloud_soa_;
+    utl::PointCloudSoA cloud_no_boundary_soa_;
+    
     /** \brief Input cloud. */
     Eigen::Vector3f cloud_mean_;
     
     /** \brief Scene occupancy map. */
     OccupancyMapConstPtr occupancy_map_;
 
+    /** \brief Search object for the input cloud. */
+    typename pcl::search::Search<PointT>::ConstPtr search_;
+
     /** \brief Refined symmetries. */
     std::vector<sym::RotationalSymmetry> symmetries_initial_;
     
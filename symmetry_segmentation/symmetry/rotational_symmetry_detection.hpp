@@ -7,8 +7,10 @@
 
 // Utilities
 #include <geometry/geometry.hpp>
+#include <geometry/line_direction_index.hpp>
 #include <graph/graph_algorithms.hpp>
 #include <pointcloud/pointcloud.hpp>
+#include <profiling.hpp>
 
 // Symmetry
 #include <symmetry/rotational_symmetry_detection.h>
@@ -33,14 +35,29 @@ void sym::mergeDuplicateRotSymmetries ( const std::vector<sym::RotationalSymmetr
   // indicate segments that are similar
   utl::Graph symmetryAdjacency (indices.size());
   
+  // Index symmetry axes so that each symmetry is only compared to the
+  // symmetries with similar axes
+  std::vector<Eigen::Vector3f> symmetryAxes (indices.size());
+  for (size_t symIdIt = 0; symIdIt < indices.size(); symIdIt++)
+    symmetryAxes[symIdIt] = symmetries[indices[symIdIt]].getDirection();
+  
+  utl::LineDirectionIndex axisIndex;
+  axisIndex.setInputDirections(symmetryAxes, max_angle_diff);
+  std::vector<int> candidateIdIts;
+  
   for (size_t srcIdIt = 0; srcIdIt < indices.size(); srcIdIt++)
   {
     int srcId = indices[srcIdIt];
     sym::RotationalSymmetry srcHypothesis = symmetries[srcId];
     Eigen::Vector3f srcReferencePoint = symmetry_reference_points[srcId];
     
-    for (size_t tgtIdIt = srcIdIt+1; tgtIdIt < indices.size(); tgtIdIt++)
+    axisIndex.getCandidates(symmetryAxes[srcIdIt], candidateIdIts);
+    for (size_t candIdIt = 0; candIdIt < candidateIdIts.size(); candIdIt++)
     {
+      size_t tgtIdIt = candidateIdIts[candIdIt];
+      if (tgtIdIt <= srcIdIt)
+        continue;
+      
       int tgtId = indices[tgtIdIt];
       sym::RotationalSymmetry tgtHypothesis = symmetries[tgtId];
       Eigen::Vector3f tgtReferencePoint = symmetry_reference_points[srcId];
@@ -130,6 +147,7 @@ void sym::mergeDuplicateRotSymmetries ( const std::vector<sym::RotationalSymmetr
 template <typename PointT>
 sym::RotationalSymmetryDetection<PointT>::RotationalSymmetryDetection () :
   params_(),
+  deadline_ (),
   cloud_ (new pcl::PointCloud<PointT>),
   cloud_no_boundary_ (new pcl::PointCloud<PointT>)
 {}
@@ -138,6 +156,7 @@ sym::RotationalSymmetryDetection<PointT>::RotationalSymmetryDetection () :
 template <typename PointT>
 sym::RotationalSymmetryDetection<PointT>::RotationalSymmetryDetection (const sym::RotSymDetectParams &params) :
   params_ (params),
+  deadline_ (),
   cloud_ (new pcl::PointCloud<PointT>),
   cloud_no_boundary_ (new pcl::PointCloud<PointT>)
 {}
@@ -163,6 +182,14 @@ sym::RotationalSymmetryDetection<PointT>::setInputOcuppancyMap  (const Occupancy
   occupancy_map_ = occupancy_map;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::RotationalSymmetryDetection<PointT>::setSearchMethod  (const typename pcl::search::Search<PointT>::ConstPtr &search)
+{ 
+  search_ = search;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline void
@@ -179,23 +206,39 @@ sym::RotationalSymmetryDetection<PointT>::setParameters  (const RotSymDetectPara
   params_ = params;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::RotationalSymmetryDetection<PointT>::setDeadline  (const utl::Deadline &deadline)
+{
+  deadline_ = deadline;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline bool
-sym::RotationalSymmetryDetection<PointT>::detect ()
+sym::RotationalSymmetryDetection<PointT>::isPartial () const
+{
+  return std::find(hypotheses_truncated_.begin(), hypotheses_truncated_.end(), 1) != hypotheses_truncated_.end();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::RotationalSymmetryDetection<PointT>::initialize ()
 {
   //--------------------------------------------------------------------------
   // Entry checks
   
   if (cloud_->size() == 0)
   {
-    std::cout << "[sym::RotationalSymmetryDetection::detect] input cloud is empty." << std::endl;
+    std::cout << "[sym::RotationalSymmetryDetection::initialize] input cloud is empty." << std::endl;
     return false;
   }
   
   if (!occupancy_map_)
   {
-    std::cout << "[sym::RotationalSymmetryDetection::detect] occupancy map is not set." << std::endl;
+    std::cout << "[sym::RotationalSymmetryDetection::initialize] occupancy map is not set." << std::endl;
     return false;
   }  
   
@@ -209,22 +252,50 @@ sym::RotationalSymmetryDetection<PointT>::detect ()
   point_perpendicular_scores_.clear();
   symmetry_filtered_ids_.clear();
   symmetry_merged_ids_.clear();
+  hypotheses_truncated_.clear();
   
   //----------------------------------------------------------------------------
   // Remove boundary points from the pointcloud
   
+  // Create a search tree for the input cloud unless a search object was provided
+  typename pcl::search::Search<PointT>::ConstPtr cloudSearch = search_;
+  if (!cloudSearch || cloudSearch->getInputCloud() != cloud_)
+  {
+    typename pcl::search::KdTree<PointT>::Ptr cloudSearchTree (new pcl::search::KdTree<PointT>);
+    cloudSearchTree->setInputCloud(cloud_);
+    cloudSearch = cloudSearchTree;
+  }
+  
   std::vector<int> cloudBoundaryPointIds, cloudNonBoundaryPointIds;
-  utl::getCloudBoundary<PointT>(cloud_, 0.01f, cloudBoundaryPointIds, cloudNonBoundaryPointIds);
+  utl::getCloudBoundary<PointT>(*cloudSearch, 0.01f, cloudBoundaryPointIds, cloudNonBoundaryPointIds);
   
   std::vector<int> allPointIds (cloud_->size());
   for (size_t pointId = 0; pointId < cloud_->size(); pointId++)
     allPointIds[pointId] = pointId;
   cloud_no_boundary_point_ids_ = utl::vectorDifference(allPointIds, cloudBoundaryPointIds);
   pcl::copyPointCloud<PointT>(*cloud_, cloud_no_boundary_point_ids_, *cloud_no_boundary_);
+  cloud_soa_.setInputCloud(*cloud_);
+  cloud_no_boundary_soa_.setInputCloud(*cloud_no_boundary_);
     
   //----------------------------------------------------------------------------
   // Get the initial symmetries
   
+  // Vote for the initial symmetries if requested. The major axes of the cloud
+  // are used if voting gives no symmetries.
+  if (symmetries_initial_.size() == 0 && params_.voting_num_pairs > 0)
+  {
+    if (!sym::getVotedRotSymmetries<PointT> ( *cloud_no_boundary_,
+                                              symmetries_initial_,
+                                              cloud_mean_,
+                                              params_.voting_num_pairs,
+                                              params_.voting_max_hypotheses,
+                                              params_.voting_angle_step,
+                                              params_.voting_distance_step,
+                                              params_.voting_max_line_distance )
+    )
+      return false;
+  }
+  
   if (symmetries_initial_.size() == 0)
   {
     if (!sym::getInitialRotSymmetries<PointT>(cloud_, symmetries_initial_, cloud_mean_))
@@ -238,7 +309,7 @@ sym::RotationalSymmetryDetection<PointT>::detect ()
   }
 
   //--------------------------------------------------------------------------
-  // Refine initial symmetries
+  // Allocate refinement results
 
   symmetries_refined_.resize(symmetries_initial_.size());
   symmetry_scores_.resize(symmetries_initial_.size());
@@ -248,48 +319,127 @@ sym::RotationalSymmetryDetection<PointT>::detect ()
   point_symmetry_scores_.resize(symmetries_initial_.size());
   point_occlusion_scores_.resize(symmetries_initial_.size());
   point_perpendicular_scores_.resize(symmetries_initial_.size());
+  hypotheses_truncated_.assign(symmetries_initial_.size(), 0);
   
-  std::vector<bool> filteredSymTableTMP (symmetries_refined_.size(), false);
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_GENERATED, symmetries_initial_.size());
   
-//     # pragma omp parallel for
-  for (size_t symId = 0; symId < symmetries_refined_.size (); symId++)
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline int
+sym::RotationalSymmetryDetection<PointT>::getNumHypotheses () const
+{
+  return static_cast<int>(symmetries_initial_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::RotationalSymmetryDetection<PointT>::refineHypothesis (const int hypothesis_id)
+{
+  if (hypothesis_id < 0 || hypothesis_id >= static_cast<int>(symmetries_refined_.size()))
+  {
+    std::cout << "[sym::RotationalSymmetryDetection::refineHypothesis] hypothesis index is out of range." << std::endl;
+    return false;
+  }
+  
+  // Drop the hypothesis if the deadline has expired. Its scores are set so
+  // that it never passes the filter.
+  if (deadline_.expired())
+  {
+    hypotheses_truncated_[hypothesis_id] = 1;
+    symmetries_refined_[hypothesis_id] = symmetries_initial_[hypothesis_id];
+    symmetry_scores_[hypothesis_id] = std::numeric_limits<float>::max();
+    occlusion_scores_[hypothesis_id] = std::numeric_limits<float>::max();
+    perpendicular_scores_[hypothesis_id] = std::numeric_limits<float>::max();
+    coverage_scores_[hypothesis_id] = 0.0f;
+    return true;
+  }
+  
+  // Create optimization object. Axis is parametrized relative to the initial
+  // symmetry with its origin projected onto the plane through the cloud mean
+  sym::RotationalSymmetry symmetryInitial = symmetries_initial_[hypothesis_id];
+  symmetryInitial.setOriginProjected (cloud_mean_);
+  
+  sym::RotSymRefineFunctor<PointT> functor;
+  functor.cloud_ = cloud_no_boundary_;
+  functor.max_fit_angle_ = params_.ref_max_fit_angle;
+  functor.setInitialSymmetry (symmetryInitial);
+  Eigen::LevenbergMarquardt<sym::RotSymRefineFunctor<PointT>, float> lm(functor);
+  lm.parameters.ftol = 1e-12;
+  lm.parameters.maxfev = 800;
+  
+  // Refine symmetry. With a deadline the optimization is stepped manually and
+  // the number of steps is capped adaptively: it stops once another step,
+  // taking as long as the average of the previous ones, would not finish
+  // before the deadline.
+  Eigen::VectorXf x = Eigen::VectorXf::Zero(4);
+  if (!deadline_.isSet())
   {
-    // Create optimization object
-    sym::RotSymRefineFunctorDiff<PointT> functor;
-    functor.cloud_ = cloud_no_boundary_;
-    functor.max_fit_angle_ = params_.ref_max_fit_angle;
-    Eigen::LevenbergMarquardt<sym::RotSymRefineFunctorDiff<PointT>, float> lm(functor);
-    lm.parameters.ftol = 1e-12;
-    lm.parameters.maxfev = 800;
-    
-    // Refine symmetry
-    Eigen::VectorXf x (6);
-    x.head(3) = symmetries_initial_[symId].getOrigin();
-    x.tail(3) = symmetries_initial_[symId].getDirection();
     lm.minimize (x);
-    symmetries_refined_[symId] = sym::RotationalSymmetry (x.head (3), x.tail (3));
-    symmetries_refined_[symId].setOriginProjected (cloud_mean_);    
-    
-    // Score symmetry
-    symmetry_scores_[symId]   = sym::rotSymCloudSymmetryScore<PointT>          ( *cloud_no_boundary_,
-                                                                                 symmetries_refined_[symId],
-                                                                                 point_symmetry_scores_[symId],
-                                                                                 params_.min_normal_fit_angle,
-                                                                                 params_.max_normal_fit_angle );
-    occlusion_scores_[symId]  = sym::rotSymCloudOcclusionScore<PointT>          ( *cloud_,
-                                                                                  occupancy_map_,
-                                                                                  symmetries_refined_[symId],
-                                                                                  point_occlusion_scores_[symId],
-                                                                                  params_.min_occlusion_distance,
-                                                                                  params_.max_occlusion_distance );
-    perpendicular_scores_[symId] = sym::rotSymCloudPerpendicularScores<PointT>  ( *cloud_no_boundary_,
-                                                                                  symmetries_refined_[symId],
-                                                                                  point_perpendicular_scores_[symId] );
+  }
+  else
+  {
+    const std::chrono::steady_clock::time_point lmStart = std::chrono::steady_clock::now();
+    Eigen::LevenbergMarquardtSpace::Status status = lm.minimizeInit (x);
+    if (status != Eigen::LevenbergMarquardtSpace::ImproperInputParameters)
+    {
+      int numSteps = 0;
+      double stepTime = 0.0;
+      do
+      {
+        status = lm.minimizeOneStep (x);
+        stepTime = std::chrono::duration<double> (std::chrono::steady_clock::now() - lmStart).count() / ++numSteps;
+      }
+      while (status == Eigen::LevenbergMarquardtSpace::Running && !deadline_.expiresWithin(stepTime));
+    }
     
-    coverage_scores_[symId] = sym::rotSymCloudCoverageAngle<PointT>             ( *cloud_,
-                                                                                  symmetries_refined_[symId] );
-    coverage_scores_[symId] /= (M_PI * 2);
+    if (status == Eigen::LevenbergMarquardtSpace::Running)
+      hypotheses_truncated_[hypothesis_id] = 1;
   }
+  UTL_PROFILE_COUNT(utl::PROFILE_LM_ITERATIONS, lm.iter);
+  symmetries_refined_[hypothesis_id] = functor.getSymmetry (x);
+  symmetries_refined_[hypothesis_id].setOriginProjected (cloud_mean_);    
+  
+  // Score symmetry
+  symmetry_scores_[hypothesis_id]   = sym::rotSymCloudSymmetryScore                  ( cloud_no_boundary_soa_,
+                                                                                       symmetries_refined_[hypothesis_id],
+                                                                                       point_symmetry_scores_[hypothesis_id],
+                                                                                       params_.min_normal_fit_angle,
+                                                                                       params_.max_normal_fit_angle );
+  occlusion_scores_[hypothesis_id]  = sym::rotSymCloudOcclusionScore                  ( cloud_soa_,
+                                                                                        occupancy_map_,
+                                                                                        symmetries_refined_[hypothesis_id],
+                                                                                        point_occlusion_scores_[hypothesis_id],
+                                                                                        params_.min_occlusion_distance,
+                                                                                        params_.max_occlusion_distance );
+  perpendicular_scores_[hypothesis_id] = sym::rotSymCloudPerpendicularScores          ( cloud_no_boundary_soa_,
+                                                                                        symmetries_refined_[hypothesis_id],
+                                                                                        point_perpendicular_scores_[hypothesis_id] );
+  
+  coverage_scores_[hypothesis_id] = sym::rotSymCloudCoverageAngle                     ( cloud_soa_,
+                                                                                        symmetries_refined_[hypothesis_id],
+                                                                                        params_.precise_coverage );
+  coverage_scores_[hypothesis_id] /= (M_PI * 2);
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_REFINED, 1);
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::RotationalSymmetryDetection<PointT>::detect ()
+{
+  if (!initialize())
+    return false;
+  
+//     # pragma omp parallel for
+  for (int symId = 0; symId < getNumHypotheses(); symId++)
+    refineHypothesis(symId);
 
   return true;  
 }
@@ -313,6 +463,8 @@ sym::RotationalSymmetryDetection<PointT>::filter ()
       symmetry_filtered_ids_.push_back(symId);
     }
   }
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_FILTERED, symmetry_filtered_ids_.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -334,6 +486,8 @@ sym::RotationalSymmetryDetection<PointT>::merge ()
   
   if (bestSymId != -1)
     symmetry_merged_ids_.push_back(bestSymId);
+  
+  UTL_PROFILE_COUNT(utl::PROFILE_HYPOTHESES_MERGED, symmetry_merged_ids_.size());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -5,9 +5,13 @@
 #ifndef ROTATIONAL_SYMMETRY_DETECTION_CORE_HPP
 #define ROTATIONAL_SYMMETRY_DETECTION_CORE_HPP
 
+// STD includes
+#include <random>
+
 // Symmetry
 #include <symmetry/rotational_symmetry.hpp>
 #include <symmetry/refinement_base_functor.hpp>
+#include <symmetry/symmetry_voting.hpp>
 
 namespace sym
 {
@@ -51,6 +55,125 @@ namespace sym
     return true;
   }    
   
+  /** \brief Get the initial symmetries used for rotational symmetry detection
+   * by voting. Normal lines of a surface of revolution intersect the
+   * symmetry axis, so:
+   * 1. Intersections of the normal lines of random pairs of points are found.
+   *    Pairs with nearly parallel normal lines or normal lines that do not
+   *    (nearly) intersect are skipped.
+   * 2. Random pairs of intersection points vote for the axis passing through
+   *    them.
+   * Votes are accumulated in a quantized accumulator and the symmetries are the
+   * strongest peaks of the accumulator.
+   *  \param[in]  cloud               input cloud
+   *  \param[out] symmetries          rotational symmetries
+   *  \param[out] cloud_mean          mean of the pointcloud
+   *  \param[in]  num_pairs           number of sampled point pairs (and of sampled intersection pairs)
+   *  \param[in]  max_symmetries      maximum number of symmetries
+   *  \param[in]  angle_step          angular step of the accumulator
+   *  \param[in]  distance_step       distance step of the accumulator
+   *  \param[in]  max_line_distance   maximum distance between two normal lines that are considered intersecting
+   *  \return FALSE if input pointcloud has less than two points
+   */
+  template <typename PointT>
+  inline
+  bool getVotedRotSymmetries  ( const pcl::PointCloud<PointT> &cloud,
+                                std::vector<sym::RotationalSymmetry> &symmetries,
+                                Eigen::Vector3f &cloud_mean,
+                                const int num_pairs = 2000,
+                                const int max_symmetries = 3,
+                                const float angle_step = pcl::deg2rad(10.0f),
+                                const float distance_step = 0.01f,
+                                const float max_line_distance = 0.005f
+                              )
+  {
+    symmetries.clear();
+    
+    // Check that input cloud has sufficient number of points
+    if (cloud.size() < 2)
+    {
+      std::cout << "[sym::getVotedRotSymmetries] input cloud has less than two points. Aborting..." << std::endl;
+      return false;
+    }
+    
+    Eigen::Vector4f cloudMeanTMP;
+    pcl::compute3DCentroid<PointT>(cloud, cloudMeanTMP);
+    cloud_mean = cloudMeanTMP.head(3);
+    
+    // Intersections far away from the cloud come from nearly parallel normal lines
+    float cloudRadius = 0.0f;
+    for (size_t pointId = 0; pointId < cloud.size(); pointId++)
+      cloudRadius = std::max(cloudRadius, (cloud.points[pointId].getVector3fMap() - cloud_mean).norm());
+    
+    //--------------------------------------------------------------------------
+    // Find normal line intersections. Pairs are sampled with a fixed seed so
+    // that detection is repeatable
+    
+    std::mt19937 gen (0);
+    std::uniform_int_distribution<int> pointDistribution (0, cloud.size() - 1);
+    const float minNormalAngleSin = std::sin(angle_step);
+    std::vector<Eigen::Vector3f> intersections;
+    for (int pairId = 0; pairId < num_pairs; pairId++)
+    {
+      const PointT &point1 = cloud.points[pointDistribution(gen)];
+      const PointT &point2 = cloud.points[pointDistribution(gen)];
+      const Eigen::Vector3f normal1 = point1.getNormalVector3fMap().normalized();
+      const Eigen::Vector3f normal2 = point2.getNormalVector3fMap().normalized();
+      
+      const float normalDot = normal1.dot(normal2);
+      const float denom = 1.0f - normalDot * normalDot;
+      if (denom < minNormalAngleSin * minNormalAngleSin)
+        continue;
+      
+      // Closest points of the two normal lines
+      const Eigen::Vector3f pointOffset = point1.getVector3fMap() - point2.getVector3fMap();
+      const float normal1DotOffset = normal1.dot(pointOffset);
+      const float normal2DotOffset = normal2.dot(pointOffset);
+      const Eigen::Vector3f linePoint1 = point1.getVector3fMap() + normal1 * ((normalDot * normal2DotOffset - normal1DotOffset) / denom);
+      const Eigen::Vector3f linePoint2 = point2.getVector3fMap() + normal2 * ((normal2DotOffset - normalDot * normal1DotOffset) / denom);
+      
+      if ((linePoint1 - linePoint2).norm() > max_line_distance)
+        continue;
+      
+      const Eigen::Vector3f intersection = (linePoint1 + linePoint2) / 2.0f;
+      if ((intersection - cloud_mean).norm() > 2.0f * cloudRadius)
+        continue;
+      
+      intersections.push_back(intersection);
+    }
+    
+    if (intersections.size() < 2)
+      return true;
+    
+    //--------------------------------------------------------------------------
+    // Vote for the axes through pairs of intersections
+    
+    sym::SymmetryVoteAccumulator accumulator (angle_step, distance_step);
+    std::uniform_int_distribution<int> intersectionDistribution (0, intersections.size() - 1);
+    for (int pairId = 0; pairId < num_pairs; pairId++)
+    {
+      const Eigen::Vector3f &intersection1 = intersections[intersectionDistribution(gen)];
+      const Eigen::Vector3f &intersection2 = intersections[intersectionDistribution(gen)];
+      
+      Eigen::Vector3f direction = intersection2 - intersection1;
+      if (direction.norm() < distance_step)
+        continue;
+      direction.normalize();
+      
+      sym::RotationalSymmetry symmetry (intersection1, direction);
+      accumulator.addVote(direction, symmetry.projectPoint(cloud_mean));
+    }
+    
+    // Convert peaks to symmetries
+    std::vector<Eigen::Vector3f> peakDirections, peakPoints;
+    std::vector<int> peakVotes;
+    accumulator.getPeaks(max_symmetries, peakDirections, peakPoints, peakVotes);
+    for (size_t peakId = 0; peakId < peakDirections.size(); peakId++)
+      symmetries.push_back(sym::RotationalSymmetry(peakPoints[peakId], peakDirections[peakId]));
+    
+    return true;
+  }
+  
   //----------------------------------------------------------------------------
   // Symmetry refinement
   //----------------------------------------------------------------------------
@@ -58,9 +181,17 @@ namespace sym
   /** \brief Given 3D pointcloud with normals and an initial 3D rotational
    * symmetry axis refine the symmetry axis such that it minimizes the error
    * of fit between the symmetry and the points.
-   * Symmetry axis is represented as a 6D vector (point on the symmetry axis and
-   * a direction vector.
-   * \note the final refined symmetry vector may have a non-unit normal.
+   * Symmetry axis is parametrized relative to the initial symmetry with a 4
+   * dimensional vector (a, b, s, t). Symmetry direction is the normalized
+   * d0 + a * u + b * v where d0 is the initial symmetry direction and u, v are
+   * orthogonal to it. Symmetry origin is o0 + s * u + t * v where o0 is the
+   * origin of the initial symmetry. Moving the origin along the axis does not
+   * change the axis, so it is only moved in the plane orthogonal to the
+   * initial direction.
+   * Given an axis (o, d) and a point p with normal m the fit error is the
+   * arcsine of |c.m| / |c| where c = (p - o) x d is the normal of the plane
+   * containing the axis and the point. This gives the derivatives of the
+   * errors in closed form.
    */
   template <typename PointT>
   struct RotSymRefineFunctor : BaseFunctor<float>
@@ -70,6 +201,25 @@ namespace sym
       : max_fit_angle_ (1.0f)
     {};
     
+    /** \brief Set the symmetry around which the axis is parametrized.
+     *  \param[in]  symmetry  initial symmetry
+     */
+    void setInitialSymmetry (const RotationalSymmetry &symmetry)
+    {
+      direction_ = symmetry.getDirection();
+      tangent1_ = direction_.unitOrthogonal();
+      tangent2_ = direction_.cross(tangent1_);
+      origin_ = symmetry.getOrigin();
+    }
+    
+    /** \brief Convert a parameter vector to a symmetry.
+     *  \param[in]  x  parameter vector
+     *  \return symmetry
+     */
+    RotationalSymmetry getSymmetry (const Eigen::VectorXf &x) const
+    {
+      return RotationalSymmetry (getOrigin(x), getDirectionUnnormalized(x));
+    }
     
     /** \brief Compute fitness for each input point.
      *  \param[in]  x symmetry axis
@@ -78,7 +228,7 @@ namespace sym
     int operator()(const Eigen::VectorXf &x, Eigen::VectorXf &fvec) const
     {
       // Get current rotational symmetry
-      RotationalSymmetry symmetry (x.head (3), x.tail (3));
+      RotationalSymmetry symmetry = getSymmetry(x);
       
       // Compute fitness
       for(size_t i = 0; i < this->cloud_->size(); i++)
@@ -92,21 +242,97 @@ namespace sym
       return 0;
     }
     
+    /** \brief Compute the jacobian of the errors.
+     *  \param[in]  x symmetry axis
+     *  \param[out] fjac jacobian
+     */
+    int df(const Eigen::VectorXf &x, Eigen::MatrixXf &fjac) const
+    {
+      const Eigen::Vector3f directionUnnormalized = getDirectionUnnormalized(x);
+      const float directionNorm = directionUnnormalized.norm();
+      const Eigen::Vector3f direction = directionUnnormalized / directionNorm;
+      const Eigen::Vector3f origin = getOrigin(x);
+      
+      // Derivatives of the normalized direction with respect to a and b
+      const Eigen::Matrix3f directionProjector = (Eigen::Matrix3f::Identity() - direction * direction.transpose()) / directionNorm;
+      const Eigen::Vector3f dDirectionDa = directionProjector * tangent1_;
+      const Eigen::Vector3f dDirectionDb = directionProjector * tangent2_;
+      
+      for(size_t i = 0; i < this->cloud_->size(); i++)
+      {
+        const Eigen::Vector3f point   = this->cloud_->points[i].getVector3fMap();
+        const Eigen::Vector3f normal  = this->cloud_->points[i].getNormalVector3fMap();
+        
+        // Plane containing the axis and the point
+        const Eigen::Vector3f pointOffset = point - origin;
+        const Eigen::Vector3f planeNormal = pointOffset.cross(direction);
+        const float planeNormalNorm = planeNormal.norm();
+        const float planeNormalDotNormal = planeNormal.dot(normal);
+        const float angleSin = std::abs(planeNormalDotNormal) / planeNormalNorm;
+        
+        // Errors that are clamped or are at a singularity of the arcsine do
+        // not change with the parameters
+        if (!(planeNormalNorm > 0.0f) || !(angleSin < 1.0f) || std::asin(angleSin) >= max_fit_angle_)
+        {
+          fjac.row(i).setZero();
+          continue;
+        }
+        
+        // Derivatives of c.m and |c| with respect to the direction and the origin
+        const float pointOffsetDotDirection = pointOffset.dot(direction);
+        const Eigen::Vector3f pointOffsetPerpendicular = pointOffset - direction * pointOffsetDotDirection;
+        const Eigen::Vector3f dDotDDirection  = normal.cross(pointOffset);
+        const Eigen::Vector3f dDotDOrigin     = normal.cross(direction);
+        const Eigen::Vector3f dNormDDirection = (direction * pointOffset.squaredNorm() - pointOffset * pointOffsetDotDirection) / planeNormalNorm;
+        const Eigen::Vector3f dNormDOrigin    = -pointOffsetPerpendicular / planeNormalNorm;
+        
+        // Derivatives of the error with respect to the direction and the origin
+        const float sign = planeNormalDotNormal < 0.0f ? -1.0f : 1.0f;
+        const float scale = 1.0f / (planeNormalNorm * std::sqrt(1.0f - angleSin * angleSin));
+        const Eigen::Vector3f dErrorDDirection  = scale * (sign * dDotDDirection - angleSin * dNormDDirection);
+        const Eigen::Vector3f dErrorDOrigin     = scale * (sign * dDotDOrigin    - angleSin * dNormDOrigin);
+        
+        fjac(i, 0) = dErrorDDirection.dot(dDirectionDa);
+        fjac(i, 1) = dErrorDDirection.dot(dDirectionDb);
+        fjac(i, 2) = dErrorDOrigin.dot(tangent1_);
+        fjac(i, 3) = dErrorDOrigin.dot(tangent2_);
+      }
+      
+      return 0;
+    }
+    
     /** \brief Input cloud. */
     typename pcl::PointCloud<PointT>::ConstPtr cloud_;
     
     /** \brief Maximum error of fit between a symmetry and a point. */
     float max_fit_angle_;
     
+    /** \brief Direction of the initial symmetry and two vectors orthogonal to it. */
+    Eigen::Vector3f direction_, tangent1_, tangent2_;
+    
+    /** \brief Origin of the initial symmetry. */
+    Eigen::Vector3f origin_;
+    
     /** \brief Dimensionality of the optimization parameter vector. */
-    int inputs() const { return 6; }
+    int inputs() const { return 4; }
     
     /** \brief Number of points. */
     int values() const { return this->cloud_->size (); }
+    
+  private:
+    
+    /** \brief Get the unnormalized symmetry direction corresponding to a parameter vector. */
+    inline Eigen::Vector3f getDirectionUnnormalized (const Eigen::VectorXf &x) const
+    {
+      return direction_ + x[0] * tangent1_ + x[1] * tangent2_;
+    }
+    
+    /** \brief Get the symmetry origin corresponding to a parameter vector. */
+    inline Eigen::Vector3f getOrigin (const Eigen::VectorXf &x) const
+    {
+      return origin_ + x[2] * tangent1_ + x[3] * tangent2_;
+    }
   };
-
-  template <typename PointT>
-  struct RotSymRefineFunctorDiff : Eigen::NumericalDiff<RotSymRefineFunctor<PointT> > {};
 }
 
 #endif    // ROTATIONAL_SYMMETRY_DETECTION_CORE_HPP
\ No newline at end of file
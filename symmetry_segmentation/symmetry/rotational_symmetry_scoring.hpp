@@ -5,25 +5,30 @@
 #ifndef ROTATIONAL_SYMMETRY_SCORING_HPP
 #define ROTATIONAL_SYMMETRY_SCORING_HPP
 
+// STD includes
+#include <stdint.h>
+
 // Octomap includes
 #include <occupancy_map.hpp>
 
+// Utilities
+#include <pointcloud/cloud_soa.hpp>
+
 // Symmetry
 #include <symmetry/rotational_symmetry.hpp>
 
 namespace sym
 {
   /** \brief Calculate how well does a rotational symmetry fit a pointcloud.
-   *  \param[in]  cloud                   input cloud
+   *  \param[in]  cloud                   structure of arrays view of the input cloud
    *  \param[in]  symmetry                input symmetry
    *  \param[in]  point_symmetry_scores   symmetry scores for individual points
    *  \param[in]  min_normal_fit_angle    minimum fit angle between a symmetry and a point
    *  \param[in]  max_normal_fit_angle    maximum fit angle between a symmetry and a point
    *  \return symmetry score for the whole pointcloud
    */
-  template <typename PointT>
   inline
-  float rotSymCloudSymmetryScore  ( const pcl::PointCloud<PointT> &cloud,
+  float rotSymCloudSymmetryScore  ( const utl::PointCloudSoA &cloud,
                                     const sym::RotationalSymmetry &symmetry,
                                     std::vector<float> &point_symmetry_scores,
                                     const float min_normal_fit_angle = 0.0f,
@@ -35,9 +40,7 @@ namespace sym
     // Get point symmetry scores
     for (size_t pointId = 0; pointId < cloud.size(); pointId++)
     {
-      Eigen::Vector3f point   = cloud.points[pointId].getVector3fMap();
-      Eigen::Vector3f normal  = cloud.points[pointId].getNormalVector3fMap();
-      float angle = getRotSymFitError  (point, normal, symmetry);
+      float angle = getRotSymFitError  (cloud.getPoint(pointId), cloud.getNormal(pointId), symmetry);
       float score = (angle - min_normal_fit_angle) / (max_normal_fit_angle - min_normal_fit_angle);
       score = utl::clampValue(score, 0.0f, 1.0f);
       point_symmetry_scores[pointId] = score;
@@ -47,8 +50,29 @@ namespace sym
     return utl::mean(point_symmetry_scores);
   }
   
-  /** \brief Calculate the occlusion score for a pointcloud and a symmetry.
+  /** \brief Calculate how well does a rotational symmetry fit a pointcloud.
+   * A structure of arrays view of the cloud is built on every call.
    *  \param[in]  cloud                   input cloud
+   *  \param[in]  symmetry                input symmetry
+   *  \param[in]  point_symmetry_scores   symmetry scores for individual points
+   *  \param[in]  min_normal_fit_angle    minimum fit angle between a symmetry and a point
+   *  \param[in]  max_normal_fit_angle    maximum fit angle between a symmetry and a point
+   *  \return symmetry score for the whole pointcloud
+   */
+  template <typename PointT>
+  inline
+  float rotSymCloudSymmetryScore  ( const pcl::PointCloud<PointT> &cloud,
+                                    const sym::RotationalSymmetry &symmetry,
+                                    std::vector<float> &point_symmetry_scores,
+                                    const float min_normal_fit_angle = 0.0f,
+                                    const float max_normal_fit_angle = M_PI / 2
+                                  )
+  {
+    return rotSymCloudSymmetryScore(utl::PointCloudSoA(cloud), symmetry, point_symmetry_scores, min_normal_fit_angle, max_normal_fit_angle);
+  }
+  
+  /** \brief Calculate the occlusion score for a pointcloud and a symmetry.
+   *  \param[in]  cloud                   structure of arrays view of the input cloud
    *  \param[in]  occupancy_map           occupancy map of the scene
    *  \param[in]  symmetry                input symmetry
    *  \param[in]  point_occlusion_scores  occlusion scores for individual points
@@ -57,9 +81,8 @@ namespace sym
    *  \param[in]  num_divisions           number of rotations of a pointcloud
    *  \return occlusion score of the whole pointcloud
    */
-  template <typename PointT>
   inline
-  float rotSymCloudOcclusionScore ( const pcl::PointCloud<PointT> &cloud,
+  float rotSymCloudOcclusionScore ( const utl::PointCloudSoA &cloud,
                                     const OccupancyMapConstPtr &occupancy_map,
                                     const sym::RotationalSymmetry &symmetry,
                                     std::vector<float> &point_occlusion_scores,
@@ -70,28 +93,43 @@ namespace sym
   {
     point_occlusion_scores.resize(cloud.size());
     
-    // Reconstruct pointcloud
-    typename pcl::PointCloud<PointT>::Ptr cloudReconstructed (new pcl::PointCloud<PointT>);
-    symmetry.reconstructCloud<PointT>(cloud, *cloudReconstructed, 2.0f * M_PI / static_cast<float> (num_divisions));
+    // Rotations of the cloud around the symmetry axis
+    const float angularStep = 2.0f * M_PI / static_cast<float> (num_divisions);
+    std::vector<Eigen::Matrix3f> rotations (num_divisions);
+    for (int divId = 0; divId < num_divisions; divId++)
+      rotations[divId] = symmetry.getRotationAroundAxis(angularStep * divId);
     
+    // Rotate the points one rotation at a time and get the distances from the
+    // rotated points to occluded/occupied space. The score of a point is
+    // determined by the maximum distance over all rotations, so points whose
+    // distance reached the maximum occlusion distance are not rotated further.
+    std::vector<float> maxDistances (cloud.size(), 0.0f);
+    std::vector<int> activePointIds (cloud.size());
     for (size_t pointId = 0; pointId < cloud.size(); pointId++)
+      activePointIds[pointId] = pointId;
+    
+    Eigen::Matrix3Xf rotPoints;
+    std::vector<float> rotDistances;
+    for (int divId = 0; divId < num_divisions && !activePointIds.empty(); divId++)
     {
-      float maxDistance = 0.0f;
+      symmetry.rotatePoints(cloud, activePointIds, rotations[divId], rotPoints);
       
-      for (size_t divId = 0; divId < num_divisions; divId++)
+      occupancy_map->getNearestObstacleDistances(rotPoints, rotDistances);
+      
+      size_t numActive = 0;
+      for (size_t pointIdIt = 0; pointIdIt < activePointIds.size(); pointIdIt++)
       {
-        int recPointId = (divId * cloud.size()) + pointId;
-        Eigen::Vector3f recPoint = cloudReconstructed->points[recPointId].getVector3fMap();        
-        
-        // Get distance from reconstrcted point to occluded/occupied space
-        float curDistance = occupancy_map->getNearestObstacleDistance(recPoint);
-        maxDistance = std::max(maxDistance, curDistance);
-        
-        if (maxDistance >= max_occlusion_distance)
-          break;        
+        const int pointId = activePointIds[pointIdIt];
+        maxDistances[pointId] = std::max(maxDistances[pointId], rotDistances[pointIdIt]);
+        if (maxDistances[pointId] < max_occlusion_distance)
+          activePointIds[numActive++] = pointId;
       }
-      
-      float score = (maxDistance - min_occlusion_distance) / (max_occlusion_distance - min_occlusion_distance);      
+      activePointIds.resize(numActive);
+    }
+    
+    for (size_t pointId = 0; pointId < cloud.size(); pointId++)
+    {
+      float score = (maxDistances[pointId] - min_occlusion_distance) / (max_occlusion_distance - min_occlusion_distance);      
       score = utl::clampValue(score, 0.0f, 1.0f);
       point_occlusion_scores[pointId] = score;
     }
@@ -100,18 +138,43 @@ namespace sym
     return utl::mean(point_occlusion_scores);    
   }  
   
+  /** \brief Calculate the occlusion score for a pointcloud and a symmetry.
+   * A structure of arrays view of the cloud is built on every call.
+   *  \param[in]  cloud                   input cloud
+   *  \param[in]  occupancy_map           occupancy map of the scene
+   *  \param[in]  symmetry                input symmetry
+   *  \param[in]  point_occlusion_scores  occlusion scores for individual points
+   *  \param[in]  min_occlusion_distance  minimum distance between a point and occluded/occupied space
+   *  \param[in]  max_occlusion_distance  maximum distance between a point and occluded/occupied space
+   *  \param[in]  num_divisions           number of rotations of a pointcloud
+   *  \return occlusion score of the whole pointcloud
+   */
+  template <typename PointT>
+  inline
+  float rotSymCloudOcclusionScore ( const pcl::PointCloud<PointT> &cloud,
+                                    const OccupancyMapConstPtr &occupancy_map,
+                                    const sym::RotationalSymmetry &symmetry,
+                                    std::vector<float> &point_occlusion_scores,
+                                    const float min_occlusion_distance = 0.0f,
+                                    const float max_occlusion_distance = 1.0f,
+                                    const int num_divisions = 12
+                                  )
+  {
+    return rotSymCloudOcclusionScore  ( utl::PointCloudSoA(cloud), occupancy_map, symmetry, point_occlusion_scores,
+                                        min_occlusion_distance, max_occlusion_distance, num_divisions);
+  }
+  
   /** \brief Calculate how perpendicular a pointcloud is to the symmetry axis.
    * The final score is in the [0, 1] range. Higher values indicate higher
    * perpendicularity.
-   *  \param[in]  cloud                       input cloud
+   *  \param[in]  cloud                       structure of arrays view of the input cloud
    *  \param[in]  symmetry                    input symmetry
    *  \param[in]  point_perpendicular_scores  perpendicularity scores for individual points
    *  \param[in]  angle_threshold angle threshold used for clamping
    *  \return cloud perpendicularity score
    */
-  template <typename PointT>
   inline
-  float rotSymCloudPerpendicularScores  ( const pcl::PointCloud<PointT> &cloud,
+  float rotSymCloudPerpendicularScores  ( const utl::PointCloudSoA &cloud,
                                           const sym::RotationalSymmetry &symmetry,
                                           std::vector<float> &point_perpendicular_scores,
                                           const float angle_threshold = M_PI / 2
@@ -128,12 +191,31 @@ namespace sym
     point_perpendicular_scores.resize(cloud.size());
     
     for (size_t pointId = 0; pointId < cloud.size (); pointId++)
-      point_perpendicular_scores[pointId] = sym::getRotSymPerpendicularity(cloud.points[pointId].getNormalVector3fMap (), symmetry, angle_threshold);
+      point_perpendicular_scores[pointId] = sym::getRotSymPerpendicularity(cloud.getNormal(pointId), symmetry, angle_threshold);
     
     // Normalize and return
     return utl::mean(point_perpendicular_scores);
   }
   
+  /** \brief Calculate how perpendicular a pointcloud is to the symmetry axis.
+   * A structure of arrays view of the cloud is built on every call.
+   *  \param[in]  cloud                       input cloud
+   *  \param[in]  symmetry                    input symmetry
+   *  \param[in]  point_perpendicular_scores  perpendicularity scores for individual points
+   *  \param[in]  angle_threshold angle threshold used for clamping
+   *  \return cloud perpendicularity score
+   */
+  template <typename PointT>
+  inline
+  float rotSymCloudPerpendicularScores  ( const pcl::PointCloud<PointT> &cloud,
+                                          const sym::RotationalSymmetry &symmetry,
+                                          std::vector<float> &point_perpendicular_scores,
+                                          const float angle_threshold = M_PI / 2
+                                        )
+  {
+    return rotSymCloudPerpendicularScores(utl::PointCloudSoA(cloud), symmetry, point_perpendicular_scores, angle_threshold);
+  }
+  
   /** \brief Get the angle measuring how much the pointcloud "wraps" around 
    * the symmetry axis. It is calculated as 2*pi - the maximum angular step
    * between adjacent points of the pointcloud. The maximum angular step is
@@ -143,14 +225,22 @@ namespace sym
    * 2. Choose a random vector.
    * 3. Compute the clockwise angles between the random vector and all other
    *    vectors.
-   * 4. Sort the angles in increasing order.
-   * 5. Find the largest step between two adjacent angles.
-   *  \param[in]  cloud                   input cloud
+   * 4. Mark the angles in an angular occupancy histogram with 0.5 degree
+   *    bins.
+   * 5. Find the largest step between two adjacent occupied bins.
+   * If precise computation is requested the angles are sorted instead and the
+   * largest step between two adjacent angles is found. Histogram steps are
+   * within one bin of the exact steps.
+   *  \param[in]  cloud                   structure of arrays view of the input cloud
    *  \param[in]  symmetry                input symmetry
+   *  \param[in]  precise                 if TRUE the exact sort based computation is used
    *  \return largest angular step
    */
-  template <typename PointT>
-  float rotSymCloudCoverageAngle (const pcl::PointCloud<PointT> &cloud, const sym::RotationalSymmetry &symmetry)
+  inline
+  float rotSymCloudCoverageAngle  ( const utl::PointCloudSoA &cloud,
+                                    const sym::RotationalSymmetry &symmetry,
+                                    const bool precise = false
+                                  )
   {
     // If cloud is empty - make a warning and return -1.
     if (cloud.empty ())
@@ -166,14 +256,53 @@ namespace sym
     }      
     
     // Get reference vector
-    Eigen::Vector3f referenceVector = cloud.points[0].getVector3fMap () - symmetry.projectPoint(cloud.points[0].getVector3fMap ());
+    const Eigen::Vector3f referencePoint = cloud.getPoint(0);
+    Eigen::Vector3f referenceVector = referencePoint - symmetry.projectPoint(referencePoint);
+    
+    // Mark the angles between vectors formed by all other points and current
+    // vector in an angular occupancy histogram.
+    if (!precise)
+    {
+      const int numBins = 720;
+      const int numWords = (numBins + 63) / 64;
+      const float binWidth = 2.0f * M_PI / static_cast<float>(numBins);
+      uint64_t occupiedBins[numWords] = {0};
+      occupiedBins[numBins / 2 / 64] |= static_cast<uint64_t>(1) << (numBins / 2 % 64);   // reference point, angle 0
+      
+      for (size_t pointId = 1; pointId < cloud.size (); pointId++)
+      {
+        const Eigen::Vector3f curPoint = cloud.getPoint(pointId);
+        Eigen::Vector3f curVector = curPoint - symmetry.projectPoint(curPoint);
+        float angle = utl::vectorVectorAngleCW<float>(referenceVector, curVector, symmetry.getDirection ());
+        int binId = static_cast<int>(std::floor((angle + M_PI) / binWidth));
+        binId = std::min(std::max(binId, 0), numBins - 1);
+        occupiedBins[binId / 64] |= static_cast<uint64_t>(1) << (binId % 64);
+      }
+      
+      // Find the largest number of bins between two adjacent occupied bins.
+      // Scan starts at the reference bin, which is always occupied, and wraps
+      // around.
+      int maxBinStep = 0, prevBinOffset = 0;
+      for (int binOffset = 1; binOffset <= numBins; binOffset++)
+      {
+        int binId = (numBins / 2 + binOffset) % numBins;
+        if (occupiedBins[binId / 64] & (static_cast<uint64_t>(1) << (binId % 64)))
+        {
+          maxBinStep = std::max(maxBinStep, binOffset - prevBinOffset);
+          prevBinOffset = binOffset;
+        }
+      }
+      
+      return (2.0f * M_PI) - static_cast<float>(maxBinStep) * binWidth;
+    }
     
     // Find angles between vectors formed by all other points and current vector.
     std::vector<float> angles (cloud.size ());
     angles[0] = 0.0f;
     for (size_t pointId = 1; pointId < cloud.size (); pointId++)
     {
-      Eigen::Vector3f curVector = cloud.points[pointId].getVector3fMap () - symmetry.projectPoint(cloud.points[pointId].getVector3fMap ());
+      const Eigen::Vector3f curPoint = cloud.getPoint(pointId);
+        Eigen::Vector3f curVector = curPoint - symmetry.projectPoint(curPoint);
       angles[pointId] = utl::vectorVectorAngleCW<float>(referenceVector, curVector, symmetry.getDirection ());
     }
       
@@ -188,6 +317,24 @@ namespace sym
     
     return (2.0f * M_PI) - utl::vectorMax(angleDifference);
   }
+
+  /** \brief Get the angle measuring how much the pointcloud "wraps" around
+   * the symmetry axis. See the structure of arrays version of
+   * rotSymCloudCoverageAngle for details. A structure of arrays view of the
+   * cloud is built on every call.
+   *  \param[in]  cloud                   input cloud
+   *  \param[in]  symmetry                input symmetry
+   *  \param[in]  precise                 if TRUE the exact sort based computation is used
+   *  \return largest angular step
+   */
+  template <typename PointT>
+  float rotSymCloudCoverageAngle  ( const pcl::PointCloud<PointT> &cloud,
+                                    const sym::RotationalSymmetry &symmetry,
+                                    const bool precise = false
+                                  )
+  {
+    return rotSymCloudCoverageAngle(utl::PointCloudSoA(cloud), symmetry, precise);
+  }
 }
 
 #endif    // ROTATIONAL_SYMMETRY_SCORING_HPP
\ No newline at end of file
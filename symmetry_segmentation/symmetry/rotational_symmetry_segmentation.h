@@ -8,6 +8,7 @@
 // Symmetry includes
 #include <symmetry/rotational_symmetry.hpp>
 #include <occupancy_map.hpp>
+#include <deadline.hpp>
 
 namespace sym
 {
@@ -85,12 +86,34 @@ namespace sym
     inline
     void setInputSymmetries  (const std::vector<sym::RotationalSymmetry> &symmetries);
     
+    /** \brief Provide a precomputed adjacency of the downsampled cloud, e.g.
+     * the adjacency of another segmentation of the same scene, or its subgraph
+     * induced by the remaining points (see utl::getInducedSubgraph). Edge
+     * weights must be the convex/concave weights computed by
+     * utl::cloudAdjacencyWeights. If set, segmentation does not compute the
+     * adjacency. An empty graph resets it.
+     *  \param adjacency adjacency graph with one vertex per downsampled cloud point
+     */
+    inline
+    void setInputAdjacency (const utl::GraphWeighted &adjacency);
+    
     /** \brief Set detection parameters.
      *  \param params detection parameters
      */
     inline
     void setParameters (const RotSymSegParams &params);
     
+    /** \brief Set a deadline for the segmentation. Symmetries are segmented in the input order.
+     * Symmetries whose segmentation starts after the deadline get empty
+     * segments that are removed by the filter.
+     *  \param deadline  deadline
+     */
+    inline
+    void setDeadline (const utl::Deadline &deadline);
+    
+    /** \brief Check if the last segmentation was cut short by the deadline. */
+    inline bool isPartial () const;
+    
     /** \brief Segment rotational symmetries. */
     inline bool segment ();
 
@@ -157,6 +180,12 @@ namespace sym
     /** \brief Detection parameters. */
     RotSymSegParams params_;
     
+    /** \brief Segmentation deadline. */
+    utl::Deadline deadline_;
+    
+    /** \brief Symmetries that were skipped because of the deadline. */
+    std::vector<char> symmetries_skipped_;
+    
     /** \brief Input cloud. */
     typename pcl::PointCloud<PointT>::ConstPtr cloud_;
         
@@ -187,6 +216,9 @@ namespace sym
     /** \brief Point perpendicular scores. */
     std::vector<std::vector<float> >  point_perpendicular_scores_;
     
+    /** \brief Precomputed adjacency weights. */
+    utl::GraphWeighted input_adjacency_;
+    
     /** \brief Adjacency weights. */
     utl::GraphWeighted adjacency_;
     
@@ -14,6 +14,7 @@
 template <typename PointT>
 sym::RotationalSymmetrySegmentation<PointT>::RotationalSymmetrySegmentation () :
   params_(),
+  deadline_ (),
   cloud_ (new pcl::PointCloud<PointT>),
   cloud_ds_ (new pcl::PointCloud<PointT>)
 {}
@@ -22,6 +23,7 @@ sym::RotationalSymmetrySegmentation<PointT>::RotationalSymmetrySegmentation () :
 template <typename PointT>
 sym::RotationalSymmetrySegmentation<PointT>::RotationalSymmetrySegmentation (const sym::RotSymSegParams &params) :
   params_ (params),
+  deadline_ (),
   cloud_ (new pcl::PointCloud<PointT>),
   cloud_ds_ (new pcl::PointCloud<PointT>)
 {}
@@ -55,6 +57,30 @@ sym::RotationalSymmetrySegmentation<PointT>::setInputSymmetries  (const std::vec
   symmetries_ = symmetries;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::RotationalSymmetrySegmentation<PointT>::setInputAdjacency  (const utl::GraphWeighted &adjacency)
+{
+  input_adjacency_ = adjacency;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::RotationalSymmetrySegmentation<PointT>::setDeadline  (const utl::Deadline &deadline)
+{
+  deadline_ = deadline;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::RotationalSymmetrySegmentation<PointT>::isPartial () const
+{
+  return std::find(symmetries_skipped_.begin(), symmetries_skipped_.end(), 1) != symmetries_skipped_.end();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename PointT>
 inline void
@@ -125,13 +151,26 @@ sym::RotationalSymmetrySegmentation<PointT>::segment ()
   //----------------------------------------------------------------------------
   // Compute binary weights
   
-  if (!utl::cloudAdjacencyWeights<PointT> ( cloud_ds_,
-                                            params_.aw_radius,
-                                            params_.aw_num_neighbors,
-                                            params_.aw_sigma_convex,
-                                            params_.aw_sigma_concave,
-                                            adjacency_))
-    return false;
+  if (input_adjacency_.getNumVertices() > 0)
+  {
+    if (input_adjacency_.getNumVertices() != static_cast<int>(cloud_ds_->size()))
+    {
+      std::cout << "[sym::RotationalSymmetrySegmentation::segment] number of input adjacency vertices is different from the number of downsampled points (" << input_adjacency_.getNumVertices() << " vs " << cloud_ds_->size() << ")." << std::endl;
+      return false;
+    }
+    
+    adjacency_ = input_adjacency_;
+  }
+  else
+  {
+    if (!utl::cloudAdjacencyWeights<PointT> ( cloud_ds_,
+                                              params_.aw_radius,
+                                              params_.aw_num_neighbors,
+                                              params_.aw_sigma_convex,
+                                              params_.aw_sigma_concave,
+                                              adjacency_))
+      return false;
+  }
   
   binary_weights_ = adjacency_;
   for (size_t edgeId = 0; edgeId < adjacency_.getNumEdges(); edgeId++)
@@ -150,6 +189,24 @@ sym::RotationalSymmetrySegmentation<PointT>::segment ()
     }
   }
   
+  // Binary weights are shared by all symmetries and are only read from here on
+  const utl::GraphCSR binaryWeights (binary_weights_);
+  
+  // Build the min cut graph once. Every thread cuts its own copy of it and
+  // reuses the flow of its previous symmetry, since only the unary weights
+  // change between symmetries. Symmetries are dealt out to the threads one
+  // at a time, so every copy cuts the same sequence of symmetries for a given
+  // number of threads and the symmetries are started in their given order.
+  // Minimum cuts that are not unique may still differ between thread counts
+  utl::MinCutSolver minCutSolver;
+  if (!minCutSolver.setBinaryPotentials(binaryWeights))
+    return false;
+  minCutSolver.setDynamic(true);
+  
+  // Search tree used to find the boundaries of all segments
+  pcl::search::KdTree<PointT> cloudDSSearchTree;
+  cloudDSSearchTree.setInputCloud(cloud_ds_);
+  
   //----------------------------------------------------------------------------
   // Do the rest of the processing in a parfor loop
       
@@ -166,10 +223,18 @@ sym::RotationalSymmetrySegmentation<PointT>::segment ()
   smoothness_scores_.resize(symmetries_.size());
   
   std::vector<bool> success (symmetries_.size(), true);
+  symmetries_skipped_.assign(symmetries_.size(), 0);
   
-  #pragma omp parallel for
+  #pragma omp parallel for schedule(static, 1) firstprivate(minCutSolver)
   for (size_t symId = 0; symId < symmetries_.size(); symId++)
   {
+    // Leave the segment empty once the deadline has expired
+    if (deadline_.expired())
+    {
+      symmetries_skipped_[symId] = 1;
+      continue;
+    }
+    
     //--------------------------------------------------------------------------
     // Compute point scores
     
@@ -212,10 +277,10 @@ sym::RotationalSymmetrySegmentation<PointT>::segment ()
     //--------------------------------------------------------------------------
     // Segment
 
-    if (!utl::segmentCloudFG  ( fg_weights_[symId], bg_weights_[symId], binary_weights_, downsample_map_, segments_ds_[symId], segments_[symId]))
+    if (!utl::segmentCloudFG  ( fg_weights_[symId], bg_weights_[symId], minCutSolver, downsample_map_, segments_ds_[symId], segments_[symId]))
       success[symId] = false;
 
-    utl::getCutEdges(binary_weights_, segments_ds_[symId], cut_edges_[symId]);
+    utl::getCutEdges(binaryWeights, segments_ds_[symId], cut_edges_[symId]);
     
     //--------------------------------------------------------------------------
     // Compute segment scores
@@ -230,7 +295,7 @@ sym::RotationalSymmetrySegmentation<PointT>::segment ()
     {
       // Symmetry scores
       std::vector<int> boundaryPointIds, nonBoundaryPointIds;
-      utl::getCloudBoundary<PointT>(cloud_ds_, segments_ds_[symId], params_.voxel_size * 2.0f, boundaryPointIds, nonBoundaryPointIds);
+      utl::getCloudBoundary<PointT>(cloudDSSearchTree, segments_ds_[symId], params_.voxel_size * 2.0f, boundaryPointIds, nonBoundaryPointIds);
       for (size_t pointIdIt = 0; pointIdIt < nonBoundaryPointIds.size(); pointIdIt++)
       {
         int pointId = nonBoundaryPointIds[pointIdIt];
@@ -0,0 +1,171 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SYMMETRY_VOTING_HPP
+#define SYMMETRY_VOTING_HPP
+
+// STD includes
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+namespace sym
+{
+  /** \brief @b SymmetryVoteAccumulator Quantized accumulator of votes for
+   * symmetry hypotheses. A vote is a line direction (symmetry plane normal or
+   * symmetry axis direction, sign is ignored) and a point on the symmetry
+   * (e.g. the projection of the cloud mean onto it). Directions are quantized
+   * with a cell size equal to the chord length corresponding to the angular
+   * step and points are quantized with the distance step. Peaks are the cells
+   * with the most votes.
+   */
+  class SymmetryVoteAccumulator
+  {
+  public:
+
+    /** \brief Constructor.
+     *  \param[in]  angle_step     angular size of a direction cell
+     *  \param[in]  distance_step  size of a point cell
+     */
+    SymmetryVoteAccumulator (const float angle_step, const float distance_step)
+      : angle_step_ (angle_step)
+      , distance_step_ (distance_step)
+    {
+      direction_cell_size_inv_ = 1.0f / (2.0f * std::sin(std::max(angle_step, 1e-3f) / 2.0f));
+      point_cell_size_inv_ = 1.0f / std::max(distance_step, 1e-6f);
+    }
+
+    /** \brief Add a vote.
+     *  \param[in]  direction  unit line direction
+     *  \param[in]  point      point on the symmetry
+     */
+    inline void
+    addVote (const Eigen::Vector3f &direction, const Eigen::Vector3f &point)
+    {
+      // Directions that differ only in sign must fall into the same cell
+      Eigen::Vector3f::Index maxCoeffId;
+      direction.cwiseAbs().maxCoeff(&maxCoeffId);
+      const Eigen::Vector3f directionCanonical = direction[maxCoeffId] < 0.0f ? -direction : direction;
+
+      Vote vote;
+      vote.direction_key_ = packCell((directionCanonical * direction_cell_size_inv_).array().floor().cast<int>());
+      vote.point_key_ = packCell((point * point_cell_size_inv_).array().floor().cast<int>());
+      vote.direction_ = directionCanonical;
+      vote.point_ = point;
+      votes_.push_back(vote);
+    }
+
+    /** \brief Get the number of votes. */
+    inline size_t
+    size () const  { return votes_.size(); }
+
+    /** \brief Get the strongest peaks of the accumulator. Peak direction and
+     * point are the averages over the votes in the peak cell. Cells with a
+     * single vote are ignored and peaks that are within two angular and two
+     * distance steps of a stronger peak are suppressed.
+     *  \param[in]  max_peaks   maximum number of peaks
+     *  \param[out] directions  peak directions
+     *  \param[out] points      peak points
+     *  \param[out] num_votes   number of votes of the peaks
+     */
+    inline void
+    getPeaks  ( const int max_peaks,
+                std::vector<Eigen::Vector3f> &directions,
+                std::vector<Eigen::Vector3f> &points,
+                std::vector<int> &num_votes
+              ) const
+    {
+      directions.clear();
+      points.clear();
+      num_votes.clear();
+
+      // Group votes by cell
+      std::vector<std::pair<std::pair<uint64_t, uint64_t>, int> > voteCells (votes_.size());
+      for (size_t voteId = 0; voteId < votes_.size(); voteId++)
+        voteCells[voteId] = std::make_pair(std::make_pair(votes_[voteId].direction_key_, votes_[voteId].point_key_), static_cast<int>(voteId));
+      std::sort(voteCells.begin(), voteCells.end());
+
+      std::vector<Eigen::Vector3f> cellDirections, cellPoints;
+      std::vector<std::pair<int, int> > cellVotes;    // (-number of votes, cell id)
+      for (size_t cellBegin = 0; cellBegin < voteCells.size(); )
+      {
+        size_t cellEnd = cellBegin + 1;
+        while (cellEnd < voteCells.size() && voteCells[cellEnd].first == voteCells[cellBegin].first)
+          cellEnd++;
+
+        if (cellEnd - cellBegin > 1)
+        {
+          const Eigen::Vector3f &directionFirst = votes_[voteCells[cellBegin].second].direction_;
+          Eigen::Vector3f directionSum = Eigen::Vector3f::Zero(), pointSum = Eigen::Vector3f::Zero();
+          for (size_t voteIdIt = cellBegin; voteIdIt < cellEnd; voteIdIt++)
+          {
+            const Vote &vote = votes_[voteCells[voteIdIt].second];
+            directionSum += vote.direction_.dot(directionFirst) < 0.0f ? -vote.direction_ : vote.direction_;
+            pointSum += vote.point_;
+          }
+
+          cellVotes.push_back(std::pair<int, int>(-static_cast<int>(cellEnd - cellBegin), static_cast<int>(cellDirections.size())));
+          cellDirections.push_back(directionSum.normalized());
+          cellPoints.push_back(pointSum / static_cast<float>(cellEnd - cellBegin));
+        }
+
+        cellBegin = cellEnd;
+      }
+      std::sort(cellVotes.begin(), cellVotes.end());
+
+      // Non maximum suppression
+      const float maxSuppressedAngleCos = std::cos(std::min(2.0f * angle_step_, static_cast<float>(M_PI / 2)));
+      for (size_t cellIdIt = 0; cellIdIt < cellVotes.size() && static_cast<int>(directions.size()) < max_peaks; cellIdIt++)
+      {
+        const int cellId = cellVotes[cellIdIt].second;
+
+        bool suppressed = false;
+        for (size_t peakId = 0; peakId < directions.size() && !suppressed; peakId++)
+          suppressed =  std::abs(directions[peakId].dot(cellDirections[cellId])) > maxSuppressedAngleCos &&
+                        (points[peakId] - cellPoints[cellId]).norm() < 2.0f * distance_step_;
+
+        if (suppressed)
+          continue;
+
+        directions.push_back(cellDirections[cellId]);
+        points.push_back(cellPoints[cellId]);
+        num_votes.push_back(-cellVotes[cellIdIt].first);
+      }
+    }
+
+  private:
+
+    /** \brief A single vote. */
+    struct Vote
+    {
+      uint64_t direction_key_, point_key_;
+      Eigen::Vector3f direction_, point_;
+    };
+
+    /** \brief Pack cell coordinates into a key. */
+    static inline uint64_t
+    packCell (const Eigen::Vector3i &cell)
+    {
+      const int64_t offset = 1 << 20;
+      return  (static_cast<uint64_t>(cell[0] + offset) << 42) |
+              (static_cast<uint64_t>(cell[1] + offset) << 21) |
+               static_cast<uint64_t>(cell[2] + offset);
+    }
+
+    /** \brief Angular and distance steps. */
+    float angle_step_, distance_step_;
+
+    /** \brief Inverse cell sizes. */
+    float direction_cell_size_inv_, point_cell_size_inv_;
+
+    /** \brief Votes. */
+    std::vector<Vote> votes_;
+  };
+}
+
+#endif  // SYMMETRY_VOTING_HPP
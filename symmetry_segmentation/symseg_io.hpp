@@ -0,0 +1,163 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SYMSEG_IO_HPP
+#define SYMSEG_IO_HPP
+
+// STD includes
+#include <fstream>
+#include <algorithm>
+
+// Utilities includes
+#include <filesystem/filesystem.hpp>
+#include <filesystem/cloud_cache.hpp>
+#include <eigen.hpp>
+
+// Occupancy map
+#include <occupancy_map.hpp>
+
+// Symmetry includes
+#include <symseg_pipeline.h>
+
+namespace sym
+{
+  /** \brief Input data of a scene. */
+  template <typename PointT>
+  struct SymSegScene
+  {
+    /** \brief Constructor. */
+    SymSegScene ()
+      : cloud (new pcl::PointCloud<PointT>)
+      , occupancy_map (new OccupancyMap)
+      , table_plane (Eigen::Vector4f::Zero())
+    { }
+
+    std::string                           dirname;          // Scene directory
+    typename pcl::PointCloud<PointT>::Ptr cloud;            // Scene cloud ('cloud.ply')
+    OccupancyMapPtr                       occupancy_map;    // Occupancy map with the occupancy tree loaded ('occupancy.bt')
+    Eigen::Vector4f                       table_plane;      // Table plane coefficients ('table_plane.txt')
+  };
+
+  /** \brief Load the cloud, the occupancy tree and the table plane of a scene
+   * directory. The cloud is loaded through a binary cache next to it (see
+   * utl::loadPointCloudCached).
+   *  \param[in]  scene_dirname   scene directory
+   *  \param[out] scene           scene data
+   *  \return false if any of the files could not be read
+   */
+  template <typename PointT>
+  inline
+  bool loadSymSegScene (const std::string &scene_dirname, SymSegScene<PointT> &scene)
+  {
+    scene.dirname = scene_dirname;
+    scene.cloud.reset(new pcl::PointCloud<PointT>);
+    scene.occupancy_map.reset(new OccupancyMap);
+
+    const std::string cloudFilename       = utl::fullfile(scene_dirname, "cloud.ply");
+    const std::string octomapFilename     = utl::fullfile(scene_dirname, "occupancy.bt");
+    const std::string tablePlaneFilename  = utl::fullfile(scene_dirname, "table_plane.txt");
+
+    if (!utl::isFile(cloudFilename) || !utl::loadPointCloudCached(cloudFilename, *scene.cloud))
+    {
+      std::cout << "[sym::loadSymSegScene] could not read pointcloud file '" << cloudFilename << "'." << std::endl;
+      return false;
+    }
+
+    if (!scene.occupancy_map->readOccupancyTree(octomapFilename))
+    {
+      std::cout << "[sym::loadSymSegScene] could not read occupancy tree file '" << octomapFilename << "'." << std::endl;
+      return false;
+    }
+
+    if (!utl::readASCII(tablePlaneFilename, scene.table_plane))
+    {
+      std::cout << "[sym::loadSymSegScene] could not read table plane file '" << tablePlaneFilename << "'." << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  /** \brief Write the final segments of a scene and their symmetries.
+   * Segments are the rotational segments followed by the reflectional
+   * segments. 'segments.txt' has a line per segment with the indices of the
+   * input cloud points of the segment. 'symmetries.txt' lists the symmetries of
+   * every segment in the same order. The result directory and its parent are
+   * created if they do not exist.
+   *  \param[in]  result          pipeline result
+   *  \param[in]  result_dirname  result directory
+   *  \return false if the files could not be written
+   */
+  template <typename PointT>
+  inline
+  bool writeSymSegResult (const SymSegResult<PointT> &result, const std::string &result_dirname)
+  {
+    // Create result directory
+    const std::string parentDirname = utl::getParentDir(result_dirname);
+    if (!parentDirname.empty() && !utl::exists(parentDirname) && !utl::createDir(parentDirname))
+      return false;
+    if (!utl::exists(result_dirname) && !utl::createDir(result_dirname))
+      return false;
+
+    const std::string symmetryFilename      = utl::fullfile(result_dirname, "symmetries.txt");
+    const std::string segmentationFilename  = utl::fullfile(result_dirname, "segments.txt");
+
+    std::ofstream symmetryFile (symmetryFilename.c_str());
+    std::ofstream segmentationFile (segmentationFilename.c_str());
+    if (!symmetryFile.is_open() || !segmentationFile.is_open())
+    {
+      std::cout << "[sym::writeSymSegResult] could not open result files in '" << result_dirname << "' for writing." << std::endl;
+      return false;
+    }
+
+    const size_t numRotSegments = result.rot_segment_filtered_ids.size();
+    const size_t numReflSegments = result.refl_segments.size();
+    symmetryFile << "segments: " << numRotSegments + numReflSegments << std::endl;
+
+    std::vector<int> segmentFullRes;
+    for (size_t segIdIt = 0; segIdIt < numRotSegments + numReflSegments; segIdIt++)
+    {
+      // Symmetries
+      const std::vector<int> *segment;
+      if (segIdIt < numRotSegments)
+      {
+        const int symId = result.rot_segment_filtered_ids[segIdIt];
+        segment = &result.rot_segments[symId];
+        symmetryFile << "segment " << segIdIt << " rotational 1" << std::endl;
+        result.rot_symmetry_refined[symId].writeASCII(symmetryFile);
+      }
+      else
+      {
+        const int segId = segIdIt - numRotSegments;
+        segment = &result.refl_segments[segId];
+        symmetryFile << "segment " << segIdIt << " reflectional " << result.refl_segment_symmetries[segId].size() << std::endl;
+        for (size_t symId = 0; symId < result.refl_segment_symmetries[segId].size(); symId++)
+          result.refl_segment_symmetries[segId][symId].writeASCII(symmetryFile);
+      }
+
+      // Segment indices in the input cloud
+      segmentFullRes.clear();
+      for (size_t pointIdIt = 0; pointIdIt < segment->size(); pointIdIt++)
+      {
+        const std::vector<int> &inputPointIds = result.downsample_map[(*segment)[pointIdIt]];
+        segmentFullRes.insert(segmentFullRes.end(), inputPointIds.begin(), inputPointIds.end());
+      }
+      std::sort(segmentFullRes.begin(), segmentFullRes.end());
+
+      for (size_t pointIdIt = 0; pointIdIt < segmentFullRes.size(); pointIdIt++)
+        segmentationFile << (pointIdIt > 0 ? " " : "") << segmentFullRes[pointIdIt];
+      segmentationFile << std::endl;
+    }
+
+    if (!symmetryFile.good() || !segmentationFile.good())
+    {
+      std::cout << "[sym::writeSymSegResult] could not write result files in '" << result_dirname << "'." << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+}
+
+#endif  // SYMSEG_IO_HPP
@@ -0,0 +1,289 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SYMSEG_PIPELINE_H
+#define SYMSEG_PIPELINE_H
+
+// Symmetry includes
+#include <symmetry/rotational_symmetry_detection.h>
+#include <symmetry/rotational_symmetry_segmentation.h>
+#include <symmetry/reflectional_symmetry_detection.h>
+#include <symmetry/reflectional_symmetry_segmentation.h>
+#include <rotational_symmetry_detection_scene.hpp>
+#include <reflectional_symmetry_detection_scene.hpp>
+
+// Segmentation includes
+#include <segmentation.hpp>
+
+// Utilities includes
+#include <deadline.hpp>
+#include <segment_set.hpp>
+
+namespace sym
+{
+  //----------------------------------------------------------------------------
+  // Pipeline parameters
+  //----------------------------------------------------------------------------
+
+  struct SymSegParams
+  {
+    // Stage parameters
+    utl::SmoothSegParams  overseg;
+    RotSymDetectParams    rot_det;
+    RotSymSegParams       rot_seg;
+    ReflSymDetectParams   refl_det;
+    ReflSymSegParams      refl_seg;
+
+    // Occupancy map parameters
+    float occupancy_bbx_inflation_radius = 0.15f;       // Inflation radius of the distance map bounding box relative to the scene cloud bounding box
+
+    // Rotational refinement parameters
+    float rot_refine_max_fit_angle = pcl::deg2rad(5.0f);  // Maximum fit angle used when refining rotational symmetries given their segments
+
+    // Rotational point removal parameters
+    int   min_non_rot_component_size = 15;              // Connected components of non rotational points smaller than this are removed with the rotational segments
+
+    // Time budget of a scene in seconds (0 - no limit). Once it runs out the
+    // remaining detection and segmentation work is skipped, the results found
+    // so far are returned and the result is marked as partial
+    float time_budget = 0.0f;
+  };
+
+  //----------------------------------------------------------------------------
+  // Pipeline result
+  //----------------------------------------------------------------------------
+
+  template <typename PointT>
+  struct SymSegResult
+  {
+    /** \brief Constructor. */
+    SymSegResult ()
+      : partial (false)
+      , scene_cloud (new pcl::PointCloud<PointT>)
+      , scene_cloud_after_rot (new pcl::PointCloud<PointT>)
+    { }
+
+    // Some detection, refinement or segmentation work was skipped or cut
+    // short because the time budget ran out
+    bool                                  partial;
+
+    // Scene oversegmentation
+    typename pcl::PointCloud<PointT>::Ptr scene_cloud;              // Downsampled scene cloud. All segments are defined over it
+    utl::Map                              downsample_map;
+    std::vector<utl::SegmentSet>          overseg_segments;         // Slices of the linear segments for every smoothness threshold
+    utl::SegmentSet                       overseg_segments_linear;
+
+    // Rotational
+    std::vector<sym::RotationalSymmetry>  rot_symmetry;
+    utl::SegmentSet                       rot_symmetry_support;
+    utl::Map                              rot_segments;
+    std::vector<int>                      rot_segment_filtered_ids;
+    std::vector<sym::RotationalSymmetry>  rot_symmetry_refined;
+    std::vector<float>                    rot_symmetry_scores_refined;
+    std::vector<float>                    rot_occlusion_scores_refined;
+    std::vector<float>                    rot_smoothness_scores;
+
+    // Points left after rotational segmentation
+    std::vector<bool>                     rot_mask;                 // Points removed with the rotational segments
+    std::vector<int>                      cloud_after_rot_indices;  // Scene cloud indices of the remaining points
+    typename pcl::PointCloud<PointT>::Ptr scene_cloud_after_rot;
+    std::vector<utl::SegmentSet>          overseg_segments_after_rot;
+    utl::SegmentSet                       overseg_segments_after_rot_linear;
+
+    // Reflectional. Symmetry support and intermediate segments are defined
+    // over the cloud after rotational segmentation, final segments over the
+    // scene cloud
+    std::vector<sym::ReflectionalSymmetry>                refl_symmetry;
+    utl::SegmentSet                                       refl_symmetry_support;
+    std::vector<sym::ReflectionalSymmetry>                refl_symmetry_refined;
+    utl::Map                                              refl_segments;
+    std::vector<std::vector<sym::ReflectionalSymmetry> >  refl_segment_symmetries;
+  };
+
+  //----------------------------------------------------------------------------
+  // Pipeline class
+  //----------------------------------------------------------------------------
+
+  /** \brief @b SymSegPipeline Full symmetry segmentation of a scene as a
+   * reusable object: oversegmentation, rotational symmetry detection and
+   * segmentation, removal of the rotational segments and reflectional
+   * symmetry detection and segmentation. Parameters are set once and the
+   * object is meant to live across many scenes. The segmentation objects, the
+   * result containers and the clouds are kept between calls to process, so
+   * that in allocation reuse mode consecutive scenes of similar size mostly
+   * reuse the memory of the previous scene. OpenMP threads are persistent for
+   * the lifetime of the process and thread local scoring workspaces are
+   * reused by all scenes processed on the same threads.
+   *
+   * Reflectional symmetry detection can run speculatively on the
+   * oversegments of the full scene while the rotational stages run. Once the
+   * rotational segments are removed, the detections of the oversegments that
+   * lost no points are kept and only the remaining oversegments are detected
+   * again.
+   */
+  template <typename PointT>
+  class SymSegPipeline
+  {
+  public:
+
+    /** \brief Empty constructor. */
+    SymSegPipeline ();
+
+    /** \brief Constructor with custom parameters. */
+    SymSegPipeline (const SymSegParams &params);
+
+    /** \brief Destructor. */
+    ~SymSegPipeline ();
+
+    /** \brief Set pipeline parameters.
+     *  \param[in] params pipeline parameters
+     */
+    inline
+    void setParameters (const SymSegParams &params);
+
+    /** \brief Get pipeline parameters. */
+    inline
+    const SymSegParams& getParameters () const;
+
+    /** \brief Keep the memory of the previous result when processing a new
+     * scene. If disabled, the previous result is released before processing.
+     *  \param[in] reuse_allocations  true to reuse the previous allocations
+     */
+    inline
+    void setReuseAllocations (const bool reuse_allocations);
+
+    /** \brief Set the directory where the distance map of the scene is cached
+     * (see OccupancyMap::distanceMapFromOccupancyCached). An empty name disables
+     * caching.
+     *  \param[in] cache_dirname  cache directory
+     */
+    inline
+    void setDistanceMapCacheDirname (const std::string &cache_dirname);
+
+    /** \brief Print the progress and the time of every stage.
+     *  \param[in] verbose  true to print
+     */
+    inline
+    void setVerbose (const bool verbose);
+
+    /** \brief Run reflectional symmetry detection on the oversegments of the
+     * full scene concurrently with the rotational stages. The OpenMP threads
+     * available to process are split between the two while they overlap. The
+     * result does not change, only the oversegments that overlap the removed
+     * rotational points are detected after the rotational stages. Enabled by
+     * default, has no effect if only one thread is available.
+     *  \param[in] speculative_refl  true to detect speculatively
+     */
+    inline
+    void setSpeculativeReflectional (const bool speculative_refl);
+
+    /** \brief Cache the rotational and reflectional detections of the scene
+     * oversegments between scenes. Oversegments of the next scene with the
+     * same quantized content are not detected again if their cached
+     * symmetries still agree with the occupancy map of the scene (see
+     * sym::SegmentDetectionCache). Useful when consecutive scenes differ
+     * only locally. Results may differ slightly from a run without the cache
+     * since a cached segment may have been detected from a differently
+     * ordered or slightly shifted copy of its points. Disabled by default.
+     *  \param[in] detection_caching  true to cache the detections
+     */
+    inline
+    void setDetectionCaching (const bool detection_caching);
+
+    /** \brief Segment a scene. The distance map of the occupancy map is
+     * rebuilt for the bounding box of the scene cloud and the map is put in
+     * query mode.
+     *  \param[in]  cloud           scene cloud
+     *  \param[in]  occupancy_map   scene occupancy map with the occupancy tree loaded
+     *  \param[in]  table_plane     table plane coefficients
+     *  \return false if any of the stages failed
+     */
+    inline
+    bool process  ( const typename pcl::PointCloud<PointT>::ConstPtr  &cloud,
+                    const OccupancyMapPtr                             &occupancy_map,
+                    const Eigen::Vector4f                             &table_plane
+                  );
+
+    /** \brief Get the result of the last processed scene. */
+    inline
+    const SymSegResult<PointT>& getResult () const;
+
+  private:
+
+    /** \brief Build the distance map of the scene and enter query mode. */
+    inline bool buildOccupancyMap ();
+
+    /** \brief Stages of the pipeline. */
+    inline bool oversegment ();
+    inline bool detectRotational ();
+    inline bool segmentRotational ();
+    inline bool removeRotational ();
+    inline bool detectReflectional ();
+    inline void detectReflectionalSpeculative (const int num_threads);
+    inline bool segmentReflectional ();
+
+    /** \brief Print a stage message if verbose. */
+    inline void printStage (const std::string &message) const;
+
+    /** \brief Print the time elapsed since the start of a stage if verbose. */
+    inline void printStageTime (const double stage_start) const;
+
+    /** \brief Pipeline parameters. */
+    SymSegParams params_;
+
+    /** \brief Reuse the allocations of the previous result. */
+    bool reuse_allocations_;
+
+    /** \brief Distance map cache directory. */
+    std::string cache_dirname_;
+
+    /** \brief Print progress. */
+    bool verbose_;
+
+    /** \brief Deadline of the scene being processed. */
+    utl::Deadline deadline_;
+
+    /** \brief Detect reflectional symmetries speculatively. */
+    bool speculative_refl_;
+
+    /** \brief Cache the detections of the scene oversegments between scenes. */
+    bool detection_caching_;
+
+    /** \brief Detection caches kept between scenes. */
+    sym::RotSymDetectionCache   rot_det_cache_;
+    sym::ReflSymDetectionCache  refl_det_cache_;
+
+    /** \brief Input cloud. */
+    typename pcl::PointCloud<PointT>::ConstPtr cloud_;
+
+    /** \brief Scene occupancy map. */
+    OccupancyMapPtr occupancy_map_;
+
+    /** \brief Table plane coefficients. */
+    Eigen::Vector4f table_plane_;
+
+    /** \brief Segmentation objects kept between scenes. */
+    sym::RotationalSymmetrySegmentation<PointT>   rot_seg_;
+    sym::ReflectionalSymmetrySegmentation<PointT> refl_seg_;
+
+    /** \brief Adjacency of the scene cloud from the rotational segmentation. */
+    utl::GraphWeighted adjacency_;
+
+    /** \brief Speculative reflectional detections of the scene oversegments. */
+    std::vector<sym::ReflSymSegmentDetection> refl_speculative_detections_;
+
+    /** \brief Reflectional detections of the oversegments after rotational removal. */
+    std::vector<sym::ReflSymSegmentDetection> refl_detections_;
+
+    /** \brief Index of the scene oversegment that every oversegment after
+     * rotational removal is equal to (-1 if it lost points).
+     */
+    std::vector<int> overseg_after_rot_source_ids_;
+
+    /** \brief Result of the last scene. */
+    SymSegResult<PointT> result_;
+  };
+}
+
+#endif // SYMSEG_PIPELINE_H
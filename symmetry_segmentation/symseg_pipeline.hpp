@@ -0,0 +1,909 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SYMSEG_PIPELINE_HPP
+#define SYMSEG_PIPELINE_HPP
+
+// STD includes
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <omp.h>
+
+// PCL includes
+#include <pcl/common/time.h>
+#include <pcl/common/centroid.h>
+
+// Symmetry includes
+#include <symseg_pipeline.h>
+#include <symmetry/rotational_symmetry_segmentation.hpp>
+#include <symmetry/reflectional_symmetry_segmentation.hpp>
+#include <scene_oversegmentation.hpp>
+#include <rotational_symmetry_detection_scene.hpp>
+#include <reflectional_symmetry_detection_scene.hpp>
+
+// Utilities includes
+#include <profiling.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+sym::SymSegPipeline<PointT>::SymSegPipeline () :
+  params_ (),
+  reuse_allocations_ (true),
+  cache_dirname_ (""),
+  verbose_ (false),
+  speculative_refl_ (true),
+  detection_caching_ (false),
+  table_plane_ (Eigen::Vector4f::Zero())
+{}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+sym::SymSegPipeline<PointT>::SymSegPipeline (const sym::SymSegParams &params) :
+  params_ (params),
+  reuse_allocations_ (true),
+  cache_dirname_ (""),
+  verbose_ (false),
+  speculative_refl_ (true),
+  detection_caching_ (false),
+  table_plane_ (Eigen::Vector4f::Zero())
+{}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+sym::SymSegPipeline<PointT>::~SymSegPipeline ()
+{}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::setParameters (const sym::SymSegParams &params)
+{
+  params_ = params;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline const sym::SymSegParams&
+sym::SymSegPipeline<PointT>::getParameters () const
+{
+  return params_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::setReuseAllocations (const bool reuse_allocations)
+{
+  reuse_allocations_ = reuse_allocations;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::setDistanceMapCacheDirname (const std::string &cache_dirname)
+{
+  cache_dirname_ = cache_dirname;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::setVerbose (const bool verbose)
+{
+  verbose_ = verbose;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::setSpeculativeReflectional (const bool speculative_refl)
+{
+  speculative_refl_ = speculative_refl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::setDetectionCaching (const bool detection_caching)
+{
+  detection_caching_ = detection_caching;
+  if (!detection_caching_)
+  {
+    rot_det_cache_.clear();
+    refl_det_cache_.clear();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline const sym::SymSegResult<PointT>&
+sym::SymSegPipeline<PointT>::getResult () const
+{
+  return result_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::process  ( const typename pcl::PointCloud<PointT>::ConstPtr  &cloud,
+                                        const OccupancyMapPtr                             &occupancy_map,
+                                        const Eigen::Vector4f                             &table_plane
+                                      )
+{
+  // Release the previous result unless its memory is reused
+  if (!reuse_allocations_)
+  {
+    result_ = sym::SymSegResult<PointT> ();
+    adjacency_ = utl::GraphWeighted ();
+    rot_seg_ = sym::RotationalSymmetrySegmentation<PointT> ();
+    refl_seg_ = sym::ReflectionalSymmetrySegmentation<PointT> ();
+    refl_speculative_detections_ = std::vector<sym::ReflSymSegmentDetection> ();
+    refl_detections_ = std::vector<sym::ReflSymSegmentDetection> ();
+  }
+
+  // Check input
+  if (!cloud || cloud->empty())
+  {
+    std::cout << "[sym::SymSegPipeline::process] input cloud is empty." << std::endl;
+    return false;
+  }
+
+  if (!occupancy_map)
+  {
+    std::cout << "[sym::SymSegPipeline::process] occupancy map is not set." << std::endl;
+    return false;
+  }
+
+  cloud_ = cloud;
+  occupancy_map_ = occupancy_map;
+  table_plane_ = table_plane;
+
+  double totalStart = pcl::getTime ();
+  deadline_ = utl::Deadline (params_.time_budget);
+  result_.partial = false;
+
+  // Drop the cached detections the previous scene did not use
+  if (detection_caching_)
+  {
+    rot_det_cache_.newScene();
+    refl_det_cache_.newScene();
+  }
+
+  if (!buildOccupancyMap() || !oversegment())
+    return false;
+
+  // Detect reflectional symmetries of the scene oversegments on a part of the
+  // threads while the rotational stages run on the others
+  refl_speculative_detections_.clear();
+  
+  // Joins the speculative thread and restores the thread count when the
+  // rotational stages finish or throw
+  struct SpeculativeThreadGuard
+  {
+    std::thread thread;
+    int num_threads;
+    
+    ~SpeculativeThreadGuard ()  { join(); }
+    
+    void join ()
+    {
+      if (!thread.joinable())
+        return;
+      thread.join();
+      omp_set_num_threads(num_threads);
+    }
+  };
+  
+  SpeculativeThreadGuard speculativeRefl;
+  speculativeRefl.num_threads = omp_get_max_threads();
+  if (speculative_refl_ && speculativeRefl.num_threads > 1)
+  {
+    const int numThreads = speculativeRefl.num_threads;
+    speculativeRefl.thread = std::thread (&sym::SymSegPipeline<PointT>::detectReflectionalSpeculative, this, numThreads / 2);
+    omp_set_num_threads(numThreads - numThreads / 2);
+  }
+
+  const bool rotSuccess = detectRotational() && segmentRotational() && removeRotational();
+  speculativeRefl.join();
+
+  if (!rotSuccess || !detectReflectional() || !segmentReflectional())
+    return false;
+
+  if (verbose_)
+  {
+    std::cout << "----------------------------" << std::endl;
+    std::cout << "Total time: " << (pcl::getTime() - totalStart) << " seconds." << std::endl;
+    if (result_.partial)
+      std::cout << "Time budget of " << params_.time_budget << " seconds exceeded, result is partial." << std::endl;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::buildOccupancyMap ()
+{
+  UTL_PROFILE_SCOPE("occupancy_map");
+
+  printStage("Constructing scene occupancy map...");
+  double start = pcl::getTime ();
+
+  // Get cloud bounding box size
+  Eigen::Vector4f bbxMin, bbxMax;
+  pcl::getMinMax3D(*cloud_, bbxMin, bbxMax);
+  bbxMin.array() -= params_.occupancy_bbx_inflation_radius;
+  bbxMax.array() += params_.occupancy_bbx_inflation_radius;
+
+  float maxDistance = std::max( std::max(params_.rot_seg.max_occlusion_distance, params_.rot_det.max_occlusion_distance),
+                                std::max(params_.refl_seg.max_occlusion_distance, params_.refl_det.max_occlusion_distance));
+
+  // Initialize map
+  occupancy_map_->setBoundingPlanes(std::vector<Eigen::Vector4f> (1, table_plane_));
+
+  bool success;
+  if (cache_dirname_.empty())
+    success = occupancy_map_->distanceMapFromOccupancy (bbxMin.head(3), bbxMax.head(3), occupancy_map_->getOccupancyTreeDepth(), maxDistance, true);
+  else
+    success = occupancy_map_->distanceMapFromOccupancyCached (cache_dirname_, bbxMin.head(3), bbxMax.head(3), occupancy_map_->getOccupancyTreeDepth(), maxDistance, true);
+
+  if (!success || !occupancy_map_->enterQueryMode())
+  {
+    std::cout << "[sym::SymSegPipeline::buildOccupancyMap] could not construct the distance map." << std::endl;
+    return false;
+  }
+
+  printStageTime(start);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::oversegment ()
+{
+  UTL_PROFILE_SCOPE("oversegmentation");
+
+  if (!oversegmentScene<PointT> ( cloud_,
+                                  params_.overseg,
+                                  result_.scene_cloud,
+                                  result_.downsample_map,
+                                  result_.overseg_segments,
+                                  result_.overseg_segments_linear ))
+  {
+    std::cout << "[sym::SymSegPipeline::oversegment] could not oversegment the scene." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::detectRotational ()
+{
+  UTL_PROFILE_SCOPE("rotational_detection");
+
+  printStage("Detecting rotational symmetry...");
+  double start = pcl::getTime ();
+
+  bool partial = false;
+  if (  !detectRotationalSymmetryScene<PointT> (  result_.scene_cloud,
+                                                  occupancy_map_,
+                                                  result_.overseg_segments_linear,
+                                                  params_.rot_det,
+                                                  result_.rot_symmetry,
+                                                  result_.rot_symmetry_support,
+                                                  deadline_,
+                                                  detection_caching_ ? &rot_det_cache_ : NULL,
+                                                  &partial ))
+  {
+    std::cout << "[sym::SymSegPipeline::detectRotational] could not detect rotational symmetries." << std::endl;
+    return false;
+  }
+  result_.partial = result_.partial || partial;
+
+  // With a time budget segment the symmetries with the largest support first,
+  // so that the segments skipped at the deadline are the least likely objects
+  if (deadline_.isSet())
+  {
+    std::vector<std::pair<size_t, int> > symmetryOrder (result_.rot_symmetry.size());
+    for (size_t symId = 0; symId < result_.rot_symmetry.size(); symId++)
+      symmetryOrder[symId] = std::make_pair(result_.rot_symmetry_support[symId].size(), static_cast<int>(symId));
+    std::stable_sort(symmetryOrder.begin(), symmetryOrder.end(), std::greater<std::pair<size_t, int> > ());
+
+    std::vector<sym::RotationalSymmetry> rotSymmetrySorted (symmetryOrder.size());
+    std::vector<int> rotSymmetrySortedIds (symmetryOrder.size());
+    for (size_t symIdIt = 0; symIdIt < symmetryOrder.size(); symIdIt++)
+    {
+      const int symId = symmetryOrder[symIdIt].second;
+      rotSymmetrySorted[symIdIt] = result_.rot_symmetry[symId];
+      rotSymmetrySortedIds[symIdIt] = symId;
+    }
+    result_.rot_symmetry.swap(rotSymmetrySorted);
+    result_.rot_symmetry_support = result_.rot_symmetry_support.select(rotSymmetrySortedIds);
+  }
+
+  if (verbose_)
+  {
+    if (detection_caching_)
+      std::cout << "  " << rot_det_cache_.getNumHits() << " / " << result_.overseg_segments_linear.size() << " segment detections found in the cache." << std::endl;
+    std::cout << "  " << result_.rot_symmetry.size() << " symmetries detected." << std::endl;
+  }
+  printStageTime(start);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::segmentRotational ()
+{
+  UTL_PROFILE_SCOPE("rotational_segmentation");
+
+  result_.rot_segments.clear();
+  result_.rot_segment_filtered_ids.clear();
+  result_.rot_symmetry_refined.clear();
+  result_.rot_symmetry_scores_refined.clear();
+  result_.rot_occlusion_scores_refined.clear();
+  result_.rot_smoothness_scores.clear();
+  adjacency_.clear();
+
+  if (result_.rot_symmetry.empty())
+    return true;
+
+  //----------------------------------------------------------------------------
+  // Symmetry segmentation
+  //----------------------------------------------------------------------------
+
+  printStage("Segmenting rotational objects...");
+  double start = pcl::getTime ();
+
+  std::vector<float> rotSymmetryScores, rotOcclusionScores;
+
+  rot_seg_.setInputCloud(result_.scene_cloud);
+  rot_seg_.setInputOcuppancyMap(occupancy_map_);
+  rot_seg_.setInputSymmetries(result_.rot_symmetry);
+  rot_seg_.setParameters(params_.rot_seg);
+  rot_seg_.setDeadline(deadline_);
+  if (!rot_seg_.segment())
+  {
+    std::cout << "[sym::SymSegPipeline::segmentRotational] could not segment rotational symmetries." << std::endl;
+    return false;
+  }
+  result_.partial = result_.partial || rot_seg_.isPartial();
+  rot_seg_.filter();
+  rot_seg_.getSegments(result_.rot_segments, result_.rot_segment_filtered_ids);
+  rot_seg_.getScores(rotSymmetryScores, rotOcclusionScores, result_.rot_smoothness_scores);
+  rot_seg_.getAdjacency(adjacency_);
+
+  printStageTime(start);
+
+  //----------------------------------------------------------------------------
+  // Refine symmetries given segments and filter
+  //----------------------------------------------------------------------------
+
+  printStage("Refining symmetry and filtering...");
+  start = pcl::getTime ();
+
+  const utl::Map &rotSegments = result_.rot_segments;
+  result_.rot_symmetry_refined.resize(rotSegments.size());
+  result_.rot_symmetry_scores_refined.assign(rotSegments.size(), 0.0f);
+  result_.rot_occlusion_scores_refined.assign(rotSegments.size(), 0.0f);
+
+  sym::RotSymDetectParams rotRefineParams = params_.rot_det;
+  rotRefineParams.ref_max_fit_angle = params_.rot_refine_max_fit_angle;
+
+  int numSkipped = 0;
+  # pragma omp parallel for reduction(+:numSkipped)
+  for (size_t segId = 0; segId < rotSegments.size(); segId++)
+  {
+    // Segments refined after the deadline keep their unrefined symmetry
+    if (rotSegments[segId].size() < 3 || deadline_.expired())
+    {
+      result_.rot_symmetry_refined[segId] = result_.rot_symmetry[segId];
+      numSkipped += rotSegments[segId].size() >= 3;
+    }
+    else
+    {
+      // Prepare input
+      typename pcl::PointCloud<PointT>::Ptr segmentCloud (new pcl::PointCloud<PointT>);
+      pcl::copyPointCloud<PointT>(*result_.scene_cloud, rotSegments[segId], *segmentCloud);
+      std::vector<sym::RotationalSymmetry> symmetriesInitial (1, result_.rot_symmetry[segId]);
+
+      // Output variables
+      std::vector<sym::RotationalSymmetry> symmetriesRefinedTMP;
+      std::vector<int>  symmetryFilteredIdsTMP, symmetryMergedIdsTMP;
+      std::vector<float>  symmetryScoresRefinedTMP;
+      std::vector<float>  occlusionScoresRefinedTMP;
+      std::vector<float>  perpendicularScoresRefinedTMP;
+      std::vector<float>  coverageScoresRefinedTMP;
+
+      // Refine
+      sym::RotationalSymmetryDetection<PointT> rsd (rotRefineParams);
+      rsd.setInputCloud(segmentCloud);
+      rsd.setInputOcuppancyMap(occupancy_map_);
+      rsd.setInputSymmetries(symmetriesInitial);
+      rsd.detect();
+      rsd.getSymmetries(symmetriesRefinedTMP, symmetryFilteredIdsTMP, symmetryMergedIdsTMP);
+      rsd.getScores(symmetryScoresRefinedTMP, occlusionScoresRefinedTMP, perpendicularScoresRefinedTMP, coverageScoresRefinedTMP);
+
+      // Get output
+      result_.rot_symmetry_refined[segId] = symmetriesRefinedTMP[0];
+      result_.rot_symmetry_scores_refined[segId] = symmetryScoresRefinedTMP[0];
+      result_.rot_occlusion_scores_refined[segId] = occlusionScoresRefinedTMP[0];
+    }
+  }
+
+  result_.partial = result_.partial || numSkipped > 0;
+
+  result_.rot_segment_filtered_ids.clear();
+  for (size_t segId = 0; segId < rotSegments.size(); segId++)
+  {
+    if (  result_.rot_symmetry_scores_refined[segId]  < params_.rot_seg.max_symmetry_score    &&
+          result_.rot_occlusion_scores_refined[segId] < params_.rot_seg.max_occlusion_score   &&
+          result_.rot_smoothness_scores[segId]        < params_.rot_seg.max_smoothness_score  &&
+          static_cast<int>(rotSegments[segId].size()) > params_.rot_seg.min_segment_size
+        )
+    {
+      result_.rot_segment_filtered_ids.push_back(segId);
+    }
+  }
+
+  if (verbose_)
+    std::cout << "  " << result_.rot_segment_filtered_ids.size() << " filtered segments." << std::endl;
+  printStageTime(start);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::removeRotational ()
+{
+  UTL_PROFILE_SCOPE("rotational_removal");
+
+  const pcl::PointCloud<PointT> &sceneCloud = *result_.scene_cloud;
+
+  //----------------------------------------------------------------------------
+  // Remove rotational segments from the pointcloud
+  //----------------------------------------------------------------------------
+
+  // Get a boolean mask of points belonging to rotational segments
+  std::vector<bool> &rotationalSegmentsMask = result_.rot_mask;
+  rotationalSegmentsMask.assign(sceneCloud.size(), false);
+  for (size_t rotSegIdIt = 0; rotSegIdIt < result_.rot_segment_filtered_ids.size(); rotSegIdIt++)
+  {
+    int rotSegId = result_.rot_segment_filtered_ids[rotSegIdIt];
+
+    for (size_t pointIdIt = 0; pointIdIt < result_.rot_segments[rotSegId].size(); pointIdIt++)
+      rotationalSegmentsMask[result_.rot_segments[rotSegId][pointIdIt]] = true;
+  }
+
+  // Remove isolated points
+  if (adjacency_.getNumVertices() == static_cast<int>(sceneCloud.size()))
+  {
+    std::vector<bool> nonRotationalMask (rotationalSegmentsMask.size());
+    for (size_t pointId = 0; pointId < rotationalSegmentsMask.size(); pointId++)
+      nonRotationalMask[pointId] = !rotationalSegmentsMask[pointId];
+
+    utl::GraphWeighted adjacencyNonRot;
+    std::vector<int> adjacencyNonRotPointIds;
+    utl::getInducedSubgraph(adjacency_, nonRotationalMask, adjacencyNonRot, adjacencyNonRotPointIds);
+
+    // Components with at least min_non_rot_component_size points are kept,
+    // all other non rotational points are removed
+    const utl::Map subSegments = utl::getConnectedComponentsParallel(utl::GraphCSR(adjacencyNonRot), params_.min_non_rot_component_size - 1);
+    std::vector<bool> isolatedMask (adjacencyNonRotPointIds.size(), true);
+    for (size_t i = 0; i < subSegments.size(); i++)
+      for (size_t j = 0; j < subSegments[i].size(); j++)
+        isolatedMask[subSegments[i][j]] = false;
+
+    for (size_t vtxId = 0; vtxId < isolatedMask.size(); vtxId++)
+      if (isolatedMask[vtxId])
+        rotationalSegmentsMask[adjacencyNonRotPointIds[vtxId]] = true;
+  }
+
+  // Get non-rotaional pointcloud
+  std::vector<int> &cloudAfterRotIndices = result_.cloud_after_rot_indices;   // Points belonging to filtered cloud
+  std::vector<int> cloudAfterRotIndicesInverse (sceneCloud.size(), -1);
+
+  cloudAfterRotIndices.clear();
+  for (size_t pointId = 0; pointId < rotationalSegmentsMask.size(); pointId++)
+  {
+    if (!rotationalSegmentsMask[pointId])
+    {
+      cloudAfterRotIndicesInverse[pointId] = cloudAfterRotIndices.size();
+      cloudAfterRotIndices.push_back(pointId);
+    }
+  }
+
+  // Reuse the cloud of the previous scene unless someone else still holds it
+  if (!result_.scene_cloud_after_rot || !result_.scene_cloud_after_rot.unique())
+    result_.scene_cloud_after_rot.reset(new pcl::PointCloud<PointT>);
+  pcl::copyPointCloud<PointT>(sceneCloud, cloudAfterRotIndices, *result_.scene_cloud_after_rot);
+
+  //----------------------------------------------------------------------------
+  // Remove segments that are already used for rotational symmetry
+  //----------------------------------------------------------------------------
+
+  // Remaining segments are collected linearly and stored once, the segments
+  // of every smoothness threshold are slices of them
+  utl::Map oversegSegmentsAfterRot;
+  std::vector<size_t> thresholdOffsets (result_.overseg_segments.size() + 1, 0);
+  overseg_after_rot_source_ids_.clear();
+
+  int oversegLinearSegId = 0;
+  for (size_t segParamId = 0; segParamId < result_.overseg_segments.size(); segParamId++)
+  {
+    for (size_t oversegSegId = 0; oversegSegId < result_.overseg_segments[segParamId].size(); oversegSegId++, oversegLinearSegId++)
+    {
+      const utl::SegmentView curSegment = result_.overseg_segments[segParamId][oversegSegId];
+      std::vector<int> curSegmentAfterRot;
+      for (const uint32_t *pointIdIt = curSegment.begin(); pointIdIt != curSegment.end(); pointIdIt++)
+      {
+        if (!rotationalSegmentsMask[*pointIdIt])
+          curSegmentAfterRot.push_back(cloudAfterRotIndicesInverse[*pointIdIt]);
+      }
+
+      if (static_cast<int>(curSegmentAfterRot.size()) > params_.overseg.min_segment_size)
+      {
+        overseg_after_rot_source_ids_.push_back(curSegmentAfterRot.size() == curSegment.size() ? oversegLinearSegId : -1);
+        oversegSegmentsAfterRot.push_back(std::vector<int> ());
+        oversegSegmentsAfterRot.back().swap(curSegmentAfterRot);
+      }
+    }
+    thresholdOffsets[segParamId + 1] = oversegSegmentsAfterRot.size();
+  }
+
+  result_.overseg_segments_after_rot_linear = utl::SegmentSet (oversegSegmentsAfterRot);
+  result_.overseg_segments_after_rot.resize(result_.overseg_segments.size());
+  for (size_t segParamId = 0; segParamId < result_.overseg_segments.size(); segParamId++)
+    result_.overseg_segments_after_rot[segParamId] = result_.overseg_segments_after_rot_linear.slice(thresholdOffsets[segParamId], thresholdOffsets[segParamId + 1]);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::detectReflectional ()
+{
+  UTL_PROFILE_SCOPE("reflectional_detection");
+
+  printStage("Detecting reflectional symmetry...");
+  double start = pcl::getTime ();
+
+  const utl::SegmentSet &segments = result_.overseg_segments_after_rot_linear;
+  refl_detections_.assign(segments.size(), sym::ReflSymSegmentDetection ());
+
+  //----------------------------------------------------------------------------
+  // Keep the speculative detections of the segments that did not change
+  //----------------------------------------------------------------------------
+
+  // A segment that did not lose any points has the same cloud as the scene
+  // oversegment it comes from. Its speculative detection can be kept if it
+  // was warm started from the same segment or not warm started in both cases.
+  int numReused = 0;
+  if (!refl_speculative_detections_.empty() && refl_speculative_detections_.size() == result_.overseg_segments_linear.size())
+  {
+    std::vector<std::pair<size_t, int> > segmentSizes, segmentSizesSpeculative;
+    getReflSymSegmentSizes(segments, segmentSizes);
+    getReflSymSegmentSizes(result_.overseg_segments_linear, segmentSizesSpeculative);
+
+    std::vector<int> warmStartSegIds, warmStartSegIdsSpeculative;
+    getReflSymWarmStartSegments(result_.scene_cloud_after_rot->size(), segments, segmentSizes, params_.refl_det.warm_start_min_iou, warmStartSegIds);
+    getReflSymWarmStartSegments(result_.scene_cloud->size(), result_.overseg_segments_linear, segmentSizesSpeculative, params_.refl_det.warm_start_min_iou, warmStartSegIdsSpeculative);
+
+    // Warm start sources are not warm started themselves, so they are checked first
+    std::vector<bool> reuse (segments.size(), false);
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (size_t segId = 0; segId < segments.size(); segId++)
+      {
+        const int sourceSegId = overseg_after_rot_source_ids_[segId];
+        const int warmStartSegId = warmStartSegIds[segId];
+        if (sourceSegId == -1 || (warmStartSegId == -1) != (pass == 0))
+          continue;
+
+        if (warmStartSegId == -1)
+          reuse[segId] = warmStartSegIdsSpeculative[sourceSegId] == -1;
+        else
+          reuse[segId] = reuse[warmStartSegId] && overseg_after_rot_source_ids_[warmStartSegId] == warmStartSegIdsSpeculative[sourceSegId];
+      }
+    }
+
+    for (size_t segId = 0; segId < segments.size(); segId++)
+    {
+      if (reuse[segId])
+      {
+        std::swap(refl_detections_[segId], refl_speculative_detections_[overseg_after_rot_source_ids_[segId]]);
+        numReused++;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Detect the remaining segments and merge the symmetries of all segments
+  //----------------------------------------------------------------------------
+
+  std::vector<int> symmetrySupportSegIds;
+  if (result_.scene_cloud_after_rot->size() >= 3)
+  {
+    detectReflSymSegments<PointT> (result_.scene_cloud_after_rot, occupancy_map_, segments, params_.refl_det, refl_detections_, deadline_, detection_caching_ ? &refl_det_cache_ : NULL);
+    mergeReflSymSegments(refl_detections_, params_.refl_det, result_.refl_symmetry, symmetrySupportSegIds);
+  }
+  else
+  {
+    result_.refl_symmetry.clear();
+  }
+
+  result_.refl_symmetry_support = segments.select(symmetrySupportSegIds);
+  for (size_t segId = 0; segId < refl_detections_.size(); segId++)
+    result_.partial = result_.partial || refl_detections_[segId].partial;
+
+  if (verbose_)
+  {
+    if (!refl_speculative_detections_.empty())
+      std::cout << "  " << numReused << " / " << segments.size() << " segment detections reused." << std::endl;
+    if (detection_caching_)
+      std::cout << "  " << refl_det_cache_.getNumHits() << " segment detections found in the cache." << std::endl;
+    std::cout << "  " << result_.refl_symmetry.size() << " symmetries detected." << std::endl;
+  }
+  printStageTime(start);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::detectReflectionalSpeculative (const int num_threads)
+{
+  omp_set_num_threads(num_threads);
+  UTL_PROFILE_SCOPE("reflectional_detection_speculative");
+
+  if (result_.scene_cloud->size() < 3)
+    return;
+
+  detectReflSymSegments<PointT> ( result_.scene_cloud,
+                                  occupancy_map_,
+                                  result_.overseg_segments_linear,
+                                  params_.refl_det,
+                                  refl_speculative_detections_,
+                                  deadline_,
+                                  detection_caching_ ? &refl_det_cache_ : NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline bool
+sym::SymSegPipeline<PointT>::segmentReflectional ()
+{
+  UTL_PROFILE_SCOPE("reflectional_segmentation");
+
+  result_.refl_symmetry_refined.clear();
+  result_.refl_segments.clear();
+  result_.refl_segment_symmetries.clear();
+
+  if (result_.refl_symmetry.empty())
+    return true;
+
+  const typename pcl::PointCloud<PointT>::Ptr &sceneCloudAfterRot = result_.scene_cloud_after_rot;
+
+  //----------------------------------------------------------------------------
+  // Symmetry segmentation
+  //----------------------------------------------------------------------------
+
+  printStage("Segmenting reflectional objects...");
+  double start = pcl::getTime ();
+
+  utl::Map                        reflSegments;
+  std::vector<int>                reflSegmentFilteredIds;
+  std::vector<std::vector<int> >  reflSegmentMergedIds;
+
+  refl_seg_.setInputCloud(sceneCloudAfterRot);
+  refl_seg_.setInputOcuppancyMap(occupancy_map_);
+  refl_seg_.setInputTablePlane(table_plane_);
+  refl_seg_.setInputSymmetries(result_.refl_symmetry, result_.refl_symmetry_support);
+  refl_seg_.setParameters(params_.refl_seg);
+  refl_seg_.setInputAdjacency(utl::GraphWeighted ());
+  refl_seg_.setDeadline(deadline_);
+
+  // Reuse the adjacency of the rotational segmentation if both segmentations
+  // use the same cloud and neighborhood. Only the points that lost one of
+  // their closest neighbors to the rotational segments are searched again.
+  if (  adjacency_.getNumVertices() == static_cast<int>(result_.scene_cloud->size()) &&
+        params_.refl_seg.voxel_size <= 0.0f &&
+        params_.refl_seg.aw_radius == params_.rot_seg.aw_radius &&
+        params_.refl_seg.aw_num_neighbors == params_.rot_seg.aw_num_neighbors)
+  {
+    utl::GraphWeighted adjacencyAfterRot;
+    std::vector<int> adjacencyAfterRotPointIds;
+    std::vector<bool> afterRotMask (result_.rot_mask.size());
+    for (size_t pointId = 0; pointId < result_.rot_mask.size(); pointId++)
+      afterRotMask[pointId] = !result_.rot_mask[pointId];
+
+    if (utl::cloudAdjacencyWeightsSubset<PointT>( result_.scene_cloud,
+                                                  adjacency_,
+                                                  afterRotMask,
+                                                  params_.refl_seg.aw_radius,
+                                                  params_.refl_seg.aw_num_neighbors,
+                                                  params_.refl_seg.aw_sigma_convex,
+                                                  params_.refl_seg.aw_sigma_concave,
+                                                  adjacencyAfterRot,
+                                                  adjacencyAfterRotPointIds))
+      refl_seg_.setInputAdjacency(adjacencyAfterRot);
+  }
+
+  if (!refl_seg_.segment())
+  {
+    std::cout << "[sym::SymSegPipeline::segmentReflectional] could not segment reflectional symmetries." << std::endl;
+    return false;
+  }
+  refl_seg_.getSegments(reflSegments, reflSegmentFilteredIds, reflSegmentMergedIds);
+  result_.partial = result_.partial || refl_seg_.isPartial();
+
+  printStageTime(start);
+
+  //----------------------------------------------------------------------------
+  // Refine symmetries given segments
+  //----------------------------------------------------------------------------
+
+  printStage("Refining symmetry...");
+  start = pcl::getTime ();
+
+  std::vector<sym::ReflectionalSymmetry> &reflSymmetryRefined = result_.refl_symmetry_refined;
+  reflSymmetryRefined.resize(reflSegments.size());
+
+  int numSkipped = 0;
+  # pragma omp parallel for reduction(+:numSkipped)
+  for (size_t segId = 0; segId < reflSegments.size(); segId++)
+  {
+    reflSymmetryRefined[segId] = result_.refl_symmetry[segId];
+    if (reflSegments[segId].size() < 3)
+      continue;
+
+    // Segments refined after the deadline keep their unrefined symmetry
+    if (deadline_.expired())
+    {
+      numSkipped++;
+      continue;
+    }
+
+    // Prepare input
+    typename pcl::PointCloud<PointT>::Ptr segmentCloud (new pcl::PointCloud<PointT>);
+    pcl::copyPointCloud<PointT>(*sceneCloudAfterRot, reflSegments[segId], *segmentCloud);
+    std::vector<sym::ReflectionalSymmetry> symmetriesInitial (1, result_.refl_symmetry[segId]);
+
+    // Output variables
+    std::vector<sym::ReflectionalSymmetry> symmetriesRefinedTMP;
+    std::vector<int>  symmetryFilteredIdsTMP, symmetryMergedIdsTMP;
+
+    // Refine
+    sym::ReflectionalSymmetryDetection<PointT> rsd (params_.refl_det);
+    rsd.setInputCloud(segmentCloud);
+    rsd.setInputOcuppancyMap(occupancy_map_);
+    rsd.setInputSymmetries(symmetriesInitial);
+    if (rsd.detect())
+    {
+      rsd.getSymmetries(symmetriesRefinedTMP, symmetryFilteredIdsTMP, symmetryMergedIdsTMP);
+      reflSymmetryRefined[segId] = symmetriesRefinedTMP[0];
+    }
+  }
+
+  result_.partial = result_.partial || numSkipped > 0;
+
+  printStageTime(start);
+
+  //----------------------------------------------------------------------------
+  // Refine segments given refined symmetries
+  //----------------------------------------------------------------------------
+
+  printStage("Segmenting refined...");
+  start = pcl::getTime ();
+
+  utl::Map                        reflSegmentsRefined;
+  std::vector<int>                reflSegmentFilteredIdsRefined;
+  std::vector<std::vector<int> >  reflSegmentMergedIdsRefined;
+
+  // Once the deadline has expired the segments of the unrefined symmetries are
+  // kept instead
+  if (deadline_.expired())
+  {
+    result_.partial = true;
+  }
+  else
+  {
+    refl_seg_.setInputSymmetries(reflSymmetryRefined, result_.refl_symmetry_support);
+    if (!refl_seg_.segment())
+    {
+      std::cout << "[sym::SymSegPipeline::segmentReflectional] could not segment refined reflectional symmetries." << std::endl;
+      return false;
+    }
+    result_.partial = result_.partial || refl_seg_.isPartial();
+  }
+  refl_seg_.filter();
+  refl_seg_.merge();
+  refl_seg_.getSegments(reflSegmentsRefined, reflSegmentFilteredIdsRefined, reflSegmentMergedIdsRefined);
+
+  // Convert segments to full cloud
+  result_.refl_segments.resize(reflSegmentMergedIdsRefined.size());
+  result_.refl_segment_symmetries.resize(reflSegmentMergedIdsRefined.size());
+
+  for (size_t segIdIt = 0; segIdIt < reflSegmentMergedIdsRefined.size(); segIdIt++)
+  {
+    const std::vector<int> &curSegment = reflSegmentsRefined[reflSegmentMergedIdsRefined[segIdIt][0]];
+    result_.refl_segments[segIdIt].resize(curSegment.size());
+    for (size_t pointIdIt = 0; pointIdIt < curSegment.size(); pointIdIt++)
+      result_.refl_segments[segIdIt][pointIdIt] = result_.cloud_after_rot_indices[curSegment[pointIdIt]];
+
+    for (size_t symIdIt = 0; symIdIt < reflSegmentMergedIdsRefined[segIdIt].size(); symIdIt++)
+    {
+      int symId = reflSegmentMergedIdsRefined[segIdIt][symIdIt];
+      result_.refl_segment_symmetries[segIdIt].push_back(reflSymmetryRefined[symId]);
+    }
+  }
+
+  if (verbose_)
+    std::cout << "  " << reflSegmentMergedIdsRefined.size() << " merged refined segments." << std::endl;
+  printStageTime(start);
+
+  //----------------------------------------------------------------------------
+  // Remove duplicate symmetries
+  //----------------------------------------------------------------------------
+
+  printStage("Remove duplicate symmetries...");
+  start = pcl::getTime ();
+
+  for (size_t segId = 0; segId < result_.refl_segment_symmetries.size(); segId++)
+  {
+    std::vector<sym::ReflectionalSymmetry> &segmentSymmetries = result_.refl_segment_symmetries[segId];
+    std::vector<int> merged;
+
+    // Get mean
+    Eigen::Vector4f centroid;
+    pcl::compute3DCentroid(*result_.scene_cloud, result_.refl_segments[segId], centroid);
+
+    sym::mergeDuplicateReflSymmetries ( segmentSymmetries,
+                                        std::vector<Eigen::Vector3f> (segmentSymmetries.size(), centroid.head(3)),
+                                        std::vector<float> (segmentSymmetries.size(), 1.0),
+                                        merged,
+                                        params_.refl_det.symmetry_min_angle_diff,
+                                        params_.refl_det.symmetry_min_distance_diff,
+                                        params_.refl_det.max_reference_point_distance
+                                      );
+
+    std::vector<sym::ReflectionalSymmetry> symmetriesFiltered;
+    for (size_t i = 0; i < merged.size(); i++)
+      symmetriesFiltered.push_back(segmentSymmetries[merged[i]]);
+
+    segmentSymmetries.swap(symmetriesFiltered);
+  }
+
+  printStageTime(start);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::printStage (const std::string &message) const
+{
+  if (verbose_)
+    std::cout << message << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointT>
+inline void
+sym::SymSegPipeline<PointT>::printStageTime (const double stage_start) const
+{
+  if (verbose_)
+    std::cout << "  " << (pcl::getTime() - stage_start) << " seconds." << std::endl;
+}
+
+#endif  // SYMSEG_PIPELINE_HPP
@@ -0,0 +1,55 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef BITS_HPP
+#define BITS_HPP
+
+// STD includes
+#include <stdint.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace utl
+{
+  /** \brief Count the number of set bits of a 64 bit word.
+   *  \param[in]  word  input word
+   *  \return number of set bits
+   */
+  inline
+  int popcount64 (const uint64_t word)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<int>(__popcnt64(word));
+#else
+    uint64_t w = word - ((word >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((w * 0x0101010101010101ULL) >> 56);
+#endif
+  }
+
+  /** \brief Get the index of the lowest set bit of a 64 bit word.
+   *  \param[in]  word  input word, must not be zero
+   *  \return index of the lowest set bit
+   */
+  inline
+  int countTrailingZeros64 (const uint64_t word)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return popcount64((word & (~word + 1)) - 1);
+#endif
+  }
+}
+
+#endif    // BITS_HPP
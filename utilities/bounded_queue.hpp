@@ -0,0 +1,108 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+// STD includes
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace utl
+{
+  /** \brief @b BoundedQueue A first in first out queue shared between
+   * producer and consumer threads. Producers block while the queue is full and
+   * consumers block while it is empty. Once the queue is closed no more items
+   * can be pushed and consumers drain the remaining items.
+   */
+  template <typename T>
+  class BoundedQueue
+  {
+  public:
+
+    /** \brief Constructor.
+     *  \param[in]  capacity  maximum number of items in the queue (at least 1)
+     */
+    explicit BoundedQueue (const size_t capacity)
+      : capacity_ (capacity > 0 ? capacity : 1)
+      , closed_ (false)
+    { }
+
+    /** \brief Add an item to the end of the queue. Blocks while the queue is
+     * full.
+     *  \param[in]  item  item
+     *  \return false if the queue was closed
+     */
+    inline bool
+    push (const T &item)
+    {
+      std::unique_lock<std::mutex> lock (mutex_);
+      not_full_.wait(lock, [this] () { return closed_ || items_.size() < capacity_; });
+      if (closed_)
+        return false;
+
+      items_.push_back(item);
+      not_empty_.notify_one();
+      return true;
+    }
+
+    /** \brief Remove an item from the front of the queue. Blocks while the
+     * queue is empty and not closed.
+     *  \param[out] item  item
+     *  \return false if the queue is closed and empty
+     */
+    inline bool
+    pop (T &item)
+    {
+      std::unique_lock<std::mutex> lock (mutex_);
+      not_empty_.wait(lock, [this] () { return closed_ || !items_.empty(); });
+      if (items_.empty())
+        return false;
+
+      item = items_.front();
+      items_.pop_front();
+      not_full_.notify_one();
+      return true;
+    }
+
+    /** \brief Close the queue. Blocked producers and consumers are woken up. */
+    inline void
+    close ()
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      closed_ = true;
+      not_full_.notify_all();
+      not_empty_.notify_all();
+    }
+
+    /** \brief Get the number of items in the queue. */
+    inline size_t
+    size () const
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      return items_.size();
+    }
+
+  private:
+
+    BoundedQueue (const BoundedQueue&);
+    BoundedQueue& operator= (const BoundedQueue&);
+
+    /** \brief Maximum number of items. */
+    const size_t capacity_;
+
+    /** \brief Queue is closed. */
+    bool closed_;
+
+    /** \brief Items. */
+    std::deque<T> items_;
+
+    /** \brief Synchronization. */
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_, not_empty_;
+  };
+}
+
+#endif  // BOUNDED_QUEUE_HPP
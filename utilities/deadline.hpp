@@ -0,0 +1,85 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef DEADLINE_HPP
+#define DEADLINE_HPP
+
+// STD includes
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace utl
+{
+  /** \brief @b Deadline A point in time by which a computation should finish.
+   * Long computations check the deadline between units of work and return the
+   * results they have so far once it has expired. A default constructed
+   * deadline never expires. Deadlines are cheap to copy and can be queried
+   * from several threads at the same time.
+   */
+  class Deadline
+  {
+  public:
+
+    /** \brief Empty constructor. The deadline never expires. */
+    Deadline ()
+      : set_ (false)
+    { }
+
+    /** \brief Constructor.
+     *  \param[in]  time_budget   time from now until the deadline in seconds (the deadline never expires if not positive)
+     */
+    explicit Deadline (const double time_budget)
+      : set_ (time_budget > 0.0)
+      , end_ (std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double> (std::max(time_budget, 0.0))))
+    { }
+
+    /** \brief Check if the deadline can expire. */
+    inline bool
+    isSet () const
+    {
+      return set_;
+    }
+
+    /** \brief Check if the deadline has expired. */
+    inline bool
+    expired () const
+    {
+      return set_ && std::chrono::steady_clock::now() >= end_;
+    }
+
+    /** \brief Check if the deadline expires within a given time from now,
+     * e.g. before another unit of work of a known duration could finish.
+     *  \param[in]  duration  time from now in seconds
+     */
+    inline bool
+    expiresWithin (const double duration) const
+    {
+      return set_ && getRemainingTime() <= duration;
+    }
+
+    /** \brief Get the time left until the deadline in seconds (infinity if
+     * the deadline is not set, 0 if it has expired).
+     */
+    inline double
+    getRemainingTime () const
+    {
+      if (!set_)
+        return std::numeric_limits<double>::infinity();
+
+      const double remaining = std::chrono::duration<double> (end_ - std::chrono::steady_clock::now()).count();
+      return remaining > 0.0 ? remaining : 0.0;
+    }
+
+  private:
+
+    /** \brief Deadline can expire. */
+    bool set_;
+
+    /** \brief Time of the deadline. */
+    std::chrono::steady_clock::time_point end_;
+  };
+}
+
+#endif  // DEADLINE_HPP
@@ -0,0 +1,350 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef CLOUD_CACHE_UTILITIES_HPP
+#define CLOUD_CACHE_UTILITIES_HPP
+
+// STD includes
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// POSIX includes
+#include <sys/stat.h>
+#include <unistd.h>
+
+// PCL includes
+#include <pcl/point_cloud.h>
+#include <pcl/common/io.h>
+#include <pcl/io/ply_io.h>
+#include <pcl/io/pcd_io.h>
+
+// Utilities includes
+#include <filesystem/filesystem.hpp>
+#include <filesystem/mapped_file.hpp>
+#include <hash.hpp>
+
+namespace utl
+{
+  /** \brief Header of a binary pointcloud cache file. The header is followed
+   * by the points of the cloud stored as a packed array of point structures,
+   * exactly as they are laid out in memory, starting at data_offset. The cache
+   * records the size and the modification time of the file it was created
+   * from and a key of the point type fields, so that stale caches and caches
+   * of a different point type are detected. All values are stored in native
+   * byte order.
+   */
+  struct CloudCacheHeader
+  {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  header_size;
+    uint64_t  fields_key;
+    uint64_t  point_size;
+    uint64_t  num_points;
+    uint32_t  width;
+    uint32_t  height;
+    uint32_t  is_dense;
+    uint32_t  reserved;
+    uint64_t  source_size;
+    int64_t   source_mtime_sec;
+    int64_t   source_mtime_nsec;
+    uint64_t  data_offset;
+  };
+
+  /** \brief Get the size and the modification time of a file.
+   *  \param[in]  filename    file name
+   *  \param[out] size        file size in bytes
+   *  \param[out] mtime_sec   modification time (seconds)
+   *  \param[out] mtime_nsec  modification time (nanoseconds)
+   *  \return false if the file can not be accessed
+   */
+  inline
+  bool getFileStamp (const std::string &filename, uint64_t &size, int64_t &mtime_sec, int64_t &mtime_nsec)
+  {
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) != 0)
+      return false;
+
+    size        = static_cast<uint64_t>(fileStat.st_size);
+    mtime_sec   = static_cast<int64_t>(fileStat.st_mtim.tv_sec);
+    mtime_nsec  = static_cast<int64_t>(fileStat.st_mtim.tv_nsec);
+    return true;
+  }
+
+  /** \brief Get a key identifying the memory layout of a point type: names,
+   * offsets, types and counts of its fields and the size of the point.
+   */
+  template <typename PointT>
+  inline
+  uint64_t getPointFieldsKey ()
+  {
+    std::vector<pcl::PCLPointField> fields;
+    pcl::getFields<PointT>(fields);
+
+    uint64_t pointSize = sizeof(PointT);
+    uint64_t key = utl::hashBytes(&pointSize, sizeof(pointSize));
+    for (size_t fieldId = 0; fieldId < fields.size(); fieldId++)
+    {
+      const uint32_t layout[3] = { fields[fieldId].offset, static_cast<uint32_t>(fields[fieldId].datatype), fields[fieldId].count };
+      key = utl::hashBytes(fields[fieldId].name.data(), fields[fieldId].name.size(), key);
+      key = utl::hashBytes(layout, sizeof(layout), key);
+    }
+
+    return key;
+  }
+
+  /** \brief @b CloudCacheFile Read-only pointcloud cache file written by
+   * CloudCacheFile::write. The file is memory mapped and the points can be
+   * accessed in place without copying.
+   */
+  class CloudCacheFile
+  {
+  public:
+
+    /** \brief Current version of the cache file format. */
+    static const uint32_t VERSION = 1;
+
+    /** \brief Empty constructor. */
+    CloudCacheFile ()
+    {
+      std::memset(&header_, 0, sizeof(header_));
+    }
+
+    /** \brief Map a cache file into memory.
+     *  \param[in]  filename    file name
+     *  \return false if the file could not be mapped or is not a valid cache file
+     */
+    inline
+    bool open (const std::string &filename)
+    {
+      close();
+
+      if (!file_.open(filename))
+        return false;
+
+      if (file_.size() < sizeof(CloudCacheHeader))
+      {
+        std::cout << "[utl::CloudCacheFile::open] file '" << filename << "' is too small to be a pointcloud cache file." << std::endl;
+        close();
+        return false;
+      }
+
+      std::memcpy(&header_, file_.data(), sizeof(CloudCacheHeader));
+      if (std::strncmp(header_.magic, getMagic(), sizeof(header_.magic)) != 0 || header_.version != VERSION || header_.header_size != sizeof(CloudCacheHeader))
+      {
+        std::cout << "[utl::CloudCacheFile::open] file '" << filename << "' is not a pointcloud cache file of version " << VERSION << "." << std::endl;
+        close();
+        return false;
+      }
+
+      if (header_.data_offset < sizeof(CloudCacheHeader) || file_.size() != header_.data_offset + header_.num_points * header_.point_size)
+      {
+        std::cout << "[utl::CloudCacheFile::open] file '" << filename << "' is truncated." << std::endl;
+        close();
+        return false;
+      }
+
+      return true;
+    }
+
+    /** \brief Release the mapped file. */
+    inline
+    void close ()
+    {
+      file_.close();
+      std::memset(&header_, 0, sizeof(header_));
+    }
+
+    /** \brief Check if a cache file is currently mapped. */
+    inline bool isOpen () const { return file_.isOpen(); }
+
+    /** \brief Get file header. Only valid if the file is open. */
+    inline const CloudCacheHeader& getHeader () const  { return header_; }
+
+    /** \brief Check if the cache was created from the current version of a
+     * source file, i.e. the size and the modification time of the source file
+     * have not changed.
+     *  \param[in]  source_filename   file the cache was created from
+     */
+    inline
+    bool isValidFor (const std::string &source_filename) const
+    {
+      uint64_t size;
+      int64_t mtimeSec, mtimeNsec;
+      if (!isOpen() || !getFileStamp(source_filename, size, mtimeSec, mtimeNsec))
+        return false;
+
+      return  header_.source_size == size &&
+              header_.source_mtime_sec == mtimeSec &&
+              header_.source_mtime_nsec == mtimeNsec;
+    }
+
+    /** \brief Get the points stored in the file. Points are not copied and
+     * are only valid while the file is open.
+     *  \return pointer to the first point or NULL if the file stores a different point type
+     */
+    template <typename PointT>
+    inline
+    const PointT* getPoints () const
+    {
+      if (!isOpen() || header_.fields_key != getPointFieldsKey<PointT>() || header_.point_size != sizeof(PointT))
+        return NULL;
+
+      return reinterpret_cast<const PointT*>(file_.data() + header_.data_offset);
+    }
+
+    /** \brief Copy the pointcloud stored in the file.
+     *  \param[out] cloud   pointcloud
+     *  \return false if the file stores a different point type
+     */
+    template <typename PointT>
+    inline
+    bool getPointCloud (pcl::PointCloud<PointT> &cloud) const
+    {
+      const PointT *points = getPoints<PointT>();
+      if (!points)
+        return false;
+
+      cloud.points.assign(points, points + header_.num_points);
+      cloud.width     = header_.width;
+      cloud.height    = header_.height;
+      cloud.is_dense  = header_.is_dense != 0;
+      return true;
+    }
+
+    /** \brief Write a pointcloud to a cache file. The file is first written
+     * under a temporary name and then renamed, so that concurrent readers
+     * never see a partially written file. The temporary name is unique to the
+     * writing process and thread, so concurrent writers of the same file do
+     * not interleave their data.
+     *  \param[in]  filename          cache file name
+     *  \param[in]  cloud             pointcloud
+     *  \param[in]  source_filename   file the pointcloud was read from
+     *  \return false if the file could not be written
+     */
+    template <typename PointT>
+    static
+    bool write (const std::string &filename, const pcl::PointCloud<PointT> &cloud, const std::string &source_filename)
+    {
+      CloudCacheHeader header;
+      std::memset(&header, 0, sizeof(header));
+      std::memcpy(header.magic, getMagic(), sizeof(header.magic));
+      header.version      = VERSION;
+      header.header_size  = sizeof(CloudCacheHeader);
+      header.fields_key   = getPointFieldsKey<PointT>();
+      header.point_size   = sizeof(PointT);
+      header.num_points   = cloud.size();
+      header.width        = cloud.width;
+      header.height       = cloud.height;
+      header.is_dense     = cloud.is_dense ? 1 : 0;
+      header.data_offset  = (sizeof(CloudCacheHeader) + 63) / 64 * 64;    // Keep the points aligned
+      if (!getFileStamp(source_filename, header.source_size, header.source_mtime_sec, header.source_mtime_nsec))
+      {
+        std::cout << "[utl::CloudCacheFile::write] could not access source file '" << source_filename << "'." << std::endl;
+        return false;
+      }
+
+      std::stringstream tmpFilename;
+      tmpFilename << filename << ".tmp." << getpid() << "." << std::this_thread::get_id();
+      {
+        std::ofstream file (tmpFilename.str().c_str(), std::ios::out | std::ios::binary);
+        if (!file.is_open())
+        {
+          std::cout << "[utl::CloudCacheFile::write] could not open file '" << tmpFilename.str() << "' for writing." << std::endl;
+          return false;
+        }
+
+        const std::vector<char> padding (header.data_offset - sizeof(CloudCacheHeader), 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(CloudCacheHeader));
+        if (!padding.empty())
+          file.write(padding.data(), padding.size());
+        if (!cloud.empty())
+          file.write(reinterpret_cast<const char*>(cloud.points.data()), cloud.size() * sizeof(PointT));
+
+        if (!file.good())
+        {
+          std::cout << "[utl::CloudCacheFile::write] could not write file '" << tmpFilename.str() << "'." << std::endl;
+          file.close();
+          std::remove(tmpFilename.str().c_str());
+          return false;
+        }
+      }
+
+      if (std::rename(tmpFilename.str().c_str(), filename.c_str()) != 0)
+      {
+        std::cout << "[utl::CloudCacheFile::write] could not rename file '" << tmpFilename.str() << "' to '" << filename << "'." << std::endl;
+        std::remove(tmpFilename.str().c_str());
+        return false;
+      }
+
+      return true;
+    }
+
+  private:
+
+    /** \brief Magic string identifying a pointcloud cache file. */
+    static const char* getMagic ()  { return "SYMSEGPC"; }
+
+    /** \brief Mapped file. */
+    utl::MappedFile file_;
+
+    /** \brief Header of the mapped file. */
+    CloudCacheHeader header_;
+  };
+
+  /** \brief Get the name of the cache file of a pointcloud file. */
+  inline
+  std::string getCloudCacheFilename (const std::string &filename)
+  {
+    return filename + ".cache";
+  }
+
+  /** \brief Load a PLY or PCD pointcloud file through a binary cache.
+   * If a cache file created from the current version of the file exists next
+   * to it, it is memory mapped and the points are copied from it. Otherwise
+   * the pointcloud file is parsed and the cache file is written for the next
+   * load.
+   *  \param[in]  filename    pointcloud file name
+   *  \param[out] cloud       pointcloud
+   *  \return false if the pointcloud could not be loaded
+   */
+  template <typename PointT>
+  inline
+  bool loadPointCloudCached (const std::string &filename, pcl::PointCloud<PointT> &cloud)
+  {
+    const std::string cacheFilename = getCloudCacheFilename(filename);
+
+    // Try the cache
+    if (utl::isFile(cacheFilename))
+    {
+      CloudCacheFile cacheFile;
+      if (cacheFile.open(cacheFilename) && cacheFile.isValidFor(filename) && cacheFile.getPointCloud(cloud))
+        return true;
+    }
+
+    // Otherwise parse the pointcloud file and write the cache
+    int status;
+    if (utl::getExtension(filename) == ".pcd")
+      status = pcl::io::loadPCDFile(filename, cloud);
+    else
+      status = pcl::io::loadPLYFile(filename, cloud);
+
+    if (status != 0)
+    {
+      std::cout << "[utl::loadPointCloudCached] could not load pointcloud file '" << filename << "'." << std::endl;
+      return false;
+    }
+
+    if (!CloudCacheFile::write(cacheFilename, cloud, filename))
+      std::cout << "[utl::loadPointCloudCached] could not write pointcloud cache." << std::endl;
+
+    return true;
+  }
+}
+
+#endif    // CLOUD_CACHE_UTILITIES_HPP
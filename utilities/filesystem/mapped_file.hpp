@@ -0,0 +1,111 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef MAPPED_FILE_UTILITIES_HPP
+#define MAPPED_FILE_UTILITIES_HPP
+
+// STD includes
+#include <iostream>
+#include <string>
+
+// POSIX includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace utl
+{
+  /** \brief A file memory mapped read-only. The mapping is released when the
+   * object is destroyed or when another file is opened.
+   */
+  class MappedFile
+  {
+  public:
+
+    /** \brief Empty constructor. */
+    MappedFile ()
+      : data_ (NULL)
+      , size_ (0)
+    { }
+
+    /** \brief Destructor. */
+    ~MappedFile ()
+    {
+      close();
+    }
+
+    /** \brief Map a file into memory.
+     *  \param[in]  filename    file name
+     *  \return TRUE if file was mapped successfully
+     */
+    inline
+    bool open (const std::string &filename)
+    {
+      close();
+
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        std::cout << "[utl::MappedFile::open] Could not open file '" << filename << "' for reading." << std::endl;
+        return false;
+      }
+
+      struct stat fileStat;
+      if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+      {
+        std::cout << "[utl::MappedFile::open] File '" << filename << "' is empty or can not be accessed." << std::endl;
+        ::close(fd);
+        return false;
+      }
+
+      void *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+
+      if (data == MAP_FAILED)
+      {
+        std::cout << "[utl::MappedFile::open] Could not map file '" << filename << "' into memory." << std::endl;
+        return false;
+      }
+
+      data_ = static_cast<const char*>(data);
+      size_ = static_cast<size_t>(fileStat.st_size);
+      return true;
+    }
+
+    /** \brief Release the mapping. */
+    inline
+    void close ()
+    {
+      if (data_)
+        munmap(const_cast<char*>(data_), size_);
+
+      data_ = NULL;
+      size_ = 0;
+    }
+
+    /** \brief Check if a file is currently mapped. */
+    inline bool isOpen () const { return data_ != NULL; }
+
+    /** \brief Get a pointer to the start of the mapped file. */
+    inline const char* data () const  { return data_; }
+
+    /** \brief Get the size of the mapped file in bytes. */
+    inline size_t size () const { return size_; }
+
+  private:
+
+    /** \brief Copying is not allowed. */
+    MappedFile (const MappedFile &);
+    MappedFile& operator= (const MappedFile &);
+
+    /** \brief Start of the mapped memory. */
+    const char* data_;
+
+    /** \brief Size of the mapped memory. */
+    size_t size_;
+  };
+}
+
+#endif    // MAPPED_FILE_UTILITIES_HPP
@@ -0,0 +1,129 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef LINE_DIRECTION_INDEX_HPP
+#define LINE_DIRECTION_INDEX_HPP
+
+// STD includes
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+namespace utl
+{
+  /** \brief @b LineDirectionIndex Find line directions (e.g. symmetry plane
+   * normals or symmetry axes) that are within a given angle of a query
+   * direction. Direction sign is ignored, i.e. the angle between two
+   * directions is the angle between the lines they define. Unit directions
+   * are bucketed by quantizing their coordinates with a cell size equal to the
+   * chord length corresponding to the maximum angle, so all directions within
+   * the maximum angle of a query direction (or of its opposite) fall into the
+   * 3x3x3 blocks of cells surrounding the two.
+   * \note returned candidates are a superset of the directions within the
+   * maximum angle. Callers are expected to apply their own similarity test.
+   */
+  class LineDirectionIndex
+  {
+  public:
+
+    /** \brief Empty constructor. */
+    LineDirectionIndex ()
+      : cell_size_inv_ (0.0f)
+    { }
+
+    /** \brief Build the index.
+     *  \param[in]  directions  direction vectors (are normalized by the index)
+     *  \param[in]  max_angle   maximum angle between similar directions
+     */
+    inline void
+    setInputDirections (const std::vector<Eigen::Vector3f> &directions, const float max_angle)
+    {
+      // Chord length corresponding to the maximum angle with a small margin
+      // for the rounding errors of the angle computation
+      float angle = std::min(std::max(max_angle, 0.0f), static_cast<float>(M_PI / 2));
+      float cellSize = 2.0f * std::sin(angle / 2.0f) * 1.001f + 1e-5f;
+      cell_size_inv_ = 1.0f / cellSize;
+
+      entries_.resize(directions.size());
+      for (size_t dirId = 0; dirId < directions.size(); dirId++)
+        entries_[dirId] = std::pair<uint64_t, int>(getCellKey(directions[dirId].normalized()), dirId);
+      std::sort(entries_.begin(), entries_.end());
+    }
+
+    /** \brief Get the number of indexed directions. */
+    inline size_t
+    size () const  { return entries_.size(); }
+
+    /** \brief Find indexed directions that may be within the maximum angle of
+     * a query direction.
+     *  \param[in]  direction   query direction
+     *  \param[out] indices     sorted indices of candidate directions
+     */
+    inline void
+    getCandidates (const Eigen::Vector3f &direction, std::vector<int> &indices) const
+    {
+      indices.clear();
+
+      const Eigen::Vector3f directionNormalized = direction.normalized();
+      for (int sign = -1; sign <= 1; sign += 2)
+      {
+        Eigen::Vector3i cell = getCell(directionNormalized * static_cast<float>(sign));
+        for (int dx = -1; dx <= 1; dx++)
+          for (int dy = -1; dy <= 1; dy++)
+            for (int dz = -1; dz <= 1; dz++)
+            {
+              const uint64_t key = packCell(cell + Eigen::Vector3i(dx, dy, dz));
+              std::vector<std::pair<uint64_t, int> >::const_iterator it = std::lower_bound(entries_.begin(), entries_.end(), std::pair<uint64_t, int>(key, -1));
+              for (; it != entries_.end() && it->first == key; it++)
+                indices.push_back(it->second);
+            }
+      }
+
+      // A direction can be close to both the query and its opposite only for
+      // very large angles
+      std::sort(indices.begin(), indices.end());
+      indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    }
+
+  private:
+
+    /** \brief Get the cell containing a unit direction. */
+    inline Eigen::Vector3i
+    getCell (const Eigen::Vector3f &direction) const
+    {
+      return (direction * cell_size_inv_).array().floor().cast<int>();
+    }
+
+    /** \brief Pack cell coordinates into a key. Coordinates are bounded by the
+     * inverse of the cell size, which is far below 2^20.
+     */
+    static inline uint64_t
+    packCell (const Eigen::Vector3i &cell)
+    {
+      const int64_t offset = 1 << 20;
+      return  (static_cast<uint64_t>(cell[0] + offset) << 42) |
+              (static_cast<uint64_t>(cell[1] + offset) << 21) |
+               static_cast<uint64_t>(cell[2] + offset);
+    }
+
+    /** \brief Get the key of the cell containing a unit direction. */
+    inline uint64_t
+    getCellKey (const Eigen::Vector3f &direction) const
+    {
+      return packCell(getCell(direction));
+    }
+
+    /** \brief Inverse of the cell size. */
+    float cell_size_inv_;
+
+    /** \brief Cell keys and indices of the directions sorted by cell. */
+    std::vector<std::pair<uint64_t, int> > entries_;
+  };
+}
+
+#endif  // LINE_DIRECTION_INDEX_HPP
@@ -5,12 +5,19 @@
 #ifndef BRON_KERBOSCH_HPP
 #define BRON_KERBOSCH_HPP
 
+// STD includes
+#include <stdint.h>
+#include <list>
+#include <vector>
+
 // Boost includes
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/bron_kerbosch_all_cliques.hpp>
 
 // Utilities includes
 #include <graph/graph.hpp>
+#include <map.hpp>
+#include <bits.hpp>
 
 struct CliqueVisitor
 {
@@ -74,6 +81,235 @@ namespace utl
         
     return cliques.size();
   }
+
+  /** \brief State of the bitset Bron-Kerbosch search. Vertex sets are
+   * bitsets of 64 bit words. Candidate and excluded sets of every recursion
+   * depth are stored in preallocated buffers.
+   */
+  struct BronKerboschBitset
+  {
+    /** \brief Number of words in a vertex set. */
+    int num_words_;
+
+    /** \brief Adjacency bitset of every vertex. */
+    std::vector<uint64_t> adjacency_;
+
+    /** \brief Candidate (P) and excluded (X) sets of every recursion depth. */
+    std::vector<std::vector<uint64_t> > candidates_, excluded_;
+
+    /** \brief Current clique (R). */
+    std::vector<int> clique_;
+
+    /** \brief Minimum size of a reported clique. */
+    int min_clique_size_;
+
+    /** \brief Found cliques. */
+    utl::Map *cliques_;
+
+    /** \brief Get the adjacency bitset of a vertex. */
+    inline const uint64_t*
+    getAdjacency (const int vtx_id) const  { return &adjacency_[vtx_id * num_words_]; }
+
+    /** \brief Make sure that the set buffers of a recursion depth exist. */
+    inline void
+    allocateDepth (const int depth)
+    {
+      while (static_cast<int>(candidates_.size()) <= depth)
+      {
+        candidates_.push_back(std::vector<uint64_t> (num_words_, 0));
+        excluded_.push_back(std::vector<uint64_t> (num_words_, 0));
+      }
+    }
+
+    /** \brief Report the current clique if all candidate and excluded sets are
+     * empty, otherwise extend it with every candidate that is not a neighbor
+     * of the pivot. The pivot is the vertex of the candidate and excluded sets
+     * with the most neighbors in the candidate set (Tomita et al.).
+     *  \param[in] depth  recursion depth of the current clique
+     */
+    inline void
+    expand (const int depth)
+    {
+      uint64_t *candidates = &candidates_[depth][0];
+      uint64_t *excluded = &excluded_[depth][0];
+
+      // Choose the pivot
+      int pivotId = -1, pivotNumNeighbors = -1;
+      for (int wordId = 0; wordId < num_words_; wordId++)
+      {
+        uint64_t word = candidates[wordId] | excluded[wordId];
+        while (word)
+        {
+          const int vtxId = wordId * 64 + utl::countTrailingZeros64(word);
+          word &= word - 1;
+
+          const uint64_t *vtxAdjacency = getAdjacency(vtxId);
+          int numNeighbors = 0;
+          for (int nbrWordId = 0; nbrWordId < num_words_; nbrWordId++)
+            numNeighbors += utl::popcount64(candidates[nbrWordId] & vtxAdjacency[nbrWordId]);
+
+          if (numNeighbors > pivotNumNeighbors)
+          {
+            pivotId = vtxId;
+            pivotNumNeighbors = numNeighbors;
+          }
+        }
+      }
+
+      // Candidate and excluded sets are empty, the clique is maximal
+      if (pivotId == -1)
+      {
+        if (static_cast<int>(clique_.size()) >= min_clique_size_)
+          cliques_->push_back(clique_);
+        return;
+      }
+
+      allocateDepth(depth + 1);
+      const uint64_t *pivotAdjacency = getAdjacency(pivotId);
+      for (int wordId = 0; wordId < num_words_; wordId++)
+      {
+        uint64_t word = candidates[wordId] & ~pivotAdjacency[wordId];
+        while (word)
+        {
+          const int vtxBit = utl::countTrailingZeros64(word);
+          const int vtxId = wordId * 64 + vtxBit;
+          word &= word - 1;
+
+          // Recurse with the candidates and excluded vertices adjacent to the
+          // new clique vertex
+          const uint64_t *vtxAdjacency = getAdjacency(vtxId);
+          uint64_t *nextCandidates = &candidates_[depth + 1][0];
+          uint64_t *nextExcluded = &excluded_[depth + 1][0];
+          for (int nbrWordId = 0; nbrWordId < num_words_; nbrWordId++)
+          {
+            nextCandidates[nbrWordId] = candidates[nbrWordId] & vtxAdjacency[nbrWordId];
+            nextExcluded[nbrWordId] = excluded[nbrWordId] & vtxAdjacency[nbrWordId];
+          }
+
+          clique_.push_back(vtxId);
+          expand(depth + 1);
+          clique_.pop_back();
+
+          // Move the vertex from the candidate to the excluded set. Deeper
+          // levels may have added set buffers, so the sets are looked up again
+          candidates = &candidates_[depth][0];
+          excluded = &excluded_[depth][0];
+          candidates[wordId] &= ~(static_cast<uint64_t>(1) << vtxBit);
+          excluded[wordId] |= static_cast<uint64_t>(1) << vtxBit;
+        }
+      }
+    }
+  };
+
+  /** \brief Find all maximal cliques in a graph using the Bron-Kerbosch
+   * algorithm with Tomita pivoting. The outer level visits vertices in a
+   * degeneracy order (Eppstein et al.), so the candidate sets of the inner
+   * levels are bounded by the degeneracy of the graph. Vertex sets are stored
+   * as bitsets and the pivot is chosen with population counts.
+   *  \param[in]  graph   input graph
+   *  \param[out] cliques output cliques. Vertices of every clique are in the
+   *                      order they were added to it.
+   *  \param[in]  min_clique_size minimum size of a valid clique
+   *  \return number of cliques
+   */
+  inline
+  int bronKerbosch  ( const utl::Graph &graph,
+                      utl::Map &cliques,
+                      const int min_clique_size = 2
+                    )
+  {
+    cliques.clear();
+    const int numVertices = graph.getNumVertices();
+    if (numVertices == 0)
+      return 0;
+
+    BronKerboschBitset state;
+    state.num_words_ = (numVertices + 63) / 64;
+    state.adjacency_.assign(numVertices * state.num_words_, 0);
+    state.min_clique_size_ = min_clique_size;
+    state.cliques_ = &cliques;
+
+    std::vector<int> degrees (numVertices, 0);
+    for (int edgeId = 0; edgeId < graph.getNumEdges(); edgeId++)
+    {
+      int vtx1Id, vtx2Id;
+      if (!graph.getEdgeVertexIds(edgeId, vtx1Id, vtx2Id))
+        continue;
+
+      state.adjacency_[vtx1Id * state.num_words_ + vtx2Id / 64] |= static_cast<uint64_t>(1) << (vtx2Id % 64);
+      state.adjacency_[vtx2Id * state.num_words_ + vtx1Id / 64] |= static_cast<uint64_t>(1) << (vtx1Id % 64);
+      degrees[vtx1Id]++;
+      degrees[vtx2Id]++;
+    }
+
+    //--------------------------------------------------------------------------
+    // Degeneracy order: repeatedly remove a vertex of minimum remaining degree
+
+    std::vector<std::vector<int> > degreeBuckets (numVertices);
+    for (int vtxId = numVertices - 1; vtxId >= 0; vtxId--)
+      degreeBuckets[degrees[vtxId]].push_back(vtxId);
+
+    std::vector<int> order;
+    order.reserve(numVertices);
+    std::vector<bool> removed (numVertices, false);
+    int minDegree = 0;
+    while (static_cast<int>(order.size()) < numVertices)
+    {
+      // Buckets may contain stale entries of vertices whose degree dropped
+      while (degreeBuckets[minDegree].empty())
+        minDegree++;
+
+      const int vtxId = degreeBuckets[minDegree].back();
+      degreeBuckets[minDegree].pop_back();
+      if (removed[vtxId] || degrees[vtxId] != minDegree)
+        continue;
+
+      removed[vtxId] = true;
+      order.push_back(vtxId);
+
+      const uint64_t *vtxAdjacency = state.getAdjacency(vtxId);
+      for (int wordId = 0; wordId < state.num_words_; wordId++)
+      {
+        uint64_t word = vtxAdjacency[wordId];
+        while (word)
+        {
+          const int nbrId = wordId * 64 + utl::countTrailingZeros64(word);
+          word &= word - 1;
+          if (!removed[nbrId])
+          {
+            degrees[nbrId]--;
+            degreeBuckets[degrees[nbrId]].push_back(nbrId);
+          }
+        }
+      }
+
+      if (minDegree > 0)
+        minDegree--;
+    }
+
+    //--------------------------------------------------------------------------
+    // Search from every vertex. Neighbors later in the order are candidates,
+    // neighbors earlier in the order are excluded
+
+    state.allocateDepth(1);
+    std::vector<uint64_t> visited (state.num_words_, 0);
+    for (int orderId = 0; orderId < numVertices; orderId++)
+    {
+      const int vtxId = order[orderId];
+      const uint64_t *vtxAdjacency = state.getAdjacency(vtxId);
+      for (int wordId = 0; wordId < state.num_words_; wordId++)
+      {
+        state.candidates_[1][wordId] = vtxAdjacency[wordId] & ~visited[wordId];
+        state.excluded_[1][wordId] = vtxAdjacency[wordId] & visited[wordId];
+      }
+      visited[vtxId / 64] |= static_cast<uint64_t>(1) << (vtxId % 64);
+
+      state.clique_.assign(1, vtxId);
+      state.expand(1);
+    }
+
+    return cliques.size();
+  }
 }
 
 # endif // BRON_KERBOSCH_HPP
\ No newline at end of file
@@ -7,9 +7,12 @@
 
 // STD includes
 #include <queue>
+#include <atomic>
 
 // Utilities includes
 #include <graph/graph_base.hpp>
+#include <graph/graph_csr.hpp>
+#include <graph/graph_weighted.hpp>
 #include <std_vector.hpp>
 #include <map.hpp>
 
@@ -48,6 +51,94 @@ namespace utl
     }
   }
   
+  /** \brief Given a set of vertices in a compacted graph return all edges
+   * between the input set of vertices and the rest of the vertices in the graph.
+   * Edges are returned in the order of their indices in the input graph.
+   *  \param[in]  graph           graph
+   *  \param[in]  cut_vertices    indices of vertices that were cut
+   *  \param[in]  cut_edge_graph  a graph only containing the edges belonging to the cut
+   */
+  inline void
+  getCutEdges (const utl::GraphCSR &graph, const std::vector<int> &cut_vertices, utl::GraphWeighted &cut_edge_graph)
+  {
+    cut_edge_graph.clear();
+
+    // Mark cut vertices
+    std::vector<bool> isCut (graph.getNumVertices(), false);
+    for (size_t vtxIdIt = 0; vtxIdIt < cut_vertices.size(); vtxIdIt++)
+      if (cut_vertices[vtxIdIt] >= 0 && cut_vertices[vtxIdIt] < graph.getNumVertices())
+        isCut[cut_vertices[vtxIdIt]] = true;
+
+    // Loop over edges
+    for (int edgeId = 0; edgeId < graph.getNumEdges(); edgeId++)
+    {
+      int vtx1Id, vtx2Id;
+      float weight;
+      if (!graph.getEdge(edgeId, vtx1Id, vtx2Id, weight))
+        continue;
+
+      // Add edge if one vertex is in cut vertices but the other is not
+      if (isCut[vtx1Id] != isCut[vtx2Id])
+        cut_edge_graph.addEdge(vtx1Id, vtx2Id, weight);
+    }
+  }
+
+  /** \brief Get the subgraph induced by a subset of vertices of a graph.
+   * Vertices of the subgraph are the selected vertices in increasing order of
+   * their indices and edges keep their order and data (e.g. weights).
+   *  \param[in]  graph         graph
+   *  \param[in]  vertex_mask   mask of the vertices selected for the subgraph
+   *  \param[out] subgraph      induced subgraph
+   *  \param[out] vertex_ids    index in the graph of every subgraph vertex
+   *  \return false if the mask size is different from the number of graph vertices
+   */
+  template <typename VertexT, typename EdgeT>
+  inline bool
+  getInducedSubgraph  ( const utl::GraphBase<VertexT, EdgeT> &graph,
+                        const std::vector<bool> &vertex_mask,
+                        utl::GraphBase<VertexT, EdgeT> &subgraph,
+                        std::vector<int> &vertex_ids
+                      )
+  {
+    subgraph.clear();
+    vertex_ids.clear();
+
+    if (static_cast<int>(vertex_mask.size()) != graph.getNumVertices())
+    {
+      std::cout << "[utl::getInducedSubgraph] vertex mask size is different from the number of graph vertices (mask size: " << vertex_mask.size() << ", num vertices: " << graph.getNumVertices() << ")." << std::endl;
+      return false;
+    }
+
+    // Map graph vertices to subgraph vertices
+    std::vector<int> subgraphVertexIds (graph.getNumVertices(), -1);
+    for (int vtxId = 0; vtxId < graph.getNumVertices(); vtxId++)
+    {
+      if (vertex_mask[vtxId])
+      {
+        subgraphVertexIds[vtxId] = vertex_ids.size();
+        vertex_ids.push_back(vtxId);
+      }
+    }
+
+    // Keep the edges between selected vertices
+    std::vector<EdgeT> subgraphEdges;
+    for (int edgeId = 0; edgeId < graph.getNumEdges(); edgeId++)
+    {
+      EdgeT edge;
+      if (!graph.getEdge(edgeId, edge))
+        continue;
+
+      if (subgraphVertexIds[edge.vtx1Id_] != -1 && subgraphVertexIds[edge.vtx2Id_] != -1)
+      {
+        edge.vtx1Id_ = subgraphVertexIds[edge.vtx1Id_];
+        edge.vtx2Id_ = subgraphVertexIds[edge.vtx2Id_];
+        subgraphEdges.push_back(edge);
+      }
+    }
+
+    return subgraph.setEdges(vertex_ids.size(), subgraphEdges);
+  }
+
   /** \brief Find connected components in the graph.
    *  \param[in]  graph         graph object
    *  \param[in]  min_cc_size   minimum size of a valid connected component (default 0)
@@ -102,6 +193,187 @@ namespace utl
     
     return CCs;
   }
+
+  /** \brief Find connected components in a compacted graph. Components and
+   * their vertices are found in the same order as for the graph it was
+   * compacted from.
+   *  \param[in]  graph         graph object
+   *  \param[in]  min_cc_size   minimum size of a valid connected component (default 0)
+   *  \return    a vector of vectors where each inner vector corresponds to a 
+   *             connected component and stores the indices of vertices belonging
+   *             to it.
+   */
+  inline utl::Map
+  getConnectedComponents  ( const utl::GraphCSR &graph, const int min_cc_size = 0)
+  {
+    std::vector<bool> visited (graph.getNumVertices(), false);
+    utl::Map CCs;
+
+    // Vertex queue of the breadth-first search. Every vertex is pushed once
+    std::vector<int> vertexQueue (graph.getNumVertices());
+
+    for (int vtxId = 0; vtxId < graph.getNumVertices(); vtxId++)
+    {
+      // If node has already been visited - skip
+      if (visited[vtxId])
+        continue;
+
+      // Run breadth-first search from current vertex
+      int queueBegin = 0, queueEnd = 0;
+      vertexQueue[queueEnd++] = vtxId;
+      visited[vtxId] = true;
+
+      while (queueBegin < queueEnd)
+      {
+        const int curVtxId = vertexQueue[queueBegin++];
+
+        // Loop over it's neighbors
+        const int *neighbors, *neighborEdges;
+        const int numNeighbors = graph.getVertexNeighborRange(curVtxId, neighbors, neighborEdges);
+        for (int nbrIt = 0; nbrIt < numNeighbors; nbrIt++)
+        {
+          const int nbrId = neighbors[nbrIt];
+          if (!visited[nbrId])
+          {
+            vertexQueue[queueEnd++] = nbrId;
+            visited[nbrId] = true;
+          }
+        }
+      }
+
+      if (queueEnd > min_cc_size)
+        CCs.push_back(std::vector<int> (vertexQueue.begin(), vertexQueue.begin() + queueEnd));
+    }
+
+    return CCs;
+  }
+
+  /** \brief Find the representative of a vertex in a concurrent union-find
+   * forest. Parents are halved on the way to the root. Concurrent updates only
+   * ever replace a parent with one of its ancestors, so the root is found even
+   * if other threads are linking at the same time.
+   *  \param[in]  parents   parent of each vertex
+   *  \param[in]  vtx_id    vertex index
+   *  \return index of the root vertex
+   */
+  inline int
+  unionFindRoot (std::vector<std::atomic<int> > &parents, int vtx_id)
+  {
+    int parentId = parents[vtx_id].load(std::memory_order_relaxed);
+    while (parentId != vtx_id)
+    {
+      int grandparentId = parents[parentId].load(std::memory_order_relaxed);
+      if (grandparentId != parentId)
+        parents[vtx_id].compare_exchange_weak(parentId, grandparentId, std::memory_order_relaxed);
+      vtx_id = parentId;
+      parentId = parents[vtx_id].load(std::memory_order_relaxed);
+    }
+
+    return vtx_id;
+  }
+
+  /** \brief Merge the sets of two vertices in a concurrent union-find forest.
+   * The root with the larger index is always hooked under the root with the
+   * smaller index, so the root of every set is its smallest vertex regardless
+   * of the order in which the links are made.
+   *  \param[in]  parents   parent of each vertex
+   *  \param[in]  vtx1_id   index of first vertex
+   *  \param[in]  vtx2_id   index of second vertex
+   */
+  inline void
+  unionFindLink (std::vector<std::atomic<int> > &parents, const int vtx1_id, const int vtx2_id)
+  {
+    while (true)
+    {
+      int root1Id = unionFindRoot(parents, vtx1_id);
+      int root2Id = unionFindRoot(parents, vtx2_id);
+      if (root1Id == root2Id)
+        return;
+
+      if (root1Id < root2Id)
+        std::swap(root1Id, root2Id);
+
+      // Hook the larger root if it is still a root, otherwise retry
+      int expectedId = root1Id;
+      if (parents[root1Id].compare_exchange_strong(expectedId, root2Id, std::memory_order_relaxed))
+        return;
+    }
+  }
+
+  /** \brief Find connected components in a compacted graph using a parallel
+   * lock-free union-find. Edges are linked in parallel and every vertex is then
+   * labelled with the smallest vertex of its component. The output does not
+   * depend on the number of threads: components are ordered by their smallest
+   * vertex and the vertices of a component are in increasing order. The
+   * components are the same as the ones returned by getConnectedComponents,
+   * only the order of vertices within a component may differ.
+   *  \param[in]  graph         graph object
+   *  \param[in]  min_cc_size   minimum size of a valid connected component (default 0)
+   *  \return    a vector of vectors where each inner vector corresponds to a 
+   *             connected component and stores the indices of vertices belonging
+   *             to it.
+   */
+  inline utl::Map
+  getConnectedComponentsParallel  ( const utl::GraphCSR &graph, const int min_cc_size = 0)
+  {
+    const int numVertices = graph.getNumVertices();
+
+    // Link the vertices of every edge
+    std::vector<std::atomic<int> > parents (numVertices);
+    for (int vtxId = 0; vtxId < numVertices; vtxId++)
+      parents[vtxId].store(vtxId, std::memory_order_relaxed);
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int edgeId = 0; edgeId < graph.getNumEdges(); edgeId++)
+    {
+      int vtx1Id, vtx2Id;
+      float weight;
+      if (graph.getEdge(edgeId, vtx1Id, vtx2Id, weight))
+        unionFindLink(parents, vtx1Id, vtx2Id);
+    }
+
+    // Label every vertex with its root
+    std::vector<int> labels (numVertices);
+    #pragma omp parallel for
+    for (int vtxId = 0; vtxId < numVertices; vtxId++)
+      labels[vtxId] = unionFindRoot(parents, vtxId);
+
+    // Count component sizes. Roots are the smallest vertices of their
+    // components, so components are created in the order of their roots
+    std::vector<int> ccIds (numVertices, -1);
+    std::vector<int> ccSizes;
+    for (int vtxId = 0; vtxId < numVertices; vtxId++)
+    {
+      if (labels[vtxId] == vtxId)
+      {
+        ccIds[vtxId] = ccSizes.size();
+        ccSizes.push_back(0);
+      }
+      ccSizes[ccIds[labels[vtxId]]]++;
+    }
+
+    // Collect valid components
+    std::vector<int> validCCIds (ccSizes.size(), -1);
+    utl::Map CCs;
+    for (size_t ccId = 0; ccId < ccSizes.size(); ccId++)
+    {
+      if (ccSizes[ccId] > min_cc_size)
+      {
+        validCCIds[ccId] = CCs.size();
+        CCs.push_back(std::vector<int> ());
+        CCs.back().reserve(ccSizes[ccId]);
+      }
+    }
+
+    for (int vtxId = 0; vtxId < numVertices; vtxId++)
+    {
+      const int validCCId = validCCIds[ccIds[labels[vtxId]]];
+      if (validCCId != -1)
+        CCs[validCCId].push_back(vtxId);
+    }
+
+    return CCs;
+  }
 }
     
 #endif    // GRAPH_ALGORITHMS_HPP
\ No newline at end of file
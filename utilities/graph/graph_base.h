@@ -70,6 +70,28 @@ namespace utl
     inline void
     preallocateVertices (const int num_vertices);
     
+    /** \brief Replace the graph with a set of edges. Edges are added in the
+     * order they are given and are assumed to be unique and not to be self
+     * loops, so no neighbor lists are searched.
+     *  \param[in]  num_vertices  number of vertices in the graph
+     *  \param[in]  edges         vertex pairs of the edges
+     *  \return false if an edge vertex is out of bounds
+     *  \note Existing graph data will be erased.
+     */
+    inline bool
+    setEdges (const int num_vertices, const std::vector<std::pair<int, int> > &edges);
+    
+    /** \brief Replace the graph with a set of edges. Edges are added in the
+     * order they are given and are assumed to be unique and not to be self
+     * loops, so no neighbor lists are searched.
+     *  \param[in]  num_vertices  number of vertices in the graph
+     *  \param[in]  edges         edges
+     *  \return false if an edge vertex is out of bounds
+     *  \note Existing graph data will be erased.
+     */
+    inline bool
+    setEdges (const int num_vertices, const std::vector<EdgeT> &edges);
+    
     /** \brief Get number of vertices in the graph.  */
     inline int
     getNumVertices () const;
@@ -100,6 +100,62 @@ inline void utl::GraphBase<VertexT, EdgeT>::preallocateVertices (const int num_v
   vertex_list_.resize(num_vertices);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+template <typename VertexT, typename EdgeT>
+inline bool utl::GraphBase<VertexT, EdgeT>::setEdges (const int num_vertices, const std::vector<std::pair<int, int> > &edges)
+{
+  std::vector<EdgeT> edgeList (edges.size());
+  for (size_t edgeId = 0; edgeId < edges.size(); edgeId++)
+  {
+    edgeList[edgeId].vtx1Id_ = edges[edgeId].first;
+    edgeList[edgeId].vtx2Id_ = edges[edgeId].second;
+  }
+  
+  return setEdges(num_vertices, edgeList);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename VertexT, typename EdgeT>
+inline bool utl::GraphBase<VertexT, EdgeT>::setEdges (const int num_vertices, const std::vector<EdgeT> &edges)
+{
+  preallocateVertices(num_vertices);
+  
+  std::vector<int> vertexDegrees (num_vertices, 0);
+  for (size_t edgeId = 0; edgeId < edges.size(); edgeId++)
+  {
+    const int vtx1Id = edges[edgeId].vtx1Id_;
+    const int vtx2Id = edges[edgeId].vtx2Id_;
+    if (vtx1Id < 0 || vtx1Id >= num_vertices || vtx2Id < 0 || vtx2Id >= num_vertices)
+    {
+      std::cout << "[utl::GraphBase::setEdges] edge vertex is out of bounds (vtx1: " << vtx1Id << ", vtx2: " << vtx2Id << ", num vertices: " << num_vertices << ")." << std::endl;
+      clear();
+      return false;
+    }
+    
+    vertexDegrees[vtx1Id]++;
+    vertexDegrees[vtx2Id]++;
+  }
+  
+  for (int vtxId = 0; vtxId < num_vertices; vtxId++)
+  {
+    vertex_list_[vtxId].neighbors_.reserve(vertexDegrees[vtxId]);
+    vertex_list_[vtxId].neighbor_edges_.reserve(vertexDegrees[vtxId]);
+  }
+  
+  edge_list_ = edges;
+  for (size_t edgeId = 0; edgeId < edges.size(); edgeId++)
+  {
+    const int vtx1Id = edges[edgeId].vtx1Id_;
+    const int vtx2Id = edges[edgeId].vtx2Id_;
+    vertex_list_[vtx1Id].neighbors_.push_back(vtx2Id);
+    vertex_list_[vtx1Id].neighbor_edges_.push_back(edgeId);
+    vertex_list_[vtx2Id].neighbors_.push_back(vtx1Id);
+    vertex_list_[vtx2Id].neighbor_edges_.push_back(edgeId);
+  }
+  
+  return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <typename VertexT, typename EdgeT>
 inline int utl::GraphBase<VertexT, EdgeT>::getNumVertices () const
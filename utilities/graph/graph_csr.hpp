@@ -0,0 +1,336 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef GRAPH_CSR_HPP
+#define GRAPH_CSR_HPP
+
+// STD includes
+#include <iostream>
+#include <vector>
+
+// Utilities includes
+#include <graph/graph_base.hpp>
+#include <graph/graph_primitives.hpp>
+
+namespace utl
+{
+  /** \brief Data structure representing an immutable undirected weighted graph
+   * in compressed sparse row format. The neighbors of a vertex are stored in a
+   * contiguous range of a single array, together with the indices of the
+   * corresponding edges. Edge vertices and weights are stored in flat arrays
+   * indexed by edge id. Vertex, neighbor and edge order is the same as in the
+   * graph it was compacted from, so algorithms visit vertices and edges in the
+   * same order on both.
+   *
+   * Graphs are built once and then only read, e.g. the adjacency of a
+   * pointcloud or the binary potentials of a segmentation. Compacting a
+   * utl::GraphBase replaces the per vertex neighbor vectors with two arrays and
+   * makes edge lookups from a neighbor position O(1).
+   */
+  class GraphCSR
+  {
+  public:
+
+    /** \brief Empty constructor. */
+    GraphCSR ()
+      : vertex_offsets_ (1, 0)
+    { }
+
+    /** \brief Constructor that compacts a graph.
+     *  \param[in]  graph   graph
+     */
+    template <typename VertexT, typename EdgeT>
+    explicit GraphCSR (const utl::GraphBase<VertexT, EdgeT> &graph)
+    {
+      setGraph(graph);
+    }
+
+    /** \brief Compact a graph. Edges of graphs without edge weights get a
+     * weight of 1.
+     *  \param[in]  graph   graph
+     */
+    template <typename VertexT, typename EdgeT>
+    inline void
+    setGraph (const utl::GraphBase<VertexT, EdgeT> &graph)
+    {
+      const int numVertices = graph.getNumVertices();
+      const int numEdges = graph.getNumEdges();
+
+      // Edges
+      edge_vertices_.resize(2 * numEdges);
+      edge_weights_.resize(numEdges);
+      for (int edgeId = 0; edgeId < numEdges; edgeId++)
+      {
+        EdgeT edge;
+        graph.getEdge(edgeId, edge);
+        edge_vertices_[2 * edgeId]     = edge.vtx1Id_;
+        edge_vertices_[2 * edgeId + 1] = edge.vtx2Id_;
+        edge_weights_[edgeId] = getEdgeWeightValue(edge);
+      }
+
+      // Adjacency
+      vertex_offsets_.resize(numVertices + 1);
+      vertex_offsets_[0] = 0;
+      neighbors_.resize(2 * numEdges);
+      neighbor_edges_.resize(2 * numEdges);
+      VertexT vertex;
+      for (int vtxId = 0; vtxId < numVertices; vtxId++)
+      {
+        graph.getVertex(vtxId, vertex);
+        const int vtxOffset = vertex_offsets_[vtxId];
+        for (size_t nbrIt = 0; nbrIt < vertex.neighbors_.size(); nbrIt++)
+        {
+          neighbors_[vtxOffset + nbrIt] = vertex.neighbors_[nbrIt];
+          neighbor_edges_[vtxOffset + nbrIt] = vertex.neighbor_edges_[nbrIt];
+        }
+        vertex_offsets_[vtxId + 1] = vtxOffset + vertex.neighbors_.size();
+      }
+    }
+
+    /** \brief Build the graph from a set of edges. Edges are assumed to be
+     * unique and not to be self loops. The neighbors of every vertex are
+     * stored in the order of the edges, i.e. sorted if the edges are sorted.
+     *  \param[in]  num_vertices  number of vertices in the graph
+     *  \param[in]  edges         vertex pairs of the edges
+     *  \param[in]  weights       edge weights. If empty all edges get a weight of 1.
+     *  \return false if an edge vertex is out of bounds or the number of weights is wrong
+     */
+    inline bool
+    setEdges  ( const int num_vertices,
+                const std::vector<std::pair<int, int> > &edges,
+                const std::vector<float> &weights = std::vector<float> ()
+              )
+    {
+      clear();
+
+      if (!weights.empty() && weights.size() != edges.size())
+      {
+        std::cout << "[utl::GraphCSR::setEdges] number of weights is different from the number of edges ( weights: " << weights.size() << ", edges: " << edges.size() << ")." << std::endl;
+        return false;
+      }
+
+      // Edges
+      const int numEdges = edges.size();
+      edge_vertices_.resize(2 * numEdges);
+      vertex_offsets_.assign(num_vertices + 1, 0);
+      for (int edgeId = 0; edgeId < numEdges; edgeId++)
+      {
+        const int vtx1Id = edges[edgeId].first;
+        const int vtx2Id = edges[edgeId].second;
+        if (vtx1Id < 0 || vtx1Id >= num_vertices || vtx2Id < 0 || vtx2Id >= num_vertices)
+        {
+          std::cout << "[utl::GraphCSR::setEdges] edge vertex is out of bounds ( vtx1: " << vtx1Id << ", vtx2: " << vtx2Id << ", num vertices: " << num_vertices << ")." << std::endl;
+          clear();
+          return false;
+        }
+
+        edge_vertices_[2 * edgeId]     = vtx1Id;
+        edge_vertices_[2 * edgeId + 1] = vtx2Id;
+        vertex_offsets_[vtx1Id + 1]++;
+        vertex_offsets_[vtx2Id + 1]++;
+      }
+
+      if (weights.empty())
+        edge_weights_.assign(numEdges, 1.0f);
+      else
+        edge_weights_ = weights;
+
+      // Adjacency
+      for (int vtxId = 0; vtxId < num_vertices; vtxId++)
+        vertex_offsets_[vtxId + 1] += vertex_offsets_[vtxId];
+
+      neighbors_.resize(2 * numEdges);
+      neighbor_edges_.resize(2 * numEdges);
+      std::vector<int> vertexFill (vertex_offsets_.begin(), vertex_offsets_.end() - 1);
+      for (int edgeId = 0; edgeId < numEdges; edgeId++)
+      {
+        const int vtx1Id = edge_vertices_[2 * edgeId];
+        const int vtx2Id = edge_vertices_[2 * edgeId + 1];
+        neighbors_[vertexFill[vtx1Id]] = vtx2Id;
+        neighbor_edges_[vertexFill[vtx1Id]++] = edgeId;
+        neighbors_[vertexFill[vtx2Id]] = vtx1Id;
+        neighbor_edges_[vertexFill[vtx2Id]++] = edgeId;
+      }
+
+      return true;
+    }
+
+    /** \brief Remove all vertices and edges from the graph. */
+    inline void
+    clear ()
+    {
+      vertex_offsets_.assign(1, 0);
+      neighbors_.clear();
+      neighbor_edges_.clear();
+      edge_vertices_.clear();
+      edge_weights_.clear();
+    }
+
+    /** \brief Get number of vertices in the graph. */
+    inline int
+    getNumVertices () const  { return vertex_offsets_.size() - 1; }
+
+    /** \brief Get number of edges in the graph. */
+    inline int
+    getNumEdges () const  { return edge_weights_.size(); }
+
+    /** \brief Get number of neighbors of a vertex.
+     *  \param[in]  vtx_id  vertex index
+     *  \return number of neighbors, -1 if vertex is out of bounds
+     */
+    inline int
+    getNumVertexNeighbors (const int vtx_id) const
+    {
+      if (vtx_id < 0 || vtx_id >= getNumVertices())
+        return -1;
+
+      return vertex_offsets_[vtx_id + 1] - vertex_offsets_[vtx_id];
+    }
+
+    /** \brief Get the neighbor of a vertex at the given position of its
+     * neighbor list. No bounds checking is done.
+     *  \param[in]  vtx_id  vertex index
+     *  \param[in]  nbr_it  neighbor position
+     *  \return neighbor vertex index
+     */
+    inline int
+    getVertexNeighbor (const int vtx_id, const int nbr_it) const  { return neighbors_[vertex_offsets_[vtx_id] + nbr_it]; }
+
+    /** \brief Get the edge connecting a vertex to the neighbor at the given
+     * position of its neighbor list. No bounds checking is done.
+     *  \param[in]  vtx_id  vertex index
+     *  \param[in]  nbr_it  neighbor position
+     *  \return edge index
+     */
+    inline int
+    getVertexNeighborEdge (const int vtx_id, const int nbr_it) const  { return neighbor_edges_[vertex_offsets_[vtx_id] + nbr_it]; }
+
+    /** \brief Get pointers to the neighbor and neighbor edge ranges of a
+     * vertex. No bounds checking is done.
+     *  \param[in]  vtx_id          vertex index
+     *  \param[out] neighbors       first neighbor of the vertex
+     *  \param[out] neighbor_edges  first neighbor edge of the vertex
+     *  \return number of neighbors
+     */
+    inline int
+    getVertexNeighborRange (const int vtx_id, const int *&neighbors, const int *&neighbor_edges) const
+    {
+      const int vtxOffset = vertex_offsets_[vtx_id];
+      neighbors = neighbors_.data() + vtxOffset;
+      neighbor_edges = neighbor_edges_.data() + vtxOffset;
+      return vertex_offsets_[vtx_id + 1] - vtxOffset;
+    }
+
+    /** \brief Get the neighbors of a vertex.
+     *  \param[in]  vtx_id      vertex index
+     *  \param[out] neighbors   neighbor vertex indices
+     *  \return false if vertex is out of bounds
+     */
+    inline bool
+    getVertexNeighbors (const int vtx_id, std::vector<int> &neighbors) const
+    {
+      if (vtx_id < 0 || vtx_id >= getNumVertices())
+      {
+        std::cout << "[utl::GraphCSR::getVertexNeighbors] requested vertex id is out of bounds ( vtx id: " << vtx_id << ")," << std::endl;
+        return false;
+      }
+
+      neighbors.assign(neighbors_.begin() + vertex_offsets_[vtx_id], neighbors_.begin() + vertex_offsets_[vtx_id + 1]);
+      return true;
+    }
+
+    /** \brief Get the index of the edge between two vertices. The neighbor
+     * list of the first vertex is searched.
+     *  \param[in]  vtx1_id   index of first vertex
+     *  \param[in]  vtx2_id   index of second vertex
+     *  \param[out] edge_id   edge index, -1 if the edge does not exist
+     *  \return false if the edge does not exist
+     */
+    inline bool
+    getEdgeId (const int vtx1_id, const int vtx2_id, int &edge_id) const
+    {
+      edge_id = -1;
+      if (vtx1_id < 0 || vtx1_id >= getNumVertices())
+        return false;
+
+      for (int nbrPos = vertex_offsets_[vtx1_id]; nbrPos < vertex_offsets_[vtx1_id + 1]; nbrPos++)
+      {
+        if (neighbors_[nbrPos] == vtx2_id)
+        {
+          edge_id = neighbor_edges_[nbrPos];
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    /** \brief Get edge at specified index.
+     *  \param[in]  edge_id   edge index
+     *  \param[out] vtx1_id   index of first vertex
+     *  \param[out] vtx2_id   index of second vertex
+     *  \param[out] weight    weight of the edge
+     *  \return false if requested edge id is out of bounds
+     */
+    inline bool
+    getEdge (const int edge_id, int &vtx1_id, int &vtx2_id, float &weight) const
+    {
+      if (edge_id < 0 || edge_id >= getNumEdges())
+      {
+        std::cout << "[utl::GraphCSR::getEdge] requested edge is out of bounds ( edge id: " << edge_id << ")," << std::endl;
+        return false;
+      }
+
+      vtx1_id = edge_vertices_[2 * edge_id];
+      vtx2_id = edge_vertices_[2 * edge_id + 1];
+      weight  = edge_weights_[edge_id];
+      return true;
+    }
+
+    /** \brief Get the vertices of an edge.
+     *  \param[in]  edge_id   edge index
+     *  \param[out] vtx1_id   index of first vertex
+     *  \param[out] vtx2_id   index of second vertex
+     *  \return false if requested edge id is out of bounds
+     */
+    inline bool
+    getEdgeVertexIds (const int edge_id, int &vtx1_id, int &vtx2_id) const
+    {
+      float weight;
+      return getEdge(edge_id, vtx1_id, vtx2_id, weight);
+    }
+
+    /** \brief Get the weight of an edge. No bounds checking is done.
+     *  \param[in]  edge_id   edge index
+     *  \return edge weight
+     */
+    inline float
+    getEdgeWeight (const int edge_id) const  { return edge_weights_[edge_id]; }
+
+  private:
+
+    /** \brief Get the weight of an edge. */
+    static inline float
+    getEdgeWeightValue (const utl::EdgeWeighted &edge)  { return edge.weight_; }
+
+    /** \brief Get the weight of an unweighted edge. */
+    template <typename EdgeT>
+    static inline float
+    getEdgeWeightValue (const EdgeT&)  { return 1.0f; }
+
+    /** \brief Position of the first neighbor of every vertex, followed by the
+     * total number of neighbors. */
+    std::vector<int> vertex_offsets_;
+
+    /** \brief Neighbor vertices and the corresponding edges. */
+    std::vector<int> neighbors_;
+    std::vector<int> neighbor_edges_;
+
+    /** \brief Vertex pairs and weights of the edges. */
+    std::vector<int>   edge_vertices_;
+    std::vector<float> edge_weights_;
+  };
+}
+
+#endif  // GRAPH_CSR_HPP
@@ -6,54 +6,306 @@
 #define MIN_CUT_HPP
 
 // Boost includes
-#include <boost/graph/adjacency_list.hpp>
+#include <boost/graph/compressed_sparse_row_graph.hpp>
 #include <boost/graph/boykov_kolmogorov_max_flow.hpp>
 
 // Utilities includes
 #include <graph/graph_weighted.hpp>
+#include <graph/graph_csr.hpp>
+#include <profiling.hpp>
 
-// Typedefs
-// NOTE! This should be moved inside the functions, so that they don't spread these typedefs outside this function.
-// The likely solution is to put the whole mincut algorithm into it's own class
-typedef boost::adjacency_list_traits  < boost::vecS, boost::vecS, boost::directedS > Traits;
-typedef boost::adjacency_list         < boost::vecS,                                                                            // Container used for vertices
-                                        boost::vecS,                                                                            // Container used for edges
-                                        boost::directedS,                                                                       // Directional graph
-                                        boost::property < boost::vertex_name_t, std::string,                                    // Vertex properties
-                                        boost::property < boost::vertex_index_t, long,
-                                        boost::property < boost::vertex_color_t, boost::default_color_type,
-                                        boost::property < boost::vertex_distance_t, long,
-                                        boost::property < boost::vertex_predecessor_t, Traits::edge_descriptor > > > > >,
-
-                                        boost::property < boost::edge_capacity_t, float,                                       // Edge properties
-                                        boost::property < boost::edge_residual_capacity_t, float,
-                                        boost::property < boost::edge_reverse_t, Traits::edge_descriptor > > > > GraphBoost;
-
-typedef boost::property_map< GraphBoost, boost::edge_capacity_t >::type CapacityMap;
-typedef boost::property_map< GraphBoost, boost::edge_reverse_t>::type ReverseEdgeMap;
-typedef boost::property_map< GraphBoost, boost::vertex_color_t, boost::default_color_type>::type VertexColorMap;
-
-////////////////////////////////////////////////////////////////////////////////
-bool addEdge (Traits::vertex_descriptor &v1, Traits::vertex_descriptor &v2, GraphBoost &graph, const float weight, CapacityMap &capacity_map, ReverseEdgeMap &reverse_edge_map)
-{
-  Traits::edge_descriptor edge, reverse_edge;
-  bool edge_was_added, reverse_edge_was_added;
-
-  boost::tie (edge, edge_was_added) = boost::add_edge ( v1, v2, graph );
-  boost::tie (reverse_edge, reverse_edge_was_added) = boost::add_edge ( v2, v1, graph );
-  if ( !edge_was_added || !reverse_edge_was_added )
-    return (false);
-  
-  capacity_map[edge] = weight;
-  capacity_map[reverse_edge] = weight;
-  reverse_edge_map[edge] = reverse_edge;
-  reverse_edge_map[reverse_edge] = edge;
-  
-  return true;
-}
-                                    
 namespace utl
 {
+  /** \brief @b MinCutSolver Min cut solver for graphs whose binary potentials
+   * stay fixed over several cuts while the unary potentials change.
+   * The graph is built once in compressed sparse row form: every vertex is
+   * connected to the source and the sink and to its neighbours in the binary
+   * potential graph. All edges come in pairs of opposite directions with equal
+   * capacities. Capacities, residual capacities and the vertex maps used by
+   * the Boykov-Kolmogorov max flow algorithm are allocated once. Setting the
+   * unary potentials only replaces the capacities of the terminal edges.
+   * In dynamic mode the flow of the previous cut is reused (Kohli and Torr,
+   * "Dynamic Graph Cuts for Efficient Inference in Markov Random Fields"). New
+   * terminal capacities are applied to the residual graph of the previous
+   * cut. Terminal edges that would get a negative residual capacity are
+   * repaired by adding the same constant to the source and sink capacities of
+   * their vertex, which does not change the minimum cut. Max flow then only
+   * has to push the flow that changed. When the minimum cut is not unique a
+   * dynamic cut may pick a different one than a cut from scratch.
+   * A solver must not be used by more than one thread at a time. Copy it to
+   * cut graphs with the same binary potentials in parallel.
+   */
+  class MinCutSolver
+  {
+  public:
+
+    typedef boost::compressed_sparse_row_graph<boost::directedS>  FlowGraph;
+    typedef boost::graph_traits<FlowGraph>::vertex_descriptor     VertexDescriptor;
+    typedef boost::graph_traits<FlowGraph>::edge_descriptor       EdgeDescriptor;
+
+    /** \brief Empty constructor. */
+    MinCutSolver ()
+      : num_vertices_ (0)
+      , dynamic_ (false)
+      , has_flow_ (false)
+      , flow_offset_ (0.0)
+    { }
+
+    /** \brief Enable or disable dynamic mode. When enabled, every cut reuses the
+     * flow of the previous cut.
+     *  \param[in]  dynamic  dynamic mode flag
+     */
+    inline void
+    setDynamic (const bool dynamic)  { dynamic_ = dynamic; }
+
+    /** \brief Build the graph from the binary potentials. Unary potentials are
+     * set to zero. Binary potentials can be a utl::GraphWeighted or a
+     * utl::GraphCSR.
+     *  \param[in]  binary_potentials   binary potential structure and weights
+     *  \return FALSE if an edge of the binary potentials could not be read
+     */
+    template <typename GraphT>
+    inline bool
+    setBinaryPotentials (const GraphT &binary_potentials)
+    {
+      num_vertices_ = binary_potentials.getNumVertices();
+      const int numBinaryEdges = binary_potentials.getNumEdges();
+      const VertexDescriptor source = num_vertices_, sink = num_vertices_ + 1;
+
+      // Generate the edges. Every vertex is connected to the source and sink,
+      // followed by the binary edges. Edges are generated in the same order as
+      // they used to be added to an adjacency list, so that the out edges of
+      // every vertex are visited in the same order by the max flow.
+      std::vector<std::pair<VertexDescriptor, VertexDescriptor> > edges;
+      std::vector<float> weights;
+      edges.reserve(4 * num_vertices_ + 2 * numBinaryEdges);
+      weights.reserve(4 * num_vertices_ + 2 * numBinaryEdges);
+      for (int vtxId = 0; vtxId < num_vertices_; vtxId++)
+      {
+        addEdgePair(vtxId, source, 0.0f, edges, weights);
+        addEdgePair(vtxId, sink,   0.0f, edges, weights);
+      }
+
+      for (int edgeId = 0; edgeId < numBinaryEdges; edgeId++)
+      {
+        int vtx1Id, vtx2Id;
+        float weight;
+        if (!binary_potentials.getEdge(edgeId, vtx1Id, vtx2Id, weight))
+        {
+          std::cout << "[utl::MinCutSolver::setBinaryPotentials] could not get binary edge " << edgeId << "." << std::endl;
+          num_vertices_ = 0;
+          return false;
+        }
+        addEdgePair(vtx1Id, vtx2Id, weight, edges, weights);
+      }
+
+      // Stable sort the edges by their source vertex
+      std::vector<int> edgeOffsets (num_vertices_ + 3, 0);
+      for (size_t edgeId = 0; edgeId < edges.size(); edgeId++)
+        edgeOffsets[edges[edgeId].first + 1]++;
+      for (int vtxId = 0; vtxId < num_vertices_ + 2; vtxId++)
+        edgeOffsets[vtxId + 1] += edgeOffsets[vtxId];
+
+      std::vector<int> edgePositions (edges.size());
+      std::vector<std::pair<VertexDescriptor, VertexDescriptor> > edgesSorted (edges.size());
+      for (size_t edgeId = 0; edgeId < edges.size(); edgeId++)
+      {
+        edgePositions[edgeId] = edgeOffsets[edges[edgeId].first]++;
+        edgesSorted[edgePositions[edgeId]] = edges[edgeId];
+      }
+
+      graph_ = FlowGraph (boost::edges_are_sorted, edgesSorted.begin(), edgesSorted.end(), num_vertices_ + 2);
+
+      // Edge properties are indexed by the position of the edge in the graph
+      capacity_.resize(edges.size());
+      residual_capacity_.resize(edges.size());
+      reverse_edges_.resize(edges.size());
+      for (size_t edgeId = 0; edgeId < edges.size(); edgeId++)
+      {
+        const size_t reverseEdgeId = edgeId ^ 1;
+        capacity_[edgePositions[edgeId]] = weights[edgeId];
+        reverse_edges_[edgePositions[edgeId]] = EdgeDescriptor(edges[reverseEdgeId].first, edgePositions[reverseEdgeId]);
+      }
+
+      terminal_edge_ids_.resize(4 * num_vertices_);
+      for (int vtxId = 0; vtxId < num_vertices_; vtxId++)
+        for (int terminalEdgeId = 0; terminalEdgeId < 4; terminalEdgeId++)
+          terminal_edge_ids_[4 * vtxId + terminalEdgeId] = edgePositions[4 * vtxId + terminalEdgeId];
+
+      has_flow_ = false;
+      colors_.resize(num_vertices_ + 2);
+      distances_.resize(num_vertices_ + 2);
+      predecessors_.resize(num_vertices_ + 2);
+
+      return true;
+    }
+
+    /** \brief Set the unary potentials.
+     *  \param[in]  source_potentials   weights between nodes and source node
+     *  \param[in]  sink_potentials     weights between nodes and sink node
+     *  \return FALSE if the number of potentials does not match the number of vertices in the graph
+     */
+    inline bool
+    setUnaryPotentials  ( const std::vector<float> &source_potentials,
+                          const std::vector<float> &sink_potentials
+                        )
+    {
+      if (!  (source_potentials.size() == sink_potentials.size() &&
+              source_potentials.size() == static_cast<size_t>(num_vertices_)))
+      {
+        std::cout << "[utl::MinCutSolver::setUnaryPotentials] number of vertices in source potentials, sink potentials and binary potentials are not equal." << std::endl;
+        return false;
+      }
+
+      for (int vtxId = 0; vtxId < num_vertices_; vtxId++)
+      {
+        capacity_[terminal_edge_ids_[4 * vtxId + 0]] = source_potentials[vtxId];
+        capacity_[terminal_edge_ids_[4 * vtxId + 1]] = source_potentials[vtxId];
+        capacity_[terminal_edge_ids_[4 * vtxId + 2]] = sink_potentials[vtxId];
+        capacity_[terminal_edge_ids_[4 * vtxId + 3]] = sink_potentials[vtxId];
+      }
+
+      if (!dynamic_ || !has_flow_)
+        return true;
+
+      // Apply the new terminal capacities to the residual graph of the previous
+      // cut. Opposite edges of a pair have equal capacities, so the flow
+      // through a pair is half the difference of their residual capacities.
+      dynamic_capacity_ = residual_capacity_;
+      flow_offset_ = 0.0;
+      for (int vtxId = 0; vtxId < num_vertices_; vtxId++)
+      {
+        const int toSourceId = terminal_edge_ids_[4 * vtxId + 0], fromSourceId  = terminal_edge_ids_[4 * vtxId + 1];
+        const int toSinkId   = terminal_edge_ids_[4 * vtxId + 2], fromSinkId    = terminal_edge_ids_[4 * vtxId + 3];
+        const float sourceFlow = (residual_capacity_[toSourceId] - residual_capacity_[fromSourceId]) / 2.0f;
+        const float sinkFlow   = (residual_capacity_[fromSinkId] - residual_capacity_[toSinkId]) / 2.0f;
+
+        float residualToSource   = source_potentials[vtxId] + sourceFlow;
+        float residualFromSource = source_potentials[vtxId] - sourceFlow;
+        float residualToSink     = sink_potentials[vtxId] - sinkFlow;
+        float residualFromSink   = sink_potentials[vtxId] + sinkFlow;
+
+        // Every cut separates a vertex from exactly one terminal, so adding a
+        // constant to both terminal capacities adds it to every cut
+        const float repair = std::max(0.0f, -std::min(std::min(residualToSource, residualFromSource), std::min(residualToSink, residualFromSink)));
+        residualToSource    += repair;
+        residualFromSource  += repair;
+        residualToSink      += repair;
+        residualFromSink    += repair;
+
+        dynamic_capacity_[toSourceId]   = residualToSource;
+        dynamic_capacity_[fromSourceId] = residualFromSource;
+        dynamic_capacity_[toSinkId]     = residualToSink;
+        dynamic_capacity_[fromSinkId]   = residualFromSink;
+        flow_offset_ += sourceFlow - repair;
+      }
+
+      return true;
+    }
+
+    /** \brief Get the number of vertices of the graph (excluding the source and the sink). */
+    inline int
+    getNumVertices () const  { return num_vertices_; }
+
+    /** \brief Cut the graph with the current potentials.
+     *  \param[out] source_points       points belonging to source
+     *  \param[out] sink_points         points belonging to sink
+     *  \return maximum flow
+     */
+    inline double
+    solve (std::vector<int> &source_points, std::vector<int> &sink_points)
+    {
+      const VertexDescriptor source = num_vertices_, sink = num_vertices_ + 1;
+
+      UTL_PROFILE_COUNT(utl::PROFILE_MINCUT_GRAPHS, 1);
+      UTL_PROFILE_COUNT(utl::PROFILE_MINCUT_VERTICES, num_vertices_);
+      UTL_PROFILE_COUNT(utl::PROFILE_MINCUT_EDGES, boost::num_edges(graph_));
+
+      boost::property_map<FlowGraph, boost::edge_index_t>::type edgeIndexMap = boost::get(boost::edge_index, graph_);
+      boost::property_map<FlowGraph, boost::vertex_index_t>::type vertexIndexMap = boost::get(boost::vertex_index, graph_);
+
+      // In dynamic mode the residual graph of the previous cut with repaired
+      // terminal capacities is cut
+      const bool reuseFlow = dynamic_ && has_flow_;
+      std::vector<float> &capacity = reuseFlow ? dynamic_capacity_ : capacity_;
+
+      double flow = boost::boykov_kolmogorov_max_flow ( graph_,
+                                                        boost::make_iterator_property_map(capacity.begin(), edgeIndexMap),
+                                                        boost::make_iterator_property_map(residual_capacity_.begin(), edgeIndexMap),
+                                                        boost::make_iterator_property_map(reverse_edges_.begin(), edgeIndexMap),
+                                                        boost::make_iterator_property_map(predecessors_.begin(), vertexIndexMap),
+                                                        boost::make_iterator_property_map(colors_.begin(), vertexIndexMap),
+                                                        boost::make_iterator_property_map(distances_.begin(), vertexIndexMap),
+                                                        vertexIndexMap,
+                                                        source,
+                                                        sink
+                                                      );
+
+      if (reuseFlow)
+        flow += flow_offset_;
+      has_flow_ = dynamic_;
+
+      source_points.clear();
+      sink_points.clear();
+
+      for (int vtxId = 0; vtxId < num_vertices_; vtxId++)
+      {
+        if (colors_[vtxId] == boost::white_color)
+          source_points.push_back(vtxId);
+        else
+          sink_points.push_back(vtxId);
+      }
+
+      return flow;
+    }
+
+  private:
+
+    /** \brief Add a pair of opposite edges with the same capacity to an edge list. */
+    static inline void
+    addEdgePair ( const VertexDescriptor vtx1,
+                  const VertexDescriptor vtx2,
+                  const float weight,
+                  std::vector<std::pair<VertexDescriptor, VertexDescriptor> > &edges,
+                  std::vector<float> &weights
+                )
+    {
+      edges.push_back(std::make_pair(vtx1, vtx2));
+      edges.push_back(std::make_pair(vtx2, vtx1));
+      weights.push_back(weight);
+      weights.push_back(weight);
+    }
+
+    /** \brief Number of vertices excluding the source and the sink. */
+    int num_vertices_;
+
+    /** \brief Graph. */
+    FlowGraph graph_;
+
+    /** \brief Edge capacities, residual capacities and reverse edges. */
+    std::vector<float> capacity_;
+    std::vector<float> residual_capacity_;
+    std::vector<EdgeDescriptor> reverse_edges_;
+
+    /** \brief Capacities of the residual graph cut in dynamic mode. */
+    std::vector<float> dynamic_capacity_;
+
+    /** \brief Dynamic mode flag and whether the residual capacities hold the flow of a previous cut. */
+    bool dynamic_;
+    bool has_flow_;
+
+    /** \brief Flow of the previous cut under the current capacities minus the terminal repairs. */
+    double flow_offset_;
+
+    /** \brief Positions of the edges to and from the source and to and from the sink of every vertex. */
+    std::vector<int> terminal_edge_ids_;
+
+    /** \brief Vertex maps used by the max flow. */
+    std::vector<boost::default_color_type> colors_;
+    std::vector<long> distances_;
+    std::vector<EdgeDescriptor> predecessors_;
+  };
+
   /** \brief Perform a min cut on a graph
    *  \param[in]  source_potentials   weights between nodes and source node
    *  \param[in]  sink_potentials     weights between nodes and sink node
@@ -61,89 +313,40 @@ namespace utl
    *  \param[out] source_points       points belonging to source
    *  \param[out] sink_points         points belonging to sink
    */
-  double mincut ( const std::vector<float> &source_potentials, 
+  template <typename GraphT>
+  inline
+  double mincut ( const std::vector<float> &source_potentials,
                   const std::vector<float> &sink_potentials,
-                  const utl::GraphWeighted &binary_potentials,
+                  const GraphT &binary_potentials,
                   std::vector<int> &source_points,
                   std::vector<int> &sink_points
                 )
   {
     ////////////////////////////////////////////////////////////////////////////
     // Check input
-    if (! (   (source_potentials.size() == sink_potentials.size()) && 
+    if (! (   (source_potentials.size() == sink_potentials.size()) &&
               (source_potentials.size() == binary_potentials.getNumVertices())))
     {
       std::cout << "[utl::minCut] number of vertices in source potentials, sink potentials and binary potentials are not equal." << std::endl;
       return -1.0;
     }
-    
+
     ////////////////////////////////////////////////////////////////////////////
     // Build graph
-    
-    int numVertices = source_potentials.size();
-    GraphBoost graph;
-    std::vector< Traits::vertex_descriptor > vertices;
-    Traits::vertex_descriptor source;
-    Traits::vertex_descriptor sink;
-    CapacityMap capacity          = boost::get (boost::edge_capacity, graph);
-    ReverseEdgeMap reverseEdgeMap = boost::get (boost::edge_reverse, graph);
-    VertexColorMap vertexColorMap = boost::get (boost::vertex_color, graph);
-
-      // Add vertices
-    vertices.resize(numVertices + 2);
-    for (size_t i = 0; i < static_cast<size_t>(numVertices + 2); i++)
-      vertices[i] = boost::add_vertex(graph);
-    
-    source  = vertices[source_potentials.size()];
-    sink    = vertices[source_potentials.size()+1];
-    
-    // Add source and sink edges
-    for (size_t i = 0; i < static_cast<size_t>(numVertices); i++)
-    {
-      addEdge(vertices[i], source, graph, source_potentials[i], capacity, reverseEdgeMap);
-      addEdge(vertices[i], sink,   graph, sink_potentials[i], capacity, reverseEdgeMap);
-    }
-    
-    // Add binary edges
-    for (size_t edgeId = 0; edgeId < binary_potentials.getNumEdges(); edgeId++)
+
+    MinCutSolver solver;
+    if (!solver.setBinaryPotentials(binary_potentials))
     {
-      // Get edge information
-      int vtx1Id, vtx2Id;
-      float weight;
-      
-      if (!binary_potentials.getEdge(edgeId, vtx1Id, vtx2Id, weight))
-      {
-        std::cout << "[utl::minCut] could not add binary edges to Boost graph." << std::endl;
-        abort();        
-      }
-      
-      // Add it to Boost graph
-      Traits::vertex_descriptor v1 = vertices[vtx1Id];
-      Traits::vertex_descriptor v2 = vertices[vtx2Id];
-      addEdge(v1, v2, graph, weight, capacity, reverseEdgeMap);      
+      std::cout << "[utl::minCut] could not add binary edges to the graph." << std::endl;
+      abort();
     }
-        
-    ////////////////////////////////////////////////////////////////////////////
-    // Compute maximim flow
-    
-    double flow = boost::boykov_kolmogorov_max_flow(graph, source, sink);
-    
+    solver.setUnaryPotentials(source_potentials, sink_potentials);
+
     ////////////////////////////////////////////////////////////////////////////
-    // Find foreground and background points
-    
-    source_points.clear();
-    sink_points.clear();
-    
-    for (size_t i = 0; i < static_cast<size_t>(numVertices); i++)
-    {    
-      if (vertexColorMap(vertices[i]) == 0)
-        source_points.push_back(i);
-      else
-        sink_points.push_back(i);
-    }
-    
-    return flow;
+    // Compute maximim flow and find foreground and background points
+
+    return solver.solve(source_points, sink_points);
   }
 }
 
-# endif // MIN_CUT_HPP
\ No newline at end of file
+# endif // MIN_CUT_HPP
@@ -0,0 +1,59 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef HASH_UTILITIES_HPP
+#define HASH_UTILITIES_HPP
+
+#include <stdint.h>
+#include <string>
+
+// Utilities includes
+#include <filesystem/mapped_file.hpp>
+
+namespace utl
+{
+  /** \brief Initial value of the 64 bit FNV-1a hash. */
+  const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+  /** \brief Update a 64 bit FNV-1a hash with a block of memory. Hashes of
+   * several blocks can be combined by passing the hash of the previous block
+   * as the seed.
+   *  \param[in]  data    pointer to the data
+   *  \param[in]  size    size of the data in bytes
+   *  \param[in]  seed    hash value to start from
+   *  \return updated hash value
+   */
+  inline
+  uint64_t hashBytes (const void *data, const size_t size, const uint64_t seed = HASH_SEED)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+      hash ^= static_cast<uint64_t>(bytes[i]);
+      hash *= 1099511628211ULL;
+    }
+
+    return hash;
+  }
+
+  /** \brief Compute a 64 bit FNV-1a hash of the contents of a file.
+   *  \param[in]  filename    file name
+   *  \param[out] hash        hash of the file contents
+   *  \param[in]  seed        hash value to start from
+   *  \return FALSE if file could not be read
+   */
+  inline
+  bool hashFile (const std::string &filename, uint64_t &hash, const uint64_t seed = HASH_SEED)
+  {
+    utl::MappedFile file;
+    if (!file.open(filename))
+      return false;
+
+    hash = hashBytes(file.data(), file.size(), seed);
+    return true;
+  }
+}
+
+#endif    // HASH_UTILITIES_HPP
@@ -0,0 +1,136 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef CLOUD_SOA_HPP
+#define CLOUD_SOA_HPP
+
+// STD includes
+#include <vector>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/StdVector>
+
+// PCL includes
+#include <pcl/point_cloud.h>
+
+namespace utl
+{
+  /** \brief @b PointCloudSoA Structure of arrays view of the points and
+   * normals of a pointcloud. Point coordinates and normal components are
+   * copied into six separate aligned float arrays, so that kernels that only
+   * need the geometry of the points do not have to stream the full point
+   * structures (colors, curvature, padding) through the cache. The view is a
+   * copy: it has to be rebuilt if the input cloud changes.
+   */
+  class PointCloudSoA
+  {
+  public:
+
+    typedef std::vector<float, Eigen::aligned_allocator<float> > FloatVector;
+
+    /** \brief Empty constructor. */
+    PointCloudSoA ()
+    { }
+
+    /** \brief Constructor from a pointcloud.
+     *  \param[in]  cloud   input cloud
+     */
+    template <typename PointT>
+    explicit PointCloudSoA (const pcl::PointCloud<PointT> &cloud)
+    {
+      setInputCloud(cloud);
+    }
+
+    /** \brief Copy the points and normals of a pointcloud.
+     *  \param[in]  cloud   input cloud
+     */
+    template <typename PointT>
+    inline void
+    setInputCloud (const pcl::PointCloud<PointT> &cloud)
+    {
+      resize(cloud.size());
+      for (size_t pointId = 0; pointId < cloud.size(); pointId++)
+        setPoint(pointId, cloud.points[pointId]);
+    }
+
+    /** \brief Copy the points and normals of a subset of a pointcloud. Points
+     * of the view are ordered as the indices.
+     *  \param[in]  cloud     input cloud
+     *  \param[in]  indices   indices of the points to copy
+     */
+    template <typename PointT>
+    inline void
+    setInputCloud (const pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices)
+    {
+      resize(indices.size());
+      for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
+        setPoint(pointIdIt, cloud.points[indices[pointIdIt]]);
+    }
+
+    /** \brief Remove all points. */
+    inline void
+    clear ()
+    {
+      resize(0);
+    }
+
+    /** \brief Get the number of points. */
+    inline size_t
+    size () const  { return x_.size(); }
+
+    /** \brief Check if the view has no points. */
+    inline bool
+    empty () const  { return x_.empty(); }
+
+    /** \brief Get a point. */
+    inline Eigen::Vector3f
+    getPoint (const size_t point_id) const
+    {
+      return Eigen::Vector3f(x_[point_id], y_[point_id], z_[point_id]);
+    }
+
+    /** \brief Get a point normal. */
+    inline Eigen::Vector3f
+    getNormal (const size_t point_id) const
+    {
+      return Eigen::Vector3f(nx_[point_id], ny_[point_id], nz_[point_id]);
+    }
+
+    /** \brief Get the coordinate and normal arrays. */
+    inline const float* x  () const  { return x_.data(); }
+    inline const float* y  () const  { return y_.data(); }
+    inline const float* z  () const  { return z_.data(); }
+    inline const float* nx () const  { return nx_.data(); }
+    inline const float* ny () const  { return ny_.data(); }
+    inline const float* nz () const  { return nz_.data(); }
+
+  private:
+
+    /** \brief Resize all arrays. */
+    inline void
+    resize (const size_t num_points)
+    {
+      x_.resize(num_points);    y_.resize(num_points);    z_.resize(num_points);
+      nx_.resize(num_points);   ny_.resize(num_points);   nz_.resize(num_points);
+    }
+
+    /** \brief Copy a point and its normal. */
+    template <typename PointT>
+    inline void
+    setPoint (const size_t point_id, const PointT &point)
+    {
+      x_[point_id]  = point.x;          y_[point_id]  = point.y;          z_[point_id]  = point.z;
+      nx_[point_id] = point.normal_x;   ny_[point_id] = point.normal_y;   nz_[point_id] = point.normal_z;
+    }
+
+    /** \brief Point coordinates. */
+    FloatVector x_, y_, z_;
+
+    /** \brief Normal components. */
+    FloatVector nx_, ny_, nz_;
+  };
+}
+
+#endif  // CLOUD_SOA_HPP
@@ -0,0 +1,176 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef CLOUD_SOA_TRANSFORM_HPP
+#define CLOUD_SOA_TRANSFORM_HPP
+
+// STD includes
+#include <cstddef>
+
+// The transform kernels are plain loops vectorized by the compiler. On x86
+// builds that do not already target AVX2 an AVX2/FMA copy of every kernel is
+// compiled as well and chosen at runtime if the CPU supports it. Other builds
+// (including NEON on AArch64, which is part of the baseline) use the kernels
+// compiled for the target instruction set.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(__AVX2__)
+#define UTL_SOA_TRANSFORM_AVX2_DISPATCH
+#define UTL_SOA_TRANSFORM_INLINE  inline __attribute__((always_inline))
+#define UTL_SOA_TRANSFORM_AVX2    __attribute__((target("avx2,fma"), noinline))
+#else
+#define UTL_SOA_TRANSFORM_INLINE  inline
+#endif
+
+namespace utl
+{
+  /** \brief Check if the AVX2/FMA transform kernels are used.
+   *  \return TRUE if the kernels were compiled with AVX2/FMA dispatch and the CPU supports it
+   */
+  inline
+  bool soaTransformUsesAvx2 ()
+  {
+#ifdef UTL_SOA_TRANSFORM_AVX2_DISPATCH
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+    return supported;
+#else
+    return false;
+#endif
+  }
+
+  /** \brief Scalar loop of transformPointsSoA with interleaved output. */
+  UTL_SOA_TRANSFORM_INLINE
+  void transformPointsSoAKernel ( const float *M, const float *t, const int num_points,
+                                  const float *x, const float *y, const float *z,
+                                  const int *point_ids,
+                                  float *out
+                                )
+  {
+    const float m00 = M[0], m01 = M[3], m02 = M[6];
+    const float m10 = M[1], m11 = M[4], m12 = M[7];
+    const float m20 = M[2], m21 = M[5], m22 = M[8];
+    const float tx = t[0], ty = t[1], tz = t[2];
+
+    if (point_ids)
+    {
+      #pragma omp simd
+      for (int pointIdIt = 0; pointIdIt < num_points; pointIdIt++)
+      {
+        const int pointId = point_ids[pointIdIt];
+        const float px = x[pointId], py = y[pointId], pz = z[pointId];
+        out[3 * pointIdIt]      = tx + m00 * px + m01 * py + m02 * pz;
+        out[3 * pointIdIt + 1]  = ty + m10 * px + m11 * py + m12 * pz;
+        out[3 * pointIdIt + 2]  = tz + m20 * px + m21 * py + m22 * pz;
+      }
+    }
+    else
+    {
+      #pragma omp simd
+      for (int pointId = 0; pointId < num_points; pointId++)
+      {
+        const float px = x[pointId], py = y[pointId], pz = z[pointId];
+        out[3 * pointId]      = tx + m00 * px + m01 * py + m02 * pz;
+        out[3 * pointId + 1]  = ty + m10 * px + m11 * py + m12 * pz;
+        out[3 * pointId + 2]  = tz + m20 * px + m21 * py + m22 * pz;
+      }
+    }
+  }
+
+  /** \brief Scalar loop of transformPointsSoA with structure of arrays output. */
+  UTL_SOA_TRANSFORM_INLINE
+  void transformPointsSoAKernel ( const float *M, const float *t, const int num_points,
+                                  const float *x, const float *y, const float *z,
+                                  float *x_out, float *y_out, float *z_out
+                                )
+  {
+    const float m00 = M[0], m01 = M[3], m02 = M[6];
+    const float m10 = M[1], m11 = M[4], m12 = M[7];
+    const float m20 = M[2], m21 = M[5], m22 = M[8];
+    const float tx = t[0], ty = t[1], tz = t[2];
+
+    #pragma omp simd
+    for (int pointId = 0; pointId < num_points; pointId++)
+    {
+      const float px = x[pointId], py = y[pointId], pz = z[pointId];
+      x_out[pointId] = tx + m00 * px + m01 * py + m02 * pz;
+      y_out[pointId] = ty + m10 * px + m11 * py + m12 * pz;
+      z_out[pointId] = tz + m20 * px + m21 * py + m22 * pz;
+    }
+  }
+
+#ifdef UTL_SOA_TRANSFORM_AVX2_DISPATCH
+  /** \brief AVX2/FMA copy of transformPointsSoAKernel with interleaved output. */
+  UTL_SOA_TRANSFORM_AVX2 inline
+  void transformPointsSoAKernelAvx2 ( const float *M, const float *t, const int num_points,
+                                      const float *x, const float *y, const float *z,
+                                      const int *point_ids,
+                                      float *out
+                                    )
+  {
+    transformPointsSoAKernel(M, t, num_points, x, y, z, point_ids, out);
+  }
+
+  /** \brief AVX2/FMA copy of transformPointsSoAKernel with structure of arrays output. */
+  UTL_SOA_TRANSFORM_AVX2 inline
+  void transformPointsSoAKernelAvx2 ( const float *M, const float *t, const int num_points,
+                                      const float *x, const float *y, const float *z,
+                                      float *x_out, float *y_out, float *z_out
+                                    )
+  {
+    transformPointsSoAKernel(M, t, num_points, x, y, z, x_out, y_out, z_out);
+  }
+#endif
+
+  /** \brief Apply an affine transformation p' = M p + t to a batch of points
+   * given as separate coordinate arrays. Normals are transformed by passing a
+   * zero translation.
+   *  \param[in]  M           3x3 matrix in column major order
+   *  \param[in]  t           translation
+   *  \param[in]  num_points  number of points to transform
+   *  \param[in]  x, y, z     point coordinates
+   *  \param[in]  point_ids   indices of the points to transform, NULL transforms the first num_points points
+   *  \param[out] out         transformed points, 3 floats per point ordered as the indices
+   */
+  inline
+  void transformPointsSoA ( const float *M, const float *t, const int num_points,
+                            const float *x, const float *y, const float *z,
+                            const int *point_ids,
+                            float *out
+                          )
+  {
+#ifdef UTL_SOA_TRANSFORM_AVX2_DISPATCH
+    if (soaTransformUsesAvx2())
+    {
+      transformPointsSoAKernelAvx2(M, t, num_points, x, y, z, point_ids, out);
+      return;
+    }
+#endif
+    transformPointsSoAKernel(M, t, num_points, x, y, z, point_ids, out);
+  }
+
+  /** \brief Apply an affine transformation p' = M p + t to a batch of points
+   * given as separate coordinate arrays and write the result to separate
+   * coordinate arrays.
+   *  \param[in]  M                     3x3 matrix in column major order
+   *  \param[in]  t                     translation
+   *  \param[in]  num_points            number of points
+   *  \param[in]  x, y, z               point coordinates
+   *  \param[out] x_out, y_out, z_out   transformed point coordinates
+   */
+  inline
+  void transformPointsSoA ( const float *M, const float *t, const int num_points,
+                            const float *x, const float *y, const float *z,
+                            float *x_out, float *y_out, float *z_out
+                          )
+  {
+#ifdef UTL_SOA_TRANSFORM_AVX2_DISPATCH
+    if (soaTransformUsesAvx2())
+    {
+      transformPointsSoAKernelAvx2(M, t, num_points, x, y, z, x_out, y_out, z_out);
+      return;
+    }
+#endif
+    transformPointsSoAKernel(M, t, num_points, x, y, z, x_out, y_out, z_out);
+  }
+}
+
+#endif    // CLOUD_SOA_TRANSFORM_HPP
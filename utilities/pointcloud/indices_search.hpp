@@ -0,0 +1,294 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef INDICES_SEARCH_HPP
+#define INDICES_SEARCH_HPP
+
+// STD includes
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <iostream>
+
+// PCL includes
+#include <pcl/point_cloud.h>
+#include <pcl/common/io.h>
+#include <pcl/search/search.h>
+#include <pcl/search/kdtree.h>
+
+namespace utl
+{
+  /** \brief @b IndicesSearch A lightweight view of a search object built for
+   * a large pointcloud (e.g. a scene) that only returns neighbours belonging to
+   * a subset of the pointcloud points (e.g. a segment). The input cloud of the
+   * view contains the subset points (either provided by the caller or copied
+   * from the scene cloud), and all of the returned neighbour indices as well
+   * as the query indices refer to that cloud. This allows
+   * code that expects a search object built on a segment cloud to work with
+   * a search object that was built once for the whole scene. Scene indices
+   * are mapped to subset indices with a binary search over the sorted subset
+   * indices, so the memory used by the view only depends on the subset size.
+   *
+   * Radius searches query the scene search object and discard neighbours
+   * that do not belong to the subset. Nearest neighbour searches query the
+   * scene search object with an increasing number of neighbours until enough
+   * subset neighbours are found. If a query point is surrounded by a large
+   * number of points that do not belong to the subset (e.g. a point reflected
+   * into a different object) the view falls back to a search tree built on
+   * the subset. This tree is only built the first time it is needed.
+   * \note the scene search object must outlive the view. Searches are thread
+   * safe as long as the scene search object is.
+   */
+  template <typename PointT>
+  class IndicesSearch : public pcl::search::Search<PointT>
+  {
+  public:
+
+    typedef boost::shared_ptr<IndicesSearch<PointT> > Ptr;
+    typedef boost::shared_ptr<const IndicesSearch<PointT> > ConstPtr;
+
+    typedef typename pcl::search::Search<PointT>::PointCloud PointCloud;
+    typedef typename pcl::search::Search<PointT>::PointCloudConstPtr PointCloudConstPtr;
+    typedef typename pcl::search::Search<PointT>::IndicesConstPtr IndicesConstPtr;
+    typedef typename pcl::search::Search<PointT>::ConstPtr SearchConstPtr;
+
+    using pcl::search::Search<PointT>::nearestKSearch;
+    using pcl::search::Search<PointT>::radiusSearch;
+
+    /** \brief Constructor.
+     *  \param[in]  search      search object with an input cloud set
+     *  \param[in]  indices     indices of the input cloud points that are searched
+     *  \param[in]  sorted      set to true if the returned neighbours should be sorted by distance
+     */
+    IndicesSearch ( const SearchConstPtr &search,
+                    const std::vector<int> &indices,
+                    const bool sorted = true
+                  )
+      : pcl::search::Search<PointT> ("IndicesSearch", sorted)
+      , search_ (search)
+      , indices_subset_ (indices)
+      , max_expansion_ (16)
+    {
+      // Copy the subset points
+      typename PointCloud::Ptr subsetCloud (new PointCloud);
+      pcl::copyPointCloud(*search_->getInputCloud(), indices_subset_, *subsetCloud);
+      input_ = subsetCloud;
+
+      initializeSubsetMap();
+    }
+
+    /** \brief Constructor for the case when the caller already holds a cloud
+     * of the subset points. The cloud is used as the input cloud of the view
+     * without being copied.
+     *  \param[in]  search        search object with an input cloud set
+     *  \param[in]  indices       indices of the input cloud points that are searched
+     *  \param[in]  subset_cloud  cloud containing the input cloud points at the subset indices (in the same order)
+     *  \param[in]  sorted        set to true if the returned neighbours should be sorted by distance
+     */
+    IndicesSearch ( const SearchConstPtr &search,
+                    const std::vector<int> &indices,
+                    const PointCloudConstPtr &subset_cloud,
+                    const bool sorted = true
+                  )
+      : pcl::search::Search<PointT> ("IndicesSearch", sorted)
+      , search_ (search)
+      , indices_subset_ (indices)
+      , max_expansion_ (16)
+    {
+      if (subset_cloud->size() != indices_subset_.size())
+        std::cout << "[utl::IndicesSearch::IndicesSearch] subset cloud size does not match the number of subset indices." << std::endl;
+
+      input_ = subset_cloud;
+      initializeSubsetMap();
+    }
+
+    /** \brief Destructor. */
+    virtual ~IndicesSearch ()  {}
+
+    /** \brief The input cloud of the view is defined by the scene search
+     * object and the subset indices and can not be changed.
+     */
+    virtual void
+    setInputCloud (const PointCloudConstPtr&, const IndicesConstPtr& = IndicesConstPtr ())
+    {
+      std::cout << "[utl::IndicesSearch::setInputCloud] input cloud of an indices search view can not be changed." << std::endl;
+    }
+
+    /** \brief Get the search object the view was created from. */
+    inline SearchConstPtr
+    getSceneSearch () const  { return search_; }
+
+    /** \brief Get the indices of the subset points in the scene cloud. */
+    inline const std::vector<int>&
+    getSubsetIndices () const  { return indices_subset_; }
+
+    /** \brief Set the maximum ratio between the number of neighbours requested
+     * from the scene search object and the number of requested neighbours
+     * before the nearest neighbour search falls back to a subset search tree.
+     */
+    inline void
+    setMaxExpansion (const int max_expansion)  { max_expansion_ = std::max(max_expansion, 1); }
+
+    /** \brief Search for the k nearest subset neighbours of a query point.
+     *  \param[in]  point           query point
+     *  \param[in]  k               number of neighbours to search for
+     *  \param[out] k_indices       indices of the neighbours in the subset cloud
+     *  \param[out] k_sqr_distances squared distances to the neighbours
+     *  \return number of neighbours found
+     */
+    virtual int
+    nearestKSearch (const PointT &point, int k, std::vector<int> &k_indices, std::vector<float> &k_sqr_distances) const
+    {
+      k_indices.clear();
+      k_sqr_distances.clear();
+
+      const int numSubsetPoints = static_cast<int>(indices_subset_.size());
+      const int numScenePoints  = static_cast<int>(search_->getInputCloud()->size());
+      k = std::min(k, numSubsetPoints);
+      if (k <= 0)
+        return 0;
+
+      // Query the scene search object with an increasing number of neighbours
+      std::vector<int>    sceneIndices;
+      std::vector<float>  sceneSqrDistances;
+      int kScene = k;
+      while (true)
+      {
+        kScene = std::min(kScene, numScenePoints);
+        search_->nearestKSearch(point, kScene, sceneIndices, sceneSqrDistances);
+        filterNeighbours(sceneIndices, sceneSqrDistances, k_indices, k_sqr_distances);
+
+        if (static_cast<int>(k_indices.size()) >= k || kScene >= numScenePoints)
+          break;
+
+        // Too many points outside the subset - use a subset search tree
+        if (kScene >= k * max_expansion_)
+          return getSubsetSearch()->nearestKSearch(point, k, k_indices, k_sqr_distances);
+
+        kScene *= 2;
+      }
+
+      k_indices.resize(std::min(static_cast<int>(k_indices.size()), k));
+      k_sqr_distances.resize(k_indices.size());
+      return static_cast<int>(k_indices.size());
+    }
+
+    /** \brief Search for all subset neighbours of a query point within a radius.
+     *  \param[in]  point           query point
+     *  \param[in]  radius          search radius
+     *  \param[out] k_indices       indices of the neighbours in the subset cloud
+     *  \param[out] k_sqr_distances squared distances to the neighbours
+     *  \param[in]  max_nn          maximum number of neighbours returned (0 returns all neighbours)
+     *  \return number of neighbours found
+     */
+    virtual int
+    radiusSearch (const PointT &point, double radius, std::vector<int> &k_indices, std::vector<float> &k_sqr_distances, unsigned int max_nn = 0) const
+    {
+      std::vector<int>    sceneIndices;
+      std::vector<float>  sceneSqrDistances;
+      search_->radiusSearch(point, radius, sceneIndices, sceneSqrDistances, 0);
+      filterNeighbours(sceneIndices, sceneSqrDistances, k_indices, k_sqr_distances);
+
+      if (max_nn > 0 && k_indices.size() > max_nn)
+      {
+        k_indices.resize(max_nn);
+        k_sqr_distances.resize(max_nn);
+      }
+
+      return static_cast<int>(k_indices.size());
+    }
+
+  protected:
+
+    using pcl::search::Search<PointT>::input_;
+
+    /** \brief Sort the subset indices together with their positions in the
+     * subset.
+     */
+    inline void
+    initializeSubsetMap ()
+    {
+      subset_map_.resize(indices_subset_.size());
+      for (size_t pointId = 0; pointId < indices_subset_.size(); pointId++)
+        subset_map_[pointId] = std::pair<int, int> (indices_subset_[pointId], static_cast<int>(pointId));
+      std::sort(subset_map_.begin(), subset_map_.end());
+    }
+
+    /** \brief Get the subset index of a scene point (-1 for points outside
+     * the subset).
+     */
+    inline int
+    getSubsetIndex (const int scene_index) const
+    {
+      std::vector<std::pair<int, int> >::const_iterator it = std::lower_bound ( subset_map_.begin(), subset_map_.end(),
+                                                                                std::pair<int, int> (scene_index, -1));
+      if (it == subset_map_.end() || it->first != scene_index)
+        return -1;
+
+      return it->second;
+    }
+
+    /** \brief Keep the neighbours that belong to the subset and convert their
+     * indices to subset indices.
+     */
+    inline void
+    filterNeighbours  ( const std::vector<int> &scene_indices,
+                        const std::vector<float> &scene_sqr_distances,
+                        std::vector<int> &k_indices,
+                        std::vector<float> &k_sqr_distances
+                      ) const
+    {
+      k_indices.clear();
+      k_sqr_distances.clear();
+
+      for (size_t nbrIdIt = 0; nbrIdIt < scene_indices.size(); nbrIdIt++)
+      {
+        int subsetId = getSubsetIndex(scene_indices[nbrIdIt]);
+        if (subsetId != -1)
+        {
+          k_indices.push_back(subsetId);
+          k_sqr_distances.push_back(scene_sqr_distances[nbrIdIt]);
+        }
+      }
+    }
+
+    /** \brief Get a search tree built on the subset cloud. The tree is built
+     * on first use.
+     */
+    inline typename pcl::search::KdTree<PointT>::Ptr
+    getSubsetSearch () const
+    {
+      typename pcl::search::KdTree<PointT>::Ptr subsetSearch;
+
+      # pragma omp critical (indices_search_subset_tree)
+      {
+        if (!subset_search_)
+        {
+          subset_search_.reset(new pcl::search::KdTree<PointT> (this->sorted_results_));
+          subset_search_->setInputCloud(input_);
+        }
+        subsetSearch = subset_search_;
+      }
+
+      return subsetSearch;
+    }
+
+    /** \brief Search object built for the full cloud. */
+    SearchConstPtr search_;
+
+    /** \brief Indices of the subset points in the full cloud. */
+    std::vector<int> indices_subset_;
+
+    /** \brief Full cloud indices of the subset points paired with their subset indices, sorted by full cloud index. */
+    std::vector<std::pair<int, int> > subset_map_;
+
+    /** \brief Maximum ratio between the number of neighbours requested from the full cloud search object and the number of requested neighbours. */
+    int max_expansion_;
+
+    /** \brief Search tree built on the subset cloud, used as a fallback for nearest neighbour search. */
+    mutable typename pcl::search::KdTree<PointT>::Ptr subset_search_;
+  };
+}
+
+#endif  // INDICES_SEARCH_HPP
@@ -0,0 +1,343 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef NEIGHBOR_GRID_HPP
+#define NEIGHBOR_GRID_HPP
+
+// STD includes
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <iostream>
+#include <cmath>
+
+// Eigen includes
+#include <eigen3/Eigen/Dense>
+
+// PCL includes
+#include <pcl/point_cloud.h>
+
+// Utilities includes
+#include <profiling.hpp>
+
+namespace utl
+{
+  /** \brief @b NeighborGrid Bounded radius nearest neighbor search over a
+   * pointcloud. Points are hashed into a uniform grid with the cell size equal
+   * to the search radius, so that the nearest neighbor of a query point within
+   * the search radius is always found among the points of the 3x3x3 block of
+   * cells surrounding the query. Point coordinates are stored in separate
+   * x, y and z arrays ordered by cell, and each cell is a contiguous range
+   * of these arrays. Queries do not allocate any memory and return the index
+   * of the nearest point of the input cloud or nothing if there are no points
+   * within the search radius.
+   * \note cell coordinates are limited to 21 bits, i.e. the grid covers roughly
+   * a million cells in every direction from the origin. Points outside of
+   * this range are ignored.
+   */
+  template <typename PointT>
+  class NeighborGrid
+  {
+  public:
+
+    typedef boost::shared_ptr<NeighborGrid<PointT> > Ptr;
+    typedef boost::shared_ptr<const NeighborGrid<PointT> > ConstPtr;
+    typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+    /** \brief Empty constructor. */
+    NeighborGrid ()
+      : radius_ (0.0f)
+      , radius_inv_ (0.0f)
+      , table_mask_ (0)
+    { }
+
+    /** \brief Build the grid for a pointcloud.
+     *  \param[in]  cloud     input cloud
+     *  \param[in]  radius    search radius (and grid cell size)
+     *  \return false if radius is not positive
+     */
+    inline bool
+    setInputCloud (const PointCloudConstPtr &cloud, const float radius)
+    {
+      clear();
+
+      if (radius <= 0.0f)
+      {
+        std::cout << "[utl::NeighborGrid::setInputCloud] search radius must be positive." << std::endl;
+        std::cout << "[utl::NeighborGrid::setInputCloud] input radius: " << radius << std::endl;
+        return false;
+      }
+
+      cloud_ = cloud;
+      radius_ = radius;
+      radius_inv_ = 1.0f / radius;
+
+      //--------------------------------------------------------------------------
+      // Sort points by cell
+
+      std::vector<std::pair<uint64_t, int> > pointKeys;
+      pointKeys.reserve(cloud_->size());
+      for (size_t pointId = 0; pointId < cloud_->size(); pointId++)
+      {
+        const PointT &point = cloud_->points[pointId];
+        if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+          continue;
+
+        int cellX, cellY, cellZ;
+        if (getCellCoordinates(Eigen::Vector3f(point.x, point.y, point.z), cellX, cellY, cellZ))
+          pointKeys.push_back(std::pair<uint64_t, int>(getCellKey(cellX, cellY, cellZ), pointId));
+      }
+      std::sort(pointKeys.begin(), pointKeys.end());
+
+      //--------------------------------------------------------------------------
+      // Copy point coordinates and find cell ranges
+
+      x_.resize(pointKeys.size());
+      y_.resize(pointKeys.size());
+      z_.resize(pointKeys.size());
+      point_ids_.resize(pointKeys.size());
+
+      std::vector<uint64_t> cellKeys;
+      for (size_t pointIdIt = 0; pointIdIt < pointKeys.size(); pointIdIt++)
+      {
+        const PointT &point = cloud_->points[pointKeys[pointIdIt].second];
+        x_[pointIdIt] = point.x;
+        y_[pointIdIt] = point.y;
+        z_[pointIdIt] = point.z;
+        point_ids_[pointIdIt] = pointKeys[pointIdIt].second;
+
+        if (pointIdIt == 0 || pointKeys[pointIdIt].first != pointKeys[pointIdIt-1].first)
+        {
+          cellKeys.push_back(pointKeys[pointIdIt].first);
+          cell_starts_.push_back(pointIdIt);
+        }
+      }
+      cell_starts_.push_back(pointKeys.size());
+
+      //--------------------------------------------------------------------------
+      // Insert cells into an open addressing hash table
+
+      size_t tableSize = 16;
+      while (tableSize < cellKeys.size() * 2)
+        tableSize *= 2;
+      table_mask_ = tableSize - 1;
+      table_keys_.assign(tableSize, EMPTY_KEY);
+      table_cells_.assign(tableSize, -1);
+
+      for (size_t cellId = 0; cellId < cellKeys.size(); cellId++)
+      {
+        size_t slot = getHash(cellKeys[cellId]);
+        while (table_keys_[slot] != EMPTY_KEY)
+          slot = (slot + 1) & table_mask_;
+
+        table_keys_[slot] = cellKeys[cellId];
+        table_cells_[slot] = cellId;
+      }
+
+      return true;
+    }
+
+    /** \brief Release grid memory. */
+    inline void
+    clear ()
+    {
+      cloud_.reset();
+      radius_ = 0.0f;
+      radius_inv_ = 0.0f;
+      table_mask_ = 0;
+      std::vector<float>().swap(x_);
+      std::vector<float>().swap(y_);
+      std::vector<float>().swap(z_);
+      std::vector<int>().swap(point_ids_);
+      std::vector<int>().swap(cell_starts_);
+      std::vector<uint64_t>().swap(table_keys_);
+      std::vector<int>().swap(table_cells_);
+    }
+
+    /** \brief Get the input cloud. */
+    inline PointCloudConstPtr
+    getInputCloud () const  { return cloud_; }
+
+    /** \brief Get the search radius. */
+    inline float
+    getRadius () const  { return radius_; }
+
+    /** \brief Find the nearest point of the input cloud within a distance to
+     * a query point.
+     *  \param[in]  point         query point
+     *  \param[in]  max_distance  maximum distance to the nearest point (must not exceed the search radius of the grid)
+     *  \param[out] index         index of the nearest point in the input cloud
+     *  \param[out] sqr_distance  squared distance to the nearest point
+     *  \return false if there are no points within the maximum distance
+     */
+    inline bool
+    nearestSearch (const Eigen::Vector3f &point, const float max_distance, int &index, float &sqr_distance) const
+    {
+      UTL_PROFILE_COUNT(utl::PROFILE_NN_QUERIES, 1);
+      index = -1;
+      sqr_distance = std::min(max_distance, radius_);
+      sqr_distance *= sqr_distance;
+
+      int cellX, cellY, cellZ;
+      if (table_keys_.empty() || !getCellCoordinates(point, cellX, cellY, cellZ))
+        return false;
+
+      for (int dx = -1; dx <= 1; dx++)
+      {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+          for (int dz = -1; dz <= 1; dz++)
+          {
+            int cellId = findCell(cellX + dx, cellY + dy, cellZ + dz);
+            if (cellId == -1)
+              continue;
+
+            for (int pointIdIt = cell_starts_[cellId]; pointIdIt < cell_starts_[cellId+1]; pointIdIt++)
+            {
+              float diffX = x_[pointIdIt] - point[0];
+              float diffY = y_[pointIdIt] - point[1];
+              float diffZ = z_[pointIdIt] - point[2];
+              float curSqrDistance = diffX * diffX + diffY * diffY + diffZ * diffZ;
+
+              if (curSqrDistance <= sqr_distance)
+              {
+                sqr_distance = curSqrDistance;
+                index = point_ids_[pointIdIt];
+              }
+            }
+          }
+        }
+      }
+
+      return index != -1;
+    }
+
+    /** \brief Find the nearest point of the input cloud within the search
+     * radius to a query point.
+     *  \param[in]  point         query point
+     *  \param[out] index         index of the nearest point in the input cloud
+     *  \param[out] sqr_distance  squared distance to the nearest point
+     *  \return false if there are no points within the search radius
+     */
+    inline bool
+    nearestSearch (const Eigen::Vector3f &point, int &index, float &sqr_distance) const
+    {
+      return nearestSearch(point, radius_, index, sqr_distance);
+    }
+
+    /** \brief Find the nearest points of the input cloud within a distance to
+     * a set of query points.
+     *  \param[in]  points          query points
+     *  \param[in]  max_distance    maximum distance to the nearest point (must not exceed the search radius of the grid)
+     *  \param[out] indices         indices of the nearest points in the input cloud (-1 if there is no point within the maximum distance)
+     *  \param[out] sqr_distances   squared distances to the nearest points
+     *  \return number of query points that have a neighbor
+     */
+    inline int
+    nearestSearch (const Eigen::Matrix3Xf &points, const float max_distance, std::vector<int> &indices, std::vector<float> &sqr_distances) const
+    {
+      indices.resize(points.cols());
+      sqr_distances.resize(points.cols());
+
+      int numFound = 0;
+      for (int pointId = 0; pointId < points.cols(); pointId++)
+      {
+        if (nearestSearch(points.col(pointId), max_distance, indices[pointId], sqr_distances[pointId]))
+          numFound++;
+      }
+
+      return numFound;
+    }
+
+  private:
+
+    /** \brief Key of an empty hash table slot. */
+    static const uint64_t EMPTY_KEY = ~static_cast<uint64_t>(0);
+
+    /** \brief Number of bits used to store each cell coordinate in a key. */
+    static const int KEY_BITS = 21;
+
+    /** \brief Get the coordinates of the cell containing a point.
+     *  \return false if the cell falls outside of the range that can be stored in a key
+     */
+    inline bool
+    getCellCoordinates (const Eigen::Vector3f &point, int &cell_x, int &cell_y, int &cell_z) const
+    {
+      const float maxCell = static_cast<float>(1 << (KEY_BITS - 1)) - 2.0f;
+      Eigen::Vector3f cell = (point * radius_inv_).array().floor();
+      if (!(cell.cwiseAbs().maxCoeff() < maxCell))
+        return false;
+
+      cell_x = static_cast<int>(cell[0]);
+      cell_y = static_cast<int>(cell[1]);
+      cell_z = static_cast<int>(cell[2]);
+      return true;
+    }
+
+    /** \brief Pack cell coordinates into a key. */
+    static inline uint64_t
+    getCellKey (const int cell_x, const int cell_y, const int cell_z)
+    {
+      const int64_t offset = 1 << (KEY_BITS - 1);
+      return  (static_cast<uint64_t>(cell_x + offset) << (2 * KEY_BITS)) |
+              (static_cast<uint64_t>(cell_y + offset) << KEY_BITS) |
+               static_cast<uint64_t>(cell_z + offset);
+    }
+
+    /** \brief Get the hash table slot of a key. */
+    inline size_t
+    getHash (const uint64_t key) const
+    {
+      uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+      return static_cast<size_t>(hash ^ (hash >> 32)) & table_mask_;
+    }
+
+    /** \brief Find a cell in the hash table.
+     *  \return cell index or -1 if the cell contains no points
+     */
+    inline int
+    findCell (const int cell_x, const int cell_y, const int cell_z) const
+    {
+      const uint64_t key = getCellKey(cell_x, cell_y, cell_z);
+      size_t slot = getHash(key);
+      while (table_keys_[slot] != EMPTY_KEY)
+      {
+        if (table_keys_[slot] == key)
+          return table_cells_[slot];
+
+        slot = (slot + 1) & table_mask_;
+      }
+
+      return -1;
+    }
+
+    /** \brief Input cloud. */
+    PointCloudConstPtr cloud_;
+
+    /** \brief Search radius and its inverse. */
+    float radius_, radius_inv_;
+
+    /** \brief Point coordinates ordered by cell. */
+    std::vector<float> x_, y_, z_;
+
+    /** \brief Input cloud indices of the points ordered by cell. */
+    std::vector<int> point_ids_;
+
+    /** \brief Index of the first point of every cell, followed by the total number of points. */
+    std::vector<int> cell_starts_;
+
+    /** \brief Hash table mapping cell keys to cell indices. */
+    std::vector<uint64_t> table_keys_;
+    std::vector<int> table_cells_;
+
+    /** \brief Hash table size minus one. */
+    size_t table_mask_;
+  };
+
+  template <typename PointT>
+  const uint64_t NeighborGrid<PointT>::EMPTY_KEY;
+}
+
+#endif  // NEIGHBOR_GRID_HPP
@@ -5,6 +5,14 @@
 #ifndef POINTCLOUD_UTILITIES_HPP
 #define POINTCLOUD_UTILITIES_HPP
 
+// STD includes
+#include <stdint.h>
+#include <cstring>
+#include <limits>
+
+// OpenMP includes
+#include <omp.h>
+
 // PCL includes
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
@@ -18,12 +26,20 @@
 
 // Utilities
 #include <graph/graph.hpp>
+#include <graph/graph_csr.hpp>
 #include <geometry/geometry.hpp>
 
 namespace utl
 {
-  /** \brief @b Downsample Downsamples a pointcloud using the @b VoxelGrid
-    * filter. Unlike the original @b VoxelGrid filter can return
+  /** \brief @b Downsample Downsamples a pointcloud using a voxel grid. The
+    * interface and output are the same as those of the @b VoxelGrid filter,
+    * but voxels are found natively: 64 bit voxel keys are computed in
+    * parallel, points are grouped by voxel with a parallel radix sort and all
+    * outputs are produced in a single pass over the voxels, so the voxel index
+    * can not overflow for large clouds or small leaf sizes. The filter field
+    * limits, the minimum number of points per voxel and the downsample all
+    * data flag of the @b VoxelGrid filter are supported, the leaf layout is
+    * not. Unlike the original @b VoxelGrid filter can return
     *  - a map from downsampled indices to original cloud indices
     *  - indices of points of the original cloud that are closest to the
     *    corresponding downsampled points
@@ -33,12 +49,11 @@ namespace utl
   {  
   protected:
 //       using pcl::PCLBase<PointT>::setIndices;
-    using pcl::VoxelGrid<PointT>::setDownsampleAllData;
     using pcl::VoxelGrid<PointT>::setSaveLeafLayout;
-    using pcl::VoxelGrid<PointT>::setMinimumPointsNumberPerVoxel;
-    using pcl::VoxelGrid<PointT>::setFilterFieldName;
-    using pcl::VoxelGrid<PointT>::setFilterLimits;
-    using pcl::VoxelGrid<PointT>::setFilterLimitsNegative;
+    using pcl::VoxelGrid<PointT>::getCentroidIndex;
+    using pcl::VoxelGrid<PointT>::getCentroidIndexAt;
+    using pcl::VoxelGrid<PointT>::getNeighborCentroidIndices;
+    using pcl::VoxelGrid<PointT>::getLeafLayout;
     
   public:
           
@@ -54,11 +69,10 @@ namespace utl
       downsample_method_ (AVERAGE),
       output_ (new pcl::PointCloud<PointT>),
       downsample_map_ (),
-      non_nan_point_map_ (),
-      nearest_indices_ ()
+      nearest_indices_ (),
+      computed_ (false)
     {
       resetComputation();
-      this->setSaveLeafLayout(true);
     }
 
     /** \brief Destructor. */
@@ -117,6 +131,57 @@ namespace utl
     /** \brief Get the voxel grid leaf size. */
     inline float
     getLeafSize ()  const   { return this->leaf_size_[0]; }
+    
+    /** \brief Set whether all point fields or only the coordinates are averaged.
+      *  \param[in] downsample if false, only the coordinates of the downsampled points are set
+      */
+    inline void
+    setDownsampleAllData (const bool downsample)
+    {
+      pcl::VoxelGrid<PointT>::setDownsampleAllData(downsample);
+      resetComputation();
+    }
+    
+    /** \brief Set the minimum number of points a voxel must have to be kept.
+      *  \param[in] min_points_per_voxel minimum number of points per voxel
+      */
+    inline void
+    setMinimumPointsNumberPerVoxel (const unsigned int min_points_per_voxel)
+    {
+      pcl::VoxelGrid<PointT>::setMinimumPointsNumberPerVoxel(min_points_per_voxel);
+      resetComputation();
+    }
+    
+    /** \brief Set the name of the point field used to filter points before downsampling.
+      *  \param[in] field_name field name, an empty name disables filtering
+      */
+    inline void
+    setFilterFieldName (const std::string &field_name)
+    {
+      pcl::VoxelGrid<PointT>::setFilterFieldName(field_name);
+      resetComputation();
+    }
+    
+    /** \brief Set the range of filter field values of the kept points.
+      *  \param[in] limit_min minimum field value
+      *  \param[in] limit_max maximum field value
+      */
+    inline void
+    setFilterLimits (const double limit_min, const double limit_max)
+    {
+      pcl::VoxelGrid<PointT>::setFilterLimits(limit_min, limit_max);
+      resetComputation();
+    }
+    
+    /** \brief Set whether points inside the filter limits are removed instead of kept.
+      *  \param[in] limit_negative if true, points inside the filter limits are removed
+      */
+    inline void
+    setFilterLimitsNegative (const bool limit_negative)
+    {
+      pcl::VoxelGrid<PointT>::setFilterLimitsNegative(limit_negative);
+      resetComputation();
+    }
 
     /** \brief Get downsample map i.e. map from downsampled cloud points to
       * original cloud points.
@@ -125,7 +190,9 @@ namespace utl
     inline void
     getDownsampleMap  (std::vector<std::vector<int> > &downsample_map)
     {
-      computeDownsampleMap();
+      if (!computed_)
+        std::cout << "[utl::Downsample::getDownsampleMap] you must donwsample the cloud first." << std::endl;
+
       downsample_map = downsample_map_;
     }
 
@@ -136,12 +203,14 @@ namespace utl
     inline void
     getNearestPointIndices  (std::vector<int> &nearest_indices)
     {
-      computeNearestPointIndices();
+      if (!computed_)
+        std::cout << "[utl::Downsample::getNearestPointIndices] you must donwsample the cloud first." << std::endl;
+
       nearest_indices = nearest_indices_;
     }      
     
   private:
-    
+
     /** \brief Downsampling method used. */
     CloudDownsampleMethod downsample_method_;
     
@@ -151,61 +220,279 @@ namespace utl
     /** \brief Downsample map */
     std::vector<std::vector<int> > downsample_map_;
 
-    /** \brief A map from the points of the donwsampled cloud mask to the indices of the NaN filtered downsampled cloud. */
-    std::vector<int> non_nan_point_map_;
-    
     /** \brief Indices of points closest to downsampled points */
     std::vector<int> nearest_indices_;
 
-    /** \brief Get downsample map i.e. map from downsampled cloud points to
-      * original cloud points.
-      */      
+    /** \brief Flag indicating whether the cloud was downsampled. The
+      * downsampled cloud may legitimately be empty. */
+    bool computed_;
+
+    /** \brief Stable parallel LSD radix sort of point indices by voxel key.
+      * Every thread histograms and scatters a contiguous range of the
+      * input, so points of the same voxel keep their input order.
+      *  \param[in,out] keys          voxel keys
+      *  \param[in,out] point_ids     point indices
+      *  \param[in]     num_key_bits  number of significant bits of the keys
+      */
+    static inline void
+    sortVoxelKeys (std::vector<uint64_t> &keys, std::vector<int> &point_ids, const int num_key_bits)
+    {
+      const int RADIX_BITS = 8;
+      const int RADIX = 1 << RADIX_BITS;
+      const int numPoints = keys.size();
+      const int numPasses = (num_key_bits + RADIX_BITS - 1) / RADIX_BITS;
+
+      std::vector<uint64_t> keysTmp (numPoints);
+      std::vector<int> pointIdsTmp (numPoints);
+      std::vector<int> digitOffsets (omp_get_max_threads() * RADIX);
+
+      #pragma omp parallel
+      {
+        const int numThreads = omp_get_num_threads();
+        const int threadId = omp_get_thread_num();
+        const int rangeBegin = static_cast<int>(static_cast<int64_t>(numPoints) * threadId / numThreads);
+        const int rangeEnd = static_cast<int>(static_cast<int64_t>(numPoints) * (threadId + 1) / numThreads);
+        int *threadOffsets = digitOffsets.data() + threadId * RADIX;
+
+        for (int pass = 0; pass < numPasses; pass++)
+        {
+          const int shift = pass * RADIX_BITS;
+          std::vector<uint64_t> &keysSrc = pass % 2 == 0 ? keys : keysTmp;
+          std::vector<uint64_t> &keysDst = pass % 2 == 0 ? keysTmp : keys;
+          std::vector<int> &pointIdsSrc = pass % 2 == 0 ? point_ids : pointIdsTmp;
+          std::vector<int> &pointIdsDst = pass % 2 == 0 ? pointIdsTmp : point_ids;
+
+          // Histogram of the digits of the thread range
+          std::fill(threadOffsets, threadOffsets + RADIX, 0);
+          for (int pointIdIt = rangeBegin; pointIdIt < rangeEnd; pointIdIt++)
+            threadOffsets[(keysSrc[pointIdIt] >> shift) & (RADIX - 1)]++;
+
+          #pragma omp barrier
+
+          // Output positions ordered by digit and then by thread
+          #pragma omp single
+          {
+            int offset = 0;
+            for (int digit = 0; digit < RADIX; digit++)
+            {
+              for (int threadIt = 0; threadIt < numThreads; threadIt++)
+              {
+                const int count = digitOffsets[threadIt * RADIX + digit];
+                digitOffsets[threadIt * RADIX + digit] = offset;
+                offset += count;
+              }
+            }
+          }
+
+          // Scatter (single has an implicit barrier)
+          for (int pointIdIt = rangeBegin; pointIdIt < rangeEnd; pointIdIt++)
+          {
+            const int dstPos = threadOffsets[(keysSrc[pointIdIt] >> shift) & (RADIX - 1)]++;
+            keysDst[dstPos] = keysSrc[pointIdIt];
+            pointIdsDst[dstPos] = pointIdsSrc[pointIdIt];
+          }
+
+          #pragma omp barrier
+        }
+      }
+
+      if (numPasses % 2 == 1)
+      {
+        keys.swap(keysTmp);
+        point_ids.swap(pointIdsTmp);
+      }
+    }
+
+    /** \brief Downsample the input cloud. Computes the downsampled cloud,
+      * the downsample map and the nearest point indices. Voxels are ordered
+      * in the same way as in the @b VoxelGrid filter. Points with non finite
+      * coordinates or outside the filter limits are ignored. Voxels with fewer
+      * than the minimum number of points and voxels whose average normal is
+      * not finite are removed.
+      */
     inline void
-    computeDownsampleMap  ()
+    downsampleVoxels ()
     {
-      if (downsample_map_.empty())
+      // Invalid parameters are reported once and leave the result empty
+      computed_ = true;
+      
+      const std::vector<int> &indices = *this->indices_;
+      const pcl::PointCloud<PointT> &cloud = *this->input_;
+      const int numIndices = indices.size();
+      const Eigen::Array3f leafSizeInv = this->inverse_leaf_size_.template head<3>();
+      
+      // Offset of the filter field in the point structure
+      int filterFieldOffset = -1;
+      if (!this->filter_field_name_.empty())
       {
-        // Check if the cloud was downsampled
-        if (output_->empty())
+        std::vector<pcl::PCLPointField> fields;
+        const int filterFieldId = pcl::getFieldIndex(cloud, this->filter_field_name_, fields);
+        if (filterFieldId == -1)
         {
-          std::cout << "[utl::Downsample::computeDownsampleMap] you must donwsample the cloud first." << std::endl;
+          std::cout << "[utl::Downsample::downsampleVoxels] invalid filter field name: " << this->filter_field_name_ << "." << std::endl;
           return;
         }
-        
-        // Generate map
-        downsample_map_.resize(output_->size());
-        for (size_t pointHRIt = 0; pointHRIt < this->indices_->size(); pointHRIt++)
+        filterFieldOffset = fields[filterFieldId].offset;
+      }
+
+      //--------------------------------------------------------------------------
+      // Voxel coordinates of the points and their bounds
+
+      const int INVALID_VOXEL = std::numeric_limits<int>::max();
+      std::vector<Eigen::Vector3i> pointVoxels (numIndices);
+      Eigen::Vector3i minVoxel = Eigen::Vector3i::Constant(INVALID_VOXEL);
+      Eigen::Vector3i maxVoxel = Eigen::Vector3i::Constant(-INVALID_VOXEL);
+
+      #pragma omp parallel
+      {
+        Eigen::Vector3i threadMinVoxel = Eigen::Vector3i::Constant(INVALID_VOXEL);
+        Eigen::Vector3i threadMaxVoxel = Eigen::Vector3i::Constant(-INVALID_VOXEL);
+
+        #pragma omp for
+        for (int pointIdIt = 0; pointIdIt < numIndices; pointIdIt++)
+        {
+          // Filter field limits are applied as in the VoxelGrid filter
+          if (filterFieldOffset != -1)
+          {
+            float fieldValue;
+            memcpy(&fieldValue, reinterpret_cast<const uint8_t*>(&cloud.points[indices[pointIdIt]]) + filterFieldOffset, sizeof(float));
+            const bool insideLimits = fieldValue >= this->filter_limit_min_ && fieldValue <= this->filter_limit_max_;
+            if (!pcl_isfinite(fieldValue) || insideLimits == this->filter_limit_negative_)
+            {
+              pointVoxels[pointIdIt][0] = INVALID_VOXEL;
+              continue;
+            }
+          }
+          
+          const Eigen::Array3f voxel = (cloud.points[indices[pointIdIt]].getArray3fMap() * leafSizeInv).floor();
+          if (!(voxel.abs().maxCoeff() < static_cast<float>(INVALID_VOXEL / 2)))    // also rejects non finite coordinates
+          {
+            pointVoxels[pointIdIt][0] = INVALID_VOXEL;
+            continue;
+          }
+
+          pointVoxels[pointIdIt] = voxel.cast<int>().matrix();
+          threadMinVoxel = threadMinVoxel.cwiseMin(pointVoxels[pointIdIt]);
+          threadMaxVoxel = threadMaxVoxel.cwiseMax(pointVoxels[pointIdIt]);
+        }
+
+        #pragma omp critical
         {
-          int pointHRId = this->indices_->at(pointHRIt);
-          int pointLRId = this->getCentroidIndex(this->input_->points[pointHRId]);
-          if (non_nan_point_map_[pointLRId] != -1)
-            downsample_map_[non_nan_point_map_[pointLRId]].push_back(pointHRId);
+          minVoxel = minVoxel.cwiseMin(threadMinVoxel);
+          maxVoxel = maxVoxel.cwiseMax(threadMaxVoxel);
         }
       }
-    }
-    
-    /** \brief Get indices of points in the original cloud that are closest to
-      * downsampled cloud points.
-      */      
-    inline void
-    computeNearestPointIndices  ()
-    {
-      if (nearest_indices_.empty())
-      {          
-        computeDownsampleMap();
-        
-        // Get nearest indices
-        pcl::search::BruteForce<PointT> search;
-        std::vector<int>            neighbors(1);
-        std::vector<float>          distances(1);
+
+      //--------------------------------------------------------------------------
+      // Voxel keys. Every coordinate gets as many bits as its range requires and
+      // z coordinate is stored in the most significant bits so that voxels are
+      // ordered in the same way as in the VoxelGrid filter.
+
+      Eigen::Vector3i keyBits = Eigen::Vector3i::Zero();
+      for (int dim = 0; dim < 3; dim++)
+        while (minVoxel[dim] <= maxVoxel[dim] && (static_cast<int64_t>(maxVoxel[dim]) - minVoxel[dim]) >> keyBits[dim] > 0)
+          keyBits[dim]++;
+
+      if (keyBits.sum() >= 64)
+      {
+        std::cout << "[utl::Downsample::downsampleVoxels] leaf size is too small for the input cloud, voxel coordinates do not fit into a key." << std::endl;
+        std::cout << "[utl::Downsample::downsampleVoxels] number of voxel coordinate bits along x, y, z: " << keyBits.transpose() << std::endl;
+        return;
+      }
+
+      std::vector<uint64_t> pointKeys;
+      std::vector<int> pointIds;
+      pointKeys.reserve(numIndices);
+      pointIds.reserve(numIndices);
+      for (int pointIdIt = 0; pointIdIt < numIndices; pointIdIt++)
+      {
+        if (pointVoxels[pointIdIt][0] == INVALID_VOXEL)
+          continue;
+
+        const Eigen::Vector3i &voxel = pointVoxels[pointIdIt];
+        pointKeys.push_back(  (static_cast<uint64_t>(static_cast<int64_t>(voxel[2]) - minVoxel[2]) << (keyBits[0] + keyBits[1])) |
+                              (static_cast<uint64_t>(static_cast<int64_t>(voxel[1]) - minVoxel[1]) << keyBits[0]) |
+                               static_cast<uint64_t>(static_cast<int64_t>(voxel[0]) - minVoxel[0]));
+        pointIds.push_back(indices[pointIdIt]);
+      }
+
+      sortVoxelKeys(pointKeys, pointIds, keyBits.sum());
+
+      //--------------------------------------------------------------------------
+      // Voxel ranges
+
+      std::vector<int> voxelStarts;
+      for (size_t pointIdIt = 0; pointIdIt < pointKeys.size(); pointIdIt++)
+        if (pointIdIt == 0 || pointKeys[pointIdIt] != pointKeys[pointIdIt-1])
+          voxelStarts.push_back(pointIdIt);
+      voxelStarts.push_back(pointKeys.size());
+      const int numVoxels = voxelStarts.size() - 1;
+
+      //--------------------------------------------------------------------------
+      // Average all point fields over every voxel and find the point nearest to
+      // the average
+
+      pcl::PointCloud<PointT> voxelCentroids;
+      voxelCentroids.resize(numVoxels);
+      std::vector<int> voxelNearestPoints (numVoxels);
+      std::vector<char> voxelValid (numVoxels);
+
+      #pragma omp parallel for schedule(dynamic, 256)
+      for (int voxelId = 0; voxelId < numVoxels; voxelId++)
+      {
+        if (voxelStarts[voxelId+1] - voxelStarts[voxelId] < static_cast<int>(this->min_points_per_voxel_))
+        {
+          voxelValid[voxelId] = false;
+          continue;
+        }
         
-        for (size_t pointId = 0; pointId < output_->size(); pointId++)
+        if (this->downsample_all_data_)
         {
-          search.setInputCloud(this->input_, boost::make_shared<std::vector<int> >(downsample_map_[pointId]));
-          search.nearestKSearch(output_->points[pointId], 1, neighbors, distances);
-          nearest_indices_.push_back(neighbors[0]);
+          pcl::CentroidPoint<PointT> centroid;
+          for (int pointIdIt = voxelStarts[voxelId]; pointIdIt < voxelStarts[voxelId+1]; pointIdIt++)
+            centroid.add(cloud.points[pointIds[pointIdIt]]);
+          centroid.get(voxelCentroids.points[voxelId]);
+        }
+        else
+        {
+          Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+          for (int pointIdIt = voxelStarts[voxelId]; pointIdIt < voxelStarts[voxelId+1]; pointIdIt++)
+            centroid += cloud.points[pointIds[pointIdIt]].getVector3fMap();
+          voxelCentroids.points[voxelId] = PointT ();
+          voxelCentroids.points[voxelId].getVector3fMap() = centroid / static_cast<float>(voxelStarts[voxelId+1] - voxelStarts[voxelId]);
+        }
+
+        const Eigen::Vector3f normal = voxelCentroids.points[voxelId].getNormalVector3fMap();
+        voxelValid[voxelId] = pcl_isfinite(normal[0]) && pcl_isfinite(normal[1]) && pcl_isfinite(normal[2]);
+
+        const Eigen::Vector3f centroidPoint = voxelCentroids.points[voxelId].getVector3fMap();
+        float minSqrDistance = std::numeric_limits<float>::max();
+        for (int pointIdIt = voxelStarts[voxelId]; pointIdIt < voxelStarts[voxelId+1]; pointIdIt++)
+        {
+          const float sqrDistance = (cloud.points[pointIds[pointIdIt]].getVector3fMap() - centroidPoint).squaredNorm();
+          if (sqrDistance < minSqrDistance)
+          {
+            minSqrDistance = sqrDistance;
+            voxelNearestPoints[voxelId] = pointIds[pointIdIt];
+          }
         }
       }
+
+      //--------------------------------------------------------------------------
+      // Remove voxels with too few points or NaN normals
+
+      output_->clear();
+      for (int voxelId = 0; voxelId < numVoxels; voxelId++)
+      {
+        if (!voxelValid[voxelId])
+          continue;
+
+        output_->push_back(voxelCentroids.points[voxelId]);
+        nearest_indices_.push_back(voxelNearestPoints[voxelId]);
+        downsample_map_.push_back(std::vector<int> (pointIds.begin() + voxelStarts[voxelId], pointIds.begin() + voxelStarts[voxelId+1]));
+      }
+      output_->header = this->input_->header;
+      output_->is_dense = true;
     }
           
     /** \brief Downsample the input pointcloud
@@ -215,23 +502,8 @@ namespace utl
     applyFilter(pcl::PointCloud<PointT> &output)
     {
       // Downsample if we haven't already
-      if (output_->empty())
-        pcl::VoxelGrid<PointT>::applyFilter(*output_);
-      
-      // Remove point with NaN normals
-      non_nan_point_map_.resize(output_->size(), -1);
-      std::vector<int> non_nan_point_indices;
-      int numFilteredPoints = 0;
-      for (size_t pointId = 0; pointId < output_->size(); pointId++)
-      {
-        Eigen::Vector3f normal = output_->points[pointId].getNormalVector3fMap();
-        if (pcl_isfinite(normal[0]) && pcl_isfinite(normal[1]) && pcl_isfinite(normal[2]))
-        {
-          non_nan_point_indices.push_back(pointId);
-          non_nan_point_map_[pointId] = numFilteredPoints++;
-        }
-      }
-      pcl::copyPointCloud<PointT>(*output_, non_nan_point_indices, *output_);
+      if (!computed_)
+        downsampleVoxels();
       
       if (downsample_method_ == AVERAGE)
       {
@@ -239,7 +511,6 @@ namespace utl
       }
       else if (downsample_method_ == NEAREST_NEIGHBOR)
       {
-        computeNearestPointIndices();
         pcl::copyPointCloud<PointT>(*this->input_, nearest_indices_, output);
       }
       
@@ -252,8 +523,8 @@ namespace utl
     {
       output_.reset(new pcl::PointCloud<PointT>);
       downsample_map_.clear();
-      non_nan_point_map_.clear();
       nearest_indices_.clear();
+      computed_ = false;
     }
   };
 
@@ -441,6 +712,71 @@ namespace utl
     }
   };
   
+  /** \brief Find the edges of a graph representing local connectivity
+    * between points in a pointcloud. Neighbor searches run in parallel and
+    * every thread collects its edges in its own buffer. Edges are then sorted
+    * and duplicates are removed, so the result does not depend on the number
+    * of threads.
+    *  \param[in]  indices           indices of the points to be analyzed
+    *  \param[in]  search            search object. Point indices[i] is queried by its position i, i.e. the search object must be built from the same indices (or from the whole cloud if indices enumerate all points).
+    *  \param[in]  radius            radius within which neighbours are searched. If not positive, the num_neighbours nearest neighbours are used instead.
+    *  \param[in]  num_neighbours    maximum number of neighbours (if set to 0 and radius is positive - all neighbours will be included)
+    *  \param[out] edges             sorted vertex pairs of the edges. The first vertex of a pair is the one with the smaller index.
+    */
+  template <typename PointT>
+  inline
+  void getCloudConnectivityEdges  ( const std::vector<int>                  &indices,
+                                    const pcl::search::Search<PointT>       &search,
+                                    const float                             radius,
+                                    const int                               num_neighbours,
+                                    std::vector<std::pair<int, int> >       &edges
+                                  )
+  {
+    edges.clear();
+    
+    std::vector<std::vector<std::pair<int, int> > > threadEdges (omp_get_max_threads());
+    
+    #pragma omp parallel
+    {
+      std::vector<std::pair<int, int> > &curEdges = threadEdges[omp_get_thread_num()];
+      std::vector<float>  distances;
+      std::vector<int>    neighbors;
+      
+      #pragma omp for schedule(dynamic, 256)
+      for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
+      {
+        int pointId = indices[pointIdIt];
+        
+        // Find nearest neighbours
+        if (radius > 0.0f)
+          search.radiusSearch(static_cast<int>(pointIdIt), radius, neighbors, distances, num_neighbours);
+        else
+          search.nearestKSearch(static_cast<int>(pointIdIt), num_neighbours, neighbors, distances);
+        
+        // Add corresponding edges
+        for (size_t nbrId = 0; nbrId < neighbors.size(); nbrId++)
+        {
+          if (pointId != neighbors[nbrId])
+            curEdges.push_back(std::pair<int, int> (std::min(pointId, neighbors[nbrId]), std::max(pointId, neighbors[nbrId])));
+        }
+      }
+    }
+    
+    // Merge thread edges and remove duplicates
+    size_t numEdges = 0;
+    for (size_t threadId = 0; threadId < threadEdges.size(); threadId++)
+      numEdges += threadEdges[threadId].size();
+    edges.reserve(numEdges);
+    for (size_t threadId = 0; threadId < threadEdges.size(); threadId++)
+    {
+      edges.insert(edges.end(), threadEdges[threadId].begin(), threadEdges[threadId].end());
+      std::vector<std::pair<int, int> >().swap(threadEdges[threadId]);
+    }
+    
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  }
+  
   /** \brief Generate graph structure representing local connectivity between
     * points in a pointcloud. Each point is connected to its k nearest
     * neighbors.
@@ -464,28 +800,14 @@ namespace utl
 
                                   )
   {
-    // Prepare graph structure
-    graph.preallocateVertices(cloud->size());
-    
     // Prepare search tree
     pcl::search::KdTree<PointT> searchTree;
     searchTree.setInputCloud(cloud, boost::make_shared<std::vector<int> > (indices));
 
-    // Loop over all points
-    for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
-    { 
-      int pointId = indices[pointIdIt];
-      
-      // Find nearest neighbours
-      std::vector<float>  distances(num_neighbours);
-      std::vector<int>    neighbors(num_neighbours);
-      searchTree.nearestKSearch(pointIdIt, num_neighbours, neighbors, distances);
-          
-      // Add corresponding edges to the graph
-      for (size_t nbrId = 0; nbrId < neighbors.size(); nbrId++)
-        if (pointId != neighbors[nbrId])
-          graph.addEdge(pointId, neighbors[nbrId]);
-    }
+    // Find edges and build the graph
+    std::vector<std::pair<int, int> > edges;
+    getCloudConnectivityEdges<PointT>(indices, searchTree, 0.0f, num_neighbours, edges);
+    graph.setEdges(cloud->size(), edges);
 
     // If there are no edges - return false
     if (graph.getNumEdges() < 1)
@@ -563,26 +885,10 @@ namespace utl
       return false;
     }
     
-    // Prepare graph structure
-    graph.preallocateVertices(cloud->size());
-    
-    // Loop over all points
-    for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
-    { 
-      int pointId = indices[pointIdIt];
-
-      // Find nearest neighbours
-      std::vector<float>  distances;
-      std::vector<int>    neighbors;
-      search_tree.radiusSearch(pointIdIt, radius, neighbors, distances, num_neighbours);
-          
-      // Add corresponding edges to the graph
-      for (size_t nbrId = 0; nbrId < neighbors.size(); nbrId++)
-      {
-        if (pointId != neighbors[nbrId])
-          graph.addEdge(pointId, neighbors[nbrId]);
-      }
-    }
+    // Find edges and build the graph
+    std::vector<std::pair<int, int> > edges;
+    getCloudConnectivityEdges<PointT>(indices, search_tree, radius, num_neighbours, edges);
+    graph.setEdges(cloud->size(), edges);
         
     // If there are no edges - return false
     if (graph.getNumEdges() < 1)
@@ -678,6 +984,84 @@ namespace utl
     return getCloudConnectivityRadius<PointT>(cloud, fake_indices, graph, radius, num_neighbours);
   }
   
+  /** \brief Generate a compressed sparse row graph representing local
+    * connectivity between points in a pointcloud. Each point is connected to
+    * it's k nearest neighbors within a radius r. Neighbor searches run in
+    * parallel and the graph is built in one step from the sorted edges.
+    *  \param[in]  cloud             input cloud
+    *  \param[in]  indices           indices of the points to be analyzed
+    *  \param[in]  search_tree       search tree built from the input cloud and indices
+    *  \param[out] graph             graph
+    *  \param[in]  radius            radius within which neighbours are searched
+    *  \param[in]  num_neighbours    maximum number of neighbours (if set to 0 - all neighbours will be included)
+    *  \return false if no edges were found, true otherwise
+    */
+  template <typename PointT>
+  inline
+  bool getCloudConnectivityRadius ( const typename pcl::PointCloud<PointT>::ConstPtr  &cloud,
+                                    const std::vector<int>                            &indices,
+                                    const pcl::search::KdTree<PointT>                 &search_tree,
+                                    utl::GraphCSR                                     &graph,
+                                    const float                                       radius,
+                                    const int                                         num_neighbours = 0
+                                  )
+  {
+    graph.clear();
+    
+    if (radius <= 0.0f)
+    {
+      std::cout << "[utl::getCloudConnectivityRadius] search radius must be positive." << std::endl;
+      std::cout << "[utl::getCloudConnectivityRadius] input radius: " << radius << std::endl;
+      return false;
+    }
+    
+    // Find edges and build the graph
+    std::vector<std::pair<int, int> > edges;
+    getCloudConnectivityEdges<PointT>(indices, search_tree, radius, num_neighbours, edges);
+    graph.setEdges(cloud->size(), edges);
+    
+    // If there are no edges - return false
+    if (graph.getNumEdges() < 1)
+    {
+      std::cout << "[utl::getCloudConnectivityRadius] no neighbouring points were found." << std::endl;
+      return false;
+    }
+      
+    // Otherwise return true
+    return true;
+  }
+  
+  /** \brief Generate a compressed sparse row graph representing local
+    * connectivity between points in a pointcloud. Each point is connected to
+    * it's k nearest neighbors within a radius r.
+    *  \param[in]  cloud             input cloud
+    *  \param[out] graph             graph
+    *  \param[in]  radius            radius within which neighbours are searched
+    *  \param[in]  num_neighbours    maximum number of neighbours (if set to 0 - all neighbours will be included)
+    *  \return false if no edges were found, true otherwise
+    */
+  template <typename PointT>
+  inline
+  bool getCloudConnectivityRadius ( const typename pcl::PointCloud<PointT>::ConstPtr  &cloud,
+                                    utl::GraphCSR                                     &graph,
+                                    const float                                       radius,
+                                    const int                                         num_neighbours = 0
+                                  )
+  {
+    // Create fake indices
+    std::vector<int> fake_indices;
+    fake_indices.resize(cloud->size());
+    for (size_t pointId = 0; pointId < cloud->size(); pointId++)
+      fake_indices[pointId] = pointId;
+    
+    // Prepare search tree
+    pcl::search::KdTree<PointT> searchTree;
+    searchTree.setInputCloud(cloud);
+    
+    // Build connectivity graph
+    return getCloudConnectivityRadius<PointT>(cloud, fake_indices, searchTree, graph, radius, num_neighbours);
+  }
+  
   /** \brief Given a point in the pointcloud and it's neighbors, check if that
     * point is a boundary point.
     * The idea is similar to occlusion boundary detection provess described in 
@@ -685,6 +1069,81 @@ namespace utl
     *  1. Project all neighboring points onto the tangent plane of the input point.
     *  2. Find the largest angle between vectors connecting the input point to projected neighbors.
     *  3. If that angle is greater than some threshold, the input point is considered to be a boundary.
+    * Instead of sorting the neighbor angles they are accumulated into a fixed
+    * number of angular bins that store the smallest and largest angle falling
+    * into them. Gaps larger than the bin size can only occur between
+    * consecutive occupied bins, so the result is exact as long as the
+    * maximum angle is larger than the bin size. No memory is allocated.
+    *  \param[in]  cloud         input pointcloud
+    *  \param[in]  point_id      index of the input point
+    *  \param[in]  neighbors     indices of neighbors of the input point
+    *  \param[in]  num_neighbors number of neighbors
+    *  \param[in]  max_angle     maximum angle between two consecutive neighbor points
+    *  \return TRUE if input point is a boundary point
+    *  \note input pointcloud must have normals
+    */
+  template <typename PointT>
+  bool isBoundaryPoint  ( const typename pcl::PointCloud<PointT>  &cloud,
+                          const int point_id,
+                          const int *neighbors,
+                          const int num_neighbors,
+                          const float max_angle = pcl::deg2rad(135.0)
+                        )
+  {
+    // If there are no neighbours it must be an occlusion
+    if (num_neighbors == 0)
+      return true;
+    
+    // A single angle has no gaps
+    if (num_neighbors == 1)
+      return false;
+    
+    // Tangent plane basis of the input point
+    const Eigen::Vector3f planePoint  = cloud.points[point_id].getVector3fMap();
+    const Eigen::Vector3f planeNormal = cloud.points[point_id].getNormalVector3fMap();
+    const Eigen::Vector3f planeX = planeNormal.unitOrthogonal();
+    const Eigen::Vector3f planeY = planeNormal.cross(planeX);
+    
+    // Bin the angles of the projected neighbors
+    const int NUM_BINS = 64;
+    const float binSizeInv = static_cast<float>(NUM_BINS / (2 * M_PI));
+    float binMinAngles[NUM_BINS], binMaxAngles[NUM_BINS];
+    std::fill(binMinAngles, binMinAngles + NUM_BINS, std::numeric_limits<float>::max());
+    std::fill(binMaxAngles, binMaxAngles + NUM_BINS, -std::numeric_limits<float>::max());
+    
+    for (int neighbourIt = 0; neighbourIt < num_neighbors; neighbourIt++)
+    {
+      const Eigen::Vector3f neighbourVector = cloud.points[neighbors[neighbourIt]].getVector3fMap() - planePoint;
+      const float angle = std::atan2(neighbourVector.dot(planeY), neighbourVector.dot(planeX)) + static_cast<float>(M_PI);
+      const int binId = std::min(std::max(static_cast<int>(angle * binSizeInv), 0), NUM_BINS - 1);
+      binMinAngles[binId] = std::min(binMinAngles[binId], angle);
+      binMaxAngles[binId] = std::max(binMaxAngles[binId], angle);
+    }
+    
+    // Find the largest difference between consecutive angles. The gap before
+    // the first occupied bin wraps around to the last one.
+    float maxAngleDifference = 0.0f;
+    float prevMaxAngle = 0.0f;
+    int firstBinId = -1;
+    for (int binId = 0; binId < NUM_BINS; binId++)
+    {
+      if (binMaxAngles[binId] < binMinAngles[binId])
+        continue;
+      
+      if (firstBinId == -1)
+        firstBinId = binId;
+      else
+        maxAngleDifference = std::max(maxAngleDifference, binMinAngles[binId] - prevMaxAngle);
+      prevMaxAngle = binMaxAngles[binId];
+    }
+    maxAngleDifference = std::max(maxAngleDifference, binMinAngles[firstBinId] + static_cast<float>(2 * M_PI) - prevMaxAngle);
+    
+    // If maximum difference is bigger than threshold mark point as boundary point
+    return maxAngleDifference > max_angle;
+  }
+
+  /** \brief Given a point in the pointcloud and it's neighbors, check if that
+    * point is a boundary point. See @utl::isBoundaryPoint for algorithm details.
     *  \param[in]  cloud     input pointcloud
     *  \param[in]  point_id  index of the input point
     *  \param[in]  neighbors indices of neighbors of the input point
@@ -699,57 +1158,101 @@ namespace utl
                           const float max_angle = pcl::deg2rad(135.0)
                         )
   {
-    // If there are no neighbours it must be an occlusion
-    if (neighbours.empty())
-      return true;
+    return isBoundaryPoint<PointT>(cloud, point_id, neighbours.data(), neighbours.size(), max_angle);
+  }
+
+  /** \brief Find the boundary points of a subset of a pointcloud using an
+    * existing search object. See @utl::isBoundaryPoint for algorithm details.
+    * Points are processed in parallel, every thread reuses its own neighbor
+    * buffers.
+    *  \param[in]  search          search object of the whole pointcloud
+    *  \param[in]  indices         indices of the points to be analyzed. Only these points are considered as neighbors.
+    *  \param[in]  search_radius   radius used to search for point neighbors
+    *  \param[out] boundary_point_ids      indices of boundary points
+    *  \param[out] non_boundary_point_ids  indices of non boundary points
+    *  \param[in]  max_angle maximum angle between two consecutive neighbor points
+    *  \return FALSE if search radius is not positive
+    *  \note input pointcloud must have normals. Output points are in the order of the input indices.
+    */
+  template <typename PointT>
+  bool getCloudBoundary ( const pcl::search::Search<PointT> &search,
+                          const std::vector<int> &indices,
+                          const float search_radius,
+                          std::vector<int> &boundary_point_ids,
+                          std::vector<int> &non_boundary_point_ids,
+                          const float max_angle = pcl::deg2rad(135.0)
+                        )
+  {
+    boundary_point_ids.resize(0);
+    non_boundary_point_ids.resize(0);
+    
+    if (search_radius <= 0.0f)
+    {
+      std::cout << "[utl::getCloudBoundary] search radius must be positive." << std::endl;
+      std::cout << "[utl::getCloudBoundary] input radius: " << search_radius << std::endl;
+      return false;
+    }
     
-    // Project neighbour points onto the tangent plane of input point
-    Eigen::Vector3f planePoint  = cloud.points[point_id].getVector3fMap();
-    Eigen::Vector3f planeNormal = cloud.points[point_id].getNormalVector3fMap();
-    std::vector<Eigen::Vector3f> projectedNeighbours(neighbours.size());
+    typename pcl::PointCloud<PointT>::ConstPtr cloud = search.getInputCloud();
     
-    for (size_t neighbourId = 0; neighbourId < neighbours.size(); neighbourId++)
+    std::vector<char> pointMask (cloud->size(), false);
+    for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
+      pointMask[indices[pointIdIt]] = true;
+    
+    // 1 - boundary, 0 - non boundary, -1 - no neighbors
+    std::vector<signed char> pointBoundary (indices.size(), -1);
+    
+    #pragma omp parallel
     {
-      Eigen::Vector3f neighbourPoint          = cloud.points[neighbours[neighbourId]].getVector3fMap();
-      Eigen::Vector3f neighbourPointProjected = utl::projectPointToPlane(neighbourPoint, planePoint, planeNormal);
-      projectedNeighbours[neighbourId]        = neighbourPointProjected;
+      std::vector<float>  distancesSquared;
+      std::vector<int>    neighbors;
+      
+      #pragma omp for schedule(dynamic, 256)
+      for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
+      {
+        const int pointId = indices[pointIdIt];
+        
+        // Find point neighbors that belong to the subset, excluding the point itself
+        search.radiusSearch(cloud->points[pointId], search_radius, neighbors, distancesSquared);
+        int numNeighbors = 0;
+        bool pointFound = false;
+        for (size_t nbrIdIt = 0; nbrIdIt < neighbors.size(); nbrIdIt++)
+        {
+          if (neighbors[nbrIdIt] == pointId)
+            pointFound = true;
+          else if (pointMask[neighbors[nbrIdIt]])
+            neighbors[numNeighbors++] = neighbors[nbrIdIt];
+        }
+        
+        if (!pointFound)                  // If there are no neighbors - do nothing. This shouldn't really happen unless search
+          continue;                       // radius is 0. In that case function will find no boundary points.
+        
+        // Check if point is a boundary point
+        pointBoundary[pointIdIt] = utl::isBoundaryPoint<PointT>(*cloud, pointId, neighbors.data(), numNeighbors, max_angle);
+      }
     }
     
-    // Calculate signed angles between first vector and all other vectors
-    Eigen::Vector3f referenceVector = projectedNeighbours[0] - planePoint;
-    std::vector<float> angles (neighbours.size());
-    for (size_t neighbourId = 0; neighbourId < projectedNeighbours.size(); neighbourId++)
+    for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
     {
-      Eigen::Vector3f currentVector = projectedNeighbours[neighbourId] - planePoint;
-      float curAngle = utl::vectorVectorAngleCW(referenceVector, currentVector, planeNormal);
-      angles[neighbourId] = curAngle;
+      if (pointBoundary[pointIdIt] == 1)
+        boundary_point_ids.push_back(indices[pointIdIt]);
+      else if (pointBoundary[pointIdIt] == 0)
+        non_boundary_point_ids.push_back(indices[pointIdIt]);
     }
-
-    // Calculate difference between consecutinve angles
-    std::sort(angles.begin(), angles.end());
-    std::vector<float> angleDifference(angles.size());
-    for (size_t i = 1; i < angles.size(); i++)
-      angleDifference[i] = utl::angleDifferenceCCW(angles[i-1], angles[i]);
-    angleDifference[0] = utl::angleDifferenceCCW(angles[angles.size()-1], angles[0]);
     
-    // If maximum difference is bigger than threshold mark point as boundary point
-    if (*std::max_element(angleDifference.begin(), angleDifference.end()) > max_angle)
-      return true;
-    else
-      return false;
+    return true;
   }
 
   /** \brief Find the boundary points of a pointcloud. See @utl::isBoundaryPoint
     * for algorithm details.
     *  \param[in]  cloud           input pointcloud
+    *  \param[in]  indices         indices of the points to be analyzed
     *  \param[in]  search_radius   radius used to search for point neighbors
     *  \param[out] boundary_point_ids  indices of boundary points
     *  \param[in]  max_angle maximum angle between two consecutive neighbor points
     *  \return TRUE if input point is a boundary point
     *  \note input pointcloud must have normals
     */
-    // NOTE: for some reason this is REEALLLLLY slow. Running this function
-    // with fake indices is order of magnitude slower than running without indices
   template <typename PointT>
   bool getCloudBoundary ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
                           const std::vector<int> &indices,
@@ -766,30 +1269,78 @@ namespace utl
       return false;
     }
     
-    boundary_point_ids.resize(0);
-    non_boundary_point_ids.resize(0);
-    
     // Prepare search tree
     typename pcl::search::KdTree<PointT> tree;
     tree.setInputCloud(cloud, boost::make_shared<std::vector<int> >(indices));
     
-    // Loop over cloud points
-    for (size_t pointIdIt = 0; pointIdIt < indices.size(); pointIdIt++)
+    return getCloudBoundary<PointT>(tree, indices, search_radius, boundary_point_ids, non_boundary_point_ids, max_angle);
+  }
+
+  /** \brief Find the boundary points of a pointcloud. See @utl::isBoundaryPoint
+    * for algorithm details.
+    *  \param[in]  search          search object of the input pointcloud
+    *  \param[in]  search_radius   radius used to search for point neighbors
+    *  \param[out] boundary_point_ids  indices of boundary points
+    *  \param[in]  max_angle maximum angle between two consecutive neighbor points
+    *  \return FALSE if search radius is not positive
+    *  \note input pointcloud must have normals
+    */
+  template <typename PointT>
+  bool getCloudBoundary ( const pcl::search::Search<PointT> &search,
+                          const float search_radius,
+                          std::vector<int> &boundary_point_ids,
+                          std::vector<int> &non_boundary_point_ids,
+                          const float max_angle = pcl::deg2rad(135.0)
+                        )
+  {
+    std::vector<int> fake_indices (search.getInputCloud()->size());
+    for (size_t pointId = 0; pointId < fake_indices.size(); pointId++)
+      fake_indices[pointId] = pointId;
+    
+    return getCloudBoundary<PointT>(search, fake_indices, search_radius, boundary_point_ids, non_boundary_point_ids, max_angle);
+  }
+
+  /** \brief Find the boundary points of a pointcloud using a precomputed
+    * neighborhood graph, e.g. the adjacency graph of the pointcloud. See
+    * @utl::isBoundaryPoint for algorithm details.
+    *  \param[in]  cloud           input pointcloud
+    *  \param[in]  neighborhood    graph connecting every point to its neighbors
+    *  \param[out] boundary_point_ids  indices of boundary points
+    *  \param[in]  max_angle maximum angle between two consecutive neighbor points
+    *  \return false if the number of graph vertices is different from the number of points
+    *  \note input pointcloud must have normals
+    */
+  template <typename PointT>
+  bool getCloudBoundary ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
+                          const utl::GraphCSR &neighborhood,
+                          std::vector<int> &boundary_point_ids,
+                          std::vector<int> &non_boundary_point_ids,
+                          const float max_angle = pcl::deg2rad(135.0)
+                        )
+  {
+    boundary_point_ids.resize(0);
+    non_boundary_point_ids.resize(0);
+    
+    if (neighborhood.getNumVertices() != static_cast<int>(cloud->size()))
     {
-      int pointId = indices[pointIdIt];
-      
-      // Find point neighbors
-      std::vector<float>  distancesSquared;
-      std::vector<int>    neighbors;
-      tree.radiusSearch(pointIdIt, search_radius, neighbors, distancesSquared);
-      
-      if (neighbors.size() < 1)         // If there are no neighbors - do nothing. This shouldn't really happen unless search
-        continue;                       // radius is 0. In that case function will find no boundary points.
-      
-      std::vector<int> neighborsFirstExcluded (neighbors.begin()+1, neighbors.end());
-      
-      // Check if point is a boundary point
-      if (utl::isBoundaryPoint<PointT>(*cloud, pointId, neighborsFirstExcluded))
+      std::cout << "[utl::getCloudBoundary] number of neighborhood graph vertices is different from the number of points." << std::endl;
+      std::cout << "[utl::getCloudBoundary] number of vertices: " << neighborhood.getNumVertices() << ", number of points: " << cloud->size() << std::endl;
+      return false;
+    }
+    
+    std::vector<char> pointBoundary (cloud->size());
+    
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int pointId = 0; pointId < static_cast<int>(cloud->size()); pointId++)
+    {
+      const int *neighbors, *neighborEdges;
+      const int numNeighbors = neighborhood.getVertexNeighborRange(pointId, neighbors, neighborEdges);
+      pointBoundary[pointId] = utl::isBoundaryPoint<PointT>(*cloud, pointId, neighbors, numNeighbors, max_angle);
+    }
+    
+    for (size_t pointId = 0; pointId < cloud->size(); pointId++)
+    {
+      if (pointBoundary[pointId])
         boundary_point_ids.push_back(pointId);
       else
         non_boundary_point_ids.push_back(pointId);
@@ -798,69 +1349,28 @@ namespace utl
     return true;
   }
   
-//     /** \brief Find the boundary points of a pointcloud. See @utl::isBoundaryPoint
-//      * for algorithm details.
-//      *  \param[in]  cloud           input pointcloud
-//      *  \param[in]  search_radius   radius used to search for point neighbors
-//      *  \param[out] boundary_point_ids  indices of boundary points
-//      *  \param[in]  max_angle maximum angle between two consecutive neighbor points
-//      *  \return TRUE if input point is a boundary point
-//      *  \note input pointcloud must have normals
-//      */
-//     template <typename PointT>
-//     void getCloudBoundary ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
-//                             const float search_radius,
-//                             std::vector<int> &boundary_point_ids,
-//                             const float max_angle = pcl::deg2rad(135.0)
-//                           )
-//     {
-//       std::vector<int> fake_indices (cloud->size());
-//       getCloudBoundary<PointT>(cloud, fake_indices, search_radius, boundary_point_ids, max_angle);
-//     }
-
   /** \brief Find the boundary points of a pointcloud. See @utl::isBoundaryPoint
     * for algorithm details.
     *  \param[in]  cloud           input pointcloud
     *  \param[in]  search_radius   radius used to search for point neighbors
     *  \param[out] boundary_point_ids  indices of boundary points
     *  \param[in]  max_angle maximum angle between two consecutive neighbor points
-    *  \return TRUE if input point is a boundary point
+    *  \return FALSE if search radius is not positive
     *  \note input pointcloud must have normals
     */
   template <typename PointT>
-  void getCloudBoundary ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
+  bool getCloudBoundary ( const typename pcl::PointCloud<PointT>::ConstPtr &cloud,
                           const float search_radius,
                           std::vector<int> &boundary_point_ids,
                           std::vector<int> &non_boundary_point_ids,
                           const float max_angle = pcl::deg2rad(135.0)
                         )
   {
-    boundary_point_ids.resize(0);
-    non_boundary_point_ids.resize(0);
-    
     // Prepare search tree
     typename pcl::search::KdTree<PointT> tree;
     tree.setInputCloud(cloud);
     
-    // Loop over cloud points
-    for (size_t pointId = 0; pointId < cloud->size(); pointId++)
-    {
-      // Find point neighbors
-      std::vector<float>  distancesSquared;
-      std::vector<int>    neighbors;
-      tree.radiusSearch(pointId, search_radius, neighbors, distancesSquared);
-      
-      if (neighbors.size() < 1)         // If there are no neighbors - do nothing. This shouldn't really happen unless search
-        continue;                       // radius is 0. In that case function will find no boundary points.
-      
-      std::vector<int> neighborsFirstExcluded (neighbors.begin()+1, neighbors.end());
-      
-      // Check if point is a boundary point
-      if (utl::isBoundaryPoint<PointT>(*cloud, pointId, neighborsFirstExcluded))
-        boundary_point_ids.push_back(pointId);
-      else
-        non_boundary_point_ids.push_back(pointId);
-    }
+    return getCloudBoundary<PointT>(tree, search_radius, boundary_point_ids, non_boundary_point_ids, max_angle);
   }
   
   /** \brief Project a pointcloud on a plane.
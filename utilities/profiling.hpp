@@ -0,0 +1,515 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef PROFILING_HPP
+#define PROFILING_HPP
+
+// STD includes
+#include <stdint.h>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+// Boost includes
+#include <boost/shared_ptr.hpp>
+
+//------------------------------------------------------------------------------
+// Instrumentation macros
+//------------------------------------------------------------------------------
+// Instrumentation is compiled in only if SYMSEG_PROFILING is defined (see the
+// SYMSEG_PROFILING CMake option). Otherwise the macros expand to nothing and
+// have no cost.
+//
+//  UTL_PROFILE_SCOPE(name)             time the enclosing scope as a stage
+//  UTL_PROFILE_SEGMENT(name, id)       attribute the counters and the time of
+//                                      the enclosing scope to a segment
+//  UTL_PROFILE_COUNT(counter, value)   add a value to a counter
+
+#ifdef SYMSEG_PROFILING
+  #define UTL_PROFILE_CONCAT_IMPL(a, b) a##b
+  #define UTL_PROFILE_CONCAT(a, b) UTL_PROFILE_CONCAT_IMPL(a, b)
+  #define UTL_PROFILE_SCOPE(name) utl::ScopedTimer UTL_PROFILE_CONCAT(utlProfileTimer, __LINE__) (name)
+  #define UTL_PROFILE_SEGMENT(name, id) utl::ScopedSegment UTL_PROFILE_CONCAT(utlProfileSegment, __LINE__) (name, id)
+  #define UTL_PROFILE_COUNT(counter, value) utl::Profiler::getInstance().count(counter, value)
+#else
+  #define UTL_PROFILE_SCOPE(name)
+  #define UTL_PROFILE_SEGMENT(name, id)
+  #define UTL_PROFILE_COUNT(counter, value)
+#endif
+
+namespace utl
+{
+  /** \brief Profiling counters */
+  enum ProfileCounter
+  {
+    PROFILE_HYPOTHESES_GENERATED,   /**< initial symmetry hypotheses */
+    PROFILE_HYPOTHESES_REFINED,     /**< successfully refined hypotheses */
+    PROFILE_HYPOTHESES_FILTERED,    /**< hypotheses that passed filtering */
+    PROFILE_HYPOTHESES_MERGED,      /**< hypotheses left after merging duplicates */
+    PROFILE_LM_ITERATIONS,          /**< Levenberg-Marquardt iterations */
+    PROFILE_NN_QUERIES,             /**< nearest neighbor grid queries */
+    PROFILE_OCCUPANCY_QUERIES,      /**< occupancy map distance and occlusion queries */
+    PROFILE_MINCUT_GRAPHS,          /**< min cuts */
+    PROFILE_MINCUT_VERTICES,        /**< vertices of the min cut graphs */
+    PROFILE_MINCUT_EDGES,           /**< edges of the min cut graphs */
+    NUM_PROFILE_COUNTERS
+  };
+
+  /** \brief Get the name of a profiling counter. */
+  inline
+  const char* getProfileCounterName (const int counter)
+  {
+    static const char* names[NUM_PROFILE_COUNTERS] = {  "hypotheses_generated",
+                                                        "hypotheses_refined",
+                                                        "hypotheses_filtered",
+                                                        "hypotheses_merged",
+                                                        "lm_iterations",
+                                                        "nn_queries",
+                                                        "occupancy_queries",
+                                                        "mincut_graphs",
+                                                        "mincut_vertices",
+                                                        "mincut_edges" };
+    return (counter >= 0 && counter < NUM_PROFILE_COUNTERS) ? names[counter] : "unknown";
+  }
+
+  /** \brief @b Profiler Process wide collector of stage timings and counters.
+   * Every thread counts into its own block of counters, so counting does not
+   * contend between threads. Counters of a segment are atomic because the
+   * work of one segment may be split into tasks running on several threads.
+   * Timed scopes are stored as events with their wall time, process CPU time
+   * (summed over all threads) and the segment they belong to. Results can be
+   * written as a JSON summary or as a Chrome trace (chrome://tracing).
+   * Use the UTL_PROFILE_* macros rather than calling the profiler directly so
+   * that instrumentation disappears when profiling is disabled.
+   */
+  class Profiler
+  {
+  public:
+
+    /** \brief Counters and time of a segment. */
+    struct SegmentRecord
+    {
+      SegmentRecord (const std::string &name, const int id)
+        : name (name)
+        , id (id)
+        , wall_time_us (0)
+      {
+        for (int counterId = 0; counterId < NUM_PROFILE_COUNTERS; counterId++)
+          counters[counterId] = 0;
+      }
+
+      std::string name;
+      int id;
+      std::atomic<int64_t> counters[NUM_PROFILE_COUNTERS];
+      std::atomic<int64_t> wall_time_us;    // Summed over all scopes of the segment
+    };
+
+    /** \brief Timed scope. Times are in microseconds since the profiler was reset. */
+    struct Event
+    {
+      std::string name;
+      const SegmentRecord *segment;
+      int thread_id;
+      int64_t start_us;
+      int64_t wall_time_us;
+      int64_t cpu_time_us;
+    };
+
+    /** \brief Get the profiler of the process. */
+    static Profiler&
+    getInstance ()
+    {
+      static Profiler profiler;
+      return profiler;
+    }
+
+    /** \brief Remove all events, segments and counts. */
+    inline void
+    reset ()
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      events_.clear();
+      segments_.clear();
+      for (size_t threadId = 0; threadId < thread_counters_.size(); threadId++)
+        for (int counterId = 0; counterId < NUM_PROFILE_COUNTERS; counterId++)
+          thread_counters_[threadId]->counters[counterId].store(0, std::memory_order_relaxed);
+      start_ = std::chrono::steady_clock::now();
+    }
+
+    /** \brief Add a value to a counter of the calling thread and of the
+     * segment of the calling thread.
+     *  \param[in]  counter   counter
+     *  \param[in]  value     value to add
+     */
+    inline void
+    count (const ProfileCounter counter, const int64_t value)
+    {
+      // Only the owning thread writes its block, so no atomic read-modify-write is needed
+      std::atomic<int64_t> &threadCounter = getThreadCounters().counters[counter];
+      threadCounter.store(threadCounter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+      SegmentRecord *segment = getCurrentSegment();
+      if (segment)
+        segment->counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /** \brief Get the total value of a counter over all threads. */
+    inline int64_t
+    getCounter (const ProfileCounter counter) const
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      int64_t value = 0;
+      for (size_t threadId = 0; threadId < thread_counters_.size(); threadId++)
+        value += thread_counters_[threadId]->counters[counter].load(std::memory_order_relaxed);
+      return value;
+    }
+
+    /** \brief Get the record of a segment, creating it if needed. Records
+     * stay valid until the profiler is reset.
+     *  \param[in]  name  segment group name (e.g. the stage that owns the segment)
+     *  \param[in]  id    segment index within the group
+     */
+    inline SegmentRecord*
+    getSegment (const std::string &name, const int id)
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      boost::shared_ptr<SegmentRecord> &segment = segments_[std::pair<std::string, int> (name, id)];
+      if (!segment)
+        segment.reset(new SegmentRecord (name, id));
+      return segment.get();
+    }
+
+    /** \brief Get the segment that the calling thread is working on (NULL if none). */
+    static SegmentRecord*&
+    getCurrentSegment ()
+    {
+      static thread_local SegmentRecord *segment = NULL;
+      return segment;
+    }
+
+    /** \brief Add a timed scope.
+     *  \param[in]  event   event
+     */
+    inline void
+    addEvent (const Event &event)
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      events_.push_back(event);
+    }
+
+    /** \brief Get the wall time since the profiler was reset in microseconds. */
+    inline int64_t
+    getTime () const
+    {
+      return std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now() - start_).count();
+    }
+
+    /** \brief Get the CPU time of the process in microseconds. */
+    static int64_t
+    getCpuTime ()
+    {
+      return static_cast<int64_t>(static_cast<double>(std::clock()) / CLOCKS_PER_SEC * 1.0e6);
+    }
+
+    /** \brief Get the profiler id of the calling thread. */
+    inline int
+    getThreadId ()
+    {
+      return getThreadCounters().thread_id;
+    }
+
+    /** \brief Write a JSON summary: total counters, wall and CPU time of every
+     * stage aggregated over its calls, and the counters and time of every
+     * segment.
+     *  \param[in]  filename  output filename
+     *  \return false if the file could not be written
+     */
+    inline bool
+    writeJSON (const std::string &filename) const
+    {
+      std::ofstream file (filename.c_str());
+      if (!file.is_open())
+      {
+        std::cout << "[utl::Profiler::writeJSON] could not open file '" << filename << "' for writing." << std::endl;
+        return false;
+      }
+
+      // Aggregate stages
+      std::map<std::string, StageSummary> stages;
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        for (size_t eventId = 0; eventId < events_.size(); eventId++)
+        {
+          StageSummary &stage = stages[events_[eventId].name];
+          stage.calls++;
+          stage.wall_time_us += events_[eventId].wall_time_us;
+          stage.cpu_time_us += events_[eventId].cpu_time_us;
+        }
+      }
+
+      file << "{" << std::endl;
+
+      // Counters
+      file << "  \"counters\": {";
+      for (int counterId = 0; counterId < NUM_PROFILE_COUNTERS; counterId++)
+        file << (counterId ? ", " : "") << "\"" << getProfileCounterName(counterId) << "\": " << getCounter(static_cast<ProfileCounter>(counterId));
+      file << "}," << std::endl;
+
+      // Stages
+      file << "  \"stages\": {";
+      for (std::map<std::string, StageSummary>::const_iterator stageIt = stages.begin(); stageIt != stages.end(); stageIt++)
+      {
+        file << (stageIt == stages.begin() ? "" : ",") << std::endl;
+        file << "    \"" << escape(stageIt->first) << "\": {\"calls\": " << stageIt->second.calls
+             << ", \"wall_time\": " << toSeconds(stageIt->second.wall_time_us)
+             << ", \"cpu_time\": " << toSeconds(stageIt->second.cpu_time_us) << "}";
+      }
+      file << std::endl << "  }," << std::endl;
+
+      // Segments
+      file << "  \"segments\": [";
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        for (SegmentMap::const_iterator segIt = segments_.begin(); segIt != segments_.end(); segIt++)
+        {
+          const SegmentRecord &segment = *segIt->second;
+          file << (segIt == segments_.begin() ? "" : ",") << std::endl;
+          file << "    {\"name\": \"" << escape(segment.name) << "\", \"id\": " << segment.id
+               << ", \"wall_time\": " << toSeconds(segment.wall_time_us.load());
+          for (int counterId = 0; counterId < NUM_PROFILE_COUNTERS; counterId++)
+            file << ", \"" << getProfileCounterName(counterId) << "\": " << segment.counters[counterId].load();
+          file << "}";
+        }
+      }
+      file << std::endl << "  ]" << std::endl;
+      file << "}" << std::endl;
+
+      return file.good();
+    }
+
+    /** \brief Write all timed scopes in the Chrome trace event format. Every
+     * thread is shown as a separate track. Segment and CPU time of a scope are
+     * stored in its arguments. Total counters are added as counter events at
+     * the end of the trace.
+     *  \param[in]  filename  output filename
+     *  \return false if the file could not be written
+     */
+    inline bool
+    writeChromeTrace (const std::string &filename) const
+    {
+      std::ofstream file (filename.c_str());
+      if (!file.is_open())
+      {
+        std::cout << "[utl::Profiler::writeChromeTrace] could not open file '" << filename << "' for writing." << std::endl;
+        return false;
+      }
+
+      int64_t endTime = 0;
+      file << "{\"traceEvents\": [";
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        for (size_t eventId = 0; eventId < events_.size(); eventId++)
+        {
+          const Event &event = events_[eventId];
+          endTime = std::max(endTime, event.start_us + event.wall_time_us);
+          file << (eventId ? "," : "") << std::endl;
+          file << "  {\"name\": \"" << escape(event.name) << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.thread_id
+               << ", \"ts\": " << event.start_us << ", \"dur\": " << event.wall_time_us
+               << ", \"args\": {\"cpu_time_us\": " << event.cpu_time_us;
+          if (event.segment)
+            file << ", \"segment\": \"" << escape(event.segment->name) << "\", \"segment_id\": " << event.segment->id;
+          file << "}}";
+        }
+      }
+
+      for (int counterId = 0; counterId < NUM_PROFILE_COUNTERS; counterId++)
+      {
+        file << "," << std::endl;
+        file << "  {\"name\": \"" << getProfileCounterName(counterId) << "\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << endTime
+             << ", \"args\": {\"value\": " << getCounter(static_cast<ProfileCounter>(counterId)) << "}}";
+      }
+
+      file << std::endl << "]}" << std::endl;
+      return file.good();
+    }
+
+  private:
+
+    /** \brief Counters of a thread. */
+    struct ThreadCounters
+    {
+      ThreadCounters (const int thread_id)
+        : thread_id (thread_id)
+      {
+        for (int counterId = 0; counterId < NUM_PROFILE_COUNTERS; counterId++)
+          counters[counterId] = 0;
+      }
+
+      int thread_id;
+      std::atomic<int64_t> counters[NUM_PROFILE_COUNTERS];
+    };
+
+    /** \brief Aggregated calls of a stage. */
+    struct StageSummary
+    {
+      StageSummary ()
+        : calls (0)
+        , wall_time_us (0)
+        , cpu_time_us (0)
+      { }
+
+      int64_t calls;
+      int64_t wall_time_us;
+      int64_t cpu_time_us;
+    };
+
+    typedef std::map<std::pair<std::string, int>, boost::shared_ptr<SegmentRecord> > SegmentMap;
+
+    /** \brief Constructor. Use getInstance. */
+    Profiler ()
+      : start_ (std::chrono::steady_clock::now())
+    { }
+
+    Profiler (const Profiler&);
+    Profiler& operator= (const Profiler&);
+
+    /** \brief Get the counters of the calling thread, registering them on first use. */
+    inline ThreadCounters&
+    getThreadCounters ()
+    {
+      static thread_local ThreadCounters *threadCounters = NULL;
+      if (!threadCounters)
+      {
+        std::lock_guard<std::mutex> lock (mutex_);
+        thread_counters_.push_back(boost::shared_ptr<ThreadCounters> (new ThreadCounters (thread_counters_.size())));
+        threadCounters = thread_counters_.back().get();
+      }
+      return *threadCounters;
+    }
+
+    /** \brief Escape a string for JSON. */
+    static std::string
+    escape (const std::string &str)
+    {
+      std::string escaped;
+      for (size_t charId = 0; charId < str.size(); charId++)
+      {
+        if (str[charId] == '"' || str[charId] == '\\')
+          escaped += '\\';
+        escaped += str[charId];
+      }
+      return escaped;
+    }
+
+    /** \brief Convert microseconds to seconds. */
+    static double
+    toSeconds (const int64_t time_us)
+    {
+      return static_cast<double>(time_us) * 1.0e-6;
+    }
+
+    /** \brief Protects events, segments and thread registration. */
+    mutable std::mutex mutex_;
+
+    /** \brief Time the profiler was reset. */
+    std::chrono::steady_clock::time_point start_;
+
+    /** \brief Counters of all threads that counted something. Never removed
+     * because threads keep pointers to their counters. */
+    std::vector<boost::shared_ptr<ThreadCounters> > thread_counters_;
+
+    /** \brief Segment records. */
+    SegmentMap segments_;
+
+    /** \brief Timed scopes. */
+    std::vector<Event> events_;
+  };
+
+  /** \brief @b ScopedTimer Records the wall and process CPU time of a scope as
+   * a profiler event. */
+  class ScopedTimer
+  {
+  public:
+
+    /** \brief Constructor. Starts the timer.
+     *  \param[in]  name  stage name
+     */
+    explicit ScopedTimer (const char *name)
+      : name_ (name)
+      , start_us_ (Profiler::getInstance().getTime())
+      , cpu_start_us_ (Profiler::getCpuTime())
+    { }
+
+    /** \brief Destructor. Stops the timer and records the event. */
+    ~ScopedTimer ()
+    {
+      Profiler &profiler = Profiler::getInstance();
+      Profiler::Event event;
+      event.name = name_;
+      event.segment = Profiler::getCurrentSegment();
+      event.thread_id = profiler.getThreadId();
+      event.start_us = start_us_;
+      event.wall_time_us = profiler.getTime() - start_us_;
+      event.cpu_time_us = Profiler::getCpuTime() - cpu_start_us_;
+      profiler.addEvent(event);
+    }
+
+  private:
+
+    ScopedTimer (const ScopedTimer&);
+    ScopedTimer& operator= (const ScopedTimer&);
+
+    const char *name_;
+    int64_t start_us_, cpu_start_us_;
+  };
+
+  /** \brief @b ScopedSegment Attributes the counters and the wall time of a
+   * scope on the calling thread to a segment. Tasks that work on a segment on
+   * other threads have to open their own scope with the same name and id.
+   * Scopes can be nested: the previous segment is restored on exit.
+   */
+  class ScopedSegment
+  {
+  public:
+
+    /** \brief Constructor.
+     *  \param[in]  name  segment group name
+     *  \param[in]  id    segment index within the group
+     */
+    ScopedSegment (const char *name, const int id)
+      : previous_ (Profiler::getCurrentSegment())
+      , start_us_ (Profiler::getInstance().getTime())
+    {
+      segment_ = Profiler::getInstance().getSegment(name, id);
+      Profiler::getCurrentSegment() = segment_;
+    }
+
+    /** \brief Destructor. */
+    ~ScopedSegment ()
+    {
+      // A scope nested in a scope of the same segment (e.g. a subtask run by
+      // the thread waiting for it) is already timed by the outer scope
+      if (segment_ != previous_)
+        segment_->wall_time_us.fetch_add(Profiler::getInstance().getTime() - start_us_, std::memory_order_relaxed);
+      Profiler::getCurrentSegment() = previous_;
+    }
+
+  private:
+
+    ScopedSegment (const ScopedSegment&);
+    ScopedSegment& operator= (const ScopedSegment&);
+
+    Profiler::SegmentRecord *segment_, *previous_;
+    int64_t start_us_;
+  };
+}
+
+#endif  // PROFILING_HPP
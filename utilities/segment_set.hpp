@@ -0,0 +1,409 @@
+// Copyright 2017 Aleksandrs Ecins
+// Licensed under GPLv2+
+// Refer to the LICENSE.txt file included.
+
+#ifndef SEGMENT_SET_HPP
+#define SEGMENT_SET_HPP
+
+// STD includes
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+// Boost includes
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+// Utilities includes
+#include <map.hpp>
+
+namespace utl
+{
+  /** \brief @b SegmentView Read only view of a single segment of a
+   * SegmentSet. Point indices of the segment are sorted and unique. Large
+   * segments also have a dense bitset covering the range of their indices that
+   * makes membership tests constant time. A view does not own any memory and
+   * is only valid while a SegmentSet that shares the segment storage exists.
+   */
+  class SegmentView
+  {
+  public:
+
+    /** \brief Empty constructor. */
+    SegmentView ()
+      : begin_ (NULL)
+      , end_ (NULL)
+      , bits_ (NULL)
+    { }
+
+    /** \brief Constructor.
+     *  \param[in]  begin   pointer to the first index of the segment
+     *  \param[in]  end     pointer past the last index of the segment
+     *  \param[in]  bits    bitset of the segment indices relative to the first index (NULL if the segment has no bitset)
+     */
+    SegmentView (const uint32_t *begin, const uint32_t *end, const uint64_t *bits)
+      : begin_ (begin)
+      , end_ (end)
+      , bits_ (bits)
+    { }
+
+    /** \brief Get the number of points in the segment. */
+    inline size_t
+    size () const  { return end_ - begin_; }
+
+    /** \brief Check if the segment has no points. */
+    inline bool
+    empty () const  { return begin_ == end_; }
+
+    /** \brief Get the index of a point of the segment. */
+    inline uint32_t
+    operator[] (const size_t point_id_it) const  { return begin_[point_id_it]; }
+
+    /** \brief Get pointers to the first and past the last index. */
+    inline const uint32_t*
+    begin () const  { return begin_; }
+
+    inline const uint32_t*
+    end () const  { return end_; }
+
+    /** \brief Check if the segment has a dense bitset. */
+    inline bool
+    isDense () const  { return bits_ != NULL; }
+
+    /** \brief Check if a point belongs to the segment. Constant time for
+     * segments with a bitset and logarithmic in the segment size otherwise.
+     *  \param[in]  point_id  point index
+     */
+    inline bool
+    contains (const uint32_t point_id) const
+    {
+      if (empty() || point_id < *begin_ || point_id > *(end_ - 1))
+        return false;
+
+      if (bits_)
+      {
+        const uint32_t bitId = point_id - *begin_;
+        return (bits_[bitId / 64] >> (bitId % 64)) & 1;
+      }
+
+      return std::binary_search(begin_, end_, point_id);
+    }
+
+    /** \brief Copy the indices of the segment.
+     *  \param[out] indices   point indices
+     */
+    inline void
+    toVector (std::vector<int> &indices) const
+    {
+      indices.assign(begin_, end_);
+    }
+
+  private:
+
+    /** \brief Indices of the segment. */
+    const uint32_t *begin_, *end_;
+
+    /** \brief Bitset of the segment indices (NULL if the segment is sparse). */
+    const uint64_t *bits_;
+  };
+
+  /** \brief Get the number of points shared by two segments. Membership of
+   * the points of the smaller segment is tested with the bitset of the larger
+   * one if it has one. Otherwise the two sorted index lists are merged.
+   *  \param[in]  segment1  first segment
+   *  \param[in]  segment2  second segment
+   *  \return number of shared points
+   */
+  inline
+  size_t getIntersectionSize (const SegmentView &segment1, const SegmentView &segment2)
+  {
+    const SegmentView &segmentSmall = segment1.size() < segment2.size() ? segment1 : segment2;
+    const SegmentView &segmentLarge = segment1.size() < segment2.size() ? segment2 : segment1;
+
+    size_t intersection = 0;
+    if (segmentLarge.isDense())
+    {
+      for (const uint32_t *pointIdIt = segmentSmall.begin(); pointIdIt != segmentSmall.end(); pointIdIt++)
+        intersection += segmentLarge.contains(*pointIdIt);
+      return intersection;
+    }
+
+    const uint32_t *it1 = segment1.begin(), *it2 = segment2.begin();
+    while (it1 != segment1.end() && it2 != segment2.end())
+    {
+      if (*it1 < *it2)
+        it1++;
+      else if (*it2 < *it1)
+        it2++;
+      else
+      {
+        intersection++;
+        it1++;
+        it2++;
+      }
+    }
+
+    return intersection;
+  }
+
+  /** \brief Get the intersection over union of two segments.
+   *  \param[in]  segment1  first segment
+   *  \param[in]  segment2  second segment
+   *  \return intersection over union (0 if both segments are empty)
+   */
+  inline
+  float getIntersectionOverUnion (const SegmentView &segment1, const SegmentView &segment2)
+  {
+    const size_t intersection = getIntersectionSize(segment1, segment2);
+    const size_t segUnion = segment1.size() + segment2.size() - intersection;
+    return segUnion == 0 ? 0.0f : static_cast<float>(intersection) / static_cast<float>(segUnion);
+  }
+
+  /** \brief @b SegmentSet Immutable set of segments with shared, reference
+   * counted storage. Point indices of all segments live in a single array of
+   * sorted and unique 32 bit indices. Copies, slices and subsets of a set share
+   * that storage and never copy point indices, so segments can be passed
+   * around and selected as cheaply as their ids. The set is convertible to and
+   * from utl::Map. Segments with at least a minimum number of points whose
+   * index range is not much wider than the segment also get a dense bitset
+   * for constant time membership tests.
+   */
+  class SegmentSet
+  {
+  public:
+
+    /** \brief Empty constructor. */
+    SegmentSet ()
+      : first_ (0)
+      , size_ (0)
+    { }
+
+    /** \brief Constructor from a map. Indices of every segment are sorted and
+     * duplicates are removed.
+     *  \param[in]  segments        segments
+     *  \param[in]  dense_min_size  minimum size of a segment that gets a bitset
+     *  \note a bitset is created for a segment only if it uses at most twice
+     *  as much memory as the indices of the segment, i.e. the index range of
+     *  the segment is at most 64 times its size.
+     */
+    explicit SegmentSet (const utl::Map &segments, const size_t dense_min_size = 1024)
+      : first_ (0)
+      , size_ (segments.size())
+    {
+      boost::shared_ptr<Storage> storage = boost::make_shared<Storage> ();
+
+      size_t numIndices = 0;
+      for (size_t segId = 0; segId < segments.size(); segId++)
+        numIndices += segments[segId].size();
+
+      storage->offsets_.resize(segments.size() + 1, 0);
+      storage->bit_offsets_.resize(segments.size(), -1);
+      storage->indices_.reserve(numIndices);
+
+      for (size_t segId = 0; segId < segments.size(); segId++)
+      {
+        const size_t segBegin = storage->indices_.size();
+        storage->indices_.insert(storage->indices_.end(), segments[segId].begin(), segments[segId].end());
+        std::sort(storage->indices_.begin() + segBegin, storage->indices_.end());
+        storage->indices_.erase(std::unique(storage->indices_.begin() + segBegin, storage->indices_.end()), storage->indices_.end());
+        storage->offsets_[segId + 1] = storage->indices_.size();
+
+        // Dense bitset
+        const size_t segSize = storage->indices_.size() - segBegin;
+        if (segSize == 0 || segSize < dense_min_size)
+          continue;
+
+        const uint32_t segFirst = storage->indices_[segBegin];
+        const size_t segRange = storage->indices_.back() - segFirst + 1;
+        if (segRange > 64 * segSize)
+          continue;
+
+        storage->bit_offsets_[segId] = storage->bits_.size();
+        storage->bits_.resize(storage->bits_.size() + (segRange + 63) / 64, 0);
+        uint64_t *bits = &storage->bits_[storage->bit_offsets_[segId]];
+        for (size_t pointIdIt = segBegin; pointIdIt < storage->indices_.size(); pointIdIt++)
+        {
+          const uint32_t bitId = storage->indices_[pointIdIt] - segFirst;
+          bits[bitId / 64] |= static_cast<uint64_t>(1) << (bitId % 64);
+        }
+      }
+
+      storage_ = storage;
+    }
+
+    /** \brief Get the number of segments. */
+    inline size_t
+    size () const  { return size_; }
+
+    /** \brief Check if the set has no segments. */
+    inline bool
+    empty () const  { return size_ == 0; }
+
+    /** \brief Get a view of a segment.
+     *  \param[in]  seg_id  segment index within the set
+     */
+    inline SegmentView
+    operator[] (const size_t seg_id) const
+    {
+      const int storageSegId = getStorageSegmentId(seg_id);
+      const uint32_t *indices = storage_->indices_.data();
+      const int64_t bitOffset = storage_->bit_offsets_[storageSegId];
+      return SegmentView (indices + storage_->offsets_[storageSegId],
+                          indices + storage_->offsets_[storageSegId + 1],
+                          bitOffset == -1 ? NULL : storage_->bits_.data() + bitOffset );
+    }
+
+    /** \brief Get a contiguous range of segments. Storage is shared.
+     *  \param[in]  first   index of the first segment of the range
+     *  \param[in]  last    index past the last segment of the range
+     *  \return set with the segments of the range
+     */
+    inline SegmentSet
+    slice (const size_t first, const size_t last) const
+    {
+      SegmentSet segments (*this);
+      const size_t lastClamped = std::min(last, size_);
+      const size_t firstClamped = std::min(first, lastClamped);
+      if (segment_ids_)
+      {
+        segments.segment_ids_ = boost::make_shared<const std::vector<int> > (segment_ids_->begin() + first_ + firstClamped, segment_ids_->begin() + first_ + lastClamped);
+        segments.first_ = 0;
+      }
+      else
+      {
+        segments.first_ = first_ + firstClamped;
+      }
+      segments.size_ = lastClamped - firstClamped;
+      return segments;
+    }
+
+    /** \brief Get an arbitrary subset of the segments. Segments may repeat.
+     * Storage is shared and only the segment ids are copied.
+     *  \param[in]  seg_ids   indices of the segments within the set
+     *  \return set with the selected segments in the order of the ids
+     */
+    inline SegmentSet
+    select (const std::vector<int> &seg_ids) const
+    {
+      boost::shared_ptr<std::vector<int> > storageSegIds = boost::make_shared<std::vector<int> > (seg_ids.size());
+      for (size_t segIdIt = 0; segIdIt < seg_ids.size(); segIdIt++)
+        (*storageSegIds)[segIdIt] = getStorageSegmentId(seg_ids[segIdIt]);
+
+      SegmentSet segments (*this);
+      segments.segment_ids_ = storageSegIds;
+      segments.first_ = 0;
+      segments.size_ = seg_ids.size();
+      return segments;
+    }
+
+    /** \brief Get a copy of the set that owns storage for its own segments
+     * only. Used to release the storage of segments that are no longer
+     * referenced after a selection.
+     *  \return set with the same segments and its own storage
+     */
+    inline SegmentSet
+    compact () const
+    {
+      boost::shared_ptr<Storage> storage = boost::make_shared<Storage> ();
+      storage->offsets_.resize(size_ + 1, 0);
+      storage->bit_offsets_.resize(size_, -1);
+
+      size_t numIndices = 0;
+      for (size_t segId = 0; segId < size_; segId++)
+        numIndices += (*this)[segId].size();
+      storage->indices_.reserve(numIndices);
+
+      for (size_t segId = 0; segId < size_; segId++)
+      {
+        const SegmentView segment = (*this)[segId];
+        storage->indices_.insert(storage->indices_.end(), segment.begin(), segment.end());
+        storage->offsets_[segId + 1] = storage->indices_.size();
+
+        if (segment.isDense())
+        {
+          const int storageSegId = getStorageSegmentId(segId);
+          const size_t numWords = (segment[segment.size() - 1] - segment[0] + 1 + 63) / 64;
+          const uint64_t *bits = storage_->bits_.data() + storage_->bit_offsets_[storageSegId];
+          storage->bit_offsets_[segId] = storage->bits_.size();
+          storage->bits_.insert(storage->bits_.end(), bits, bits + numWords);
+        }
+      }
+
+      SegmentSet segments;
+      segments.storage_ = storage;
+      segments.size_ = size_;
+      return segments;
+    }
+
+    /** \brief Copy the segments to a map.
+     *  \param[out] segments  segments
+     */
+    inline void
+    toMap (utl::Map &segments) const
+    {
+      segments.resize(size_);
+      for (size_t segId = 0; segId < size_; segId++)
+        (*this)[segId].toVector(segments[segId]);
+    }
+
+    /** \brief Get the number of sets sharing the storage of this set. */
+    inline long
+    useCount () const  { return storage_.use_count(); }
+
+  private:
+
+    /** \brief Storage shared between copies, slices and subsets of a set. */
+    struct Storage
+    {
+      /** \brief Index of the first point of every segment. */
+      std::vector<uint32_t> offsets_;
+
+      /** \brief Point indices of all segments. */
+      std::vector<uint32_t> indices_;
+
+      /** \brief Offset of the bitset of every segment (-1 if the segment has no bitset). */
+      std::vector<int64_t> bit_offsets_;
+
+      /** \brief Bitsets of all dense segments. */
+      std::vector<uint64_t> bits_;
+    };
+
+    /** \brief Get the index of a segment in the storage. */
+    inline int
+    getStorageSegmentId (const size_t seg_id) const
+    {
+      return segment_ids_ ? (*segment_ids_)[first_ + seg_id] : static_cast<int>(first_ + seg_id);
+    }
+
+    /** \brief Segment storage. */
+    boost::shared_ptr<const Storage> storage_;
+
+    /** \brief Storage ids of the segments of the set (NULL if the set is a contiguous range of the storage). */
+    boost::shared_ptr<const std::vector<int> > segment_ids_;
+
+    /** \brief First segment and number of segments of the set. */
+    size_t first_, size_;
+  };
+
+  /** \brief Get the point indices of a segment as a vector. Segments that are
+   * already vectors are returned as is and segment views are copied into the
+   * buffer.
+   *  \param[in]  segment   segment
+   *  \param[in]  buffer    buffer used if the segment has to be copied
+   *  \return point indices of the segment
+   */
+  inline
+  const std::vector<int>& getSegmentIndices (const std::vector<int> &segment, std::vector<int> &)
+  {
+    return segment;
+  }
+
+  inline
+  const std::vector<int>& getSegmentIndices (const SegmentView &segment, std::vector<int> &buffer)
+  {
+    segment.toVector(buffer);
+    return buffer;
+  }
+}
+
+#endif  // SEGMENT_SET_HPP